@@ -1,61 +1,144 @@
+#include <cstdlib>
 #include <iostream>
 #include <memory>
-#include <unistd.h>
+#include <new>
 
 #include "./src/core.h"
 #include "./src/fs.h"
-#include "./src/parser2.h"
-#include "./src/checker/vm2.h"
-#include "./src/checker/module2.h"
-#include "./src/checker/debug.h"
-#include "./src/checker/compiler.h"
+#include "./src/bench.h"
+#include "./src/generator.h"
 
 using namespace tr;
 
-void compileAndRun(const string &code, const string &fileName) {
-    ZoneScoped;
-    auto iterations = 1000;
-    auto cold = benchRun(iterations, [&] {
-        checker::Compiler compiler;
-        Parser parser;
-        auto result = parser.parseSourceFile(fileName, code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
-        auto program = compiler.compileSourceFile(result);
-        auto bin = program.build();
-        auto module = make_shared<vm2::Module>(bin, fileName, code);
-        vm2::run(module);
-    });
-
-    checker::Compiler compiler;
-    Parser parser;
-    auto result = parser.parseSourceFile(fileName, code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
-    auto program = compiler.compileSourceFile(result);
-    auto bin = program.build();
-    auto module = make_shared<vm2::Module>(bin, fileName, code);
-    auto warm = benchRun(iterations, [&] {
-        module->clear();
-        vm2::run(module);
-    });
-
-    std::cout << fmt::format("typerunner: {} iterations (it): cold {:.9f}ms/it, warm {:.9f}ms/it\n", iterations, cold.count() / iterations, warm.count() / iterations);
+//counts every heap allocation for benchmark::FileResult::coldAllocations and warmAllocations
+void *operator new(std::size_t size) {
+    benchmark::heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
 }
 
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+/**
+ * Benchmarks a corpus of files.
+ *
+ *   bench [-n iterations] [--json out.json] [--baseline baseline.json] [--threshold percent] [file.ts|directory ...]
+ *
+ * Directories stand for the .ts files in them, without paths ../tests is used. Parse, compile, build and the first
+ * run of the module (cold) as well as runs of the already built module (warm) are measured separately per file and
+ * reported with median, p95, heap allocations per iteration and the pool peak of the VM, see benchmark::FileResult.
+ *
+ * --json writes the report as JSON. --baseline compares the medians against such a JSON of an earlier run and exits
+ * with 1 when one is more than --threshold percent (default 10) slower.
+ *
+ *   bench --scale [feature] [-n iterations] [--csv out.csv] [--max-exponent 1.5]
+ *
+ * Grows each feature of benchmark::Shape (or only `feature`) in generated files instead and reports time and pool memory
+ * per size as CSV, plus the growth exponent of the warm time. Exits with 1 when one is above --max-exponent.
+ */
 int main(int argc, char *argv[]) {
     ZoneScoped;
-    std::string file;
     auto cwd = std::filesystem::current_path();
+    unsigned int iterations = 100;
+    vector<string> paths;
+    string json;
+    string baseline;
+    double threshold = 10;
+    bool scale = false;
+    string feature;
+    string csv;
+    double maxExponent = 1.5;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            json = (cwd / argv[++i]).string();
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline = (cwd / argv[++i]).string();
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::stod(argv[++i]);
+        } else if (arg == "--scale") {
+            scale = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') feature = argv[++i];
+        } else if (arg == "--csv" && i + 1 < argc) {
+            csv = (cwd / argv[++i]).string();
+        } else if (arg == "--max-exponent" && i + 1 < argc) {
+            maxExponent = std::stod(argv[++i]);
+        } else {
+            paths.push_back((cwd / arg).string());
+        }
+    }
 
-    if (argc > 1) {
-        file = cwd.string() + "/" + argv[1];
-    } else {
-        file = cwd.string() + "/../tests/basic1.ts";
+    if (scale) {
+        string out = "feature,size,cold,warm,poolBytes\n";
+        auto superLinear = false;
+        for (auto &&name: benchmark::scalingFeatures()) {
+            if (!feature.empty() && name != feature) continue;
+            //generic instantiations nest in the VM, so depth grows slower than the others
+            auto sizes = name == "depth" ? vector<unsigned int>{8, 16, 32, 64} : vector<unsigned int>{50, 100, 200, 400, 800};
+            auto scaling = benchmark::scale(name, sizes, iterations);
+            out += scaling.csv();
+            auto exponent = scaling.exponent();
+            superLinear |= exponent > maxExponent;
+            std::cout << fmt::format("{}{:<12}{} exponent {:.2f}{}\n", exponent > maxExponent ? red : "", name, reset, exponent, exponent > maxExponent ? " super-linear" : "");
+        }
+        if (csv.empty()) {
+            std::cout << out;
+        } else {
+            fileWrite(csv, out);
+        }
+        return superLinear ? 1 : 0;
     }
+    if (paths.empty()) paths.push_back((cwd / "../tests").string());
 
-    if (!fileExists(file)) {
-        std::cout << "File not found " << file << "\n";
+    auto files = benchmark::corpus(paths);
+    if (files.empty()) {
+        std::cout << "Usage: " << argv[0] << " [-n iterations] [--json out.json] [--baseline baseline.json] [--threshold percent] [file.ts|directory ...]\n";
         return 4;
     }
-    auto code = fileRead(file);
-    auto relative = std::filesystem::relative(file, cwd);
-    compileAndRun(code, relative.string());
+
+    benchmark::Report report;
+    report.iterations = iterations;
+    for (auto &&file: files) {
+        auto name = std::filesystem::relative(file, cwd).string();
+        auto &result = report.files.emplace_back(benchmark::runFile(file, name, iterations));
+        if (!result.error.empty()) {
+            std::cout << fmt::format("{}: {}\n", name, result.error);
+            continue;
+        }
+        std::cout << fmt::format("{} ({} errors)\n", name, result.errors);
+        for (unsigned int p = 0; p < benchmark::FileResult::phases; p++) {
+            auto [phase, samples] = result.phase(p);
+            std::cout << fmt::format("  {:<8} median {:.6f}ms, p95 {:.6f}ms\n", phase, samples->median(), samples->p95());
+        }
+        std::cout << fmt::format("  allocations cold {}/it, warm {}/it, pool peak {} types, {} refs, {} bytes\n",
+                                 result.coldAllocations, result.warmAllocations, result.peakTypes, result.peakRefs, result.poolBytes);
+    }
+    report.peakRss = benchmark::peakRss();
+    std::cout << fmt::format("typerunner: {} files, {} iterations, peak RSS {:.1f}MB\n", report.files.size(), iterations, report.peakRss / 1024.0 / 1024.0);
+
+    if (!json.empty()) fileWrite(json, report.json());
+
+    if (!baseline.empty()) {
+        if (!fileExists(baseline)) {
+            std::cout << "Baseline not found " << baseline << "\n";
+            return 4;
+        }
+        auto regressions = benchmark::compare(report, fileRead(baseline), threshold);
+        for (auto &&regression: regressions) {
+            std::cout << fmt::format("{}regression{} {} {}: {:.6f}ms -> {:.6f}ms (+{:.1f}%)\n", red, reset,
+                                     regression.file, regression.phase, regression.baseline, regression.current, regression.change());
+        }
+        if (!regressions.empty()) return 1;
+        std::cout << fmt::format("no regressions above {}% against {}\n", threshold, baseline);
+    }
     return 0;
 }
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <memory>
+
+#include "./src/core.h"
+#include "./src/driver.h"
+
+using namespace tr;
+
+/**
+ * Checks many files in parallel.
+ *
+ *   typescript_check [-j threads] [-p manifest.json|files.txt] [--lib lib.d.ts] [--no-cache] [--format text|json|sarif] [--max-errors n] [--fail-fast] [--profile out.json] [--flamegraph out.folded] [file.ts ...]
+ *
+ * Bytecode is cached in BytecodeCache::defaultDirectory(), --no-cache always compiles. --lib declarations are
+ * compiled once and shared by all files, see vm2::Prelude. With the cache their snapshot is restored instead.
+ *
+ * Diagnostics are formatted by the workers and written in file order as --format (default text), see
+ * vm2::DiagnosticWriter. With json and sarif only the diagnostics go to stdout, the report goes to stderr.
+ * --max-errors stops checking a file once it has n errors, --fail-fast at the first one, see vm2::VM::maxErrors.
+ *
+ * Built with TYPERUNNER_PROFILE, the ops and subroutines the VMs executed are reported after the files, --profile
+ * out.json writes the ops as JSON instead and --flamegraph out.folded the subroutine call stacks as folded stacks,
+ * see vm2::OpProfile and vm2::SubroutineProfile.
+ */
+int main(int argc, char *argv[]) {
+    ZoneScoped;
+    auto cwd = std::filesystem::current_path();
+    unsigned int threads = std::thread::hardware_concurrency();
+    vector<string> files;
+    bool useCache = true;
+    string lib;
+    string profile;
+    string flamegraph;
+    auto format = vm2::DiagnosticFormat::Text;
+    unsigned int maxErrors = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--lib" && i + 1 < argc) {
+            lib = (cwd / argv[++i]).string();
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile = (cwd / argv[++i]).string();
+        } else if (arg == "--flamegraph" && i + 1 < argc) {
+            flamegraph = (cwd / argv[++i]).string();
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = vm2::parseDiagnosticFormat(argv[++i]);
+        } else if (arg == "--max-errors" && i + 1 < argc) {
+            maxErrors = std::stoi(argv[++i]);
+        } else if (arg == "--fail-fast") {
+            maxErrors = 1;
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "-p" && i + 1 < argc) {
+            for (auto &&file: driver::readManifest((cwd / argv[++i]).string())) files.push_back(file);
+        } else {
+            files.push_back((cwd / arg).string());
+        }
+    }
+
+    if (files.empty()) {
+        std::cout << "Usage: " << argv[0] << " [-j threads] [-p manifest] [--lib lib.d.ts] [--no-cache] [--format text|json|sarif] [--max-errors n] [--fail-fast] [--profile out.json] [--flamegraph out.folded] [file.ts ...]\n";
+        return 4;
+    }
+
+    std::unique_ptr<BytecodeCache> cache;
+    if (useCache) cache = std::make_unique<BytecodeCache>();
+    shared<const vm2::Prelude> prelude;
+    if (!lib.empty()) prelude = driver::loadPrelude(lib, cache.get());
+    auto result = driver::check(files, threads, cache.get(), prelude, format, maxErrors);
+    {
+        vm2::DiagnosticWriter writer(format, std::cout);
+        for (auto &&file: result.files) {
+            if (file.module && !file.module->errors.empty()) writer.write(file.diagnostics);
+        }
+    }
+    auto &report = format == vm2::DiagnosticFormat::Text ? std::cout : std::cerr;
+    driver::printReport(result, report);
+#if TYPERUNNER_PROFILE
+    if (profile.empty()) {
+        report << "\n" << result.profile.report();
+    } else {
+        fileWrite(profile, result.profile.json());
+    }
+    if (flamegraph.empty()) {
+        report << "\n" << result.subroutineProfile.report();
+    } else {
+        fileWrite(flamegraph, result.subroutineProfile.folded());
+    }
+#endif
+    return result.errors() ? 1 : 0;
+}
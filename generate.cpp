@@ -0,0 +1,49 @@
+#include <iostream>
+
+#include "./src/core.h"
+#include "./src/generator.h"
+
+using namespace tr;
+
+/**
+ * Writes a synthetic corpus, see benchmark::Shape.
+ *
+ *   typescript_generate directory [--files N] [--declarations M] [--union W] [--depth D] [--template F] [--object S] [--no-imports]
+ *
+ * The files go to directory/file0.ts ... with a files.txt manifest, which typescript_check -p and bench take.
+ */
+int main(int argc, char *argv[]) {
+    auto cwd = std::filesystem::current_path();
+    benchmark::Shape shape;
+    string directory;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto number = [&] { return (unsigned int) std::stoi(argv[++i]); };
+        if (arg == "--files" && i + 1 < argc) {
+            shape.files = number();
+        } else if (arg == "--declarations" && i + 1 < argc) {
+            shape.declarations = number();
+        } else if (arg == "--union" && i + 1 < argc) {
+            shape.unionWidth = number();
+        } else if (arg == "--depth" && i + 1 < argc) {
+            shape.genericDepth = number();
+        } else if (arg == "--template" && i + 1 < argc) {
+            shape.templateFanout = number();
+        } else if (arg == "--object" && i + 1 < argc) {
+            shape.objectSize = number();
+        } else if (arg == "--no-imports") {
+            shape.imports = false;
+        } else {
+            directory = (cwd / arg).string();
+        }
+    }
+
+    if (directory.empty()) {
+        std::cout << "Usage: " << argv[0] << " directory [--files N] [--declarations M] [--union W] [--depth D] [--template F] [--object S] [--no-imports]\n";
+        return 4;
+    }
+    auto files = benchmark::generate(shape, directory);
+    std::cout << fmt::format("{} files written to {}\n", files.size(), directory);
+    return 0;
+}
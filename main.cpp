@@ -4,45 +4,95 @@
 
 #include "./src/core.h"
 #include "./src/fs.h"
+#include "./src/cache.h"
 #include "./src/parser2.h"
 #include "./src/checker/vm2.h"
 #include "./src/checker/module2.h"
 #include "./src/checker/debug.h"
 #include "./src/checker/compiler.h"
+#include "./src/driver.h"
+#include "./src/project.h"
+#include "./src/watcher.h"
 
 using namespace tr;
 
-void run(const string &bytecode, const string &code, const string &fileName) {
+void run(const shared<MappedFile> &bytecode, const shared<MappedFile> &code, const string &fileName) {
     ZoneScoped;
+    //cached bytecode and source are mapped, not copied
     auto module = std::make_shared<vm2::Module>(bytecode, fileName, code);
+    auto vm = std::make_unique<vm2::VM>();
     bench(1, [&]{
-        vm2::run(module);
+        vm->run(module);
         module->printErrors();
     });
 }
 
-void compileAndRun(const string &code, const string &file, const string &fileName) {
+void compileAndRun(BytecodeCache &cache, const string &code, const string &file, const string &fileName) {
     ZoneScoped;
-    auto bytecodePath = file + ".tsb";
-    auto buffer = fileRead(file);
     checker::Compiler compiler;
     Parser parser;
-    auto result = parser.parseSourceFile(file, buffer, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
-    auto program = compiler.compileSourceFile(result);
+    //each top-level statement is compiled and released as soon as it is parsed
+    auto program = compiler.compileStatements([&](auto &compile) {
+        parser.parseSourceFileStatements(file, code, types::ScriptTarget::Latest, ScriptKind::TS, compile);
+    });
+    program.compactSourceMap = true;
     auto bin = program.build();
-    fileWrite(bytecodePath, bin);
-    std::filesystem::last_write_time(bytecodePath, std::filesystem::last_write_time(file));
+    cache.store(code, bin);
     checker::printBin(bin);
-    auto module = make_shared<vm2::Module>(bin, fileName, code);
-    vm2::run(module);
+    //the module adopts the image build() allocated, no copy
+    auto module = make_shared<vm2::Module>(std::make_shared<const string>(std::move(bin)), fileName, std::make_shared<const string>(code));
+    auto vm = std::make_unique<vm2::VM>();
+    vm->run(module);
     module->printErrors();
 }
 
+/**
+ * Checks `files`, then again each time some of them change, until killed. Only changed files are read again, and only
+ * they and the files whose imports changed their exports are run, see driver::Project.
+ */
+int watch(const vector<string> &files) {
+    BytecodeCache cache;
+    driver::Project project(std::thread::hardware_concurrency(), &cache);
+    FileWatcher watcher(files);
+    auto report = [](const driver::Result &result) {
+        for (auto &&file: result.files) {
+            if (!file.reused && file.module && !file.module->errors.empty()) file.module->printErrors();
+        }
+        driver::printReport(result);
+    };
+
+    report(project.check(files));
+    while (true) {
+        auto changed = watcher.wait(std::chrono::milliseconds(100));
+        if (changed.empty()) continue;
+        std::cout << changed.size() << " files changed\n";
+        report(project.check(files, &changed));
+    }
+}
+
 int main(int argc, char *argv[]) {
     ZoneScoped;
     std::string file;
     auto cwd = std::filesystem::current_path();
 
+    //typescript_main --watch [-p manifest] [file.ts ...]
+    if (argc > 1 && string(argv[1]) == "--watch") {
+        vector<string> files;
+        for (int i = 2; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "-p" && i + 1 < argc) {
+                for (auto &&manifestFile: driver::readManifest((cwd / argv[++i]).string())) files.push_back(std::filesystem::path(manifestFile).lexically_normal().string());
+            } else {
+                files.push_back((cwd / arg).lexically_normal().string());
+            }
+        }
+        if (files.empty()) {
+            std::cout << "Usage: " << argv[0] << " --watch [-p manifest] [file.ts ...]\n";
+            return 4;
+        }
+        return watch(files);
+    }
+
     if (argc > 1) {
         file = cwd.string() + "/" + argv[1];
     } else {
@@ -53,14 +103,15 @@ int main(int argc, char *argv[]) {
         std::cout << "File not found " << file << "\n";
         return 4;
     }
-    auto code = fileRead(file);
-    auto bytecode = file + ".tsb";
     auto relative = std::filesystem::relative(file, cwd);
 
-    if (fileExists(bytecode) && std::filesystem::last_write_time(bytecode) == std::filesystem::last_write_time(file)) {
-        run(fileRead(bytecode), code, relative.string());
+    //bytecode is cached by content, see BytecodeCache
+    BytecodeCache cache;
+    auto code = fileMap(file);
+    if (auto bytecode = cache.find(code->view())) {
+        run(bytecode, code, relative.string());
     } else {
-        compileAndRun(code, file, relative.string());
+        compileAndRun(cache, string(code->view()), file, relative.string());
     }
     return 0;
 }
@@ -0,0 +1,137 @@
+#include <deque>
+#include <iostream>
+#include <memory>
+
+#include "./src/core.h"
+#include "./src/fs.h"
+#include "./src/bench.h"
+#include "./src/scanner.h"
+#include "./src/parser2.h"
+#include "./src/checker/compiler.h"
+#include "./src/checker/check2.h"
+#include "./src/checker/pool_single.h"
+#include "./src/checker/pool_array.h"
+#include "./src/checker/vm2.h"
+
+using namespace tr;
+
+static string generated() {
+    string code;
+    for (unsigned int i = 0; i < 500; i++) {
+        code += fmt::format("type A{0}<T> = T | 'a{0}' | {{a: string, b: T}};\n", i);
+        code += fmt::format("const v{0}: A{0}<number> = {{a: 'x', b: {0}}};\n", i);
+        code += fmt::format("function f{0}(a: string, b: number): string {{ return a; }}\n", i);
+    }
+    return code;
+}
+
+//ops in the subroutines of `program`
+static double countOps(checker::Program &program) {
+    double ops = 0;
+    for (auto &&routine: program.subroutines) {
+        for (unsigned int i = 0; i < routine->ops.size(); i++) {
+            ops++;
+            vm::eatParams((instructions::OP) routine->ops[i], &i);
+        }
+    }
+    return ops;
+}
+
+/**
+ * Micro benchmarks of single stages, see benchmark::measure().
+ *
+ *   microbench [filter] [file.ts]
+ *
+ * Only benchmarks whose name contains `filter` run. Scanner, parser and compiler use `file.ts`, by default a generated
+ * source with type aliases, generics and variables.
+ */
+int main(int argc, char *argv[]) {
+    string filter = argc > 1 ? argv[1] : "";
+    string code = argc > 2 ? fileRead(argv[2]) : generated();
+    auto run = [&filter](string_view name, auto &&callback, double items = 0, string_view unit = {}) {
+        if (!filter.empty() && name.find(filter) == string_view::npos) return;
+        std::cout << benchmark::measure(name, callback, items, unit).format() << "\n";
+    };
+
+    std::cout << fmt::format("source: {} bytes\n", code.size());
+
+    run("scanner scan", [&] {
+        Scanner scanner(code);
+        while (scanner.scan() != types::SyntaxKind::EndOfFileToken) {}
+        benchmark::doNotOptimize(scanner);
+    }, code.size() / 1024.0 / 1024.0, "MB/s");
+
+    Parser parser;
+    auto sourceFile = parser.parseSourceFile("app.ts", code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    run("parser parseSourceFile", [&] {
+        Parser parser;
+        auto result = parser.parseSourceFile("app.ts", code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+        benchmark::doNotOptimize(result);
+    }, parser.nodeCount, "nodes/s");
+
+    checker::Compiler compiler;
+    auto program = compiler.compileSourceFile(sourceFile);
+    run("compiler compileSourceFile", [&] {
+        checker::Compiler compiler;
+        auto program = compiler.compileSourceFile(sourceFile);
+        benchmark::doNotOptimize(program);
+    }, countOps(program), "ops/s");
+
+    {
+        PoolSingle<vm2::Type, vm2::poolSize> pool;
+        run("PoolSingle allocate+deallocate", [&] {
+            auto p = pool.allocate();
+            benchmark::doNotOptimize(p);
+            pool.deallocate(p);
+        });
+        vector<vm2::Type *> items(1000);
+        run("PoolSingle 1000 allocate, free", [&] {
+            for (auto &&item: items) item = pool.allocate();
+            benchmark::doNotOptimize(items);
+            for (auto &&item: items) pool.deallocate(item);
+        }, items.size(), "allocations/s");
+    }
+
+    {
+        PoolArray<vm2::TypeRef, vm2::poolSize> pool;
+        for (unsigned int size: {1, 4, 32}) {
+            run(fmt::format("PoolArray<{}> allocate+deallocate", size), [&] {
+                auto span = pool.allocate(size);
+                benchmark::doNotOptimize(span);
+                pool.deallocate(span);
+            });
+        }
+    }
+
+    {
+        vm2::VM vm;
+        vm2::check::State state;
+        std::deque<string> texts;
+        auto literal = [&](string text) {
+            return vm.allocate(vm2::TypeKind::Literal)->setLiteral(vm2::TypeFlag::StringLiteral, texts.emplace_back(std::move(text)));
+        };
+        auto unionOf = [&](unsigned int size, unsigned int offset = 0) {
+            vector<vm2::Type *> members;
+            for (unsigned int i = 0; i < size; i++) members.push_back(literal(fmt::format("m{}", i + offset)));
+            auto type = vm.unionOf(members);
+            type->refCount++;
+            return type;
+        };
+        auto hit = literal("m40");
+        auto miss = literal("x");
+        auto big = unionOf(64);
+        auto small = unionOf(8, 20);
+        auto check = [&](vm2::Type *left, vm2::Type *right) {
+            return [&state, left, right] {
+                state.depth = 0;
+                benchmark::doNotOptimize(vm2::extends(left, right, state));
+            };
+        };
+        //`left extends right` for freshly built (not stored, so not cached) types
+        run("extends literal string", check(hit, &vm.immortal.string));
+        run("extends literal union(64) hit", check(hit, big));
+        run("extends literal union(64) miss", check(miss, big));
+        run("extends union(8) union(64)", check(small, big));
+    }
+    return 0;
+}
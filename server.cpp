@@ -0,0 +1,52 @@
+#include <iostream>
+#include <memory>
+
+#include "./src/core.h"
+#include "./src/server.h"
+
+using namespace tr;
+
+/**
+ * Long-lived check server, see driver::Server for the request protocol.
+ *
+ *   typescript_server [-j threads] [--socket path] [--lib lib.d.ts] [--no-cache]
+ *
+ * Answers requests on stdin/stdout, or with --socket on a Unix domain socket. Modules, workers and their VMs stay
+ * resident between requests, so only what changed is compiled and checked again.
+ */
+int main(int argc, char *argv[]) {
+    ZoneScoped;
+    auto cwd = std::filesystem::current_path();
+    unsigned int threads = std::thread::hardware_concurrency();
+    bool useCache = true;
+    string lib;
+    string socket;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--lib" && i + 1 < argc) {
+            lib = (cwd / argv[++i]).string();
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socket = argv[++i];
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [-j threads] [--socket path] [--lib lib.d.ts] [--no-cache]\n";
+            return 4;
+        }
+    }
+
+    std::unique_ptr<BytecodeCache> cache;
+    if (useCache) cache = std::make_unique<BytecodeCache>();
+    shared<const vm2::Prelude> prelude;
+    if (!lib.empty()) prelude = driver::loadPrelude(lib, cache.get());
+    driver::Server server(threads, cache.get(), prelude, cwd);
+    if (socket.empty()) {
+        server.serve(std::cin, std::cout);
+    } else {
+        server.serve(socket);
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace tr {
+    /**
+     * Bump allocator for the AST of one source file.
+     *
+     * Nodes and NodeArrays (together with their shared_ptr control block) are carved out of big chunks instead of
+     * getting one heap block each, so creating a node is a pointer bump and a tree lies mostly contiguous in memory.
+     * Nothing is given back individually: the chunks are released all at once when the last node allocated from the
+     * arena is gone.
+     *
+     * While a NodeArena::Scope is alive, makeNode() on that thread allocates from its arena. The parser opens one per
+     * parseSourceFile() call. Without an active scope makeNode() falls back to make_shared.
+     */
+    class NodeArena {
+        static constexpr size_t chunkSize = 64 * 1024;
+
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        std::byte *current = nullptr;
+        size_t left = 0;
+        size_t used = 0;
+
+        static std::shared_ptr<NodeArena> &activeArena() {
+            static thread_local std::shared_ptr<NodeArena> arena;
+            return arena;
+        }
+
+    public:
+        NodeArena() = default;
+        NodeArena(const NodeArena &) = delete;
+        NodeArena &operator=(const NodeArena &) = delete;
+
+        void *allocate(size_t size, size_t alignment) {
+            auto padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+            if (size + padding>left) {
+                //big blocks get their own chunk, so the current one is not thrown away
+                if (size + alignment>chunkSize / 4) {
+                    auto &chunk = chunks.emplace_back(new std::byte[size + alignment]);
+                    auto address = reinterpret_cast<uintptr_t>(chunk.get());
+                    used += size;
+                    return chunk.get() + (alignment - address % alignment) % alignment;
+                }
+                current = chunks.emplace_back(new std::byte[chunkSize]).get();
+                left = chunkSize;
+                padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+            }
+            auto result = current + padding;
+            current += padding + size;
+            left -= padding + size;
+            used += size;
+            return result;
+        }
+
+        /**
+         * Bytes handed out so far.
+         */
+        size_t size() const {
+            return used;
+        }
+
+        static const std::shared_ptr<NodeArena> &active() {
+            return activeArena();
+        }
+
+        /**
+         * Makes `arena` the active one of this thread until destroyed, restoring the previous one after.
+         */
+        class Scope {
+            std::shared_ptr<NodeArena> previous;
+        public:
+            explicit Scope(std::shared_ptr<NodeArena> arena): previous(std::exchange(activeArena(), std::move(arena))) {}
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+            ~Scope() {
+                activeArena() = std::move(previous);
+            }
+        };
+    };
+
+    /**
+     * Allocator for std::allocate_shared. Every control block keeps the arena alive, deallocate is a no-op.
+     */
+    template<typename T>
+    struct ArenaAllocator {
+        using value_type = T;
+        std::shared_ptr<NodeArena> arena;
+
+        explicit ArenaAllocator(std::shared_ptr<NodeArena> arena): arena(std::move(arena)) {}
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other): arena(other.arena) {}
+
+        T *allocate(size_t n) {
+            return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, size_t) {
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U> &other) const {
+            return arena == other.arena;
+        }
+    };
+
+    /**
+     * Vector with room for Inline elements inside the object itself.
+     *
+     * Most AST lists (parameters, type arguments, heritage clauses) hold 0-3 entries, so they never allocate. Bigger
+     * ones spill into the NodeArena that is active at the first spill (the heap without one) and keep it alive; growing
+     * again just abandons the old block in the arena. Slices are spans into the list, nothing is copied.
+     */
+    template<typename T, unsigned int Inline>
+    class ArenaList {
+        T *values;
+        unsigned int count = 0;
+        unsigned int capacity = Inline;
+        std::shared_ptr<NodeArena> arena; //owner of values once spilled, nullptr means heap
+        alignas(T) std::byte inlineValues[sizeof(T) * Inline];
+
+        T *inlineData() {
+            return std::launder(reinterpret_cast<T *>(inlineValues));
+        }
+
+        bool spilled() const {
+            return capacity>Inline;
+        }
+
+        void release() {
+            std::destroy_n(values, count);
+            if (spilled() && !arena) ::operator delete(values, std::align_val_t(alignof(T)));
+            values = inlineData();
+            count = 0;
+            capacity = Inline;
+            arena.reset();
+        }
+
+        void grow(unsigned int size) {
+            auto newCapacity = std::max(size, capacity * 2);
+            if (!spilled()) arena = NodeArena::active();
+            auto newValues = static_cast<T *>(arena ? arena->allocate(sizeof(T) * newCapacity, alignof(T)) : ::operator new(sizeof(T) * newCapacity, std::align_val_t(alignof(T))));
+            std::uninitialized_move_n(values, count, newValues);
+            std::destroy_n(values, count);
+            if (spilled() && !arena) ::operator delete(values, std::align_val_t(alignof(T)));
+            values = newValues;
+            capacity = newCapacity;
+        }
+
+    public:
+        using value_type = T;
+        using iterator = T *;
+        using const_iterator = const T *;
+
+        ArenaList(): values(inlineData()) {}
+
+        ArenaList(std::span<const T> items): values(inlineData()) {
+            reserve(items.size());
+            std::uninitialized_copy(items.begin(), items.end(), values);
+            count = items.size();
+        }
+
+        ArenaList(std::initializer_list<T> items): ArenaList(std::span<const T>(items.begin(), items.size())) {}
+
+        ArenaList(const ArenaList &other): ArenaList(other.span()) {}
+
+        ArenaList(ArenaList &&other) noexcept: values(inlineData()) {
+            *this = std::move(other);
+        }
+
+        ArenaList &operator=(const ArenaList &other) {
+            if (this == &other) return *this;
+            clear();
+            reserve(other.count);
+            std::uninitialized_copy_n(other.values, other.count, values);
+            count = other.count;
+            return *this;
+        }
+
+        ArenaList &operator=(ArenaList &&other) noexcept {
+            if (this == &other) return *this;
+            release();
+            if (other.spilled()) {
+                //take over the block
+                values = std::exchange(other.values, other.inlineData());
+                count = std::exchange(other.count, 0);
+                capacity = std::exchange(other.capacity, Inline);
+                arena = std::move(other.arena);
+            } else {
+                std::uninitialized_move_n(other.values, other.count, values);
+                count = other.count;
+                other.clear();
+            }
+            return *this;
+        }
+
+        ~ArenaList() {
+            release();
+        }
+
+        void reserve(size_t size) {
+            if (size>capacity) grow(size);
+        }
+
+        void push_back(const T &item) {
+            if (count == capacity) [[unlikely]] {
+                //item might live in this list
+                T copy = item;
+                grow(count + 1);
+                new(values + count++) T(std::move(copy));
+                return;
+            }
+            new(values + count++) T(item);
+        }
+
+        void push_back(T &&item) {
+            if (count == capacity) [[unlikely]] grow(count + 1);
+            new(values + count++) T(std::move(item));
+        }
+
+        void pop_back() {
+            values[--count].~T();
+        }
+
+        void clear() {
+            std::destroy_n(values, count);
+            count = 0;
+        }
+
+        T *begin() { return values; }
+        T *end() { return values + count; }
+        const T *begin() const { return values; }
+        const T *end() const { return values + count; }
+        T *data() { return values; }
+
+        T &operator[](size_t i) { return values[i]; }
+        const T &operator[](size_t i) const { return values[i]; }
+        T &front() { return values[0]; }
+        T &back() { return values[count - 1]; }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        std::span<const T> span(size_t start = 0, size_t end = -1) const {
+            if (end>count) end = count;
+            return {values + start, end - start};
+        }
+    };
+
+    /**
+     * make_shared for AST nodes, allocating from the active NodeArena of this thread if there is one.
+     */
+    template<typename T, typename ...Args>
+    std::shared_ptr<T> makeNode(Args &&...args) {
+        if (auto &arena = NodeArena::active()) return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+}
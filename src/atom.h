@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "./hash.h"
+
+namespace tr {
+    /**
+     * An interned identifier text. `id` is unique per text within one AtomTable (0 means not interned),
+     * `hash` is hash::runtime_hash of the text.
+     */
+    struct Atom {
+        unsigned int id = 0;
+        uint64_t hash = 0;
+    };
+
+    /**
+     * Identifier texts of one parse, each stored once.
+     *
+     * The scanner hashes an identifier once and intern() buckets by that hash, so equal texts get the same id without
+     * hashing again. The hash travels with the Identifier node into the compiler (symbol tables, storage deduplication)
+     * and the bytecode storage, from where the VM reads it instead of hashing property names at runtime.
+     */
+    class AtomTable {
+        std::deque<std::string> texts; //text of id at [id - 1], stable addresses
+        std::vector<unsigned int> next; //next id with the same hash, 0 ends the chain
+        std::unordered_map<uint64_t, unsigned int> heads; //hash to last interned id
+
+    public:
+        Atom intern(std::string_view text, uint64_t hash) {
+            auto [head, inserted] = heads.try_emplace(hash, 0);
+            for (auto id = head->second; id; id = next[id - 1]) {
+                if (texts[id - 1] == text) return {id, hash};
+            }
+            texts.emplace_back(text);
+            next.push_back(head->second);
+            head->second = texts.size();
+            return {head->second, hash};
+        }
+
+        Atom intern(std::string_view text) {
+            return intern(text, hash::runtime_hash(text));
+        }
+
+        std::string_view text(unsigned int id) const {
+            return texts[id - 1];
+        }
+
+        size_t size() const {
+            return texts.size();
+        }
+    };
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "./core.h"
+#include "./fs.h"
+#include "./driver.h"
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace tr::benchmark {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+    using driver::Milliseconds;
+    using driver::since;
+
+    //counted by the operator new of the bench executable, stays 0 everywhere else
+    inline std::atomic<uint64_t> heapAllocations = 0;
+
+    struct Samples {
+        vector<double> values; //ms in FileResult, ns in MicroResult
+
+        void add(Milliseconds took) {
+            values.push_back(took.count());
+        }
+
+        //nearest rank, 0 without samples
+        double percentile(double p) const {
+            if (values.empty()) return 0;
+            auto sorted = values;
+            std::sort(sorted.begin(), sorted.end());
+            auto rank = (std::size_t) std::ceil(p * sorted.size());
+            return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+        }
+
+        double median() const {
+            return percentile(0.5);
+        }
+
+        double p95() const {
+            return percentile(0.95);
+        }
+    };
+
+    /**
+     * Timings of one file. Each cold iteration parses, compiles, builds and runs the module once (`cold` is that first
+     * run), warm iterations run the same module again after Module::clear(), like an editor checking unchanged code.
+     */
+    struct FileResult {
+        string file;
+        string error; //set when a stage threw, the file has no timings then
+        unsigned int errors = 0; //diagnostics of the module
+        Samples parse, compile, build, cold, warm;
+        uint64_t coldAllocations = 0; //heap allocations per cold iteration
+        uint64_t warmAllocations = 0; //per warm iteration
+        unsigned int peakTypes = 0; //VM::pool
+        unsigned int peakRefs = 0; //VM::poolRef
+        std::size_t poolBytes = 0; //of all pools of the VM, see vm2::memoryStats()
+
+        std::pair<string_view, const Samples *> phase(unsigned int i) const {
+            switch (i) {
+                case 0: return {"parse", &parse};
+                case 1: return {"compile", &compile};
+                case 2: return {"build", &build};
+                case 3: return {"cold", &cold};
+                default: return {"warm", &warm};
+            }
+        }
+
+        static constexpr unsigned int phases = 5;
+    };
+
+    //peak resident set size of the process in bytes, 0 where unknown
+    inline std::size_t peakRss() {
+#if defined(_WIN32)
+        return 0;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#if defined(__APPLE__)
+        return usage.ru_maxrss;
+#else
+        return (std::size_t) usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    inline string escape(string_view text) {
+        string out;
+        for (auto c: text) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    struct Report {
+        vector<FileResult> files;
+        unsigned int iterations = 0;
+        std::size_t peakRss = 0;
+
+        string json() const {
+            string out = fmt::format("{{\"iterations\": {}, \"peakRss\": {}, \"files\": [", iterations, peakRss);
+            for (unsigned int i = 0; i < files.size(); i++) {
+                auto &file = files[i];
+                out += fmt::format("{}\n  {{\"file\": \"{}\", \"error\": \"{}\", \"errors\": {}", i ? "," : "", escape(file.file), escape(file.error), file.errors);
+                for (unsigned int p = 0; p < FileResult::phases; p++) {
+                    auto [name, samples] = file.phase(p);
+                    out += fmt::format(", \"{}\": {{\"median\": {:.6f}, \"p95\": {:.6f}}}", name, samples->median(), samples->p95());
+                }
+                out += fmt::format(", \"allocations\": {{\"cold\": {}, \"warm\": {}}}, \"pool\": {{\"peakTypes\": {}, \"peakRefs\": {}, \"bytes\": {}}}}}",
+                                   file.coldAllocations, file.warmAllocations, file.peakTypes, file.peakRefs, file.poolBytes);
+            }
+            return out + "\n]}\n";
+        }
+    };
+
+    /**
+     * All files of `paths`, directories are replaced by the .ts files in them (not recursive), sorted by name.
+     */
+    inline vector<string> corpus(const vector<string> &paths) {
+        vector<string> files;
+        for (auto &&path: paths) {
+            if (!std::filesystem::is_directory(path)) {
+                files.push_back(path);
+                continue;
+            }
+            vector<string> found;
+            for (auto &&entry: std::filesystem::directory_iterator(path)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".ts") found.push_back(entry.path().string());
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        return files;
+    }
+
+    /**
+     * Benchmarks `code` (reported as `name`) with `iterations` cold and as many warm iterations.
+     */
+    inline FileResult run(const string &name, const string &code, unsigned int iterations) {
+        FileResult result;
+        result.file = name;
+        try {
+            auto vm = std::make_unique<vm2::VM>();
+            shared<vm2::Module> module;
+
+            auto allocations = heapAllocations.load();
+            for (unsigned int i = 0; i < iterations; i++) {
+                auto t = std::chrono::high_resolution_clock::now();
+                Parser parser;
+                auto sourceFile = parser.parseSourceFile(name, code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+                result.parse.add(since(t));
+
+                t = std::chrono::high_resolution_clock::now();
+                checker::Compiler compiler;
+                auto program = compiler.compileSourceFile(sourceFile);
+                result.compile.add(since(t));
+
+                t = std::chrono::high_resolution_clock::now();
+                auto bin = program.build();
+                result.build.add(since(t));
+
+                t = std::chrono::high_resolution_clock::now();
+                module = std::make_shared<vm2::Module>(bin, name, code);
+                vm->run(module);
+                result.cold.add(since(t));
+            }
+            if (iterations) result.coldAllocations = (heapAllocations.load() - allocations) / iterations;
+
+            vm->pool.resetPeak();
+            vm->poolRef.resetPeak();
+            allocations = heapAllocations.load();
+            for (unsigned int i = 0; module && i < iterations; i++) {
+                auto t = std::chrono::high_resolution_clock::now();
+                module->clear();
+                vm->run(module);
+                result.warm.add(since(t));
+            }
+            if (iterations) result.warmAllocations = (heapAllocations.load() - allocations) / iterations;
+
+            if (module) result.errors = module->errors.size();
+            auto memory = vm2::memoryStats(*vm);
+            result.peakTypes = memory.types.peak;
+            result.peakRefs = memory.refs.peak;
+            result.poolBytes = memory.bytes();
+        } catch (std::exception &e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    //of the file `path`
+    inline FileResult runFile(const string &path, const string &name, unsigned int iterations) {
+        if (!fileExists(path)) {
+            FileResult result;
+            result.file = name;
+            result.error = "File not found " + path;
+            return result;
+        }
+        return run(name, fileRead(path), iterations);
+    }
+
+    struct Regression {
+        string file;
+        string phase;
+        double baseline = 0; //median in ms
+        double current = 0;
+
+        //in percent
+        double change() const {
+            return baseline > 0 ? (current - baseline) / baseline * 100 : 0;
+        }
+    };
+
+    /**
+     * Medians of `report` that are more than `threshold` percent slower than in `baseline`, a Report::json() of an
+     * earlier run. Differences below `floor` milliseconds are noise of tiny files and never count. Files and phases
+     * missing in the baseline are skipped.
+     */
+    inline vector<Regression> compare(const Report &report, string_view baseline, double threshold, double floor = 0.01) {
+        vector<Regression> regressions;
+        for (auto &&file: report.files) {
+            if (!file.error.empty()) continue;
+            auto key = fmt::format("\"file\": \"{}\"", escape(file.file));
+            auto start = baseline.find(key);
+            if (start == string_view::npos) continue;
+            auto end = baseline.find("\"file\": \"", start + key.size());
+            auto entry = baseline.substr(start, end == string_view::npos ? string_view::npos : end - start);
+
+            for (unsigned int p = 0; p < FileResult::phases; p++) {
+                auto [name, samples] = file.phase(p);
+                auto phaseKey = fmt::format("\"{}\": {{\"median\": ", name);
+                auto at = entry.find(phaseKey);
+                if (at == string_view::npos) continue;
+                auto value = std::strtod(string(entry.substr(at + phaseKey.size(), 32)).c_str(), nullptr);
+                auto current = samples->median();
+                if (current - value < floor) continue;
+                if (current > value * (1 + threshold / 100)) regressions.push_back({file.file, string(name), value, current});
+            }
+        }
+        return regressions;
+    }
+
+    //keeps `value` (and what it points to) alive for the optimizer, so a benchmarked computation is not removed
+    template<typename T>
+    inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static const void *volatile sink;
+        sink = &value;
+#endif
+    }
+
+    struct MicroOptions {
+        Milliseconds warmup{50};
+        Milliseconds batch{20}; //minimum duration of one batch, the iteration count is doubled until it is reached
+        unsigned int batches = 7;
+    };
+
+    struct MicroResult {
+        string name;
+        uint64_t iterations = 0; //per batch
+        Samples ns; //per call, one sample per batch
+        double items = 0; //processed per call, e.g. bytes or nodes
+        string unit;
+
+        //items per second of the median
+        double rate() const {
+            auto median = ns.median();
+            return median > 0 ? items / (median / 1e9) : 0;
+        }
+
+        string format() const {
+            auto out = fmt::format("{:<32} {:>12.1f}ns median {:>12.1f}ns p95 {:>10} it", name, ns.median(), ns.p95(), iterations);
+            if (items > 0) out += fmt::format(" {:>14.1f} {}", rate(), unit);
+            return out;
+        }
+    };
+
+    /**
+     * Calls `callback` for `options.warmup` (caches, branch predictors, pool blocks), then doubles the iterations per
+     * batch until one batch takes `options.batch`, and reports the time per call of `options.batches` such batches.
+     * `items` is what a single call processes, reported as `unit` per second.
+     */
+    template<typename F>
+    inline MicroResult measure(string_view name, F &&callback, double items = 0, string_view unit = {}, const MicroOptions &options = {}) {
+        MicroResult result{.name = string(name), .items = items, .unit = string(unit)};
+        auto start = std::chrono::high_resolution_clock::now();
+        while (since(start) < options.warmup) callback();
+
+        uint64_t iterations = 1;
+        while (true) {
+            auto t = std::chrono::high_resolution_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) callback();
+            if (since(t) >= options.batch || iterations >= (1ull << 32)) break;
+            iterations *= 2;
+        }
+        result.iterations = iterations;
+
+        for (unsigned int b = 0; b < options.batches; b++) {
+            auto t = std::chrono::high_resolution_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) callback();
+            result.ns.values.push_back(since(t).count() * 1e6 / iterations);
+        }
+        return result;
+    }
+}
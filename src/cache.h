@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./core.h"
+#include "./fs.h"
+#include "./hash.h"
+#include "./checker/utils.h"
+
+namespace tr {
+    using std::string;
+    using std::string_view;
+    using std::filesystem::path;
+
+    /**
+     * Content addressed store for compiled bytecode: `<directory>/<xxh64 of source and compiler version>.tsb`.
+     *
+     * Since the key is derived from the source itself, a checkout, a restored CI cache or a changed mtime
+     * never serve stale bytecode, and nothing is written next to the sources. Entries are written to a temporary
+     * file and renamed, so concurrent writers and readers never see partial files. Hits refresh the mtime of the
+     * entry and store() evicts the least recently used entries once the directory exceeds maxBytes.
+     *
+     * An optional read-only tier (e.g. a cache shipped by CI) is consulted after the writable directory.
+     */
+    class BytecodeCache {
+        std::mutex mutex;
+        uint64_t usedBytes = 0;
+        bool scanned = false; //usedBytes is only known after the first scan of the directory
+        inline static std::atomic<unsigned int> temporaryCounter = 0;
+
+        static bool valid(string_view bin) {
+            return bin.size() >= 5 + vm::header::size
+                   && (vm::readUint32(bin, vm::header::Magic) == vm::header::magic || vm::readUint32(bin, vm::header::Magic) == vm::header::snapshotMagic)
+                   && vm::readUint32(bin, vm::header::Version) == vm::header::version;
+        }
+
+        shared<MappedFile> open(const path &file) {
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(file, ec)) return nullptr;
+            try {
+                auto mapped = fileMap(file.string());
+                return valid(mapped->view()) ? mapped : nullptr;
+            } catch (std::exception &e) {
+                return nullptr;
+            }
+        }
+
+        //sum of all entries, in the caller's lock
+        void scan() {
+            usedBytes = 0;
+            std::error_code ec;
+            for (auto &&entry: std::filesystem::directory_iterator(directory, ec)) {
+                if (entry.path().extension() == ".tsb") usedBytes += entry.file_size(ec);
+            }
+            scanned = true;
+        }
+
+    public:
+        path directory;
+        path readOnlyDirectory; //empty when there is no shared tier
+        uint64_t maxBytes;
+
+        explicit BytecodeCache(path directory = defaultDirectory(), path readOnlyDirectory = defaultReadOnlyDirectory(), uint64_t maxBytes = 1024 * 1024 * 1024):
+                directory(std::move(directory)), readOnlyDirectory(std::move(readOnlyDirectory)), maxBytes(maxBytes) {
+        }
+
+        BytecodeCache(const BytecodeCache &) = delete;
+        BytecodeCache &operator=(const BytecodeCache &) = delete;
+
+        /**
+         * $TYPERUNNER_CACHE, $XDG_CACHE_HOME/typerunner, ~/.cache/typerunner or the temp directory, in that order.
+         */
+        static path defaultDirectory() {
+            if (auto dir = std::getenv("TYPERUNNER_CACHE"); dir && *dir) return dir;
+            if (auto dir = std::getenv("XDG_CACHE_HOME"); dir && *dir) return path(dir) / "typerunner";
+#if defined(_WIN32)
+            if (auto dir = std::getenv("LOCALAPPDATA"); dir && *dir) return path(dir) / "typerunner";
+#else
+            if (auto dir = std::getenv("HOME"); dir && *dir) return path(dir) / ".cache" / "typerunner";
+#endif
+            return std::filesystem::temp_directory_path() / "typerunner";
+        }
+
+        /**
+         * $TYPERUNNER_CACHE_READONLY, e.g. a cache directory restored by CI. Empty otherwise.
+         */
+        static path defaultReadOnlyDirectory() {
+            if (auto dir = std::getenv("TYPERUNNER_CACHE_READONLY"); dir && *dir) return dir;
+            return {};
+        }
+
+        /**
+         * `salt` is mixed into the key for bytecode that depends on more than the source, e.g. vm2::Prelude::hash.
+         */
+        static uint64_t key(string_view source, uint64_t salt = 0) {
+            auto seed = hash::combine(hash::combine(vm::header::version, vm::header::compilerVersion), salt);
+            return hash::xxh64::hashLarge(source.data(), source.size(), seed);
+        }
+
+        static string fileName(uint64_t key) {
+            return fmt::format("{:016x}.tsb", key);
+        }
+
+        /**
+         * Bytecode for the given source, nullptr on a miss. Entries with an invalid or outdated header count as a miss.
+         */
+        shared<MappedFile> find(string_view source, uint64_t salt = 0) {
+            auto name = fileName(key(source, salt));
+            if (auto found = open(directory / name)) {
+                std::error_code ec;
+                std::filesystem::last_write_time(directory / name, std::filesystem::file_time_type::clock::now(), ec);
+                return found;
+            }
+            if (!readOnlyDirectory.empty()) return open(readOnlyDirectory / name);
+            return nullptr;
+        }
+
+        /**
+         * Writes the entry atomically. Failing to write (read-only or full disk) is not an error, the cache is just not filled.
+         */
+        void store(string_view source, string_view bin, uint64_t salt = 0) {
+            store(key(source, salt), bin);
+        }
+
+        //store() with a key() computed before, e.g. by the thread that still has the source while a writer has the bytecode
+        void store(uint64_t key, string_view bin) {
+            std::error_code ec;
+            std::filesystem::create_directories(directory, ec);
+            auto target = directory / fileName(key);
+            auto temporary = target;
+            temporary += fmt::format(".{}.{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()), temporaryCounter++);
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                out.write(bin.data(), bin.size());
+                if (!out) {
+                    out.close();
+                    std::filesystem::remove(temporary, ec);
+                    return;
+                }
+            }
+            std::filesystem::rename(temporary, target, ec);
+            if (ec) {
+                std::filesystem::remove(temporary, ec);
+                return;
+            }
+
+            std::lock_guard lock(mutex);
+            if (!scanned) {
+                scan();
+            } else {
+                usedBytes += bin.size();
+            }
+            if (usedBytes > maxBytes) prune();
+        }
+
+        /**
+         * Removes least recently used entries until the directory is at 3/4 of maxBytes.
+         */
+        void evict() {
+            std::lock_guard lock(mutex);
+            prune();
+        }
+
+    private:
+        //evict() in the caller's lock
+        void prune() {
+            struct Entry {
+                path file;
+                std::filesystem::file_time_type time;
+                uint64_t size;
+            };
+            std::vector<Entry> entries;
+            std::error_code ec;
+            usedBytes = 0;
+            for (auto &&entry: std::filesystem::directory_iterator(directory, ec)) {
+                if (entry.path().extension() != ".tsb") continue;
+                entries.push_back({entry.path(), entry.last_write_time(ec), entry.file_size(ec)});
+                usedBytes += entries.back().size;
+            }
+            std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+
+            auto limit = maxBytes / 4 * 3;
+            for (auto &&entry: entries) {
+                if (usedBytes <= limit) break;
+                //mapped entries stay readable after removal on POSIX
+                if (std::filesystem::remove(entry.file, ec)) usedBytes -= entry.size;
+            }
+            scanned = true;
+        }
+    };
+}
@@ -0,0 +1,129 @@
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "./typerunner.h"
+#include "./core.h"
+#include "./parser2.h"
+#include "./checker/compiler.h"
+#include "./checker/module2.h"
+#include "./checker/types2.h"
+#include "./checker/vm2.h"
+
+using namespace tr;
+
+struct tr_context {
+    vm2::VM vm;
+    //the parser needs a string, kept so its capacity is reused by the next check
+    string source;
+    //code of `module` is a view into `source`
+    shared<vm2::Module> module;
+    vector<tr_diagnostic> diagnostics;
+    string type;
+    string error;
+
+    void reset() {
+        module = nullptr;
+        diagnostics.clear();
+        type.clear();
+        error.clear();
+    }
+};
+
+tr_context *tr_context_new(void) {
+    try {
+        return new tr_context;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void tr_context_free(tr_context *context) {
+    delete context;
+}
+
+void tr_context_reset(tr_context *context) {
+    context->reset();
+}
+
+int tr_check_source(tr_context *context, const char *file, size_t file_length, const char *source, size_t source_length) {
+    context->reset();
+    string fileName(file, file_length);
+    Parser parser;
+    shared<SourceFile> sourceFile;
+    try {
+        context->source.assign(source, source_length);
+        sourceFile = parser.parseSourceFile(fileName, context->source, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    } catch (std::exception &e) {
+        context->reset();
+        context->error = e.what();
+        return TR_ERROR_PARSE;
+    }
+
+    //from here on a failure is ours, not one of the source
+    try {
+        checker::Compiler compiler;
+        auto program = compiler.compileSourceFile(sourceFile);
+        auto bin = std::make_shared<const string>(program.build());
+
+        //the context outlives its module, so the code needs no storage of its own
+        context->module = std::make_shared<vm2::Module>(bin, *bin, fileName, nullptr, context->source);
+        context->vm.run(context->module);
+
+        auto &module = *context->module;
+        module.renderErrors();
+        context->diagnostics.reserve(module.errors.size());
+        for (auto &&e: module.errors) {
+            tr_diagnostic diagnostic{.message = e.message.data(), .message_length = e.message.size(), .line = UINT32_MAX, .character = UINT32_MAX, .start = 0, .end = 0};
+            auto map = module.findNormalizedMap(e.ip);
+            if (map.found()) {
+                auto lineCharacter = module.mapToLineCharacter(map);
+                diagnostic.line = lineCharacter.line;
+                diagnostic.character = lineCharacter.pos;
+                diagnostic.start = map.pos;
+                diagnostic.end = map.end;
+            }
+            context->diagnostics.push_back(diagnostic);
+        }
+        return context->diagnostics.size() > INT_MAX ? INT_MAX : (int) context->diagnostics.size();
+    } catch (std::exception &e) {
+        context->reset();
+        context->error = fmt::format("Internal error: {}", e.what());
+    } catch (...) {
+        context->reset();
+        context->error = "Internal error";
+    }
+    return TR_ERROR_INTERNAL;
+}
+
+size_t tr_get_diagnostics(tr_context *context, const tr_diagnostic **diagnostics) {
+    *diagnostics = context->diagnostics.data();
+    return context->diagnostics.size();
+}
+
+int tr_query_type(tr_context *context, const char *name, size_t name_length, const char **type, size_t *type_length) {
+    context->error.clear();
+    if (!context->module) return 0;
+    string_view wanted(name, name_length);
+    auto &subroutines = context->module->subroutines;
+    try {
+        for (unsigned int i = 0; i < subroutines.size(); i++) {
+            auto &routine = subroutines[i];
+            if (routine.main || routine.name != wanted) continue;
+            //results of subroutines the main subroutine did not need are computed on demand
+            auto result = routine.result ? routine.result : context->vm.call(context->module, i);
+            context->type = result ? vm2::stringify(result) : "unknown";
+            *type = context->type.data();
+            *type_length = context->type.size();
+            return 1;
+        }
+    } catch (std::exception &e) {
+        context->error = e.what();
+    }
+    return 0;
+}
+
+const char *tr_last_error(tr_context *context) {
+    return context->error.c_str();
+}
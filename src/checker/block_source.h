@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Where PoolSingle and PoolArray get their blocks from, operator new without one. Blocks are only requested when a
+ * pool grows and handed back by trim() and the destructor, so the virtual call is not on any hot path.
+ * A source has to outlive all pools using it, see vm2::VM::setBlockSource().
+ */
+class BlockSource {
+public:
+    virtual ~BlockSource() = default;
+    virtual void *allocate(std::size_t bytes) = 0;
+    virtual void deallocate(void *block, std::size_t bytes) = 0;
+};
+
+/**
+ * Blocks carved out of regions of `regionBytes` mapped at once.
+ *
+ * With `hugePages` regions are aligned to 2 MiB and advised with MADV_HUGEPAGE (Linux), so the pools of a VM are
+ * backed by a few huge pages instead of thousands of 4 KiB ones. With a `node` >= 0 regions prefer that NUMA node
+ * (mbind(), Linux). Without one pages are placed on the node of the thread touching them first, which for a VM that
+ * only runs on one worker thread is already local. Use currentNode() from that thread to ask for it explicitly.
+ *
+ * Freed blocks are kept by size and handed out again, regions are unmapped when the source is destroyed.
+ * Not thread-safe, one source per VM.
+ */
+class RegionBlockSource: public BlockSource {
+public:
+    constexpr static std::size_t hugePageSize = 2 * 1024 * 1024;
+    constexpr static std::size_t alignment = 64;
+
+    explicit RegionBlockSource(bool hugePages = true, int node = -1, std::size_t regionBytes = 16 * hugePageSize):
+            hugePages(hugePages), node(node), regionBytes(roundUp(regionBytes, hugePageSize)) {}
+
+    RegionBlockSource(const RegionBlockSource &) = delete;
+    RegionBlockSource &operator=(const RegionBlockSource &) = delete;
+
+    ~RegionBlockSource() override {
+        for (auto &&region: regions) unmap(region.data, region.bytes);
+    }
+
+    void *allocate(std::size_t bytes) override {
+        bytes = roundUp(bytes, alignment);
+        auto &free = freeBlocks[bytes];
+        if (!free.empty()) {
+            auto block = free.back();
+            free.pop_back();
+            return block;
+        }
+        if (end - current < (std::ptrdiff_t) bytes) {
+            //blocks bigger than a region get one of their own, the rest of the current region stays usable
+            if (bytes > regionBytes / 2) return map(roundUp(bytes, hugePageSize));
+            current = reinterpret_cast<char *>(map(regionBytes));
+            end = current + regionBytes;
+        }
+        auto block = current;
+        current += bytes;
+        return block;
+    }
+
+    void deallocate(void *block, std::size_t bytes) override {
+        freeBlocks[roundUp(bytes, alignment)].push_back(block);
+    }
+
+    //mapped bytes
+    std::size_t reserved() const {
+        std::size_t bytes = 0;
+        for (auto &&region: regions) bytes += region.bytes;
+        return bytes;
+    }
+
+    //NUMA node of the calling thread, -1 if unknown
+    static int currentNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned int cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return (int) node;
+#endif
+        return -1;
+    }
+
+private:
+    struct Region {
+        void *data;
+        std::size_t bytes;
+    };
+
+    bool hugePages;
+    int node;
+    std::size_t regionBytes;
+    std::vector<Region> regions;
+    std::unordered_map<std::size_t, std::vector<void *>> freeBlocks;
+    char *current = nullptr;
+    char *end = nullptr;
+
+    static std::size_t roundUp(std::size_t bytes, std::size_t to) {
+        return (bytes + to - 1) / to * to;
+    }
+
+    void *map(std::size_t bytes) {
+#if defined(_WIN32)
+        auto data = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!data) throw std::bad_alloc();
+#else
+        //over-map by one huge page so the region can start on a huge page boundary
+        auto mapped = hugePages ? bytes + hugePageSize : bytes;
+        auto raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        auto data = raw;
+        if (hugePages) {
+            auto address = reinterpret_cast<std::uintptr_t>(raw);
+            auto aligned = roundUp(address, hugePageSize);
+            if (aligned > address) munmap(raw, aligned - address);
+            if (aligned + bytes < address + mapped) munmap(reinterpret_cast<void *>(aligned + bytes), address + mapped - aligned - bytes);
+            data = reinterpret_cast<void *>(aligned);
+#if defined(MADV_HUGEPAGE)
+            madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+        }
+#if defined(__linux__) && defined(SYS_mbind)
+        if (node >= 0 && node < (int) (sizeof(unsigned long) * 8)) {
+            //MPOL_PREFERRED, falls back to other nodes instead of failing when the node is full
+            unsigned long mask = 1ul << node;
+            syscall(SYS_mbind, data, bytes, 1, &mask, sizeof(mask) * 8 + 1, 0);
+        }
+#endif
+#endif
+        regions.push_back({data, bytes});
+        return data;
+    }
+
+    static void unmap(void *data, std::size_t bytes) {
+#if defined(_WIN32)
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        munmap(data, bytes);
+#endif
+    }
+};
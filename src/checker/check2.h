@@ -1,6 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <string_view>
 #include "./types2.h"
+#include "./simd.h"
 
 namespace tr::vm2 {
 
@@ -10,251 +18,415 @@ namespace tr::vm2 {
             Type *right;
         };
 
-        inline std::array<Check, 4096> checks;
-        inline unsigned int depth;
+        struct Relation {
+            Type *left = nullptr;
+            Type *right = nullptr;
+            //Type::hash of both sides, a recycled address of another type does not match
+            uint64_t hash = 0;
+            //State::generation it was stored in, entries of an earlier one are empty
+            unsigned int generation = 0;
+            bool result = false;
+        };
+
+        constexpr unsigned int maxDepth = 1024;
+        constexpr unsigned int relationCacheSize = 4096; //power of two
+
+        /**
+         * State of extends() for one VM.
+         *
+         * `checks` are the pairs currently compared, a pair that shows up again while being compared (a recursive type)
+         * is assumed to hold, like TypeScript does. Results are cached in `relations` when both sides are stored or immortal,
+         * since those are neither modified nor freed until VM::run or VM::clear, which call clear(). Entries are keyed by
+         * the addresses and hashes of both sides, clear() only starts a new generation instead of emptying all entries.
+         */
+        struct State {
+            std::array<Check, maxDepth> checks;
+            unsigned int depth = 0;
+            //incremented whenever a result was assumed, results depending on an assumption are not cached
+            unsigned int assumptions = 0;
+            unsigned int generation = 1;
+            std::array<Relation, relationCacheSize> relations;
+
+            void clear() {
+                depth = 0;
+                assumptions = 0;
+                //after a wrap around, entries of generation 1 would count again
+                if (!++generation) {
+                    relations.fill({});
+                    generation = 1;
+                }
+            }
+
+            bool has(const Relation &entry, Type *left, Type *right, uint64_t hash) const {
+                return entry.generation == generation && entry.left == left && entry.right == right && entry.hash == hash;
+            }
+        };
+
+        inline bool isStable(Type *type) {
+            return type->flag & (TypeFlag::Stored | TypeFlag::Immortal);
+        }
+
+        constexpr uint32_t kindBit(TypeKind kind) {
+            return 1u << (unsigned int) kind;
+        }
+
+        constexpr unsigned int kindCount = (unsigned int) TypeKind::FunctionRef + 1;
+        static_assert(kindCount<=32, "kind sets are uint32_t bitmasks");
+
+        //only types containing other types can be expensive or recursive
+        constexpr uint32_t compositeKinds = kindBit(TypeKind::Union) | kindBit(TypeKind::Tuple) | kindBit(TypeKind::TupleMember) | kindBit(TypeKind::Array)
+            | kindBit(TypeKind::ObjectLiteral) | kindBit(TypeKind::ClassInstance) | kindBit(TypeKind::PropertySignature) | kindBit(TypeKind::Function)
+            | kindBit(TypeKind::Parameter);
+
+        inline bool isComposite(Type *type) {
+            return compositeKinds & kindBit(type->kind);
+        }
+
+        inline unsigned int relationIndex(Type *left, Type *right) {
+            return hash::combine((uint64_t) left, (uint64_t) right) & (relationCacheSize - 1);
+        }
+
+        inline uint64_t relationHash(Type *left, Type *right) {
+            return hash::combine(left->hash, right->hash);
+        }
     }
 
+    inline bool extends(Type *left, Type *right, check::State &state);
+
     /**
-     * `left extends right ? true : false`
+     * Comparison kernels of extends(), one per (right kind, left kind) pair, see check::kernels. Children are compared
+     * via extends() again.
      */
-    bool extends(Type *left, Type *right) {
-        switch (right->kind) {
-            case TypeKind::Any: {
-                return true;
+    namespace check {
+        using Kernel = bool (*)(Type *left, Type *right, State &state);
+
+        inline bool returnTrue(Type *, Type *, State &) {
+            return true;
+        }
+
+        inline bool returnFalse(Type *, Type *, State &) {
+            return false;
+        }
+
+        //literal extends its primitive
+        template<unsigned int flags>
+        inline bool literalHasFlag(Type *left, Type *, State &) {
+            return left->flag & flags;
+        }
+
+        inline bool literalLiteral(Type *left, Type *right, State &) {
+            if ((left->flag & TypeFlag::StringLiteral && right->flag & TypeFlag::StringLiteral) || (left->flag & TypeFlag::NumberLiteral && right->flag & TypeFlag::NumberLiteral))
+                return left->hash == right->hash;
+            return (left->flag & TypeFlag::True && right->flag & TypeFlag::True) || (left->flag & TypeFlag::False && right->flag & TypeFlag::False);
+        }
+
+        //text a `${number}` placeholder accepts, like TypeScript's isValidNumberString: anything `+text` makes a finite number of
+        inline bool isNumberText(std::string_view text) {
+            if (text.empty() || std::isspace((unsigned char) text.front()) || std::isspace((unsigned char) text.back())) return false;
+            std::string copy(text);
+            char *end = nullptr;
+            auto value = std::strtod(copy.c_str(), &end);
+            return end == copy.c_str() + copy.size() && std::isfinite(value);
+        }
+
+        inline bool matchesPlaceholder(Type *placeholder, std::string_view text) {
+            switch (placeholder->kind) {
+                case TypeKind::Any:
+                case TypeKind::Unknown:
+                case TypeKind::String: return true;
+                case TypeKind::Number: return isNumberText(text);
+                case TypeKind::BigInt: {
+                    if (text.starts_with('-')) text.remove_prefix(1);
+                    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c<='9'; });
+                }
             }
-            case TypeKind::TupleMember: {
-                if (left->kind != TypeKind::TupleMember) return false;
-                //todo: handle optional
-                if (!extends((Type *) left->type, (Type *) right->type)) return false;
+            return false;
+        }
 
-                return true;
+        /**
+         * Whether `text` matches the parts of a template literal from `part` on. Literal parts match themselves, a
+         * placeholder takes as few characters as possible, e.g. `${string}-${string}` splits "a-b-c" into "a" and "b-c".
+         */
+        inline bool matchesTemplate(std::string_view text, TypeRef *part) {
+            if (!part) return text.empty();
+            auto type = part->type;
+            if (type->kind == TypeKind::Literal) {
+                auto literal = type->text();
+                return text.starts_with(literal) && matchesTemplate(text.substr(literal.size()), part->next);
+            }
+            for (size_t size = 0; size<=text.size(); size++) {
+                if (matchesPlaceholder(type, text.substr(0, size)) && matchesTemplate(text.substr(size), part->next)) return true;
             }
-            case TypeKind::Function: {
-                switch (left->kind) {
-                    case TypeKind::Function: {
-                        auto leftFirst = (TypeRef *) left->type;
-                        auto leftSecond = (TypeRef *) leftFirst->next;
-                        auto leftReturnType = leftSecond->type;
+            return false;
+        }
 
-                        auto rightFirst = (TypeRef *) right->type;
-                        auto rightSecond = (TypeRef *) rightFirst->next;
-                        auto rightReturnType = rightSecond->type;
+        inline bool literalTemplateLiteral(Type *left, Type *right, State &) {
+            return left->flag & TypeFlag::StringLiteral && matchesTemplate(left->text(), (TypeRef *) right->type);
+        }
 
-                        auto leftCurrent = leftSecond->next;
-                        auto rightCurrent = rightSecond->next;
-                        while (leftCurrent) {
-                            if (!rightCurrent) return false;
+        inline bool tupleMemberTupleMember(Type *left, Type *right, State &state) {
+            //todo: handle optional
+            return extends((Type *) left->type, (Type *) right->type, state);
+        }
 
-                            auto leftParameter = leftCurrent->type;
-                            auto rightParameter = rightCurrent->type;
+        inline bool functionFunction(Type *left, Type *right, State &state) {
+            auto leftFirst = (TypeRef *) left->type;
+            auto leftSecond = (TypeRef *) leftFirst->next;
+            auto leftReturnType = leftSecond->type;
 
-                            if (!extends(leftParameter, rightParameter)) return false;
+            auto rightFirst = (TypeRef *) right->type;
+            auto rightSecond = (TypeRef *) rightFirst->next;
+            auto rightReturnType = rightSecond->type;
 
-                            leftCurrent = leftCurrent->next;
-                            rightCurrent = rightCurrent->next;
-                        }
+            auto leftCurrent = leftSecond->next;
+            auto rightCurrent = rightSecond->next;
+            while (leftCurrent) {
+                if (!rightCurrent) return false;
 
-                        return extends(leftReturnType, rightReturnType);
-                    }
-                }
-                return false;
-                break;
+                auto leftParameter = leftCurrent->type;
+                auto rightParameter = rightCurrent->type;
+
+                if (!extends(leftParameter, rightParameter, state)) return false;
+
+                leftCurrent = leftCurrent->next;
+                rightCurrent = rightCurrent->next;
             }
-            case TypeKind::Tuple: {
-                switch (left->kind) {
-                    case TypeKind::Tuple: {
-                        //todo: comparing tuple is much more complex than that
-                        auto rightCurrent = (TypeRef *) right->type;
-                        auto leftCurrent = (TypeRef *) left->type;
-                        if (rightCurrent && !leftCurrent) return false;
-                        if (!rightCurrent && leftCurrent) return false;
-
-                        while (rightCurrent) {
-                            if (rightCurrent && !leftCurrent) return false;
-                            if (!rightCurrent && leftCurrent) return false;
-                            if (!extends(leftCurrent->type, rightCurrent->type)) return false;
-
-                            rightCurrent = rightCurrent->next;
-                            leftCurrent = leftCurrent->next;
-                        }
-                        return true;
-                    }
-                    case TypeKind::Array: {
-                        auto elementType = (Type *) left->type;
-                        if (elementType->kind == TypeKind::Any) return true;
-
-                        auto current = (TypeRef *) right->type;
-                        while (current) {
-                            if (!extends(elementType, current->type)) return false;
-                            current = current->next;
-                        }
-                        return true;
-                    }
-                }
 
-                return false;
+            return extends(leftReturnType, rightReturnType, state);
+        }
+
+        inline bool tupleExtendsTuple(Type *left, Type *right, State &state) {
+            //todo: comparing tuple is much more complex than that
+            auto rightCurrent = (TypeRef *) right->type;
+            auto leftCurrent = (TypeRef *) left->type;
+            if (rightCurrent && !leftCurrent) return false;
+            if (!rightCurrent && leftCurrent) return false;
+
+            while (rightCurrent) {
+                if (rightCurrent && !leftCurrent) return false;
+                if (!rightCurrent && leftCurrent) return false;
+                if (!extends(leftCurrent->type, rightCurrent->type, state)) return false;
+
+                rightCurrent = rightCurrent->next;
+                leftCurrent = leftCurrent->next;
             }
-            case TypeKind::Array: {
-                switch (left->kind) {
-                    case TypeKind::Array: {
-                        return extends((Type *) left->type, (Type *) right->type);
-                    }
-                    case TypeKind::Tuple: {
-                        auto elementType = (Type *) right->type;
-                        if (elementType->kind == TypeKind::Any) return true;
-
-                        auto current = (TypeRef *) left->type;
-                        while (current) {
-                            //current->type is TupleMember
-                            if (!extends((Type *) current->type->type, elementType)) return false;
-                            current = current->next;
-                        }
-                        return true;
-                    }
-                }
-                return false;
+            return true;
+        }
+
+        inline bool arrayExtendsTuple(Type *left, Type *right, State &state) {
+            auto elementType = (Type *) left->type;
+            if (elementType->kind == TypeKind::Any) return true;
+
+            auto current = (TypeRef *) right->type;
+            while (current) {
+                if (!extends(elementType, current->type, state)) return false;
+                current = current->next;
             }
-            case TypeKind::PropertySignature: {
-                switch (left->kind) {
-                    case TypeKind::PropertySignature: {
-                        return extends(((TypeRef *) left->type)->next->type, ((TypeRef *) right->type)->next->type);
-                    }
-                }
-                return false;
+            return true;
+        }
+
+        inline bool arrayExtendsArray(Type *left, Type *right, State &state) {
+            return extends((Type *) left->type, (Type *) right->type, state);
+        }
+
+        inline bool tupleExtendsArray(Type *left, Type *right, State &state) {
+            auto elementType = (Type *) right->type;
+            if (elementType->kind == TypeKind::Any) return true;
+
+            auto current = (TypeRef *) left->type;
+            while (current) {
+                //current->type is TupleMember
+                if (!extends((Type *) current->type->type, elementType, state)) return false;
+                current = current->next;
             }
-            case TypeKind::ObjectLiteral: {
-                switch (left->kind) {
-                    case TypeKind::ObjectLiteral: {
-                        auto valid = true;
-                        forEachChild(right, [&left, &valid](auto child, auto &stop) {
-                            auto leftMember = findChild(left, child->hash);
-                            if (!leftMember || !extends(leftMember, child)) {
-                                stop = true;
-                                valid = false;
-                            }
-                        });
-                        return valid;
-
-                        //auto rightCurrent = (TypeRef *) right->type;
-                        //auto leftStart = (TypeRef *) left->type;
-                        //
-                        //auto i = 0;
-                        //while (rightCurrent) {
-                        //    auto rightName = getPropertyOrMethodName(rightCurrent->type);
-                        //    //if (rightName) {
-                        //        //switch (rightCurrent->type->kind) {
-                        //        //    case TypeKind::Method:
-                        //        //    case TypeKind::MethodSignature:
-                        //        //    case TypeKind::Property:
-                        //        //    case TypeKind::PropertySignature: {
-                        //        //        i++;
-                        //        //        auto found = findMember(leftStart, rightName->hash);
-                        //        //        if (!found) return false;
-                        //        //        if (!extends(getPropertyOrMethodType(found), getPropertyOrMethodType(rightCurrent->type))) return false;
-                        //        //    }
-                        //        //}
-                        //    //}
-                        //    rightCurrent = rightCurrent->next;
-                        //}
-                        //if (i == 0) return false;
-
-                        return true;
-                    }
+            return true;
+        }
+
+        inline bool propertyProperty(Type *left, Type *right, State &state) {
+            return extends(((TypeRef *) left->type)->next->type, ((TypeRef *) right->type)->next->type, state);
+        }
+
+        inline bool objectObject(Type *left, Type *right, State &state) {
+            if (left->shape && left->shape == right->shape) {
+                //same keys in the same slots
+                auto leftMembers = (TypeRef *) left->type;
+                auto rightMembers = (TypeRef *) right->type;
+                for (unsigned int i = 0; i<right->shape->size(); i++) {
+                    if (!extends(leftMembers[i].type, rightMembers[i].type, state)) return false;
                 }
-                return false;
+                return true;
             }
-            case TypeKind::Union: {
-                if (left->kind == TypeKind::Union) {
-                    //number | string extends number => false
-                    //number | string extends number | string => true
-                    //string extends number | string => true
-
-                    //pretty inefficient I know
-                    auto current = (TypeRef *) right->type;
-                    while (current) {
-                        auto currentLeft = (TypeRef *) left->type;
-                        bool fit = false;
-                        while (currentLeft) {
-                            if (extends(currentLeft->type, current->type)) {
-                                fit = true;
-                                break;
-                            };
-                            currentLeft = currentLeft->next;
-                        }
-                        if (!fit) return false;
-                        current = current->next;
-                    }
-                    return true;
-                } else {
-                    //fast path first, if hash exists
-                    if (!right->children.empty()) {
-                        TypeRef *entry = &right->children[left->hash % right->children.size()];
-                        if (entry->type) {
-                            while (entry && entry->type->hash != left->hash) {
-                                //follow collision link
-                                entry = entry->next;
-                            }
-                            if (entry) return true;
-                        }
-                    }
 
-                    //slow path, full scan
-                    auto valid = false;
-                    forEachChild(right, [&left, &valid](Type *child, bool &stop) {
-                        if (extends(left, child)) {
-                            stop = true;
-                            valid = true;
-                        }
-                    });
-                    return valid;
+            auto valid = true;
+            forEachChild(right, [&left, &valid, &state](auto child, auto &stop) {
+                auto leftMember = findChild(left, child->hash);
+                if (!leftMember || !extends(leftMember, child, state)) {
+                    stop = true;
+                    valid = false;
                 }
-            }
-            case TypeKind::Literal: {
-                switch (left->kind) {
-                    case TypeKind::Literal:
-                        if ((left->flag & TypeFlag::StringLiteral && right->flag & TypeFlag::StringLiteral) || (left->flag & TypeFlag::NumberLiteral && right->flag & TypeFlag::NumberLiteral))
-                            return left->hash == right->hash;
-                        return (left->flag & TypeFlag::True && right->flag & TypeFlag::True) || (left->flag & TypeFlag::False && right->flag & TypeFlag::False);
+            });
+            return valid;
+        }
+
+        inline bool unionExtendsUnion(Type *left, Type *right, State &state) {
+            //number | string extends number => false
+            //number | string extends number | string => true
+            //string extends number | string => true
+            //each member of left has to extend right, which looks it up like a single type
+            auto valid = true;
+            forEachChild(left, [&right, &valid, &state](Type *child, bool &stop) {
+                if (!extends(child, right, state)) {
+                    stop = true;
+                    valid = false;
                 }
-                return false;
-            }
-            case TypeKind::String: {
-                switch (left->kind) {
-                    case TypeKind::String:
-                        return true;
-                    case TypeKind::Literal:
-                        return left->flag & TypeFlag::StringLiteral;
+            });
+            return valid;
+        }
+
+        inline bool extendsUnion(Type *left, Type *right, State &state) {
+            auto hashes = right->memberHashes();
+            if (!hashes.empty() && right->flag & TypeFlag::ChildrenArray) {
+                //members with the same Type::hash first, found a few at once by simd::findHash()
+                auto members = (TypeRef *) right->type;
+                auto size = (unsigned int) hashes.size();
+                for (auto i = simd::findHash(hashes.data(), size, left->hash); i<size; i = simd::findHash(hashes.data(), size, left->hash, i + 1)) {
+                    if (extends(left, members[i].type, state)) return true;
                 }
-                return false;
-            }
-            case TypeKind::Number: {
-                switch (left->kind) {
-                    case TypeKind::Number:
-                        return true;
-                    case TypeKind::Literal:
-                        return left->flag & TypeFlag::NumberLiteral;
+                //a literal only extends a literal of the same hash
+                if (left->kind == TypeKind::Literal && right->flag & TypeFlag::LiteralMembers) return false;
+            } else {
+                //fast path first, if hash exists
+                auto children = right->children();
+                if (!children.empty()) {
+                    TypeRef *entry = &children[left->hash % children.size()];
+                    if (entry->type) {
+                        while (entry && entry->type->hash != left->hash) {
+                            //follow collision link
+                            entry = entry->next;
+                        }
+                        if (entry) return true;
+                    }
                 }
-                break;
             }
-            case TypeKind::Boolean: {
-                switch (left->kind) {
-                    case TypeKind::Boolean:
-                        return true;
-                    case TypeKind::Literal:
-                        return left->flag & TypeFlag::True || left->flag & TypeFlag::False;
+
+            //slow path, full scan
+            auto valid = false;
+            forEachChild(right, [&left, &valid, &state](Type *child, bool &stop) {
+                if (extends(left, child, state)) {
+                    stop = true;
+                    valid = true;
                 }
-                break;
+            });
+            return valid;
+        }
+
+        inline bool parameterParameter(Type *left, Type *right, State &state) {
+            return extends((Type *) left->type, (Type *) right->type, state);
+        }
+
+        inline bool extendsParameter(Type *left, Type *right, State &state) {
+            return extends(left, (Type *) right->type, state);
+        }
+
+        struct Kernels {
+            //[right kind][left kind]
+            std::array<std::array<Kernel, kindCount>, kindCount> table{};
+            //per right kind the left kinds decided by the kinds alone, without a call
+            std::array<uint32_t, kindCount> alwaysTrue{};
+            std::array<uint32_t, kindCount> alwaysFalse{};
+        };
+
+        constexpr Kernels buildKernels() {
+            Kernels kernels;
+            auto set = [&kernels](TypeKind right, TypeKind left, Kernel kernel) {
+                kernels.table[(unsigned int) right][(unsigned int) left] = kernel;
+            };
+            auto setAll = [&set](TypeKind right, Kernel kernel) {
+                for (unsigned int left = 0; left<kindCount; left++) set(right, (TypeKind) left, kernel);
+            };
+            for (unsigned int right = 0; right<kindCount; right++) setAll((TypeKind) right, returnFalse);
+
+            setAll(TypeKind::Any, returnTrue);
+            set(TypeKind::TupleMember, TypeKind::TupleMember, tupleMemberTupleMember);
+            set(TypeKind::Function, TypeKind::Function, functionFunction);
+            set(TypeKind::Tuple, TypeKind::Tuple, tupleExtendsTuple);
+            set(TypeKind::Tuple, TypeKind::Array, arrayExtendsTuple);
+            set(TypeKind::Array, TypeKind::Array, arrayExtendsArray);
+            set(TypeKind::Array, TypeKind::Tuple, tupleExtendsArray);
+            set(TypeKind::PropertySignature, TypeKind::PropertySignature, propertyProperty);
+            for (auto right: {TypeKind::ClassInstance, TypeKind::ObjectLiteral}) {
+                for (auto left: {TypeKind::ClassInstance, TypeKind::ObjectLiteral}) set(right, left, objectObject);
             }
-            case TypeKind::Parameter: {
-                switch (left->kind) {
-                    case TypeKind::Parameter:
-                        return extends((Type *) left->type, (Type *) right->type);
+            setAll(TypeKind::Union, extendsUnion);
+            set(TypeKind::Union, TypeKind::Union, unionExtendsUnion);
+            set(TypeKind::Literal, TypeKind::Literal, literalLiteral);
+            set(TypeKind::String, TypeKind::String, returnTrue);
+            set(TypeKind::String, TypeKind::Literal, literalHasFlag<TypeFlag::StringLiteral>);
+            set(TypeKind::String, TypeKind::TemplateLiteral, returnTrue);
+            set(TypeKind::TemplateLiteral, TypeKind::Literal, literalTemplateLiteral);
+            set(TypeKind::Number, TypeKind::Number, returnTrue);
+            set(TypeKind::Number, TypeKind::Literal, literalHasFlag<TypeFlag::NumberLiteral>);
+            set(TypeKind::Boolean, TypeKind::Boolean, returnTrue);
+            set(TypeKind::Boolean, TypeKind::Literal, literalHasFlag<TypeFlag::True | TypeFlag::False>);
+            setAll(TypeKind::Parameter, extendsParameter);
+            set(TypeKind::Parameter, TypeKind::Parameter, parameterParameter);
+
+            for (unsigned int right = 0; right<kindCount; right++) {
+                for (unsigned int left = 0; left<kindCount; left++) {
+                    auto kernel = kernels.table[right][left];
+                    if (kernel == returnTrue) kernels.alwaysTrue[right] |= 1u << left;
+                    if (kernel == returnFalse) kernels.alwaysFalse[right] |= 1u << left;
                 }
-                return extends(left, (Type *) right->type);
             }
+            return kernels;
         }
-        return false;
+
+        inline constexpr Kernels kernels = buildKernels();
     }
 
+    /**
+     * The structural comparison of `left extends right`: one call of the kernel of their kinds.
+     */
+    inline bool isExtendable(Type *left, Type *right, check::State &state) {
+        return check::kernels.table[(unsigned int) right->kind][(unsigned int) left->kind](left, right, state);
+    }
+
+    /**
+     * `left extends right ? true : false`
+     */
+    inline bool extends(Type *left, Type *right, check::State &state) {
+        //pairs decided by their kinds alone: anything extends any, string never extends number, ...
+        auto leftBit = check::kindBit(left->kind);
+        if (check::kernels.alwaysTrue[(unsigned int) right->kind] & leftBit) return true;
+        if (check::kernels.alwaysFalse[(unsigned int) right->kind] & leftBit) return false;
+        if (!((leftBit | check::kindBit(right->kind)) & check::compositeKinds)) return isExtendable(left, right, state);
+
+        check::Relation *cached = nullptr;
+        uint64_t hash = 0;
+        if (check::isStable(left) && check::isStable(right)) {
+            cached = &state.relations[check::relationIndex(left, right)];
+            hash = check::relationHash(left, right);
+            if (state.has(*cached, left, right, hash)) return cached->result;
+        }
 
-}
\ No newline at end of file
+        for (unsigned int i = 0; i<state.depth; i++) {
+            if (state.checks[i].left == left && state.checks[i].right == right) {
+                state.assumptions++;
+                return true;
+            }
+        }
+        if (state.depth == check::maxDepth) {
+            //give up instead of overflowing the C stack
+            state.assumptions++;
+            return false;
+        }
+
+        auto assumptions = state.assumptions;
+        state.checks[state.depth++] = {left, right};
+        auto result = isExtendable(left, right, state);
+        state.depth--;
+
+        if (cached && assumptions == state.assumptions) *cached = {left, right, hash, state.generation, result};
+        return result;
+    }
+}
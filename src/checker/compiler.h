@@ -1,11 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <optional>
 #include <string>
+#include <thread>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include "./instructions.h"
 #include "./utils.h"
+#include "../hash.h"
+#include "../number.h"
 #include "../node_test.h"
 
 namespace tr::checker {
@@ -110,13 +123,17 @@ namespace tr::checker {
         vector<unsigned char> ops; //OPs, and its parameters
         unsigned int lastOpIp;
         SourceMap sourceMap;
+        vector<unsigned int> relocations; //ips of fragment-local subroutine indices and storage addresses, see Program::link
         string_view identifier{};
         unsigned int index{};
         unsigned int slots{};
         unsigned int slotIP{};
         unsigned int nameAddress{};
         SymbolType type = SymbolType::Type;
+        bool exported = false; //declared with `export` at the top-level
         vector<Symbol> symbols{};
+        //indices into symbols by hash of their name, in declaration order
+        unordered_map<uint64_t, vector<unsigned int>> symbolTable;
 
         vector<Section> sections;
         unsigned int activeSection = 0;
@@ -250,15 +267,33 @@ namespace tr::checker {
 
         unsigned int getFlags() {
             unsigned int flags = 0;
+            if (exported) {
+                auto generic = false;
+                for (auto &&symbol: symbols) generic |= symbol.type == SymbolType::TypeArgument;
+                if (!generic) flags |= instructions::SubroutineFlag::Exported;
+            }
             return flags;
         }
     };
 
+    /**
+     * Text together with its hash::runtime_hash. Identifiers bring the hash the scanner computed, everything else is hashed here, once.
+     */
+    struct HashedText {
+        string_view text;
+        uint64_t hash;
+
+        HashedText(string_view text, uint64_t hash): text(text), hash(hash) {}
+        HashedText(string_view text): HashedText(text, hash::runtime_hash(text)) {}
+        HashedText(const string &text): HashedText(string_view(text)) {}
+        HashedText(const char *text): HashedText(string_view(text)) {}
+        HashedText(const Identifier &identifier): HashedText(identifier.escapedText, identifier.hash ? identifier.hash : hash::runtime_hash(identifier.escapedText)) {}
+    };
+
     struct StorageItem {
         string_view value;
+        uint64_t hash{};
         unsigned int address{};
-
-        explicit StorageItem(const string_view &value): value(value) {}
     };
 
     struct FrameOffset {
@@ -383,64 +418,533 @@ namespace tr::checker {
 ////        }
 //    }
 
-//    struct Optimiser {
-//        vector<shared<Subroutine>> *subroutines;
-//
-//        explicit Optimiser(vector<shared<Subroutine>> *subroutines): subroutines(subroutines) {}
-//
-//        void optimise(unsigned int index) {
-//            auto current = (*subroutines)[index];
-//            if (current->optimised) return;
-//
-//            current->optimised = true;
-//
-//            for (unsigned int i = 0; i<current->ops.size(); i++) {
-//                auto op = (OP) current->ops[i];
-////                debug("[{}] optimise OP {}", current->index, op);
-//
-//                switch (op) {
-//                    case OP::Rest: {
-//                        debug("optimise Rest");
-//                        //todo: check if previous is ::Loads
-//                        // determine the identity of the Loads variable
-//                        // and
-//                        break;
-//                    }
-//                    case OP::Call: {
-//                        //go deeper
-//                        auto address = vm::readUint32(current->ops, i + 1);
-//                        optimise(address);
-//                        break;
-//                    }
-//                    case OP::JumpCondition: {
-//                        //go deeper
-//                        const auto leftProgram = vm::readUint16(current->ops, i + 1);
-//                        const auto rightProgram = vm::readUint16(current->ops, i + 3);
-//                        optimise(leftProgram);
-//                        optimise(rightProgram);
-//                        break;
-//                    }
-//                }
-//                vm::eatParams(op, &i);
-//            }
-//        }
-//    };
+    /**
+     * Peephole pass over the finished subroutines, run by Program::build().
+     *
+     * Each subroutine is decoded into a list of instructions, rewritten, and written back with its jump operands,
+     * source map, slotIP and lastOpIp relocated. Rewrites:
+     *
+     *  - `Slots 0` is dropped.
+     *  - `Call A` without arguments to a trivial type alias is replaced by the alias' body when that is a single
+     *    primitive or literal (`type A = string`), or redirected to the aliased subroutine (`type A = B`).
+     *  - `Extends` between two primitives or literals is folded to True/False, with the semantics of isExtendable().
+     *  - `True/False JumpCondition` drops the branch that is never taken.
+     *  - `Dup Pop` and `<primitive> Pop` are removed.
+     *
+     * Finally the hottest remaining sequences are fused into superinstructions: `Extends JumpCondition` (every conditional type)
+     * into ExtendsJump and `Loads IndexAccess` (e.g. `T[K]` in mapped types) into LoadsIndexAccess.
+     *
+     * Instructions something jumps to are never merged into a pattern, so control flow stays intact.
+     */
+    class Optimiser {
+        struct Instruction {
+            unsigned int ip{}; //in the original ops
+            unsigned int size{};
+            int target = -1; //instruction index of the jump target of Jump, JumpCondition and Distribute
+            bool removed = false;
+            std::array<unsigned char, 8> bytes{};
+
+            OP op() const {
+                return (OP) bytes[0];
+            }
+
+            string_view view() const {
+                return string_view((const char *) bytes.data(), size);
+            }
+
+            void replace(const vector<unsigned char> &ops, unsigned int ip) {
+                auto end = ip;
+                vm::eatParams((OP) ops[ip], &end);
+                size = end + 1 - ip;
+                std::copy(ops.begin() + ip, ops.begin() + ip + size, bytes.begin());
+            }
+        };
+
+        vector<shared<Subroutine>> &subroutines;
+        unordered_map<unsigned int, string_view> literals; //storage address to text
+        vector<bool> setTargets; //subroutines narrowed via OP::Set, their result is not constant
+
+        vector<Instruction> instructions;
+        vector<int> index; //original ip to instruction index
+        vector<unsigned int> targets; //how many jumps go to each instruction
+
+        static bool isConstant(OP op) {
+            switch (op) {
+                case OP::Never:
+                case OP::Any:
+                case OP::Unknown:
+                case OP::Void:
+                case OP::Object:
+                case OP::String:
+                case OP::Number:
+                case OP::Boolean:
+                case OP::BigInt:
+                case OP::Symbol:
+                case OP::Null:
+                case OP::Undefined:
+                case OP::StringLiteral:
+                case OP::NumberLiteral:
+                case OP::BigIntLiteral:
+                case OP::True:
+                case OP::False:
+                    return true;
+            }
+            return false;
+        }
+
+        static int jumpTarget(const Instruction &instruction) {
+            switch (instruction.op()) {
+                case OP::Jump: return instruction.ip + vm::readInt32(instruction.view(), 1);
+                case OP::JumpCondition:
+                case OP::ExtendsJump: return instruction.ip + vm::readUint32(instruction.view(), 1);
+                case OP::Distribute: return instruction.ip + vm::readUint32(instruction.view(), 3);
+            }
+            return -1;
+        }
+
+        //false if the ops are not fully understood, the subroutine is then left as is
+        bool decode(const vector<unsigned char> &ops) {
+            instructions.clear();
+            index.assign(ops.size() + 1, -1);
+            for (unsigned int i = 0; i<ops.size(); i++) {
+                auto &instruction = instructions.emplace_back();
+                instruction.ip = i;
+                vm::eatParams((OP) ops[i], &i);
+                if (i>=ops.size() || i + 1 - instruction.ip>instruction.bytes.size()) return false;
+                instruction.replace(ops, instruction.ip);
+                for (auto j = instruction.ip; j<=i; j++) index[j] = instructions.size() - 1;
+            }
+            index[ops.size()] = instructions.size();
+
+            targets.assign(instructions.size() + 1, 0);
+            for (auto &&instruction: instructions) {
+                if (!hasTarget(instruction.op())) continue;
+                auto target = jumpTarget(instruction);
+                if (target<0 || target>ops.size() || ops.size() != target && instructions[index[target]].ip != target) return false;
+                instruction.target = index[target];
+                targets[instruction.target]++;
+            }
+            return true;
+        }
+
+        static bool hasTarget(OP op) {
+            return op == OP::Jump || op == OP::JumpCondition || op == OP::ExtendsJump || op == OP::Distribute;
+        }
+
+        void remove(unsigned int i) {
+            auto &instruction = instructions[i];
+            instruction.removed = true;
+            if (instruction.target>=0) targets[instruction.target]--;
+        }
+
+        int previous(int i) {
+            while (--i>=0) {
+                if (!instructions[i].removed) return i;
+            }
+            return -1;
+        }
+
+        //jumps to removed instructions land on the next live one
+        bool isTarget(int i) {
+            for (auto j = i; j>=0; j--) {
+                if (targets[j]) return true;
+                if (j == 0 || !instructions[j - 1].removed) break;
+            }
+            return false;
+        }
+
+        //whether a live jump other than `except` and outside [from, to) lands in [targetFrom, to)
+        bool jumpsInto(int from, int targetFrom, int to, int except) {
+            for (int i = 0; i<instructions.size(); i++) {
+                auto &instruction = instructions[i];
+                if (i == except || instruction.removed || instruction.target<0 || (i>=from && i<to)) continue;
+                if (instruction.target>=targetFrom && instruction.target<to) return true;
+            }
+            return false;
+        }
+
+        //ip of the single op in the body of a type alias without type arguments, -1 if not trivial
+        int trivialBody(const Subroutine &routine) {
+            if (routine.type != SymbolType::Type || routine.slots || setTargets[routine.index]) return -1;
+            auto &ops = routine.ops;
+            unsigned int ip = 0;
+            if (!ops.empty() && ops[0] == OP::Slots) ip += 3;
+            if (ip>=ops.size()) return -1;
+            auto body = ip;
+            auto op = (OP) ops[ip];
+            if (op == OP::Call || op == OP::TailCall) {
+                if (vm::readUint16(ops, ip + 5) != 0) return -1;
+            } else if (!isConstant(op)) {
+                return -1;
+            }
+            vm::eatParams(op, &ip);
+            if (ip + 2 != ops.size() || ops[ip + 1] != OP::Return) return -1;
+            return body;
+        }
+
+        bool inlineCall(Instruction &instruction) {
+            if (vm::readUint16(instruction.view(), 5) != 0) return false;
+            const auto address = vm::readUint32(instruction.view(), 1);
+            auto current = address;
+            //follow `type A = B` chains, giving up on cycles
+            for (unsigned int depth = 0; depth<subroutines.size(); depth++) {
+                if (current>=subroutines.size()) return false;
+                auto &callee = *subroutines[current];
+                auto body = trivialBody(callee);
+                if (body<0) break;
+                auto op = (OP) callee.ops[body];
+                if (op == OP::Call || op == OP::TailCall) {
+                    current = vm::readUint32(callee.ops, body + 1);
+                    continue;
+                }
+                instruction.replace(callee.ops, body);
+                return true;
+            }
+            if (current == address || trivialBody(*subroutines[current])>=0) return false;
+            *(uint32_t *) (instruction.bytes.data() + 1) = current;
+            return true;
+        }
+
+        //mirrors isExtendable() for what a single op pushes, nullopt when it depends on more than that
+        std::optional<bool> extends(const Instruction &left, const Instruction &right) {
+            auto l = left.op();
+            //any and never distribute or depend on the context
+            if (l == OP::Any || l == OP::Never || !isConstant(l)) return std::nullopt;
+            switch (right.op()) {
+                case OP::Any: return true;
+                case OP::String: return l == OP::String || l == OP::StringLiteral;
+                case OP::Number: return l == OP::Number || l == OP::NumberLiteral;
+                case OP::Boolean: return l == OP::Boolean || l == OP::True || l == OP::False;
+                case OP::True:
+                case OP::False: return l == right.op();
+                case OP::StringLiteral:
+                case OP::NumberLiteral: {
+                    if (l != right.op()) return false;
+                    auto a = literals.find(vm::readUint32(left.view(), 1));
+                    auto b = literals.find(vm::readUint32(right.view(), 1));
+                    if (a == literals.end() || b == literals.end()) return std::nullopt;
+                    return a->second == b->second;
+                }
+            }
+            return std::nullopt;
+        }
+
+        bool foldCondition(int i) {
+            auto condition = previous(i);
+            if (condition<0 || isTarget(i)) return false;
+            auto op = instructions[condition].op();
+            if (op != OP::True && op != OP::False) return false;
+
+            //`JumpCondition F; <true branch> Jump E; F: <false branch> E:`
+            auto falseStart = instructions[i].target;
+            auto jump = falseStart - 1;
+            if (jump<=i || instructions[jump].removed || instructions[jump].op() != OP::Jump || instructions[jump].target<falseStart) return false;
+            auto end = instructions[jump].target;
+
+            if (op == OP::True) {
+                if (jumpsInto(jump, jump + 1, end, i)) return false;
+                for (auto j = jump; j<end; j++) if (!instructions[j].removed) remove(j);
+            } else {
+                if (jumpsInto(i + 1, i + 1, falseStart, i)) return false;
+                for (auto j = i + 1; j<falseStart; j++) if (!instructions[j].removed) remove(j);
+            }
+            remove(condition);
+            remove(i);
+            return true;
+        }
+
+        bool pass(Subroutine &routine) {
+            bool changed = false;
+            for (int i = 0; i<instructions.size(); i++) {
+                auto &instruction = instructions[i];
+                if (instruction.removed) continue;
+                switch (instruction.op()) {
+                    case OP::Slots: {
+                        if (!routine.slots) {
+                            remove(i);
+                            changed = true;
+                        }
+                        break;
+                    }
+                    case OP::Call:
+                    case OP::TailCall: {
+                        if (inlineCall(instruction)) changed = true;
+                        break;
+                    }
+                    case OP::Extends: {
+                        auto right = previous(i);
+                        auto left = right>=0 ? previous(right) : -1;
+                        if (left<0 || isTarget(right) || isTarget(i)) break;
+                        if (auto result = extends(instructions[left], instructions[right])) {
+                            remove(left);
+                            remove(right);
+                            instruction.bytes[0] = *result ? OP::True : OP::False;
+                            instruction.size = 1;
+                            changed = true;
+                        }
+                        break;
+                    }
+                    case OP::JumpCondition: {
+                        if (foldCondition(i)) changed = true;
+                        break;
+                    }
+                    case OP::Pop: {
+                        auto pushed = previous(i);
+                        if (pushed<0 || isTarget(i)) break;
+                        auto op = instructions[pushed].op();
+                        if (op == OP::Dup || isConstant(op)) {
+                            remove(pushed);
+                            remove(i);
+                            changed = true;
+                        }
+                        break;
+                    }
+                }
+            }
+            return changed;
+        }
+
+        int next(int i) {
+            while (++i<instructions.size()) {
+                if (!instructions[i].removed) return i;
+            }
+            return -1;
+        }
+
+        bool fuse() {
+            bool changed = false;
+            for (int i = 0; i<instructions.size(); i++) {
+                auto &instruction = instructions[i];
+                if (instruction.removed) continue;
+                switch (instruction.op()) {
+                    case OP::Extends: {
+                        auto jump = next(i);
+                        if (jump<0 || instructions[jump].op() != OP::JumpCondition || isTarget(jump)) break;
+                        auto target = instructions[jump].target;
+                        remove(jump);
+                        instruction.bytes[0] = OP::ExtendsJump;
+                        instruction.size = 5;
+                        instruction.target = target;
+                        targets[target]++;
+                        changed = true;
+                        break;
+                    }
+                    case OP::IndexAccess: {
+                        auto loads = previous(i);
+                        if (loads<0 || instructions[loads].op() != OP::Loads || isTarget(i)) break;
+                        instructions[loads].bytes[0] = OP::LoadsIndexAccess;
+                        remove(i);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+            return changed;
+        }
+
+        void write(Subroutine &routine) {
+            vector<unsigned int> ips(instructions.size() + 1);
+            unsigned int ip = 0;
+            for (unsigned int i = 0; i<instructions.size(); i++) {
+                ips[i] = ip;
+                if (!instructions[i].removed) ip += instructions[i].size;
+            }
+            ips[instructions.size()] = ip;
+
+            vector<unsigned char> ops;
+            ops.reserve(ip);
+            for (unsigned int i = 0; i<instructions.size(); i++) {
+                auto &instruction = instructions[i];
+                if (instruction.removed) continue;
+                ops.insert(ops.end(), instruction.bytes.begin(), instruction.bytes.begin() + instruction.size);
+                if (instruction.target<0) continue;
+                auto offset = ips[instruction.target] - ips[i];
+                switch (instruction.op()) {
+                    case OP::Jump: vm::writeInt32(ops, ips[i] + 1, (int32_t) offset); break;
+                    case OP::JumpCondition:
+                    case OP::ExtendsJump: vm::writeUint32(ops, ips[i] + 1, offset); break;
+                    case OP::Distribute: vm::writeUint32(ops, ips[i] + 3, offset); break;
+                }
+            }
+
+            auto relocate = [&](unsigned int old) {
+                return old<index.size() ? ips[index[old]] : ip;
+            };
+            //entries of removed ops end up on the next live op, keep the ones of live ops first so findMap picks them
+            vector<SourceMapEntry> live, dead;
+            for (auto &&map: routine.sourceMap.map) {
+                auto i = map.bytecodePos<index.size() ? index[map.bytecodePos] : instructions.size();
+                auto &to = i<instructions.size() && instructions[i].removed ? dead : live;
+                to.push_back({relocate(map.bytecodePos), map.sourcePos, map.sourceEnd});
+            }
+            live.insert(live.end(), dead.begin(), dead.end());
+            routine.sourceMap.map = std::move(live);
+            routine.slotIP = relocate(routine.slotIP);
+            routine.lastOpIp = relocate(routine.lastOpIp);
+            routine.ops = std::move(ops);
+        }
+
+    public:
+        Optimiser(vector<shared<Subroutine>> &subroutines, const vector<StorageItem> &storage): subroutines(subroutines) {
+            for (auto &&item: storage) {
+                literals[item.address] = item.value;
+            }
+            setTargets.assign(subroutines.size(), false);
+            for (auto &&routine: subroutines) {
+                for (unsigned int i = 0; i<routine->ops.size(); i++) {
+                    auto op = (OP) routine->ops[i];
+                    if (op == OP::Set && i + 4<routine->ops.size()) {
+                        auto address = vm::readUint32(routine->ops, i + 1);
+                        if (address<setTargets.size()) setTargets[address] = true;
+                    }
+                    vm::eatParams(op, &i);
+                }
+            }
+        }
+
+        void optimise() {
+            for (auto &&routine: subroutines) {
+                if (!decode(routine->ops)) continue;
+                bool changed = false;
+                while (pass(*routine)) changed = true;
+                if (fuse()) changed = true;
+                if (changed) write(*routine);
+            }
+        }
+    };
+
+    /**
+     * Top-level names of a vm2::Prelude that modules compiled against it can reference. OP::Prelude loads them by
+     * their index in Prelude::types.
+     */
+    struct PreludeSymbols {
+        unordered_map<uint64_t, unsigned int> indices; //hash of the name to index
+        vector<string> names; //by index
+
+        //false if the name (or its hash) is taken already
+        bool add(const HashedText &name) {
+            if (!indices.try_emplace(name.hash, names.size()).second) return false;
+            names.emplace_back(name.text);
+            return true;
+        }
+
+        //-1 if not found
+        int find(const HashedText &name) const {
+            auto found = indices.find(name.hash);
+            if (found == indices.end() || names[found->second] != name.text) return -1;
+            return found->second;
+        }
+    };
+
+    /**
+     * A top-level type alias, function or class whose body compilation was deferred, see Compiler::compileSourceFile(file, threads).
+     */
+    struct DeferredBody {
+        Node *node;
+        shared<Subroutine> routine;
+        unsigned int visibleSymbols; //symbols of main declared up to and including this one
+    };
+
+    struct DeferredError {
+        ErrorCode code;
+        unsigned int pos;
+        unsigned int end;
+    };
 
     class Program {
+        //in a fragment, values with these bits are indices into its own subroutines and addresses in its own storage
+        static constexpr unsigned int localSubroutine = 1u << 31;
+        static constexpr unsigned int localStorage = 1u << 30;
+
     public:
-        vector<string_view> storage; //all kind of literals, as strings
-        unordered_map<uint64_t, reference_wrapper<StorageItem>> storageMap; //used to deduplicated storage entries
+        vector<StorageItem> storage; //all kind of literals, as strings
+        unordered_map<uint64_t, unsigned int> storageMap; //hash to index in storage, used to deduplicate storage entries
 
         unsigned int storageIndex{};
 
+        //storage and subroutine names are views into the AST. When it is released before build() (see
+        //Compiler::compileStatements), the texts are copied into ownedTexts instead.
+        bool ownTexts = false;
+        std::deque<string> ownedTexts;
+
+        //write the source map as varints, see vm::CompactSourceMapReader. Smaller images, findMap decodes it once.
+        bool compactSourceMap = false;
+        vector<SourceMapEntry> compactEntries; //prepareBuild() to write(), bytecodePos relative to the code
+        unsigned int compactSize = 0;
+        //write the operands of the code as varints, see vm::compactOperandsSize(). Smaller images, but vm2::Module
+        //expands them into a copy, so a mapped image is no longer used in place.
+        bool compactOperands = false;
+
+        //by subroutine index, e.g. calls of vm2::SubroutineProfile::weights() of a previous run. See layout()
+        vector<uint64_t> weights;
+        //indices of subroutines in the order their bodies are written, declaration order if empty
+        vector<unsigned int> bodyOrder;
+
+        //storage addresses of module specifier and imported name, by index of OP::Import. See vm::header::Imports
+        vector<std::pair<unsigned int, unsigned int>> imports;
+
         //tracks which subroutine is active (end() is), so that pushOp calls are correctly assigned.
         vector<shared<Subroutine>> activeSubroutines;
         vector<shared<Subroutine>> subroutines;
 
+        //when set, top-level declarations push their body to deferredBodies instead of compiling it
+        bool deferBodies = false;
+        vector<DeferredBody> deferredBodies;
+
+        //a fragment compiles one deferred body on its own, with read-only access to main of the program, see link()
+        bool fragment = false;
+        unsigned int visibleSymbols = 0;
+        vector<DeferredError> errors;
+
         Program() {
             pushSubroutineNameLess(); //main
         }
 
+        /**
+         * Fragment for the body of `body`. Only the first `body.visibleSymbols` symbols of `main` can be found, as
+         * if the body was compiled right after its declaration.
+         */
+        Program(const shared<Subroutine> &main, const DeferredBody &body): fragment(true), visibleSymbols(body.visibleSymbols) {
+            activeSubroutines.push_back(main);
+        }
+
+        /**
+         * Moves the subroutines, storage and errors of `fragment`, which compiled the body of `routine`, into this
+         * program. Fragment-local subroutine indices and storage addresses are rewritten to the ones in this program.
+         */
+        void link(Program &fragment, Subroutine &routine) {
+            unordered_map<unsigned int, unsigned int> addresses; //fragment storage address to ours
+            //texts the fragment owns go away with it, so ours get a copy. The others view into the AST.
+            std::unordered_set<const char *> owned;
+            for (auto &&text: fragment.ownedTexts) owned.insert(text.data());
+            for (auto &&item: fragment.storage) {
+                addresses[item.address] = registerStorageItem({item.value, item.hash}, owned.contains(item.value.data())).address;
+            }
+            for (auto &&local: fragment.subroutines) {
+                local->index = subroutines.size();
+                subroutines.push_back(local);
+            }
+
+            auto relocate = [&](unsigned int value) {
+                if (value & localSubroutine) return fragment.subroutines[value & ~localSubroutine]->index;
+                if (value & localStorage) return addresses[value];
+                return value;
+            };
+            auto relocateOps = [&](Subroutine &subroutine) {
+                for (auto ip: subroutine.relocations) {
+                    vm::writeUint32(subroutine.ops, ip, relocate(vm::readUint32(subroutine.ops, ip)));
+                }
+                subroutine.relocations.clear();
+            };
+            relocateOps(routine);
+            for (auto &&local: fragment.subroutines) {
+                relocateOps(*local);
+                local->nameAddress = relocate(local->nameAddress);
+            }
+
+            for (auto &&error: fragment.errors) pushError(error.code, error.pos, error.end);
+        }
+
         /**
          * Creates a new nameless subroutine, used for example in mapped-type, conditional type
          * @return
@@ -448,7 +952,7 @@ namespace tr::checker {
         unsigned int pushSubroutineNameLess() {
             auto routine = make_shared<Subroutine>();
             routine->type = SymbolType::Inline;
-            routine->index = subroutines.size();
+            routine->index = nextSubroutineIndex();
 
             subroutines.push_back(routine);
             activeSubroutines.push_back(subroutines.back());
@@ -470,14 +974,23 @@ namespace tr::checker {
         unsigned int pushSubroutine(Symbol &symbol) {
             //find subroutine
             if (!symbol.routine) throw runtime_error(fmt::format("symbol has no routine {}", symbol.name));
-            activeSubroutines.push_back(symbol.routine);
-            return symbol.routine->index;
+            return pushSubroutine(symbol.routine);
+        }
+
+        unsigned int pushSubroutine(const shared<Subroutine> &routine) {
+            activeSubroutines.push_back(routine);
+            return routine->index;
+        }
+
+        unsigned int nextSubroutineIndex() const {
+            return fragment ? localSubroutine | subroutines.size() : subroutines.size();
         }
 
         shared<Subroutine> popSubroutine() {
             if (activeSubroutines.empty()) throw runtime_error("No active subroutine found");
             auto subroutine = activeSubroutines.back();
-            if (subroutine->ops.empty()) {
+            //main of a module that only declares types has nothing to run, it gets the bare OP::Return below
+            if (subroutine->ops.empty() && activeSubroutines.size() > 1) {
                 throw runtime_error("Routine is empty");
             }
 
@@ -498,14 +1011,21 @@ namespace tr::checker {
             return activeSubroutines.back();
         }
 
-        FoundSymbol findSymbol(const string_view &identifier) {
+        FoundSymbol findSymbol(const HashedText &identifier) {
             unsigned int offset = 0;
+            auto key = identifier.hash;
             for (auto subroutine = activeSubroutines.rbegin(); subroutine != activeSubroutines.rend(); ++subroutine) {
                 auto &symbols = (*subroutine)->symbols;
-                //we go in reverse to fetch the closest
-                for (auto it = symbols.rbegin(); it != symbols.rend(); ++it) {
-                    if (it->active && it->name == identifier) {
-                        return FoundSymbol(&(*it), offset);
+                auto candidates = (*subroutine)->symbolTable.find(key);
+                if (candidates != (*subroutine)->symbolTable.end()) {
+                    //we go in reverse to fetch the closest
+                    for (auto it = candidates->second.rbegin(); it != candidates->second.rend(); ++it) {
+                        //main is shared by all fragments, it knows declarations that come after this one
+                        if (fragment && subroutine + 1 == activeSubroutines.rend() && *it >= visibleSymbols) continue;
+                        auto &symbol = symbols[*it];
+                        if (symbol.active && symbol.name == identifier.text) {
+                            return FoundSymbol(&symbol, offset);
+                        }
                     }
                 }
                 offset++;
@@ -521,8 +1041,9 @@ namespace tr::checker {
          * In this case it will be replaced in build with the real address in the binary (hence why we need 4 bytes, so space stays constant).
          */
         void pushAddress(unsigned int address, unsigned int offset = 0) {
-            auto &ops = activeSubroutines.back()->ops;
-            vm::writeUint32(ops, offset == 0 ? ops.size() : offset, address);
+            auto &routine = *activeSubroutines.back();
+            if (address & (localSubroutine | localStorage)) routine.relocations.push_back(offset == 0 ? routine.ops.size() : offset);
+            vm::writeUint32(routine.ops, offset == 0 ? routine.ops.size() : offset, address);
         }
 
         void pushInt32Address(int32_t address, unsigned int offset = 0) {
@@ -544,10 +1065,24 @@ namespace tr::checker {
             return subroutines[0];
         }
 
-        void pushError(ErrorCode code, const shared<Node> &node) {
+        template<typename T>
+        void pushError(ErrorCode code, const shared<T> &node) {
+            pushError(code, (const Node *) node.get());
+        }
+
+        void pushError(ErrorCode code, const Node *node) {
+            pushError(code, node->pos, node->end);
+        }
+
+        void pushError(ErrorCode code, unsigned int pos, unsigned int end) {
+            //main is not ours to write in a fragment, link() adds them
+            if (fragment) {
+                errors.push_back({code, pos, end});
+                return;
+            }
             auto main = mainSubroutine();
             //errors need to be part of main
-            main->sourceMap.push(0, node->pos, node->end);
+            main->pushSourceMap(pos, end);
             main->ops.push_back(OP::Error);
             vm::writeUint16(main->ops, main->ops.size(), (unsigned int) code);
         }
@@ -558,7 +1093,7 @@ namespace tr::checker {
             pushUint16(foundSymbol.symbol->index);
         }
 
-        void pushSourceMap(const shared<Node> &node) {
+        void pushSourceMap(const Node *node) {
             activeSubroutines.back()->pushSourceMap(node->pos, node->end);
         }
 
@@ -609,7 +1144,12 @@ namespace tr::checker {
             return activeSubroutines.back()->ops.size();
         }
 
-        void pushOp(OP op, const sharedOpt<Node> &node) {
+        template<typename T>
+        void pushOp(OP op, const shared<T> &node) {
+            pushOp(op, (const Node *) node.get());
+        }
+
+        void pushOp(OP op, const Node *node) {
             if (node) pushSourceMap(node);
             pushOp(op);
         }
@@ -630,7 +1170,7 @@ namespace tr::checker {
         }
 
         void restoreSymbolCheckout(unsigned int checkpoint) {
-            auto symbols = currentSubroutine()->symbols;
+            auto &symbols = currentSubroutine()->symbols;
             for (; checkpoint<symbols.size(); checkpoint++) {
                 symbols[checkpoint].active = false;
             }
@@ -645,137 +1185,353 @@ namespace tr::checker {
          * Symbols will be created first before a body is extracted. This makes sure all
          * symbols are known before their reference is used.
          */
-        Symbol &pushSymbol(string_view name, SymbolType type, const shared<Node> &node) {
+        template<typename T>
+        Symbol &pushSymbol(const HashedText &name, SymbolType type, const shared<T> &node) {
+            return pushSymbol(name, type, (const Node *) node.get());
+        }
+
+        Symbol &pushSymbol(const HashedText &name, SymbolType type, const Node *node) {
             auto subroutine = currentSubroutine();
-            for (auto &&v: subroutine->symbols) {
-                if (type != SymbolType::TypeVariable && v.name == name) {
-                    v.declarations++;
-                    return v;
+            auto &candidates = subroutine->symbolTable[name.hash];
+            if (type != SymbolType::TypeVariable) {
+                for (auto &&i: candidates) {
+                    auto &v = subroutine->symbols[i];
+                    if (v.name == name.text) {
+                        v.declarations++;
+                        return v;
+                    }
                 }
             }
 
             Symbol symbol;
-            symbol.name = string(name);
+            symbol.name = string(name.text);
             symbol.type = type;
             symbol.index = currentSubroutine()->symbols.size();
             symbol.pos = node->pos;
             symbol.end = node->end;
             if (type == SymbolType::TypeVariable) subroutine->slots++;
+            candidates.push_back(symbol.index);
             subroutine->symbols.push_back(symbol);
             return subroutine->symbols.back();
         }
 
-        Symbol &pushSymbolForRoutine(string_view name, SymbolType type, const shared<Node> &node) {
+        template<typename T>
+        Symbol &pushSymbolForRoutine(const HashedText &name, SymbolType type, const shared<T> &node) {
+            return pushSymbolForRoutine(name, type, (const Node *) node.get());
+        }
+
+        Symbol &pushSymbolForRoutine(const HashedText &name, SymbolType type, const Node *node) {
             auto &symbol = pushSymbol(name, type, node);
             if (symbol.routine) return symbol;
 
-            auto routine = make_shared<Subroutine>(name);
+            auto text = name.text;
+            auto routine = make_shared<Subroutine>(text);
             routine->type = type;
-            routine->nameAddress = registerStorage(routine->identifier);
-            routine->index = subroutines.size();
+            auto &item = registerStorageItem(name);
+            routine->identifier = item.value;
+            routine->nameAddress = item.address;
+            routine->index = nextSubroutineIndex();
             subroutines.push_back(routine);
             symbol.routine = routine;
 
             return symbol;
         }
 
-        //note: make sure the same name is not added twice. needs hashmap
-        unsigned int registerStorage(const string_view &s) {
-            if (!storageIndex) storageIndex = 1 + 4; //jump+address
+        /**
+         * Storage entry of `s`. Equal texts share one entry. With `copy` (or ownTexts) a new entry keeps a copy of the
+         * text in ownedTexts, for texts that do not outlive the call.
+         */
+        const StorageItem &registerStorageItem(const HashedText &s, bool copy = false) {
+            if (!storageIndex) storageIndex = 1 + 4 + vm::header::size; //jump+address+header
+
+            auto [existing, inserted] = storageMap.try_emplace(s.hash, storage.size());
+            //on a hash collision the new text simply gets its own entry
+            if (!inserted && storage[existing->second].value == s.text) return storage[existing->second];
+
+            const auto address = fragment ? localStorage | storageIndex : storageIndex;
+            storage.push_back({ownTexts || copy ? string_view(ownedTexts.emplace_back(s.text)) : s.text, s.hash, address});
+            storageIndex += 8 + 2 + s.text.size(); //hash + size + data
+            return storage.back();
+        }
 
-            const auto address = storageIndex;
-            storage.push_back(s);
-            storageIndex += 8 + 2 + s.size(); //hash + size + data
-            return address;
+        /**
+         * Address of `s` in the storage. Equal texts share one entry.
+         */
+        unsigned int registerStorage(const HashedText &s) {
+            return registerStorageItem(s).address;
         }
 
         /**
          * Pushes a Uint32 and stores the text into the storage.
          * @param s
          */
-        void pushStorage(string_view s) {
+        void pushStorage(const HashedText &s) {
             pushAddress(registerStorage(s));
         }
 
-        void pushStringLiteral(string_view s, const shared<Node> &node) {
+        template<typename T>
+        void pushStringLiteral(const HashedText &s, const shared<T> &node) {
+            pushStringLiteral(s, (const Node *) node.get());
+        }
+
+        /**
+         * Pushes OP::Import of `name` exported by the module `specifier`, which vm2::link() resolves.
+         */
+        void pushImport(const HashedText &specifier, const HashedText &name, const Node *node) {
+            pushOp(OP::Import, node);
+            pushUint32(imports.size());
+            imports.push_back({registerStorage(specifier), registerStorage(name)});
+        }
+
+        void pushStringLiteral(const HashedText &s, const Node *node) {
             pushOp(OP::StringLiteral, node);
             pushStorage(s);
         }
 
-        string build() {
-            vector<unsigned char> bin;
-            unsigned int address = 0;
+        /**
+         * Pushes OP::NumberLiteral with the canonical text of `literal` (formatNumber()), so its storage hash is
+         * by value: `1`, `1.0` and `0x1` share one entry and compare equal in the VM.
+         */
+        void pushNumberLiteral(const NumericLiteral &literal, const Node *node) {
+            pushOp(OP::NumberLiteral, node);
+            auto text = formatNumber(literal.value);
+            //the source text lives as long as the node, a different spelling is copied by a new storage entry and
+            //by link() from a fragment
+            if (text == literal.text) {
+                pushStorage(literal.text);
+            } else {
+                pushAddress(registerStorageItem(text, true).address);
+            }
+        }
 
-            address = 5; //we add JUMP + index when building the program to jump over all subroutines&storages
-            bin.push_back(OP::Jump);
-            vm::writeUint32(bin, bin.size(), 0); //set after storage handling
+        /**
+         * Orders the subroutine bodies by `weights`: hot ones first by descending weight, so they are next to each
+         * other in the image, the ones without weight after them in declaration order. Only the code moves,
+         * subroutines are referenced by index and jumps are relative, so the subroutine table and the source map are
+         * all that change. Run by prepareBuild() after the optimiser.
+         */
+        void layout() {
+            bodyOrder.clear();
+            if (weights.empty()) return;
+            auto weight = [this](unsigned int i) { return i < weights.size() ? weights[i] : 0; };
+            bodyOrder.resize(subroutines.size());
+            for (unsigned int i = 0; i < bodyOrder.size(); i++) bodyOrder[i] = i;
+            std::stable_sort(bodyOrder.begin(), bodyOrder.end(), [&weight](unsigned int a, unsigned int b) { return weight(a) > weight(b); });
+        }
 
-            for (auto &&item: storage) {
-                address += 8 + 2 + item.size(); //hash+size+data
-            }
+        //indices of subroutines in the order of their bodies in the image
+        vector<unsigned int> bodies() const {
+            if (bodyOrder.size() == subroutines.size()) return bodyOrder;
+            vector<unsigned int> order(subroutines.size());
+            for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+            return order;
+        }
 
-            //set initial jump position to right after the storage data
-            vm::writeUint32(bin, 1, address);
-            //push all storage data to the binary
-            for (auto &&item: storage) {
-                vm::writeUint64(bin, bin.size(), hash::runtime_hash(item));
-                vm::writeUint16(bin, bin.size(), item.size());
-                bin.insert(bin.end(), item.begin(), item.end());
+        static string_view code(const Subroutine &routine) {
+            return {(const char *) routine.ops.data(), routine.ops.size()};
+        }
+
+        unsigned int sourceMapSize() const {
+            unsigned int size = 0;
+            for (auto &&routine: subroutines) size += routine->sourceMap.map.size() * (4 * 3);
+            return size;
+        }
+
+        /**
+         * Collects the entries of all subroutines sorted by position and returns their encoded size. Positions are
+         * relative to the code so that they do not depend on the size of the source map itself.
+         */
+        unsigned int prepareCompactSourceMap() {
+            compactEntries.clear();
+            unsigned int bytecodePosOffset = 0;
+            for (auto i: bodies()) {
+                auto &routine = subroutines[i];
+                for (auto &&map: routine->sourceMap.map) {
+                    compactEntries.push_back({bytecodePosOffset + map.bytecodePos, map.sourcePos, map.sourceEnd});
+                }
+                bytecodePosOffset += routine->ops.size();
+            }
+            std::stable_sort(compactEntries.begin(), compactEntries.end(), [](const SourceMapEntry &a, const SourceMapEntry &b) {
+                return a.bytecodePos < b.bytecodePos;
+            });
+
+            compactSize = 0;
+            SourceMapEntry last{0, 0, 0};
+            for (auto &&entry: compactEntries) {
+                compactSize += vm::varUintSize(entry.bytecodePos - last.bytecodePos);
+                compactSize += vm::varUintSize(vm::zigzag(entry.sourcePos - last.sourcePos));
+                compactSize += vm::varUintSize(vm::zigzag(entry.sourceEnd - entry.sourcePos));
+                last = entry;
             }
+            return compactSize;
+        }
 
-            //collect sourcemap data
-            unsigned int sourceMapSize = 0;
+        /**
+         * Runs the optimiser and returns the exact size of the image write() produces. All sections are known at this
+         * point, so the image can be written in one go into memory allocated once, e.g. a mapped file.
+         */
+        unsigned int prepareBuild() {
+            Optimiser(subroutines, storage).optimise();
+            layout();
+
+            unsigned int size = 5 + vm::header::size; //JUMP + address + header
+            for (auto &&item: storage) size += 8 + 2 + item.value.size(); //hash+size+data
+            size += 1 + 4 + (compactSourceMap ? prepareCompactSourceMap() : sourceMapSize()); //OP::SourceMap + uint32 size
+            size += subroutines.size() * vm::header::subroutineEntrySize;
+            size += imports.size() * vm::header::importEntrySize;
+            size += 1; //OP::Main
             for (auto &&routine: subroutines) {
-                sourceMapSize += routine->sourceMap.map.size() * (4 * 3);
+                if (routine->slots) {
+                    vm::writeUint16(routine->ops, routine->slotIP + 1, routine->slots);
+                }
+                size += compactOperands ? vm::compactOperandsSize(code(*routine)) : routine->ops.size();
             }
+            return size;
+        }
+
+        /**
+         * Writes the image into `bin`, which has room for exactly prepareBuild() bytes.
+         */
+        void write(char *bin) {
+            unsigned int ip = 0;
+            auto writeUint16 = [&](uint16_t value) { vm::writeUint16(bin, ip, value); ip += 2; };
+            auto writeUint32 = [&](uint32_t value) { vm::writeUint32(bin, ip, value); ip += 4; };
+            auto writeUint64 = [&](uint64_t value) { vm::writeUint64(bin, ip, value); ip += 8; };
+
+            //we add JUMP + index to jump over all subroutines&storages, the index is set after storage handling
+            bin[ip++] = OP::Jump;
+            ip += 4;
+
+            //fixed header, see vm::header. Addresses are filled in as the sections are written.
+            vm::writeUint32(bin, vm::header::Magic, vm::header::magic);
+            vm::writeUint32(bin, vm::header::Version, vm::header::version);
+            vm::writeUint32(bin, vm::header::SubroutineCount, subroutines.size());
+            vm::writeUint32(bin, vm::header::Flags, (compactSourceMap ? vm::header::CompactSourceMap : 0) | (compactOperands ? vm::header::CompactOperands : 0));
+            vm::writeUint32(bin, vm::header::ImportCount, imports.size());
+            ip += vm::header::size;
+            vm::writeUint32(bin, vm::header::Storage, ip);
+
+            //push all storage data to the binary
+            for (auto &&item: storage) {
+                writeUint64(item.hash);
+                writeUint16(item.value.size());
+                std::memcpy(bin + ip, item.value.data(), item.value.size());
+                ip += item.value.size();
+            }
+            //set initial jump position to right after the storage data
+            vm::writeUint32(bin, 1, ip);
 
             //write sourcemap
-            bin.push_back(OP::SourceMap);
-            vm::writeUint32(bin, bin.size(), sourceMapSize);
-            address += 1 + 4 + sourceMapSize; //OP::SourceMap + uint32 size
+            auto mapSize = compactSourceMap ? compactSize : sourceMapSize();
+            bin[ip++] = OP::SourceMap;
+            writeUint32(mapSize);
+            vm::writeUint32(bin, vm::header::SourceMap, ip);
+            vm::writeUint32(bin, vm::header::SourceMapEnd, ip + mapSize);
 
+            unsigned int address = ip + mapSize + subroutines.size() * vm::header::subroutineEntrySize + imports.size() * vm::header::importEntrySize + 1; //OP::Main
             unsigned int bytecodePosOffset = address;
-            bytecodePosOffset += subroutines.size() * (1 + 4 + 4 + 1); //OP::Subroutine + uint32 name address + uint32 routine address + flags
-            bytecodePosOffset += 1; //OP::Main
 
-            for (auto &&routine: subroutines) {
-                for (auto &&map: routine->sourceMap.map) {
-                    vm::writeUint32(bin, bin.size(), bytecodePosOffset + map.bytecodePos);
-                    vm::writeUint32(bin, bin.size(), map.sourcePos);
-                    vm::writeUint32(bin, bin.size(), map.sourceEnd);
+            //sorted by bytecode position so Module::findMap can binary search. Subroutines are laid out in order and
+            //their maps are usually in order as well, so the entries are written as they are and only sorted if not.
+            if (compactSourceMap) {
+                SourceMapEntry last{0, 0, 0};
+                for (auto &&entry: compactEntries) {
+                    ip = vm::writeVarUint(bin, ip, entry.bytecodePos - last.bytecodePos);
+                    ip = vm::writeVarUint(bin, ip, vm::zigzag(entry.sourcePos - last.sourcePos));
+                    ip = vm::writeVarUint(bin, ip, vm::zigzag(entry.sourceEnd - entry.sourcePos));
+                    last = entry;
+                }
+                compactEntries.clear();
+            } else {
+                auto mapStart = ip;
+                bool sorted = true;
+                unsigned int lastBytecodePos = 0;
+                for (auto i: bodies()) {
+                    auto &routine = subroutines[i];
+                    for (auto &&map: routine->sourceMap.map) {
+                        auto bytecodePos = bytecodePosOffset + map.bytecodePos;
+                        if (bytecodePos < lastBytecodePos) sorted = false;
+                        lastBytecodePos = bytecodePos;
+                        writeUint32(bytecodePos);
+                        writeUint32(map.sourcePos);
+                        writeUint32(map.sourceEnd);
+                    }
+                    bytecodePosOffset += routine->ops.size();
+                }
+                if (!sorted) {
+                    //stable to keep the first entry of an ip first
+                    vector<SourceMapEntry> sourceMap(mapSize / (4 * 3));
+                    std::memcpy(sourceMap.data(), bin + mapStart, mapSize);
+                    std::stable_sort(sourceMap.begin(), sourceMap.end(), [](const SourceMapEntry &a, const SourceMapEntry &b) {
+                        return a.bytecodePos < b.bytecodePos;
+                    });
+                    std::memcpy(bin + mapStart, sourceMap.data(), mapSize);
                 }
-                bytecodePosOffset += routine->ops.size();
             }
 
-            address += 1; //OP::Main
-            address += subroutines.size() * (1 + 4 + 4 + 1); //OP::Subroutine + uint32 name address + uint32 routine address + flags
-
             //after the storage data follows the subroutine meta-data.
-            for (auto &&routine: subroutines) {
-                bin.push_back(OP::Subroutine);
-                vm::writeUint32(bin, bin.size(), routine->nameAddress);
-                vm::writeUint32(bin, bin.size(), address);
-                bin.push_back(routine->getFlags());
-                address += routine->ops.size();
+            auto order = bodies();
+            vector<unsigned int> addresses(subroutines.size());
+            for (auto i: order) {
+                addresses[i] = address;
+                address += subroutines[i]->ops.size();
+            }
+            vm::writeUint32(bin, vm::header::Subroutines, ip);
+            for (unsigned int i = 0; i < subroutines.size(); i++) {
+                auto &routine = subroutines[i];
+                bin[ip++] = OP::Subroutine;
+                writeUint32(routine->nameAddress);
+                writeUint32(addresses[i]);
+                bin[ip++] = routine->getFlags();
+            }
+
+            vm::writeUint32(bin, vm::header::Imports, ip);
+            for (auto &&[specifier, name]: imports) {
+                bin[ip++] = OP::ModuleImport;
+                writeUint32(specifier);
+                writeUint32(name);
             }
 
             //after subroutine meta-data follows the actual subroutine code, which we jump over.
             //this marks the end of the header.
-            bin.push_back(OP::Main);
+            vm::writeUint32(bin, vm::header::Main, ip);
+            bin[ip++] = OP::Main;
 
-            for (auto &&routine: subroutines) {
-                if (routine->slots) {
-                    vm::writeUint16(routine->ops, routine->slotIP + 1, routine->slots);
+            for (auto i: order) {
+                auto &routine = subroutines[i];
+                if (compactOperands) {
+                    ip = vm::writeCompactOperands(bin, ip, code(*routine));
+                    continue;
                 }
-                bin.insert(bin.end(), routine->ops.begin(), routine->ops.end());
+                std::memcpy(bin + ip, routine->ops.data(), routine->ops.size());
+                ip += routine->ops.size();
             }
+        }
+
+        /**
+         * The image in a string allocated once, which vm2::Module adopts when moved in.
+         */
+        string build() {
+            string bin;
+            bin.resize_and_overwrite(prepareBuild(), [this](char *data, size_t size) {
+                write(data);
+                return size;
+            });
+            return bin;
+        }
 
-            return string(bin.begin(), bin.end());
+        //with the bodies ordered by `weights`, see layout()
+        string build(const vector<uint64_t> &weights) {
+            this->weights = weights;
+            return build();
         }
     };
 
     class Compiler {
     public:
+        //names not declared in the source file itself are looked up here, see pushPreludeReference()
+        const PreludeSymbols *prelude = nullptr;
+
         Program compileSourceFile(const shared<SourceFile> &file) {
             Program program;
 
@@ -786,45 +1542,120 @@ namespace tr::checker {
             return program;
         }
 
-        void pushName(sharedOpt<Node> name, Program &program) {
+        /**
+         * compileSourceFile with the bodies of top-level type aliases, functions and classes compiled on up to
+         * `threads` threads. Everything else (symbols, variables, statements) is compiled serially first, the bodies
+         * are queued and compiled in fragments with read-only access to the top-level symbols, which are then linked
+         * in declaration order. The result is the same for any number of threads and checks like compileSourceFile,
+         * only errors found in these bodies are reported after the others.
+         */
+        Program compileSourceFile(const shared<SourceFile> &file, unsigned int threads) {
+            Program program;
+            program.deferBodies = true;
+            handle(file, program);
+            program.deferBodies = false;
+
+            auto &bodies = program.deferredBodies;
+            vector<std::unique_ptr<Program>> fragments(bodies.size());
+            std::atomic<unsigned int> next = 0;
+            std::mutex mutex;
+            std::exception_ptr error;
+            auto work = [&] {
+                for (unsigned int i; (i = next++) < bodies.size();) {
+                    try {
+                        auto fragment = std::make_unique<Program>(program.mainSubroutine(), bodies[i]);
+                        handleDeclarationBody(bodies[i].node, bodies[i].routine, *fragment);
+                        fragments[i] = std::move(fragment);
+                    } catch (...) {
+                        std::lock_guard lock(mutex);
+                        if (!error) error = std::current_exception();
+                    }
+                }
+            };
+            vector<std::thread> workers;
+            for (unsigned int i = 1; i < std::min<size_t>(threads, bodies.size()); i++) workers.emplace_back(work);
+            work();
+            for (auto &&worker: workers) worker.join();
+            if (error) std::rethrow_exception(error);
+
+            for (unsigned int i = 0; i < bodies.size(); i++) program.link(*fragments[i], *bodies[i].routine);
+            bodies.clear();
+
+            program.popSubroutine(); //main
+
+            return program;
+        }
+
+        /**
+         * Like compileSourceFile, for top-level statements that arrive one at a time. `produce` gets a callback that
+         * compiles a statement right away, e.g. Parser::parseSourceFileStatements, so no statement has to be kept
+         * after it was compiled. The symbols are resolved in declaration order in both cases, so the program is the same.
+         */
+        Program compileStatements(const function<void(const function<void(const shared<Node> &)> &)> &produce) {
+            Program program;
+            program.ownTexts = true;
+
+            produce([this, &program](const shared<Node> &statement) {
+                handle(statement, program);
+            });
+
+            program.popSubroutine(); //main
+
+            return program;
+        }
+
+        template<typename T>
+        void pushName(const sharedOpt<T> &name, Program &program) {
+            pushName((Node *) name.get(), program);
+        }
+
+        void pushName(Node *name, Program &program) {
             if (!name) {
                 program.pushOp(OP::Never);
                 return;
             }
 
             if (name->kind == SyntaxKind::Identifier) {
-                program.pushStringLiteral(to<Identifier>(name)->escapedText, name);
+                program.pushStringLiteral(*to<Identifier>(name), name);
             } else {
                 //computed type name like `[a]: string`
                 handle(name, program);
             }
         }
 
-        void pushFunction(OP op, sharedOpt<Node> node, Program &program, sharedOpt<Node> withName) {
-            sharedOpt<Node> body;
-            sharedOpt<Node> type;
-            sharedOpt<NodeArray> typeParameters;
-            sharedOpt<NodeArray> parameters;
+        template<typename T>
+        void pushFunction(OP op, Node *node, Program &program, const sharedOpt<T> &withName) {
+            pushFunction(op, node, program, (Node *) withName.get());
+        }
+
+        void pushFunction(OP op, Node *node, Program &program, Node *withName) {
+            Node *body = nullptr;
+            Node *type = nullptr;
+            NodeArray *typeParameters = nullptr;
+            NodeArray *parameters = nullptr;
             if (auto a = to<FunctionDeclaration>(node)) {
-                body = a->body;
-                type = a->type;
-                parameters = a->parameters;
-                typeParameters = a->typeParameters;
+                body = a->body.get();
+                type = a->type.get();
+                parameters = a->parameters.get();
+                typeParameters = a->typeParameters.get();
             } else if (auto a = to<FunctionTypeNode>(node)) {
-                type = a->type;
-                parameters = a->parameters;
-                typeParameters = a->typeParameters;
+                type = a->type.get();
+                parameters = a->parameters.get();
+                typeParameters = a->typeParameters.get();
             } else if (auto a = to<MethodDeclaration>(node)) {
-                body = a->body;
-                type = a->type;
-                parameters = a->parameters;
-                typeParameters = a->typeParameters;
+                body = a->body.get();
+                type = a->type.get();
+                parameters = a->parameters.get();
+                typeParameters = a->typeParameters.get();
             } else {
                 throw std::runtime_error("function type not supported");
             }
 
+            //a body skipped by the parser has nothing to check or infer from
+            if (body && body->kind == SyntaxKind::Block && to<Block>(body)->bodySkipped) body = nullptr;
+
             auto pushBodyType = [&] {
-                unsigned int bodyAddress;
+                unsigned int bodyAddress = 0;
                 if (body) {
                     bodyAddress = program.pushSubroutineNameLess();
                     program.pushOp(OP::TypeArgument);
@@ -883,11 +1714,11 @@ namespace tr::checker {
                 }
 
                 pushName(withName, program);
-                program.pushOp(op, reinterpret_pointer_cast<Node>(node));
+                program.pushOp(op, node);
                 program.pushUint16(size);
                 program.popSubroutine();
 
-                program.pushOp(OP::FunctionRef, reinterpret_pointer_cast<Node>(node));
+                program.pushOp(OP::FunctionRef, node);
                 program.pushAddress(subroutineIndex);
             } else {
                 unsigned int size = 0;
@@ -902,12 +1733,126 @@ namespace tr::checker {
                 }
 
                 pushName(withName, program);
-                program.pushOp(op, reinterpret_pointer_cast<Node>(node));
+                program.pushOp(op, node);
                 program.pushUint16(size);
             }
         }
 
-        void handle(const shared<Node> &node, Program &program) {
+        /**
+         * A top-level `export` declaration with a routine, whose result vm2::Exports can link into other modules.
+         */
+        void markExported(const Node *declaration, Symbol &symbol, Program &program) {
+            if (symbol.routine && program.activeSubroutines.size() == 1 && hasModifier(declaration, SyntaxKind::ExportKeyword)) {
+                symbol.routine->exported = true;
+            }
+        }
+
+        /**
+         * Links `name` to a pinned type of the prelude, if it has one of that name.
+         */
+        bool pushPreludeReference(const HashedText &name, const Node *node, Program &program) {
+            if (!prelude) return false;
+            auto index = prelude->find(name);
+            if (index < 0) return false;
+            program.pushOp(OP::Prelude, node);
+            program.pushUint32(index);
+            return true;
+        }
+
+        /**
+         * Compiles the body of a type alias, function or class declaration into its `routine`. At the top-level of a
+         * program with deferBodies, the body is only queued and compiled later in a fragment.
+         */
+        void pushDeclarationBody(Node *node, Symbol &symbol, Program &program) {
+            if (program.deferBodies && program.activeSubroutines.size() == 1) {
+                program.deferredBodies.push_back({node, symbol.routine, (unsigned int) program.currentSubroutine()->symbols.size()});
+                return;
+            }
+            handleDeclarationBody(node, symbol.routine, program);
+        }
+
+        void handleDeclarationBody(Node *node, const shared<Subroutine> &routine, Program &program) {
+            switch (node->kind) {
+                case SyntaxKind::TypeAliasDeclaration: {
+                    const auto n = to<TypeAliasDeclaration>(node);
+                    //populate routine
+                    program.pushSubroutine(routine);
+                    //in symbol subroutines we block TailCalls because want to store the result on the routine
+                    //but only if it has no typeParameters
+                    if (!n->typeParameters || n->typeParameters->length() == 0) {
+                        program.blockTailCall();
+                    }
+
+                    if (n->typeParameters) {
+                        for (auto &&p: n->typeParameters->list) {
+                            handle(p, program);
+                        }
+                    }
+                    program.pushSlots();
+
+                    handle(n->type, program);
+                    program.popSubroutine();
+                    break;
+                }
+                case SyntaxKind::FunctionDeclaration: {
+                    const auto n = to<FunctionDeclaration>(node);
+                    program.pushSubroutine(routine);
+                    program.pushSlots();
+                    pushFunction(OP::Function, n, program, n->name);
+                    program.popSubroutine();
+                    break;
+                }
+                case SyntaxKind::ClassDeclaration: {
+                    const auto n = to<ClassDeclaration>(node);
+                    //populate routine
+                    program.pushSubroutine(routine);
+                    program.blockTailCall();
+
+                    if (n->typeParameters) {
+                        auto subroutineIndex = program.pushSubroutineNameLess();
+                        program.blockTailCall();
+                        for (auto &&p: n->typeParameters->list) {
+                            handle(p, program);
+                        }
+
+                        program.pushSlots();
+
+                        unsigned int size = 0;
+                        for (auto &&member: n->members->list) {
+                            size++;
+                            handle(member, program);
+                        }
+                        program.pushOp(OP::Class, node);
+                        program.pushUint16(size);
+                        program.popSubroutine();
+
+                        program.pushOp(OP::ClassRef, node);
+                        program.pushAddress(subroutineIndex);
+                    } else {
+                        program.pushSlots();
+
+                        unsigned int size = 0;
+                        for (auto &&member: n->members->list) {
+                            size++;
+                            handle(member, program);
+                        }
+                        program.pushOp(OP::Class, node);
+                        program.pushUint16(size);
+                    }
+                    program.popSubroutine();
+                    break;
+                }
+                default:
+                    throw std::runtime_error(fmt::format("{} has no declaration body", node->kind));
+            }
+        }
+
+        template<typename T>
+        void handle(const shared<T> &node, Program &program) {
+            handle((Node *) node.get(), program);
+        }
+
+        void handle(Node *node, Program &program) {
             switch (node->kind) {
                 case SyntaxKind::SourceFile: {
                     for (auto &&statement: to<SourceFile>(node)->statements->list) {
@@ -927,6 +1872,9 @@ namespace tr::checker {
                 case SyntaxKind::NeverKeyword:
                     program.pushOp(OP::Never, node);
                     break;
+                case SyntaxKind::UnknownKeyword:
+                    program.pushOp(OP::Unknown, node);
+                    break;
                 case SyntaxKind::BooleanKeyword:
                     program.pushOp(OP::Boolean, node);
                     break;
@@ -941,8 +1889,7 @@ namespace tr::checker {
                     program.pushStorage(to<BigIntLiteral>(node)->text);
                     break;
                 case SyntaxKind::NumericLiteral:
-                    program.pushOp(OP::NumberLiteral, node);
-                    program.pushStorage(to<NumericLiteral>(node)->text);
+                    program.pushNumberLiteral(*to<NumericLiteral>(node), node);
                     break;
                 case SyntaxKind::StringLiteral:
                     program.pushOp(OP::StringLiteral, node);
@@ -996,13 +1943,13 @@ namespace tr::checker {
                             if (a->rawText && !a->rawText->empty()) {
                                 size++;
                                 program.pushOp(OP::StringLiteral, sub);
-                                program.pushStorage(a->rawText ? *a->rawText : "");
+                                program.pushStorage(*a->rawText);
                             }
                         } else if (auto a = to<TemplateTail>(span->literal)) {
                             if (a->rawText && !a->rawText->empty()) {
                                 size++;
                                 program.pushOp(OP::StringLiteral, a);
-                                program.pushStorage(a->rawText ? *a->rawText : "");
+                                program.pushStorage(*a->rawText);
                             }
                         }
                     }
@@ -1024,14 +1971,21 @@ namespace tr::checker {
                     program.pushUint16(size);
                     break;
                 }
+                case SyntaxKind::IntersectionType: {
+                    const auto n = to<IntersectionTypeNode>(node);
+                    for (auto &&s: n->types->list) handle(s, program);
+                    program.pushOp(OP::Intersection, node);
+                    program.pushUint16(n->types->list.size());
+                    break;
+                }
                 case SyntaxKind::TypeReference: {
                     //todo: search in symbol table and get address
 //                    debug("type reference {}", to<TypeReferenceNode>(node)->typeName->to<Identifier>().escapedText);
 //                    program.pushOp(OP::Number);
                     const auto n = to<TypeReferenceNode>(node);
-                    const auto name = to<Identifier>(n->typeName)->escapedText;
-                    auto foundSymbol = program.findSymbol(name);
+                    auto foundSymbol = program.findSymbol(*to<Identifier>(n->typeName));
                     if (!foundSymbol.symbol) {
+                        if (!n->typeArguments && pushPreludeReference(*to<Identifier>(n->typeName), n->typeName.get(), program)) break;
                         program.pushOp(OP::Never, n->typeName);
                         program.pushError(ErrorCode::CannotFind, n->typeName);
                     } else {
@@ -1064,27 +2018,12 @@ namespace tr::checker {
                 case SyntaxKind::TypeAliasDeclaration: {
                     const auto n = to<TypeAliasDeclaration>(node);
 
-                    auto &symbol = program.pushSymbolForRoutine(n->name->escapedText, SymbolType::Type, n); //move this to earlier symbol-scan round
+                    auto &symbol = program.pushSymbolForRoutine(*n->name, SymbolType::Type, n); //move this to earlier symbol-scan round
                     if (symbol.declarations>1) {
                         //todo: for functions/variable embed an error that symbol was declared twice in the same scope
                     } else {
-                        //populate routine
-                        program.pushSubroutine(symbol);
-                        //in symbol subroutines we block TailCalls because want to store the result on the routine
-                        //but only if it has no typeParameters
-                        if (!n->typeParameters || n->typeParameters->length() == 0) {
-                            program.blockTailCall();
-                        }
-
-                        if (n->typeParameters) {
-                            for (auto &&p: n->typeParameters->list) {
-                                handle(p, program);
-                            }
-                        }
-                        program.pushSlots();
-
-                        handle(n->type, program);
-                        program.popSubroutine();
+                        markExported(n, symbol, program);
+                        pushDeclarationBody(node, symbol, program);
                     }
                     break;
                 }
@@ -1097,7 +2036,7 @@ namespace tr::checker {
                     }
                     program.pushOp(OP::Parameter, node);
                     if (auto id = to<Identifier>(n->name)) {
-                        program.pushStorage(id->escapedText);
+                        program.pushStorage(*id);
                     } else {
                         program.pushStorage("");
                     }
@@ -1110,7 +2049,7 @@ namespace tr::checker {
                 }
                 case SyntaxKind::TypeParameter: {
                     const auto n = to<TypeParameterDeclaration>(node);
-                    auto &symbol = program.pushSymbol(n->name->escapedText, SymbolType::TypeArgument, n);
+                    auto &symbol = program.pushSymbol(*n->name, SymbolType::TypeArgument, n);
                     auto subroutine = program.currentSubroutine();
                     if (n->defaultType) {
                         program.pushSubroutineNameLess();
@@ -1131,14 +2070,12 @@ namespace tr::checker {
                 case SyntaxKind::FunctionDeclaration: {
                     const auto n = to<FunctionDeclaration>(node);
                     if (const auto id = to<Identifier>(n->name)) {
-                        auto &symbol = program.pushSymbolForRoutine(id->escapedText, SymbolType::Function, id); //move this to earlier symbol-scan round
+                        auto &symbol = program.pushSymbolForRoutine(*id, SymbolType::Function, id); //move this to earlier symbol-scan round
                         if (symbol.declarations>1) {
                             //todo: embed error since function is declared twice
                         } else {
-                            program.pushSubroutine(symbol);
-                            program.pushSlots();
-                            pushFunction(OP::Function, n, program, n->name);
-                            program.popSubroutine();
+                            markExported(n, symbol, program);
+                            pushDeclarationBody(node, symbol, program);
                         }
                     } else {
                         debug("No identifier in name");
@@ -1153,8 +2090,9 @@ namespace tr::checker {
                 }
                 case SyntaxKind::Identifier: {
                     const auto n = to<Identifier>(node);
-                    auto foundSymbol = program.findSymbol(n->escapedText);
+                    auto foundSymbol = program.findSymbol(*n);
                     if (!foundSymbol.symbol) {
+                        if (!n->typeArguments && pushPreludeReference(*n, n, program)) break;
                         program.pushOp(OP::Never, n);
                         program.pushError(ErrorCode::CannotFind, n);
                     } else {
@@ -1392,7 +2330,7 @@ namespace tr::checker {
 
                         //Distribute creates implicit TypeVariable on the stack and populates it
                         //todo: we have to move it to the beginning of the subroutine
-                        auto symbol = program.pushSymbol(distributiveOverIdentifier->escapedText, SymbolType::TypeVariable, distributiveOverIdentifier);
+                        auto symbol = program.pushSymbol(*distributiveOverIdentifier, SymbolType::TypeVariable, distributiveOverIdentifier);
 
                         program.pushOp(OP::Distribute);
                         distributeJumpIp = program.ip();
@@ -1500,47 +2438,13 @@ namespace tr::checker {
                         throw std::runtime_error("class without name not supported");
                     }
 
-                    auto &symbol = program.pushSymbolForRoutine(n->name->escapedText, SymbolType::Class, n); //move this to earlier symbol-scan round
+                    auto &symbol = program.pushSymbolForRoutine(*n->name, SymbolType::Class, n); //move this to earlier symbol-scan round
                     if (symbol.declarations>1) {
                         //todo: for functions/variable embed an error that symbol was declared twice in the same scope
                         throw std::runtime_error("Nope");
                     } else {
-                        //populate routine
-                        program.pushSubroutine(symbol);
-                        program.blockTailCall();
-
-                        if (n->typeParameters) {
-                            auto subroutineIndex = program.pushSubroutineNameLess();
-                            program.blockTailCall();
-                            for (auto &&p: n->typeParameters->list) {
-                                handle(p, program);
-                            }
-
-                            program.pushSlots();
-
-                            unsigned int size = 0;
-                            for (auto &&member: n->members->list) {
-                                size++;
-                                handle(member, program);
-                            }
-                            program.pushOp(OP::Class, node);
-                            program.pushUint16(size);
-                            program.popSubroutine();
-
-                            program.pushOp(OP::ClassRef, reinterpret_pointer_cast<Node>(node));
-                            program.pushAddress(subroutineIndex);
-                        } else {
-                            program.pushSlots();
-
-                            unsigned int size = 0;
-                            for (auto &&member: n->members->list) {
-                                size++;
-                                handle(member, program);
-                            }
-                            program.pushOp(OP::Class, node);
-                            program.pushUint16(size);
-                        }
-                        program.popSubroutine();
+                        markExported(n, symbol, program);
+                        pushDeclarationBody(node, symbol, program);
                     }
                     break;
                 }
@@ -1593,8 +2497,7 @@ namespace tr::checker {
                     switch (n->operatorToken->kind) {
                         case SyntaxKind::EqualsToken: {
                             if (n->left->kind == SyntaxKind::Identifier) {
-                                const auto name = to<Identifier>(n->left)->escapedText;
-                                auto foundSymbol = program.findSymbol(name);
+                                auto foundSymbol = program.findSymbol(*to<Identifier>(n->left));
                                 if (!foundSymbol.symbol) {
                                     program.pushOp(OP::Never, n->left);
                                     program.pushError(ErrorCode::CannotFind, n->left);
@@ -1617,15 +2520,59 @@ namespace tr::checker {
                     break;
                 }
                 case SyntaxKind::VariableStatement: {
-                    for (auto &&s: to<VariableStatement>(node)->declarationList->declarations->list) {
+                    const auto n = to<VariableStatement>(node);
+                    for (auto &&s: n->declarationList->declarations->list) {
                         handle(s, program);
+                        if (auto id = to<Identifier>(to<VariableDeclaration>(s)->name)) {
+                            if (auto found = program.findSymbol(*id); found.symbol) markExported(n, *found.symbol, program);
+                        }
+                    }
+                    break;
+                }
+                case SyntaxKind::ImportDeclaration: {
+                    //named imports only, each one a routine returning the type linked by vm2::link()
+                    const auto n = to<ImportDeclaration>(node);
+                    auto specifier = to<StringLiteral>(n->moduleSpecifier);
+                    if (!specifier || !n->importClause) break;
+                    auto named = to<NamedImports>(n->importClause->namedBindings);
+                    if (!named) break;
+                    for (auto &&element: named->elements->list) {
+                        auto importSpecifier = to<ImportSpecifier>(element);
+                        auto &symbol = program.pushSymbolForRoutine(*importSpecifier->name, SymbolType::Type, importSpecifier->name);
+                        if (symbol.declarations>1) continue;
+                        program.pushSubroutine(symbol);
+                        program.blockTailCall();
+                        program.pushSlots();
+                        auto exported = importSpecifier->propertyName ? importSpecifier->propertyName : importSpecifier->name;
+                        program.pushImport(specifier->text, *exported, importSpecifier->name.get());
+                        program.popSubroutine();
+                        //resolved in main, so unused imports report as well
+                        program.pushOp(OP::Call, importSpecifier->name);
+                        program.pushAddress(symbol.routine->index);
+                        program.pushUint16(0);
+                        program.pushOp(OP::Pop);
+                    }
+                    break;
+                }
+                case SyntaxKind::ExportDeclaration: {
+                    //`export {a, b}` of local declarations
+                    const auto n = to<ExportDeclaration>(node);
+                    if (n->moduleSpecifier || program.activeSubroutines.size() != 1) break;
+                    auto named = to<NamedExports>(n->exportClause);
+                    if (!named) break;
+                    for (auto &&element: named->elements->list) {
+                        auto exportSpecifier = to<ExportSpecifier>(element);
+                        //renamed exports would need a routine of the new name
+                        if (exportSpecifier->propertyName) continue;
+                        auto found = program.findSymbol(*exportSpecifier->name);
+                        if (found.symbol && found.symbol->routine) found.symbol->routine->exported = true;
                     }
                     break;
                 }
                 case SyntaxKind::VariableDeclaration: {
                     const auto n = to<VariableDeclaration>(node);
                     if (const auto id = to<Identifier>(n->name)) {
-                        auto &symbol = program.pushSymbolForRoutine(id->escapedText, SymbolType::Variable, id); //move this to earlier symbol-scan round
+                        auto &symbol = program.pushSymbolForRoutine(*id, SymbolType::Variable, id); //move this to earlier symbol-scan round
                         if (symbol.declarations>1) {
                             //todo: embed error since variable is declared twice
                         } else {
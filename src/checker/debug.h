@@ -36,6 +36,12 @@ namespace tr::checker {
     };
 
     inline DebugBinResult parseBin(string_view bin, bool print = false) {
+        //addresses refer to the fixed-width operands
+        string expanded;
+        if (vm::hasCompactOperands(bin)) {
+            expanded = vm::expandOperands(bin);
+            bin = expanded;
+        }
         const auto end = bin.size();
         unsigned int storageEnd = 0;
         bool newSubRoutine = false;
@@ -89,17 +95,27 @@ namespace tr::checker {
                     auto size = vm::readUint32(bin, i + 1);
                     auto start = i + 1;
                     i += 4 + size;
-                    params += fmt::format(" {}->{} ({})", start, i, size / (4 * 3)); //each entry has 3x 4bytes (uint32)
-
-                    for (unsigned int j = start + 4; j < i; j += 4 * 3) {
+                    auto addEntry = [&](unsigned int bytecodePos, unsigned int sourcePos, unsigned int sourceEnd) {
                         DebugSourceMapEntry sourceMapEntry{
-                                                                   .op = (OP)(bin[vm::readUint32(bin, j)]),
-                                                                   .bytecodePos = vm::readUint32(bin, j),
-                                                                   .sourcePos = vm::readUint32(bin, j + 4),
-                                                                   .sourceEnd =  vm::readUint32(bin, j + 8),
+                                                                   .op = (OP)(bin[bytecodePos]),
+                                                                   .bytecodePos = bytecodePos,
+                                                                   .sourcePos = sourcePos,
+                                                                   .sourceEnd = sourceEnd,
                                                            };
                         result.sourceMap.push_back(sourceMapEntry);
                         if (print) debug("Map [{}]{} to {}:{}", sourceMapEntry.bytecodePos, sourceMapEntry.op, sourceMapEntry.sourcePos, sourceMapEntry.sourceEnd);
+                    };
+
+                    if (vm::readUint32(bin, vm::header::Flags) & vm::header::CompactSourceMap) {
+                        params += fmt::format(" {}->{} (compact)", start, i);
+                        vm::CompactSourceMapReader reader(bin, start + 4, i, vm::readUint32(bin, vm::header::Main) + 1);
+                        while (reader.next()) addEntry(reader.bytecodePos, reader.sourcePos, reader.sourceEnd);
+                        break;
+                    }
+
+                    params += fmt::format(" {}->{} ({})", start, i, size / (4 * 3)); //each entry has 3x 4bytes (uint32)
+                    for (unsigned int j = start + 4; j < i; j += 4 * 3) {
+                        addEntry(vm::readUint32(bin, j), vm::readUint32(bin, j + 4), vm::readUint32(bin, j + 8));
                     }
                     break;
                 }
@@ -116,7 +132,12 @@ namespace tr::checker {
                     auto address = vm::readInt32(bin, i + 1);
                     params += fmt::format(" [{}, +{}]", startI + address, address);
                     vm::eatParams(op, &i);
-                    if (!firstJump) storageEnd = address;
+                    if (!firstJump) {
+                        storageEnd = address;
+                        //the fixed header between the initial jump and the storage, see vm::header
+                        if (print) std::cout << fmt::format("(Header v{}) ", vm::readUint32(bin, vm::header::Version));
+                        i += vm::header::size;
+                    }
                     if (firstJump) newLine = true;
                     firstJump = true;
                     break;
@@ -135,7 +156,8 @@ namespace tr::checker {
                     newLine = true;
                     break;
                 }
-                case OP::JumpCondition: {
+                case OP::JumpCondition:
+                case OP::ExtendsJump: {
                     params += fmt::format(" [{}]", startI + vm::readUint32(bin, i + 1));
                     vm::eatParams(op, &i);
                     newLine = true;
@@ -157,6 +179,21 @@ namespace tr::checker {
                     vm::eatParams(op, &i);
                     break;
                 }
+                case OP::Prelude: {
+                    params += fmt::format(" prelude[{}]", vm::readUint32(bin, i + 1));
+                    vm::eatParams(op, &i);
+                    break;
+                }
+                case OP::ModuleImport: {
+                    params += fmt::format(" {} from \"{}\"", vm::readStorage(bin, vm::readUint32(bin, i + 5) + 8), vm::readStorage(bin, vm::readUint32(bin, i + 1) + 8));
+                    vm::eatParams(op, &i);
+                    break;
+                }
+                case OP::Import: {
+                    params += fmt::format(" import[{}]", vm::readUint32(bin, i + 1));
+                    vm::eatParams(op, &i);
+                    break;
+                }
                 case OP::New:
                 case OP::Instantiate: {
                     params += fmt::format(" {}", vm::readUint16(bin, i + 1));
@@ -176,6 +213,7 @@ namespace tr::checker {
                 case OP::Method:
                 case OP::Function:
                 case OP::Union:
+                case OP::Intersection:
                 case OP::Tuple:
                 case OP::TemplateLiteral:
                 case OP::Class:
@@ -185,7 +223,8 @@ namespace tr::checker {
                     vm::eatParams(op, &i);
                     break;
                 }
-                case OP::Loads: {
+                case OP::Loads:
+                case OP::LoadsIndexAccess: {
                     params += fmt::format(" {} {}", vm::readUint16(bin, i + 1), vm::readUint16(bin, i + 3));
                     vm::eatParams(op, &i);
                     break;
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "../core.h"
+#include "./module2.h"
+
+namespace tr::vm2 {
+    using std::string;
+    using std::string_view;
+
+    enum class DiagnosticFormat {
+        Text, //Module::formatErrors()
+        Json, //one array of {file, line, character, endLine, endCharacter, start, end, code, message}, lines and characters 1-based
+        Sarif, //SARIF 2.1.0 with one run
+    };
+
+    inline DiagnosticFormat parseDiagnosticFormat(string_view name) {
+        if (name == "text") return DiagnosticFormat::Text;
+        if (name == "json") return DiagnosticFormat::Json;
+        if (name == "sarif") return DiagnosticFormat::Sarif;
+        throw std::runtime_error(fmt::format("Unknown diagnostic format {}, expected text, json or sarif", name));
+    }
+
+    //appends `text` as JSON string content
+    inline void appendJsonEscaped(string &out, string_view text) {
+        for (auto c: text) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default: {
+                    if ((unsigned char) c < 0x20) {
+                        fmt::format_to(std::back_inserter(out), "\\u{:04x}", (unsigned int) c);
+                    } else {
+                        out += c;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Appends the errors of `module` to `out`. Json and Sarif entries are separated by commas but have none before the
+     * first and after the last, so buffers of several modules can be joined, see DiagnosticWriter.
+     */
+    inline void formatDiagnostics(Module &module, DiagnosticFormat format, string &out) {
+        if (format == DiagnosticFormat::Text) {
+            module.formatErrors(out);
+            return;
+        }
+        module.renderErrors();
+        auto it = std::back_inserter(out);
+        for (unsigned int i = 0; i < module.errors.size(); i++) {
+            auto &e = module.errors[i];
+            if (i) out += ",\n";
+            auto map = e.ip ? module.findNormalizedMap(e.ip) : FoundSourceMap{};
+            unsigned int line = 0, character = 0, endLine = 0, endCharacter = 0;
+            if (map.found()) {
+                auto &starts = module.getLineStarts();
+                line = module.lineOf(map.pos);
+                endLine = module.lineOf(map.end);
+                character = map.pos - starts[line];
+                endCharacter = map.end - starts[endLine];
+            }
+
+            if (format == DiagnosticFormat::Json) {
+                out += "{\"file\": \"";
+                appendJsonEscaped(out, module.fileName);
+                if (map.found()) {
+                    fmt::format_to(it, "\", \"line\": {}, \"character\": {}, \"endLine\": {}, \"endCharacter\": {}, \"start\": {}, \"end\": {}",
+                                   line + 1, character + 1, endLine + 1, endCharacter + 1, map.pos, map.end);
+                } else {
+                    out += "\"";
+                }
+                fmt::format_to(it, ", \"code\": {}, \"message\": \"", (unsigned int) e.code);
+                appendJsonEscaped(out, e.message);
+                out += "\"}";
+            } else {
+                fmt::format_to(it, "{{\"ruleId\": \"TS{:04}\", \"level\": \"error\", \"message\": {{\"text\": \"", (unsigned int) e.code);
+                appendJsonEscaped(out, e.message);
+                out += "\"}, \"locations\": [{\"physicalLocation\": {\"artifactLocation\": {\"uri\": \"";
+                appendJsonEscaped(out, module.fileName);
+                out += "\"}";
+                if (map.found()) {
+                    fmt::format_to(it, ", \"region\": {{\"startLine\": {}, \"startColumn\": {}, \"endLine\": {}, \"endColumn\": {}, \"charOffset\": {}, \"charLength\": {}}}",
+                                   line + 1, character + 1, endLine + 1, endCharacter + 1, map.pos, map.end - map.pos);
+                }
+                out += "}}]}";
+            }
+        }
+    }
+
+    /**
+     * Writes the diagnostics of many modules to `out` in one format. Each module is formatted into a buffer of its own
+     * with formatDiagnostics(), e.g. by the worker that checked it (see driver::CheckedFile::diagnostics), and write()
+     * appends the buffers in the order it gets them with one write each, so output is not interleaved and stays in
+     * file order no matter which worker finished first.
+     */
+    class DiagnosticWriter {
+        DiagnosticFormat format;
+        std::ostream &out;
+        bool empty = true;
+        bool finished = false;
+
+    public:
+        DiagnosticWriter(DiagnosticFormat format, std::ostream &out): format(format), out(out) {
+            if (format == DiagnosticFormat::Json) out << "[\n";
+            if (format == DiagnosticFormat::Sarif) {
+                out << "{\"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\", \"version\": \"2.1.0\", \"runs\": [{\"tool\": {\"driver\": {\"name\": \"TypeRunner\"}}, \"results\": [\n";
+            }
+        }
+
+        ~DiagnosticWriter() {
+            finish();
+        }
+
+        DiagnosticWriter(const DiagnosticWriter &) = delete;
+        DiagnosticWriter &operator=(const DiagnosticWriter &) = delete;
+
+        //a buffer of formatDiagnostics()
+        void write(string_view buffer) {
+            if (buffer.empty()) return;
+            if (!empty && format != DiagnosticFormat::Text) out.write(",\n", 2);
+            out.write(buffer.data(), buffer.size());
+            empty = false;
+        }
+
+        void write(Module &module) {
+            string buffer;
+            formatDiagnostics(module, format, buffer);
+            write(buffer);
+        }
+
+        //closes the JSON, called by the destructor if not before
+        void finish() {
+            if (finished) return;
+            finished = true;
+            if (format == DiagnosticFormat::Json) out << "\n]\n";
+            if (format == DiagnosticFormat::Sarif) out << "\n]}]}\n";
+            out.flush();
+        }
+    };
+}
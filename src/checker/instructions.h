@@ -66,6 +66,7 @@ namespace tr::instructions {
         Extends, //expected 2 entries on the stack
         Condition, //expected 3 entries on the stack
         JumpCondition, //expected 1 entry on the stack + two uint16 parameters
+        ExtendsJump, //fused Extends + JumpCondition, expects 2 entries on the stack + the uint32 JumpCondition parameter
 
         CallExpression, //JS call expression, with 1 parameter (amount of parameters)
         Instantiate, //instantiates a type on the stack (FunctionRef for example), ExpressionWithTypeArguments
@@ -125,6 +126,7 @@ namespace tr::instructions {
          */
         TypeVar,
         Loads, //LOAD from stack. pushes to the stack a referenced type in the stack. has 2 parameters: <frame> <index>, frame is a negative offset to the frame, and index the index of the stack entry withing the referenced frame
+        LoadsIndexAccess, //fused Loads + IndexAccess, the loaded type is the index. Same parameters as Loads
         Assign,
         Dup, //Duplicates the current stack end
         Set, //narrows/Sets a new value for a subroutine (variables)
@@ -145,6 +147,9 @@ namespace tr::instructions {
         CheckBody,
         InferBody,
         UnwrapInferBody,
+        Prelude, //pushes a pinned type of the vm2::Prelude the module was compiled against, one parameter (uint32 index in Prelude::types)
+        ModuleImport, //entry of the import table, see vm::header::Imports. Two parameters (storage address of module specifier and imported name)
+        Import, //pushes the linked type of an import, one parameter (uint32 index in the import table). See vm2::link()
     };
 
     enum class ErrorCode {
@@ -153,6 +158,7 @@ namespace tr::instructions {
 
     //Max 8 bits, used in the bytecode
     enum SubroutineFlag: unsigned int {
+        Exported = 1<<0, //non-generic top-level `export` declaration, its result can be linked into other modules, see vm2::Exports
     };
 }
 
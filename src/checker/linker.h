@@ -0,0 +1,101 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../core.h"
+#include "./compiler.h"
+#include "./module2.h"
+#include "./pinned.h"
+#include "./vm2.h"
+
+namespace tr::vm2 {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * The exported types of a checked module, which other modules import via vm2::link().
+     *
+     * Results of the module's subroutines flagged instructions::SubroutineFlag::Exported (non-generic top-level
+     * `export` declarations) are computed once in the VM that checked the module and copied out as PinnedTypes, so
+     * they neither depend on that VM nor on the module staying alive, and any VM on any thread can use them. Exports
+     * that are not pinnable (classes, function expressions) are left out, importing them reports a missing member.
+     *
+     * When a module changes, only modules importing it have to be linked again against its new Exports and rerun;
+     * their bytecode references imports by name and stays valid. Whether they have to at all tells `hash`.
+     */
+    class Exports {
+        PinnedTypes heap;
+
+        //structural, unlike vm2::structuralHash() also for kinds that hash by identity, so it does not depend on the run
+        static uint64_t hashType(Type *type) {
+            if (type->kind == TypeKind::Literal) return structuralHash(type);
+            auto result = hash::combine((uint64_t) type->kind, type->flag & (TypeFlag::Optional | TypeFlag::Readonly));
+            if (type->kind == TypeKind::Parameter) result = hash::combine(result, hash::runtime_hash(type->text()));
+            if (pinned::hasChildType(type->kind)) return type->type ? hash::combine(result, hashType((Type *) type->type)) : result;
+            if (pinned::hasChildRefs(type->kind)) {
+                forEachChild(type, [&result](Type *child, auto &) { result = hash::combine(result, hashType(child)); });
+            }
+            return result;
+        }
+
+    public:
+        string fileName;
+        checker::PreludeSymbols symbols;
+        vector<Type *> types; //by index in symbols
+        //over names and structure of all types, equal for two runs of a module exporting the same. 0 if it exports nothing
+        uint64_t hash = 0;
+
+        //of a module that exports nothing
+        Exports() = default;
+
+        /**
+         * `vm` has just run `module`.
+         */
+        Exports(VM &vm, shared<Module> &module): fileName(module->fileName) {
+            TypeGraph graph;
+            vector<std::pair<string_view, unsigned int>> roots;
+            for (unsigned int i = 0; i < module->subroutines.size(); i++) {
+                auto routine = module->getSubroutine(i);
+                if (!routine->exported) continue;
+                auto type = routine->result ? routine->result : vm.call(module, i);
+                if (!pinned::pinnable(type) || !symbols.add(routine->name)) continue;
+                roots.emplace_back(routine->name, graph.type(type));
+            }
+            heap.copy(graph);
+            for (auto &&[name, id]: roots) {
+                types.push_back(heap.type(id));
+                hash = hash::combine(hash::combine(hash, hash::runtime_hash(name)), hashType(types.back()));
+            }
+        }
+
+        Exports(const Exports &) = delete;
+        Exports &operator=(const Exports &) = delete;
+
+        //nullptr if not exported
+        Type *find(string_view name) const {
+            auto index = symbols.find(name);
+            return index < 0 ? nullptr : types[index];
+        }
+    };
+
+    /**
+     * Resolves the import table of `module`: `resolve` returns the Exports of a module specifier as written in the
+     * import, nullptr if there is no such module. Linking again replaces the previous links and drops the results and
+     * errors of the last run. Unresolved imports report a diagnostic when the module runs and are `any`.
+     */
+    inline void link(shared<Module> &module, const std::function<shared<const Exports>(string_view specifier)> &resolve) {
+        parseHeader(module);
+        module->clear();
+        module->links.clear();
+        for (auto &&import: module->imports) {
+            auto exports = resolve(import.specifier);
+            import.resolved = !!exports;
+            import.type = exports ? exports->find(import.name) : nullptr;
+            if (exports) module->links.push_back(exports);
+        }
+    }
+}
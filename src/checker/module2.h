@@ -1,10 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include "../core.h"
+#include "../fs.h"
 #include "./utils.h"
 #include "./types2.h"
 #include "./instructions.h"
+#include "./tier.h"
 #include "../utf.h"
 
 namespace tr::vm2 {
@@ -13,6 +20,12 @@ namespace tr::vm2 {
     using tr::instructions::OP;
     using tr::utf::eatWhitespace;
 
+    enum class MemoizeState: uint8_t {
+        Unknown, //not analysed yet
+        Cacheable, //result only depends on the type arguments, see VM::isMemoizable
+        Uncacheable,
+    };
+
     struct ModuleSubroutine {
         string_view name;
         bool main = false;
@@ -21,7 +34,25 @@ namespace tr::vm2 {
         bool exported = false;
         Type *result = nullptr;
         Type *narrowed = nullptr; //when control flow analysis sets a new value
+        MemoizeState memoize = MemoizeState::Unknown;
+        //frames above its own it reads variables of, -1 if not analysed yet, see VM::outerFrames()
+        int outerFrames = -1;
         ModuleSubroutine(string_view name, unsigned int address, unsigned int flags, bool main): name(name), address(address), flags(flags), main(main) {}
+
+        void reset() {
+            result = nullptr;
+            narrowed = nullptr;
+        }
+    };
+
+    /**
+     * Entry of the import table: `name` exported by the module `specifier`. vm2::link() sets `type`.
+     */
+    struct ModuleImport {
+        string_view specifier;
+        string_view name;
+        bool resolved = false; //the module was found
+        Type *type = nullptr; //pinned, nullptr if not linked
     };
 
     struct FoundSourceMap {
@@ -39,18 +70,45 @@ namespace tr::vm2 {
      *
      * This function makes sure map.pos starts at `v`, basically eating whitespace.
      */
-    inline void omitWhitespace(const string &code, FoundSourceMap &map) {
+    inline void omitWhitespace(string_view code, FoundSourceMap &map) {
         map.pos = eatWhitespace(code, map.pos);
     }
 
     struct Module;
 
+    /**
+     * Messages the VM reports with their TypeScript code (see diagnostic_messages.h), rendered from the arguments
+     * of DiagnosticMessage by Module::renderErrors(). Custom ones come with their text.
+     */
+    enum class DiagnosticCode: uint16_t {
+        Custom = 0,
+        CannotFindName = 2304, //ip
+        NoExportedMember = 2305, //texts: specifier, name
+        CannotFindModule = 2307, //texts: specifier
+        NotAssignable = 2322, //types: source, target
+        ConstraintNotSatisfied = 2344, //types: argument, constraint
+        ArgumentNotAssignable = 2345, //types: argument, parameter
+        NotCallable = 2349,
+        NotConstructable = 2351,
+        ArgumentNotProvided = 6210, //types: parameter
+    };
+
     struct DiagnosticMessage {
-        string message;
+        string message; //empty until rendered, see Module::renderErrors()
         unsigned int ip; //ip of the node/OP
         Module * module = nullptr;
+        DiagnosticCode code = DiagnosticCode::Custom;
+        //kept alive by a reference of the VM that reported them until it rendered the message, see VM::releaseMessages()
+        std::array<Type *, 2> types{};
+        std::array<string_view, 2> texts{}; //into the bytecode of `module`
         DiagnosticMessage() {}
         explicit DiagnosticMessage(const string &message, int ip): message(message), ip(ip) {}
+        DiagnosticMessage(DiagnosticCode code, unsigned int ip, Type *first = nullptr, Type *second = nullptr): ip(ip), code(code), types{first, second} {}
+        DiagnosticMessage(DiagnosticCode code, unsigned int ip, string_view first, string_view second = {}): ip(ip), code(code), texts{first, second} {}
+
+        bool rendered() const {
+            return code == DiagnosticCode::Custom || !message.empty();
+        }
     };
 
     struct FoundSourceLineCharacter {
@@ -60,23 +118,77 @@ namespace tr::vm2 {
     };
 
     struct Module {
-        const string bin;
+        //keep `bin` and `code` alive: an owned std::string or a MappedFile, shared by all views into it
+        std::shared_ptr<const void> binStorage;
+        std::shared_ptr<const void> codeStorage;
+
+        const string_view bin;
         string fileName = "index.ts";
-        const string code = ""; //for diagnostic messages only
+        const string_view code = ""; //for diagnostic messages only
 
         vector<ModuleSubroutine> subroutines;
+        //bin passed verifyBytecode(), set by parseHeader() together with the subroutine and import tables
+        bool verified = false;
         unsigned int sourceMapAddress;
         unsigned int sourceMapAddressEnd;
+        bool compactSourceMap = false; //see vm::header::CompactSourceMap
+        //ip, pos, end of a compact source map, decoded on the first findMap
+        vector<std::array<unsigned int, 3>> decodedSourceMap;
 
         vector<DiagnosticMessage> errors;
+        //incremented by clear(), VM caches of results of an earlier generation are stale
+        unsigned int generation = 0;
+
+        //the import table, see vm::header::Imports, and the vm2::Exports the imports were linked to, kept alive
+        vector<ModuleImport> imports;
+        vector<std::shared_ptr<const void>> links;
+
+        //offsets where lines of `code` start, built on the first diagnostic that needs it. See getLineStarts().
+        vector<unsigned int> lineStarts;
+
+        //handler lists of hot subroutines by index, nullptr if the body has other ops. Kept on clear() since the bytecode does not change.
+        //Several VMs can run the module at once, entries are added under handlerListMutex and never change afterwards.
+        std::unordered_map<unsigned int, std::unique_ptr<tier::HandlerList>> handlerLists;
+        std::mutex handlerListMutex;
+
         Module() {}
 
-        Module(const string_view &bin, const string &fileName, const string &code): bin(bin), fileName(fileName), code(code) {
+        //copies bin and code
+        Module(const string_view &bin, const string &fileName, const string &code): Module(std::make_shared<const string>(bin), fileName, std::make_shared<const string>(code)) {
+        }
+
+        Module(string &&bin, const string &fileName, string &&code): Module(std::make_shared<const string>(std::move(bin)), fileName, std::make_shared<const string>(std::move(code))) {
+        }
+
+        Module(const shared<const string> &bin, const string &fileName, const shared<const string> &code): Module(bin, *bin, fileName, code, *code) {
+        }
+
+        /**
+         * Zero-copy: bin and code are views into the mappings, which are kept alive as long as the module.
+         */
+        Module(const shared<MappedFile> &bin, const string &fileName, const shared<MappedFile> &code): Module(bin, bin->view(), fileName, code, code->view()) {
+        }
+
+        /**
+         * `bin` and `code` have to point into the memory kept alive by their storage. An image with compact operands
+         * is expanded into a copy, see vm::header::CompactOperands, which then is the storage of `bin`.
+         */
+        Module(shared<const void> binStorage, string_view bin, const string &fileName, shared<const void> codeStorage, string_view code):
+                binStorage(std::move(binStorage)), codeStorage(std::move(codeStorage)), bin(expand(this->binStorage, bin)), fileName(fileName), code(code) {
+        }
+
+        static string_view expand(shared<const void> &storage, string_view bin) {
+            if (!vm::hasCompactOperands(bin)) return bin;
+            auto expanded = std::make_shared<const string>(vm::expandOperands(bin));
+            storage = expanded;
+            return *expanded;
         }
 
+        //the subroutine table stays, only their results of the last run are dropped
         void clear() {
             errors.clear();
-            subroutines.clear();
+            for (auto &&routine: subroutines) routine.reset();
+            generation++;
         }
 
         ModuleSubroutine *getSubroutine(unsigned int index) {
@@ -90,22 +202,42 @@ namespace tr::vm2 {
         string findIdentifier(unsigned int ip) {
             auto map = findNormalizedMap(ip);
             if (!map.found()) return "";
-            return code.substr(map.pos, map.end - map.pos);
+            return string(code.substr(map.pos, map.end - map.pos));
         }
 
+        /**
+         * Binary search in the SourceMap section, Program::build() emits it sorted by ip.
+         */
         FoundSourceMap findMap(unsigned int ip) {
-            unsigned int found = 0;
-            for (unsigned int i = sourceMapAddress; i < sourceMapAddressEnd; i += 3 * 4) {
-                auto mapIp = vm::readUint32(bin, i);
-                if (mapIp == ip) {
-                    found = i;
-                    break;
+            if (compactSourceMap) {
+                if (decodedSourceMap.empty()) {
+                    vm::CompactSourceMapReader reader(bin, sourceMapAddress, sourceMapAddressEnd, vm::readUint32(bin, vm::header::Main) + 1);
+                    while (reader.next()) decodedSourceMap.push_back({reader.bytecodePos, reader.sourcePos, reader.sourceEnd});
+                }
+                auto found = std::lower_bound(decodedSourceMap.begin(), decodedSourceMap.end(), ip, [](const std::array<unsigned int, 3> &entry, unsigned int ip) {
+                    return entry[0] < ip;
+                });
+                if (found != decodedSourceMap.end() && (*found)[0] == ip) return {(*found)[1], (*found)[2]};
+                return {0, 0};
+            }
+
+            constexpr auto entrySize = 3 * 4;
+            //first entry with mapIp >= ip
+            unsigned int first = 0;
+            unsigned int count = (sourceMapAddressEnd - sourceMapAddress) / entrySize;
+            while (count > 0) {
+                auto step = count / 2;
+                auto mapIp = vm::readUint32(bin, sourceMapAddress + (first + step) * entrySize);
+                if (mapIp < ip) {
+                    first += step + 1;
+                    count -= step + 1;
+                } else {
+                    count = step;
                 }
-//                if (mapIp > ip) break;
-//                found = i;
             }
 
-            if (found) {
+            auto found = sourceMapAddress + first * entrySize;
+            if (found < sourceMapAddressEnd && vm::readUint32(bin, found) == ip) {
                 return {vm::readUint32(bin, found + 4), vm::readUint32(bin, found + 8)};
             }
             return {0, 0};
@@ -117,84 +249,280 @@ namespace tr::vm2 {
             return map;
         }
 
+        const vector<unsigned int> &getLineStarts() {
+            if (lineStarts.empty()) lineStarts = utf::computeLineStarts(code);
+            return lineStarts;
+        }
+
+        /**
+         * Zero based line of the given offset in `code`, binary search in getLineStarts().
+         */
+        unsigned int lineOf(unsigned int pos) {
+            auto &starts = getLineStarts();
+            return std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+        }
+
         /**
          * Converts FindSourceMap{x,y} to
          */
         FoundSourceLineCharacter mapToLineCharacter(FoundSourceMap map) {
-            unsigned int pos = 0;
-            unsigned int line = 0;
-            while (pos < map.pos) {
-                std::size_t lineStart = code.find('\n', pos);
-                if (lineStart == std::string::npos) {
-                    return {.line = line, .pos = map.pos - pos, .end = map.end - pos};
-                } else if (lineStart > map.pos) {
-                    //dont overshot
-                    break;
+            auto line = lineOf(map.pos);
+            auto pos = getLineStarts()[line];
+            return {.line = line, .pos = map.pos - pos, .end = map.end - pos};
+        }
+
+        /**
+         * Renders the messages of errors reported with a DiagnosticCode. The VM does this after each run unless
+         * VM::deferMessages is set, then only what is actually shown pays for stringifying its types. Has to be called
+         * before the VM that reported them runs again, which the VM does itself while the module is alive.
+         * Types mentioned by several errors are printed once, with the VM's `printer` across modules of one run.
+         */
+        void renderErrors(TypePrinter *printer = nullptr) {
+            TypePrinter own;
+            if (!printer) printer = &own;
+            auto text = [printer](Type *type) { return string(printer->print(type)); };
+            for (auto &&e: errors) {
+                if (e.rendered()) continue;
+                switch (e.code) {
+                    case DiagnosticCode::CannotFindName: e.message = fmt::format("Cannot find name '{}'", findIdentifier(e.ip)); break;
+                    case DiagnosticCode::NoExportedMember: e.message = fmt::format("Module '{}' has no exported member '{}'", e.texts[0], e.texts[1]); break;
+                    case DiagnosticCode::CannotFindModule: e.message = fmt::format("Cannot find module '{}'", e.texts[0]); break;
+                    case DiagnosticCode::NotAssignable: e.message = fmt::format("Type '{}' is not assignable to type '{}'", text(e.types[0]), text(e.types[1])); break;
+                    case DiagnosticCode::ConstraintNotSatisfied: e.message = fmt::format("Type '{}' does not satisfy the constraint '{}'", text(e.types[0]), text(e.types[1])); break;
+                    case DiagnosticCode::ArgumentNotAssignable: {
+                        e.message = fmt::format("Argument of type '{}' is not assignable to parameter '{}' of type '{}'", text(e.types[0]), e.types[1]->text(), text(e.types[1]));
+                        break;
+                    }
+                    case DiagnosticCode::NotCallable: e.message = "This expression is not callable."; break;
+                    case DiagnosticCode::NotConstructable: e.message = "This expression is not constructable."; break;
+                    case DiagnosticCode::ArgumentNotProvided: e.message = fmt::format("An argument for '{}' was not provided.", e.types[0]->text()); break;
+                    default: break;
                 }
-                pos = lineStart + 1;
-                line++;
             }
-            return {.line = line, .pos = map.pos - pos, .end = map.end - pos};
         }
 
-        void printErrors() {
+        /**
+         * Appends the errors as text with the source line and a ~ under the range, in the colors of enableColors().
+         * One growing buffer, no temporary strings, see DiagnosticWriter for writing many modules.
+         */
+        void formatErrors(string &out) {
+            renderErrors();
+            auto it = std::back_inserter(out);
             for (auto &&e: errors) {
                 if (e.ip) {
                     auto map = findNormalizedMap(e.ip);
 
                     if (map.found()) {
-                        auto lineStart = code.rfind('\n', map.pos);
-                        lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
-
-                        auto lineEnd = code.find('\n', map.end);
-                        if (lineEnd == std::string::npos) lineEnd = code.size();
-                        std::cout << cyan << fileName << ":" << yellow << map.pos << ":" << map.end << reset << " - " << red << "error" << reset << " TS0000: " << e.message << "\n\n";
-                        std::cout << "»" << code.substr(lineStart, lineEnd - lineStart - 1) << "\n";
-                        auto space = map.pos - lineStart;
-                        std::cout << "»" << std::string(space, ' ') << red << std::string(map.end - map.pos, '~') << reset << "\n\n";
+                        auto &starts = getLineStarts();
+                        auto lineStart = starts[lineOf(map.pos)];
+                        auto endLine = lineOf(map.end);
+                        auto lineEnd = endLine + 1 < starts.size() ? starts[endLine + 1] - 1 : code.size();
+                        fmt::format_to(it, "{}{}:{}{}:{}{} - {}error{} TS{:04}: {}\n\n", cyan, fileName, yellow, map.pos, map.end, reset, red, reset, (unsigned int) e.code, e.message);
+                        fmt::format_to(it, "»{}\n»", code.substr(lineStart, lineEnd - lineStart - 1));
+                        out.append(map.pos - lineStart, ' ');
+                        out += red;
+                        out.append(map.end - map.pos, '~');
+                        out += reset;
+                        out += "\n\n";
                         continue;
                     }
                 }
-                std::cout << "  " << e.message << "\n";
+                fmt::format_to(it, "  {}\n", e.message);
             }
-            std::cout << "Found " << errors.size() << " errors in " << fileName << "\n";
+            fmt::format_to(it, "Found {} errors in {}\n", errors.size(), fileName);
+        }
+
+        //with a single write, so output of other threads does not end up in between
+        void printErrors() {
+            string out;
+            formatErrors(out);
+            std::cout.write(out.data(), out.size());
         }
     };
 
-    inline void parseHeader(shared<Module> &module) {
-        auto &bin = module->bin;
-        auto end = bin.size();
-        bool main = true;
-        for (unsigned int i = 0; i < end; i++) {
-            const auto op = (OP) bin[i];
-            switch (op) {
-                case OP::Jump: {
-                    i = vm::readUint32(bin, i + 1) - 1; //minus 1 because for's i++
-                    break;
-                }
-                case OP::SourceMap: {
-                    unsigned int size = vm::readUint32(bin, i + 1);
-                    module->sourceMapAddress = i + 1 + 4;
-                    i += 4 + size;
-                    module->sourceMapAddressEnd = i;
-                    break;
-                }
-                case OP::Subroutine: {
-                    unsigned int nameAddress = vm::readUint32(bin, i + 1);
-                    auto name = nameAddress ? vm::readStorage(bin, nameAddress + 8) : "";
-                    unsigned int address = vm::readUint32(bin, i + 5);
-                    unsigned int flags = vm::readUint32(bin, i + 5 + 4);
-                    vm::eatParams(op, &i);
-                    module->subroutines.push_back(ModuleSubroutine(name, address, flags, main));
-                    main = false;
-                    break;
+    /**
+     * Checks an image written by Program::build() once, so the VM and tier::Ops::decode() can decode it without checks of
+     * their own: every op and its parameters lie within the image, jumps land on ops of the same subroutine, which ends
+     * with OP::Return or OP::Halt, subroutine and import indices exist, literals and names point to storage entries,
+     * and Loads only reads slots declared by a frame. Throws for corrupt or stale bytecode, e.g. of a cache file.
+     *
+     * Not checked are stack effects and the index of OP::Prelude, which depends on the prelude of the VM.
+     */
+    inline void verifyBytecode(string_view bin) {
+        auto fail = [](string_view what, unsigned int ip) {
+            throw std::runtime_error(fmt::format("Invalid bytecode: {} at {}", what, ip));
+        };
+        auto field = [&bin](vm::header::Field field) { return vm::readUint32(bin, field); };
+        if (bin.size() < 5 + vm::header::size || (OP) bin[0] != OP::Jump) fail("no header", 0);
+
+        //1 for ops of the code section, 2 for storage entries
+        vector<uint8_t> marks(bin.size());
+        auto storageEnd = (unsigned int) vm::readInt32(bin, 1);
+        if (storageEnd > bin.size()) fail("storage out of bounds", 0);
+        for (unsigned int i = field(vm::header::Storage); i < storageEnd;) {
+            if (i + 8 + 2 > storageEnd) fail("truncated storage entry", i);
+            marks[i] = 2;
+            i += 8 + 2 + vm::readUint16(bin, i + 8);
+            if (i > storageEnd) fail("truncated storage entry", i);
+        }
+        auto storage = [&](unsigned int address, unsigned int ip) {
+            if (address >= bin.size() || marks[address] != 2) fail("no storage entry", ip);
+        };
+
+        if (field(vm::header::SourceMap) > field(vm::header::SourceMapEnd) || field(vm::header::SourceMapEnd) > bin.size()) fail("source map out of bounds", 0);
+
+        auto count = field(vm::header::SubroutineCount);
+        auto table = field(vm::header::Subroutines);
+        if (!count || table + (uint64_t) count * vm::header::subroutineEntrySize > bin.size()) fail("invalid subroutine table", table);
+        auto importCount = field(vm::header::ImportCount);
+        auto imports = field(vm::header::Imports);
+        if (imports + (uint64_t) importCount * vm::header::importEntrySize > bin.size()) fail("invalid import table", imports);
+        for (unsigned int i = 0; i < importCount; i++) {
+            auto entry = imports + i * vm::header::importEntrySize;
+            if ((OP) bin[entry] != OP::ModuleImport) fail("invalid import entry", entry);
+            storage(vm::readUint32(bin, entry + 1), entry);
+            storage(vm::readUint32(bin, entry + 5), entry);
+        }
+
+        auto main = field(vm::header::Main);
+        if (main >= bin.size() || (OP) bin[main] != OP::Main) fail("no OP::Main", main);
+        for (unsigned int i = main + 1; i < bin.size();) {
+            auto op = (OP) (unsigned char) bin[i];
+            //OP::Import is the last op, the others only appear in the sections before OP::Main
+            if (op > OP::Import || op == OP::SourceMap || op == OP::Subroutine || op == OP::Main || op == OP::ModuleImport) fail("invalid op", i);
+            marks[i] = 1;
+            auto end = i;
+            vm::eatParams(op, &end);
+            if (end >= bin.size()) fail("truncated op", i);
+            i = end + 1;
+        }
+
+        //routines are laid out one after another, each ends where the next one starts
+        vector<unsigned int> starts;
+        starts.reserve(count);
+        for (unsigned int i = 0; i < count; i++) {
+            auto entry = table + i * vm::header::subroutineEntrySize;
+            if ((OP) bin[entry] != OP::Subroutine) fail("invalid subroutine entry", entry);
+            if (auto name = vm::readUint32(bin, entry + 1)) storage(name, entry);
+            auto address = vm::readUint32(bin, entry + 5);
+            if (address >= bin.size() || marks[address] != 1) fail("subroutine does not start at an op", entry);
+            starts.push_back(address);
+        }
+        auto mainAddress = starts[0];
+        std::sort(starts.begin(), starts.end());
+        starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+        //variable slots of each routine, Loads of outer frames are checked against the biggest
+        vector<unsigned int> slots(starts.size());
+        for (unsigned int r = 0; r < starts.size(); r++) {
+            auto end = r + 1 < starts.size() ? starts[r + 1] : (unsigned int) bin.size();
+            unsigned int last = starts[r];
+            for (unsigned int i = starts[r]; i < end;) {
+                last = i;
+                auto op = (OP) bin[i];
+                switch (op) {
+                    case OP::TypeArgument:
+                    case OP::TypeArgumentDefault: slots[r]++; break;
+                    case OP::Slots: slots[r] += vm::readUint16(bin, i + 1); break;
+                    default: break;
                 }
-                case OP::Main: {
-                    return;
+                vm::eatParams(op, &i);
+                i++;
+            }
+            if ((OP) bin[last] != OP::Return && (OP) bin[last] != OP::Halt) fail("subroutine does not end with OP::Return", last);
+        }
+        auto maxSlots = *std::max_element(slots.begin(), slots.end());
+
+        for (unsigned int r = 0; r < starts.size(); r++) {
+            auto start = starts[r];
+            auto end = r + 1 < starts.size() ? starts[r + 1] : (unsigned int) bin.size();
+            auto jump = [&](int64_t target, unsigned int ip) {
+                if (target < start || target >= end || marks[target] != 1) fail("jump target is not an op of the subroutine", ip);
+            };
+            auto subroutine = [&](unsigned int ip) {
+                if (vm::readUint32(bin, ip + 1) >= count) fail("invalid subroutine index", ip);
+            };
+            for (unsigned int i = start; i < end;) {
+                auto op = (OP) bin[i];
+                switch (op) {
+                    case OP::Jump: jump((int64_t) i + vm::readInt32(bin, i + 1), i); break;
+                    case OP::JumpCondition:
+                    case OP::ExtendsJump: jump((int64_t) i + vm::readUint32(bin, i + 1), i); break;
+                    case OP::Distribute: {
+                        if (vm::readUint16(bin, i + 1) >= slots[r]) fail("undeclared slot", i);
+                        jump((int64_t) i + vm::readUint32(bin, i + 3), i);
+                        break;
+                    }
+                    case OP::Call:
+                    case OP::TailCall:
+                    case OP::Set:
+                    case OP::CheckBody:
+                    case OP::InferBody:
+                    case OP::SelfCheck:
+                    case OP::Inline:
+                    case OP::TypeArgumentDefault:
+                    case OP::ClassRef:
+                    case OP::FunctionRef: subroutine(i); break;
+                    case OP::Import: if (vm::readUint32(bin, i + 1) >= importCount) fail("invalid import index", i); break;
+                    case OP::Parameter:
+                    case OP::NumberLiteral:
+                    case OP::BigIntLiteral:
+                    case OP::StringLiteral: storage(vm::readUint32(bin, i + 1), i); break;
+                    case OP::Loads:
+                    case OP::LoadsIndexAccess: {
+                        auto frameOffset = vm::readUint16(bin, i + 1);
+                        auto varIndex = vm::readUint16(bin, i + 3);
+                        //main runs in the first frame, there is none above it
+                        if (frameOffset && start == mainAddress) fail("Loads of a frame above main", i);
+                        if (varIndex >= (frameOffset ? maxSlots : slots[r])) fail("Loads of an undeclared slot", i);
+                        break;
+                    }
+                    default: break;
                 }
+                vm::eatParams(op, &i);
+                i++;
             }
         }
+    }
 
-        throw std::runtime_error("No OP::Main found");
+    /**
+     * Reads the sections from the fixed header written by Program::build(), see vm::header.
+     * The subroutine table is only decoded once per Module, Module::clear() keeps it. Before that the image is checked
+     * with verifyBytecode(), so Module::verified bytecode is not checked again.
+     */
+    inline void parseHeader(shared<Module> &module) {
+        auto &bin = module->bin;
+        if (bin.size() < 5 + vm::header::size || vm::readUint32(bin, vm::header::Magic) != vm::header::magic) {
+            throw std::runtime_error("No bytecode header found");
+        }
+        if (vm::readUint32(bin, vm::header::Version) != vm::header::version) throw std::runtime_error("Unsupported bytecode version");
+
+        module->sourceMapAddress = vm::readUint32(bin, vm::header::SourceMap);
+        module->sourceMapAddressEnd = vm::readUint32(bin, vm::header::SourceMapEnd);
+        module->compactSourceMap = vm::readUint32(bin, vm::header::Flags) & vm::header::CompactSourceMap;
+        if (module->verified) return;
+        verifyBytecode(bin);
+        module->verified = true;
+
+        auto count = vm::readUint32(bin, vm::header::SubroutineCount);
+        auto table = vm::readUint32(bin, vm::header::Subroutines);
+        module->subroutines.reserve(count);
+        for (unsigned int i = 0; i < count; i++) {
+            auto entry = table + i * vm::header::subroutineEntrySize;
+            unsigned int nameAddress = vm::readUint32(bin, entry + 1);
+            auto name = nameAddress ? vm::readStorage(bin, nameAddress + 8) : "";
+            unsigned int address = vm::readUint32(bin, entry + 5);
+            unsigned int flags = (unsigned char) bin[entry + 9];
+            module->subroutines.push_back(ModuleSubroutine(name, address, flags, i == 0));
+            module->subroutines.back().exported = flags & instructions::SubroutineFlag::Exported;
+        }
+
+        auto importCount = vm::readUint32(bin, vm::header::ImportCount);
+        auto imports = vm::readUint32(bin, vm::header::Imports);
+        module->imports.reserve(importCount);
+        for (unsigned int i = 0; i < importCount; i++) {
+            auto entry = imports + i * vm::header::importEntrySize;
+            module->imports.push_back({vm::readStorage(bin, vm::readUint32(bin, entry + 1) + 8), vm::readStorage(bin, vm::readUint32(bin, entry + 5) + 8)});
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "./types2.h"
+
+namespace tr::vm2 {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * Types flagged TypeFlag::Immortal and TypeFlag::Stored, so no VM collects, steals or counts references to them.
+     * Any number of VMs, also on different threads, can reference them, see Prelude and Exports.
+     */
+    namespace pinned {
+        //refCount of pinned types, so that no "unused, can be modified in place" fast path ever picks them
+        constexpr unsigned int refCount = 1u << 30;
+
+        //kinds whose `type` is a Type *
+        inline bool hasChildType(TypeKind kind) {
+            return kind == TypeKind::Array || kind == TypeKind::Rest || kind == TypeKind::TupleMember || kind == TypeKind::Parameter;
+        }
+
+        //kinds whose `type` is a TypeRef * list
+        inline bool hasChildRefs(TypeKind kind) {
+            switch (kind) {
+                case TypeKind::Union:
+                case TypeKind::ObjectLiteral:
+                case TypeKind::Tuple:
+                case TypeKind::TemplateLiteral:
+                case TypeKind::Function:
+                case TypeKind::PropertySignature:
+                case TypeKind::MethodSignature: {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Whether `type` means the same in every module. Not the case for types referencing subroutines of the module
+         * they were created in (classes, function expressions).
+         */
+        inline bool pinnable(Type *type) {
+            switch (type->kind) {
+                case TypeKind::Unknown:
+                case TypeKind::Never:
+                case TypeKind::Any:
+                case TypeKind::Null:
+                case TypeKind::Undefined:
+                case TypeKind::String:
+                case TypeKind::Number:
+                case TypeKind::BigInt:
+                case TypeKind::Boolean:
+                case TypeKind::Symbol:
+                case TypeKind::Literal: {
+                    return true;
+                }
+            }
+            if (hasChildType(type->kind)) return !type->type || pinnable((Type *) type->type);
+            if (hasChildRefs(type->kind)) {
+                auto result = true;
+                forEachChild(type, [&result](Type *child, auto &stop) {
+                    if (!pinnable(child)) result = false, stop = true;
+                });
+                return result;
+            }
+            return false;
+        }
+
+        /**
+         * Pins `type` and its children in place, they stay in the memory of the VM that created them.
+         */
+        inline void pin(Type *type) {
+            if (type->flag & TypeFlag::Immortal) return;
+            type->flag |= TypeFlag::Immortal | TypeFlag::Stored;
+            type->refCount = refCount;
+            //its ip points into the module that created it, not into the one reporting a diagnostic on it
+            type->ip = 0;
+            if (hasChildType(type->kind) && type->type) pin((Type *) type->type);
+            if (hasChildRefs(type->kind)) forEachChild(type, [](Type *child, auto &) { pin(child); });
+        }
+    }
+
+    /**
+     * Numbers all types and refs reachable from some roots, 0 is nullptr. The refs of one list (and the buckets of one
+     * hash table) get consecutive numbers, so lists allocated as one block stay one block in a PinnedTypes copy.
+     */
+    struct TypeGraph {
+        std::unordered_map<const Type *, unsigned int> typeIds;
+        std::unordered_map<const TypeRef *, unsigned int> refIds;
+        vector<const Type *> types;
+        vector<const TypeRef *> refs;
+
+        unsigned int ref(const TypeRef *ref) {
+            if (!ref) return 0;
+            auto [it, inserted] = refIds.try_emplace(ref, refs.size() + 1);
+            if (inserted) refs.push_back(ref);
+            return it->second;
+        }
+
+        unsigned int list(const TypeRef *first) {
+            for (auto current = first; current; current = current->next) ref(current);
+            for (auto current = first; current; current = current->next) type(current->type);
+            return first ? refIds[first] : 0;
+        }
+
+        unsigned int type(const Type *type) {
+            if (!type) return 0;
+            auto [it, inserted] = typeIds.try_emplace(type, types.size() + 1);
+            auto id = it->second;
+            if (!inserted) return id;
+            types.push_back(type);
+
+            if (pinned::hasChildType(type->kind)) this->type((const Type *) type->type);
+            if (pinned::hasChildRefs(type->kind)) list((const TypeRef *) type->type);
+            auto buckets = type->children();
+            for (auto &&bucket: buckets) ref(&bucket);
+            for (auto &&bucket: buckets) {
+                this->type(bucket.type);
+                list(bucket.next);
+            }
+            return id;
+        }
+
+        //of a child of a numbered type: `type` of hasChildType/hasChildRefs kinds
+        unsigned int child(const Type *type) {
+            if (pinned::hasChildType(type->kind)) return this->type((const Type *) type->type);
+            if (pinned::hasChildRefs(type->kind)) return ref((const TypeRef *) type->type);
+            return 0;
+        }
+
+        //first bucket of the hash table
+        unsigned int table(const Type *type) {
+            return type->children().empty() ? 0 : ref(type->children().data());
+        }
+    };
+
+    /**
+     * Pinned types in memory of their own, independent of any VM: a copy of a TypeGraph or a restored snapshot. Types
+     * are numbered as in the graph. Literal and Parameter texts are copied, a dynamic literal text is not dynamic anymore.
+     */
+    class PinnedTypes {
+        vector<Type> types;
+        vector<TypeRef> refs;
+        string texts;
+
+    public:
+        PinnedTypes() = default;
+        //types point into the vectors and texts
+        PinnedTypes(const PinnedTypes &) = delete;
+        PinnedTypes &operator=(const PinnedTypes &) = delete;
+
+        Type *type(unsigned int id) {
+            if (id > types.size()) throw std::runtime_error("Invalid pinned type");
+            return id ? &types[id - 1] : nullptr;
+        }
+
+        TypeRef *ref(unsigned int id) {
+            if (id > refs.size()) throw std::runtime_error("Invalid pinned type");
+            return id ? &refs[id - 1] : nullptr;
+        }
+
+        /**
+         * Room for `typeCount` types added with add() and `refCount` refs, all texts are in `texts`.
+         */
+        void reserve(unsigned int typeCount, unsigned int refCount, string texts) {
+            types.clear();
+            types.reserve(typeCount);
+            refs.assign(refCount, TypeRef{});
+            this->texts = std::move(texts);
+        }
+
+        Type &add(TypeKind kind, uint64_t hash, unsigned int flag, unsigned int size) {
+            if (types.size() == types.capacity() || (unsigned int) kind > (unsigned int) TypeKind::FunctionRef) throw std::runtime_error("Invalid pinned type");
+            auto &type = types.emplace_back(kind, hash);
+            //member hashes are not copied, the hash table alone still works
+            type.flag = (flag & ~TypeFlag::MemberHashes) | TypeFlag::Immortal | TypeFlag::Stored;
+            type.refCount = pinned::refCount;
+            type.size = size;
+            type.ip = 0;
+            return type;
+        }
+
+        /**
+         * Sets the pointers of a type added with add(): `child` is a type or ref id depending on the kind, `tableOrText`
+         * the first bucket of its hash table or for Literal and Parameter the offset of its text in `texts`. Ids out of
+         * range throw, also when a ChildrenArray or a hash table would reach past the refs, since both are indexed.
+         */
+        void link(Type &type, unsigned int child, unsigned int tableOrText) {
+            if (pinned::hasChildType(type.kind)) type.type = this->type(child);
+            if (pinned::hasChildRefs(type.kind)) {
+                type.type = ref(child);
+                if (type.flag & TypeFlag::ChildrenArray && type.size && (!child || child - 1 + (uint64_t) type.size > refs.size())) throw std::runtime_error("Invalid pinned type");
+            }
+            if (type.kind == TypeKind::Literal || type.kind == TypeKind::Parameter) {
+                if (tableOrText > texts.size() || texts.size() - tableOrText < type.size) throw std::runtime_error("Invalid pinned type");
+                type.textData = texts.data() + tableOrText;
+            } else if (tableOrText) {
+                //only unions and classes have one, see Type::children(), for others the field is their shape
+                if ((type.kind != TypeKind::Union && type.kind != TypeKind::Class) || tableOrText - 1 + (uint64_t) type.size > refs.size()) throw std::runtime_error("Invalid pinned type");
+                type.table = ref(tableOrText);
+            } else {
+                type.table = nullptr;
+            }
+        }
+
+        void link(TypeRef &ref, unsigned int type, unsigned int next) {
+            ref.type = this->type(type);
+            ref.next = this->ref(next);
+        }
+
+        /**
+         * Copies all types of `graph`.
+         */
+        void copy(TypeGraph &graph) {
+            string allTexts;
+            vector<unsigned int> textOffsets;
+            for (auto &&type: graph.types) {
+                textOffsets.push_back(allTexts.size());
+                if (type->kind == TypeKind::Literal || type->kind == TypeKind::Parameter) allTexts.append(type->text());
+            }
+            reserve(graph.types.size(), graph.refs.size(), std::move(allTexts));
+            for (auto &&type: graph.types) {
+                auto isText = type->kind == TypeKind::Literal || type->kind == TypeKind::Parameter;
+                add(type->kind, type->hash, type->flag, isText ? type->text().size() : type->size);
+            }
+            for (unsigned int i = 0; i < graph.types.size(); i++) {
+                auto source = graph.types[i];
+                auto isText = source->kind == TypeKind::Literal || source->kind == TypeKind::Parameter;
+                link(types[i], graph.child(source), isText ? textOffsets[i] : graph.table(source));
+            }
+            for (unsigned int i = 0; i < graph.refs.size(); i++) {
+                link(refs[i], graph.type(graph.refs[i]->type), graph.ref(graph.refs[i]->next));
+            }
+        }
+
+        size_t size() const {
+            return types.size();
+        }
+    };
+}
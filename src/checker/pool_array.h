@@ -5,13 +5,28 @@
 #include <cstddef>
 #include <cstdint>
 #include <span>
-#include "math.h"
+#include <algorithm>
+#include <bit>
 #include <array>
+#include <vector>
 #include <type_traits>
+#include <stdexcept>
+#include "./block_source.h"
+#include "./pool_stats.h"
+#include "Tracy.hpp"
 
 /**
  * Block is memory (Items + 1) * sizeof<T>. Plus 1 because first entry is block header.
  * Block header points to next and previous block.
+ *
+ * Allocations are served from size classes of 2^i slots, as long as a block holds at least two of them. Bigger ones
+ * (e.g. the children table of a union with thousands of members) get their own allocation, see allocateLarge().
+ *
+ * With TRACY_ENABLE blocks and large allocations are reported to Tracy's memory profiler as pools "PoolArray" and
+ * "PoolArray large".
+ *
+ * Blocks come from operator new, or from a BlockSource set with setBlockSource(). Large allocations always use
+ * operator new, they vary in size and are freed one by one.
  */
 template<typename T, size_t Items = 4096, size_t GCQueueSize = Items / 2, size_t BlockSize = sizeof(T) * (1 + Items)>
 class PoolArray {
@@ -41,17 +56,21 @@ public:
         Slot *lastSlot = nullptr;
         Slot *freeSlot = nullptr;
         unsigned int blocks = 0;
+        unsigned int usedBlocks = 0;
+        unsigned int active = 0; //allocations, not items
+        unsigned int peak = 0;
         unsigned int slotSize;
 
         std::vector<T *> gcQueue;
         unsigned int gcQueued = 0;
         unsigned int gcQueueSize = 0;
 
-        explicit Pool(unsigned int slotSize): slotSize(slotSize), gcQueueSize(ceil(GCQueueSize/slotSize)) {
+        explicit Pool(unsigned int slotSize = 1): slotSize(slotSize), gcQueueSize(std::max<unsigned int>(1, GCQueueSize / slotSize)) {
             gcQueue.resize(gcQueueSize);
         }
 
         void deallocate(const std::span<T> &span) {
+            active--;
             T *p = &span[0];
             auto slot = reinterpret_cast<slot_pointer>(p);
             slot->header = {.prev = nullptr, .next = freeSlot};
@@ -70,7 +89,7 @@ public:
         }
 
         void gcFlush() {
-            for (unsigned int i = 0; i<gcQueueSize; i++) {
+            for (unsigned int i = 0; i<gcQueued; i++) {
                 //we don't need to call destructor since TypeRef doesn't have one
                 //for (unsigned int j = 0; j<slotSize; j++) {
                 //    (gcQueue[i][j]).~T();
@@ -79,38 +98,52 @@ public:
                 slot->header = {.prev = nullptr, .next = freeSlot};
                 freeSlot = slot;
             }
+            active -= gcQueued;
             gcQueued = 0;
         }
+
+        PoolStats stats() const {
+            PoolStats stats{.active = active, .peak = peak, .blocks = blocks, .usedBlocks = usedBlocks, .gcQueued = gcQueued, .gcQueueSize = gcQueueSize, .bytes = blocks * BlockSize};
+            for (auto slot = freeSlot; slot; slot = slot->header.next) stats.freeSlots++;
+            return stats;
+        }
     };
 
-    constexpr static unsigned int poolAmount = 11;
-    std::array<Pool, poolAmount> pools = {Pool(1), Pool(2), Pool(4), Pool(8), Pool(16), Pool(32), Pool(64), Pool(128), Pool(256), Pool(512), Pool(1024)};
+    constexpr static unsigned int poolAmount = std::max<unsigned int>(1, std::bit_width(Items / 2));
+    constexpr static unsigned int maxSlotSize = 1u << (poolAmount - 1);
+    std::array<Pool, poolAmount> pools;
 
-    PoolArray() noexcept {}
+    PoolArray() noexcept {
+        for (unsigned int i = 0; i<poolAmount; i++) pools[i] = Pool(1u << i);
+    }
 
     ~PoolArray() noexcept {
+        //from the first block, since after clear() blocks kept for reuse follow currentBlock
         for (auto &&pool: pools) {
-            slot_pointer curr = pool.currentBlock;
+            slot_pointer curr = pool.firstBlock;
             while (curr != nullptr) {
-                slot_pointer prev = curr->header.prev;
-                operator delete(reinterpret_cast<void *>(curr));
-                curr = prev;
+                slot_pointer next = curr->header.next;
+                freeBlock(curr);
+                curr = next;
             }
         }
+        freeLarge();
     }
 
-    unsigned int poolIndex(unsigned int size) {
-        if (size>1024) size = 1024;
-        return ceil(log2(size));
+    //smallest size class of at least `size` slots, sizes above maxSlotSize have none
+    static unsigned int poolIndex(unsigned int size) {
+        return size<=1 ? 0 : std::bit_width(size - 1);
     }
 
-    Pool &getPool(unsigned int size) {
+    Pool &pool(unsigned int size) {
         return pools[poolIndex(size)];
     }
 
     std::span<T> allocate(unsigned int size) {
-        auto &pool = getPool(size);
         active += size;
+        if (size>maxSlotSize) return allocateLarge(size);
+        auto &pool = this->pool(size);
+        if (++pool.active>pool.peak) pool.peak = pool.active;
         if (pool.freeSlot != nullptr) {
             T *result = reinterpret_cast<T *>(pool.freeSlot);
             pool.freeSlot = pool.freeSlot->header.next;
@@ -119,7 +152,7 @@ public:
             if (pool.currentSlot + pool.slotSize - 1>=pool.lastSlot) {
                 allocateBlock(pool);
             }
-            auto result = reinterpret_cast<T *>(pool.currentSlot + 1);
+            auto result = reinterpret_cast<T *>(pool.currentSlot);
             pool.currentSlot += pool.slotSize;
             return {result, size};
         }
@@ -127,8 +160,19 @@ public:
 
     void deallocate(const std::span<T> &span) {
         active -= span.size();
-        auto &pool = getPool(span.size());
-        pool.deallocate(span);
+        if (span.size()>maxSlotSize) return deallocateLarge(span);
+        pool(span.size()).deallocate(span);
+    }
+
+    /**
+     * Resizes `span` in place if `size` falls into the same size class, so the slot already has room for it. The
+     * items after the old end are uninitialized. Later deallocate() and gc() get the new span.
+     */
+    bool grow(std::span<T> &span, unsigned int size) {
+        if (size<span.size() || size>maxSlotSize || poolIndex(span.size()) != poolIndex(size)) return false;
+        active += size - span.size();
+        span = {span.data(), size};
+        return true;
     }
 
     std::span<T> construct(unsigned int size) {
@@ -144,32 +188,158 @@ public:
 
     void clear() {
         active = 0;
+        freeLarge();
         for (auto &&pool: pools) {
             pool.freeSlot = nullptr;
             pool.gcQueued = 0;
-            if (pool.firstBlock) initializeBlock(pool, pool.firstBlock);
+            pool.active = 0;
+            if (pool.firstBlock) {
+                initializeBlock(pool, pool.firstBlock);
+                pool.usedBlocks = 1;
+            }
+        }
+    }
+
+    /**
+     * One entry per size class, pools[i] holds allocations of up to 2^i items.
+     */
+    std::array<PoolStats, poolAmount> stats() const {
+        std::array<PoolStats, poolAmount> result;
+        for (unsigned int i = 0; i<poolAmount; i++) result[i] = pools[i].stats();
+        return result;
+    }
+
+    void resetPeak() {
+        for (auto &&pool: pools) pool.peak = pool.active;
+        largePeak = largeActive;
+    }
+
+    /**
+     * Like PoolSingle::trim(), per size class: releases blocks no slot was handed out from since the last clear(),
+     * until at most `keepBlocks` remain in each class. Returns the released blocks.
+     */
+    unsigned int trim(unsigned int keepBlocks = 1) {
+        unsigned int released = 0;
+        for (auto &&pool: pools) {
+            if (!pool.currentBlock) continue;
+            unsigned int kept = pool.usedBlocks;
+            slot_pointer last = pool.currentBlock;
+            while (kept<keepBlocks && last->header.next) {
+                last = last->header.next;
+                kept++;
+            }
+            slot_pointer curr = last->header.next;
+            last->header.next = nullptr;
+            while (curr != nullptr) {
+                slot_pointer next = curr->header.next;
+                freeBlock(curr);
+                curr = next;
+                pool.blocks--;
+                released++;
+            }
         }
+        return released;
+    }
+
+    //like PoolSingle::setBlockSource(), before the first block of any size class
+    void setBlockSource(BlockSource *source) {
+        for (auto &&pool: pools) {
+            if (pool.firstBlock) throw std::runtime_error("PoolArray already has blocks, set its block source before");
+        }
+        this->source = source;
     }
 
     void gc(const std::span<T> &span) {
-        auto &pool = getPool(span.size());
-        pool.gc(span);
+        if (span.size()>maxSlotSize) {
+            if (largeQueue.size()>=largeQueueSize) gcFlushLarge();
+            largeQueue.push_back(span);
+            return;
+        }
+        pool(span.size()).gc(span);
+    }
+
+    /**
+     * Allocations above maxSlotSize, `blocks` and `active` count allocations.
+     */
+    PoolStats largeStats() const {
+        return {.active = largeActive, .peak = largePeak, .blocks = largeActive, .usedBlocks = largeActive, .gcQueued = (unsigned int) largeQueue.size(), .gcQueueSize = largeQueueSize, .bytes = largeBytes};
     }
 
 private:
+    constexpr static unsigned int largeQueueSize = 8;
+
+    BlockSource *source = nullptr;
+
+    //allocations above maxSlotSize, each with a header slot linking them, so that clear() can release them
+    Slot *large = nullptr;
+    unsigned int largeActive = 0;
+    unsigned int largePeak = 0;
+    std::size_t largeBytes = 0;
+    std::vector<std::span<T>> largeQueue;
+
+    std::span<T> allocateLarge(unsigned int size) {
+        auto bytes = sizeof(slot_type) + sizeof(T) * size;
+        auto slot = reinterpret_cast<slot_pointer>(operator new(bytes));
+        TracyAllocN(slot, bytes, "PoolArray large");
+        slot->header = {.prev = nullptr, .next = large};
+        if (large) large->header.prev = slot;
+        large = slot;
+        largeBytes += bytes;
+        if (++largeActive>largePeak) largePeak = largeActive;
+        return {reinterpret_cast<T *>(slot + 1), size};
+    }
+
+    void deallocateLarge(const std::span<T> &span) {
+        auto slot = reinterpret_cast<slot_pointer>(&span[0]) - 1;
+        if (slot->header.prev) slot->header.prev->header.next = slot->header.next; else large = slot->header.next;
+        if (slot->header.next) slot->header.next->header.prev = slot->header.prev;
+        largeBytes -= sizeof(slot_type) + sizeof(T) * span.size();
+        largeActive--;
+        TracyFreeN(slot, "PoolArray large");
+        operator delete(reinterpret_cast<void *>(slot));
+    }
+
+    void gcFlushLarge() {
+        //like Pool::gcFlush(), without destructor
+        for (auto &&span: largeQueue) deallocateLarge(span);
+        largeQueue.clear();
+    }
+
+    void freeLarge() {
+        while (large) {
+            auto next = large->header.next;
+            TracyFreeN(large, "PoolArray large");
+            operator delete(reinterpret_cast<void *>(large));
+            large = next;
+        }
+        largeActive = 0;
+        largeBytes = 0;
+        largeQueue.clear();
+    }
 
     void allocateBlock(Pool &pool) {
+        pool.usedBlocks++;
         if (pool.currentBlock && reinterpret_cast<slot_pointer>(pool.currentBlock)->header.next) {
             initializeBlock(pool, reinterpret_cast<slot_pointer>(pool.currentBlock)->header.next);
         } else {
             pool.blocks++;
             // Allocate space for the new block and store a pointer to the previous one
-            data_pointer newBlock = reinterpret_cast<data_pointer>(operator new(BlockSize));
+            data_pointer newBlock = reinterpret_cast<data_pointer>(source ? source->allocate(BlockSize) : operator new(BlockSize));
+            TracyAllocN(newBlock, BlockSize, "PoolArray");
             reinterpret_cast<slot_pointer>(newBlock)->header = {.prev = pool.currentBlock, .next = nullptr};
             setNextBlock(pool, reinterpret_cast<slot_pointer>(newBlock));
         }
     }
 
+    void freeBlock(slot_pointer block) {
+        TracyFreeN(block, "PoolArray");
+        if (source) {
+            source->deallocate(block, BlockSize);
+        } else {
+            operator delete(reinterpret_cast<void *>(block));
+        }
+    }
+
     void setNextBlock(Pool &pool, slot_pointer nextBlock) {
         if (pool.currentBlock) pool.currentBlock->header.next = nextBlock;
         if (!pool.firstBlock) pool.firstBlock = nextBlock;
@@ -6,11 +6,20 @@
 #include <cstdint>
 #include <type_traits>
 #include <span>
+#include <stdexcept>
 #include "../core.h"
+#include "./block_source.h"
+#include "./pool_stats.h"
+#include "Tracy.hpp"
 
 /**
  * Block is memory (Items + 1) * sizeof<T>. Plus 1 because first entry is block header.
  * Block header points to next and previous block.
+ *
+ * With TRACY_ENABLE blocks are reported to Tracy's memory profiler as pool "PoolSingle". Slots are not, clear() hands
+ * them out again without a free, the VM plots their occupancy instead.
+ *
+ * Blocks come from operator new, or from a BlockSource set with setBlockSource().
  */
 template<class T, size_t Items = 4096, size_t GCQueueSize = Items / 2, size_t BlockSize = sizeof(T) * (1 + Items)>
 class PoolSingle {
@@ -36,19 +45,21 @@ public:
     static_assert(BlockSize>=2 * sizeof(slot_type), "BlockSize too small.");
 
     ~PoolSingle() noexcept {
-        slot_pointer curr = currentBlock;
+        //from the first block, since after clear() blocks kept for reuse follow currentBlock
+        slot_pointer curr = firstBlock;
         while (curr != nullptr) {
-            slot_pointer prev = curr->pointer.prev;
-            operator delete(reinterpret_cast<void *>(curr));
-            curr = prev;
+            slot_pointer next = curr->pointer.next;
+            freeBlock(curr);
+            curr = next;
         }
     }
 
     unsigned int active = 0;
     unsigned int blocks = 0;
+    unsigned int peak = 0;
 
     pointer allocate() {
-        active++;
+        if (++active>peak) peak = active;
         if (freeSlot != nullptr) {
             pointer result = reinterpret_cast<pointer>(freeSlot);
             freeSlot = freeSlot->pointer.next;
@@ -86,7 +97,54 @@ public:
         active = 0;
         freeSlot = nullptr;
         gcQueued = 0;
-        if (firstBlock) initializeBlock(firstBlock);
+        if (firstBlock) {
+            initializeBlock(firstBlock);
+            usedBlocks = 1;
+        }
+    }
+
+    PoolStats stats() const {
+        PoolStats stats{.active = active, .peak = peak, .blocks = blocks, .usedBlocks = usedBlocks, .gcQueued = gcQueued, .gcQueueSize = GCQueueSize, .bytes = blocks * BlockSize};
+        for (auto slot = freeSlot; slot; slot = slot->pointer.next) stats.freeSlots++;
+        return stats;
+    }
+
+    void resetPeak() {
+        peak = active;
+    }
+
+    /**
+     * Releases blocks so that at most `keepBlocks` remain. Only blocks no slot was handed out from since the last
+     * clear() are released, so call it after clear() to give back what a large run needed. Returns the released blocks.
+     */
+    unsigned int trim(unsigned int keepBlocks = 1) {
+        if (!currentBlock) return 0;
+        unsigned int kept = usedBlocks;
+        slot_pointer last = currentBlock;
+        while (kept<keepBlocks && last->pointer.next) {
+            last = last->pointer.next;
+            kept++;
+        }
+        unsigned int released = 0;
+        slot_pointer curr = last->pointer.next;
+        last->pointer.next = nullptr;
+        while (curr != nullptr) {
+            slot_pointer next = curr->pointer.next;
+            freeBlock(curr);
+            curr = next;
+            released++;
+        }
+        blocks -= released;
+        return released;
+    }
+
+    /**
+     * Takes blocks from `source` instead of operator new, nullptr for operator new again. Only before the first block,
+     * since blocks are handed back to where they came from.
+     */
+    void setBlockSource(BlockSource *source) {
+        if (firstBlock) throw std::runtime_error("PoolSingle already has blocks, set its block source before");
+        this->source = source;
     }
 
     void gc(pointer p) {
@@ -101,25 +159,38 @@ public:
     }
 
 private:
+    BlockSource *source = nullptr;
     slot_pointer currentBlock = nullptr;
     slot_pointer firstBlock = nullptr;
 
     slot_pointer currentSlot = nullptr;
     slot_pointer lastSlot = nullptr;
     slot_pointer freeSlot = nullptr;
+    unsigned int usedBlocks = 0;
 
     void allocateBlock() {
+        usedBlocks++;
         if (currentBlock && reinterpret_cast<slot_pointer>(currentBlock)->pointer.next) {
             initializeBlock(reinterpret_cast<slot_pointer>(currentBlock)->pointer.next);
         } else {
             blocks++;
             // Allocate space for the new block and store a pointer to the previous one
-            data_pointer newBlock = reinterpret_cast<data_pointer>(operator new(BlockSize));
+            data_pointer newBlock = reinterpret_cast<data_pointer>(source ? source->allocate(BlockSize) : operator new(BlockSize));
+            TracyAllocN(newBlock, BlockSize, "PoolSingle");
             reinterpret_cast<slot_pointer>(newBlock)->pointer = {.prev = currentBlock, .next = nullptr};
             setNextBlock(reinterpret_cast<slot_pointer>(newBlock));
         }
     }
 
+    void freeBlock(slot_pointer block) {
+        TracyFreeN(block, "PoolSingle");
+        if (source) {
+            source->deallocate(block, BlockSize);
+        } else {
+            operator delete(reinterpret_cast<void *>(block));
+        }
+    }
+
     void setNextBlock(slot_pointer nextBlock) {
         if (currentBlock) currentBlock->pointer.next = nextBlock;
         if (!firstBlock) firstBlock = nextBlock;
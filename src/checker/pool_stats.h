@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Snapshot of a pool (or one size class of a PoolArray), see PoolSingle::stats() and PoolArray::stats().
+ * Counts are in slots, one slot per item for PoolSingle and one per allocation for a PoolArray size class.
+ */
+struct PoolStats {
+    unsigned int active = 0; //slots in use
+    unsigned int peak = 0; //highest `active` since construction or resetPeak()
+    unsigned int blocks = 0; //allocated blocks, including those kept for reuse after clear()
+    unsigned int usedBlocks = 0; //blocks slots were handed out from since the last clear()
+    unsigned int freeSlots = 0; //length of the free list
+    unsigned int gcQueued = 0;
+    unsigned int gcQueueSize = 0;
+    std::size_t bytes = 0; //of all blocks
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../core.h"
+#include "../hash.h"
+#include "./compiler.h"
+#include "./module2.h"
+#include "./pinned.h"
+#include "./vm2.h"
+
+namespace tr::vm2 {
+    using std::string;
+    using std::vector;
+
+    /**
+     * Declarations shared by all modules, e.g. a lib.d.ts, compiled and run once.
+     *
+     * The results of its top-level non-generic type aliases, variables and functions are pinned: flagged
+     * TypeFlag::Immortal and TypeFlag::Stored, so no VM collects, steals or counts references to them. Modules compiled
+     * with Compiler::prelude = &symbols load them by their index in `types` (OP::Prelude) instead of compiling and
+     * running the declarations again, and any number of VMs, also on different threads, reference the same Prelude
+     * via VM::prelude.
+     *
+     * Generic declarations have to be instantiated per use and are not linked, neither are types referencing
+     * subroutines of the prelude (classes, function expressions), which only have a meaning in its own module.
+     *
+     * snapshot() writes the pinned types into an image that restores the prelude in another process without
+     * compiling or running anything, e.g. for one-shot checks that would otherwise spend most of their time on it.
+     */
+    class Prelude {
+        //owns the memory of the pinned types, it does not run again
+        std::unique_ptr<VM> vm;
+
+        //instead of vm when restored from a snapshot
+        PinnedTypes restored;
+
+    public:
+        shared<Module> module; //errors of the prelude itself are in module->errors
+        checker::PreludeSymbols symbols;
+        vector<Type *> types; //by index in symbols
+        uint64_t hash; //of the source, modules compiled against the prelude have to be cached under it as well
+
+        /**
+         * `file` is the parsed `code`, it is only needed during construction.
+         */
+        Prelude(const shared<SourceFile> &file, const string &code, const string &fileName = "lib.d.ts"): vm(std::make_unique<VM>()), hash(hash::runtime_hash(code)) {
+            checker::Compiler compiler;
+            auto program = compiler.compileSourceFile(file);
+
+            vector<std::pair<string, unsigned int>> candidates; //name and subroutine index
+            for (auto &&symbol: program.mainSubroutine()->symbols) {
+                if (!symbol.routine || symbol.declarations > 1) continue;
+                if (symbol.type != checker::SymbolType::Type && symbol.type != checker::SymbolType::Variable && symbol.type != checker::SymbolType::Function) continue;
+                auto generic = false;
+                for (auto &&inner: symbol.routine->symbols) generic |= inner.type == checker::SymbolType::TypeArgument;
+                if (!generic) candidates.emplace_back(symbol.name, symbol.routine->index);
+            }
+
+            module = std::make_shared<Module>(program.build(), fileName, string(code));
+            vm->run(module);
+
+            for (auto &&[name, index]: candidates) {
+                auto routine = module->getSubroutine(index);
+                auto type = routine->result ? routine->result : vm->call(module, index);
+                if (!pinned::pinnable(type) || !symbols.add(name)) continue;
+                pinned::pin(type);
+                types.push_back(type);
+            }
+        }
+
+        /**
+         * Restores a snapshot() of a prelude. Needs the same compiler version, throws if the image is invalid: every
+         * size, offset and id in it is checked against the image, so a truncated or corrupt cache entry is a miss.
+         */
+        explicit Prelude(string_view image) {
+            unsigned int offset = vm::header::Version + 4;
+            auto need = [&](uint64_t size) {
+                if (image.size() < offset || image.size() - offset < size) throw std::runtime_error("Invalid prelude snapshot");
+            };
+            auto read32 = [&] {
+                need(4);
+                offset += 4;
+                return vm::readUint32(image, offset - 4);
+            };
+            auto readText = [&](unsigned int size) {
+                need(size);
+                offset += size;
+                return image.substr(offset - size, size);
+            };
+
+            if (image.size() < vm::header::Version + 4 || vm::readUint32(image, vm::header::Magic) != vm::header::snapshotMagic) throw std::runtime_error("No prelude snapshot");
+            if (vm::readUint32(image, vm::header::Version) != vm::header::version || read32() != vm::header::compilerVersion) throw std::runtime_error("Unsupported prelude snapshot version");
+            need(8);
+            hash = vm::readUint64(image, offset);
+            offset += 8;
+
+            auto bin = string(readText(read32()));
+            auto code = string(readText(read32()));
+            auto fileName = string(readText(read32()));
+            module = std::make_shared<Module>(std::move(bin), fileName, std::move(code));
+            parseHeader(module);
+
+            auto names = read32();
+            for (unsigned int i = 0; i < names; i++) {
+                if (!symbols.add(string(readText(read32())))) throw std::runtime_error("Invalid prelude snapshot");
+            }
+
+            //all records first, then the pointers between them: the types do not move anymore
+            auto typeCount = read32();
+            need((uint64_t) typeCount * 32);
+            auto typeRecords = offset;
+            offset += typeCount * 32;
+            auto refCount = read32();
+            need((uint64_t) refCount * 8);
+            auto refRecords = offset;
+            offset += refCount * 8;
+            restored.reserve(typeCount, refCount, string(readText(read32())));
+
+            for (unsigned int i = 0; i < typeCount; i++) {
+                auto record = typeRecords + i * 32;
+                restored.add((TypeKind) image[record], vm::readUint64(image, record + 8), vm::readUint32(image, record + 4), vm::readUint32(image, record + 20));
+            }
+            for (unsigned int i = 0; i < typeCount; i++) {
+                auto record = typeRecords + i * 32;
+                restored.link(*restored.type(i + 1), vm::readUint32(image, record + 16), vm::readUint32(image, record + 24));
+            }
+            for (unsigned int i = 0; i < refCount; i++) {
+                auto record = refRecords + i * 8;
+                restored.link(*restored.ref(i + 1), vm::readUint32(image, record), vm::readUint32(image, record + 4));
+            }
+
+            for (unsigned int i = 0; i < names; i++) {
+                auto type = restored.type(read32());
+                if (!type) throw std::runtime_error("Invalid prelude snapshot");
+                types.push_back(type);
+            }
+            if (offset != image.size()) throw std::runtime_error("Invalid prelude snapshot");
+        }
+
+        /**
+         * Pointers between types are written as indices, so restoring is just one pass over the records. Errors of
+         * the prelude itself are not part of the image.
+         */
+        string snapshot() const {
+            TypeGraph graph;
+            vector<unsigned int> roots;
+            for (auto &&type: types) roots.push_back(graph.type(type));
+
+            string image(vm::header::Version + 4, '\0');
+            vm::writeUint32(image.data(), vm::header::Magic, vm::header::snapshotMagic);
+            vm::writeUint32(image.data(), vm::header::Version, vm::header::version);
+            auto put32 = [&](uint32_t value) { image.append((const char *) &value, 4); };
+            auto put64 = [&](uint64_t value) { image.append((const char *) &value, 8); };
+            auto putText = [&](string_view text) {
+                put32(text.size());
+                image.append(text);
+            };
+            put32(vm::header::compilerVersion);
+            put64(hash);
+            putText(module->bin);
+            putText(module->code);
+            putText(module->fileName);
+            put32(symbols.names.size());
+            for (auto &&name: symbols.names) putText(name);
+
+            string texts;
+            put32(graph.types.size());
+            for (auto &&type: graph.types) {
+                image.push_back((char) type->kind);
+                image.append(3, '\0');
+                //as PinnedTypes::add() restores it
+                put32((type->flag | TypeFlag::Immortal | TypeFlag::Stored) & ~TypeFlag::MemberHashes);
+                put64(type->hash);
+                put32(graph.child(type));
+                if (type->kind == TypeKind::Literal || type->kind == TypeKind::Parameter) {
+                    put32(type->text().size());
+                    put32(texts.size());
+                    texts.append(type->text());
+                } else {
+                    put32(type->size);
+                    put32(graph.table(type));
+                }
+                put32(0);
+            }
+            put32(graph.refs.size());
+            for (auto &&ref: graph.refs) {
+                put32(graph.type(ref->type));
+                put32(graph.ref(ref->next));
+            }
+            putText(texts);
+            for (auto &&root: roots) put32(root);
+            return image;
+        }
+
+        Prelude(const Prelude &) = delete;
+        Prelude &operator=(const Prelude &) = delete;
+    };
+}
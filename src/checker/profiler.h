@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../core.h"
+#include "./instructions.h"
+#include "./module2.h"
+#include "./utils.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+namespace tr::vm2 {
+    using instructions::OP;
+    using std::string;
+    using std::vector;
+
+    /**
+     * Execution count, cycles and successor counts per OP, recorded by VM::process() when built with TYPERUNNER_PROFILE.
+     * Without it VM has no profile and process() contains no profiling code at all.
+     *
+     * Cycles of an op are the ticks from its dispatch to the dispatch of the next op, so they include the dispatch
+     * itself. Ticks are rdtsc on x86-64, cntvct_el0 on arm64 and steady_clock nanoseconds elsewhere. Subroutines
+     * running as tier::HandlerList are not dispatched and count towards the op that called them.
+     */
+    class OpProfile {
+        static constexpr unsigned int ops = 256;
+        //[previous][next], heap allocated since it is 512kb
+        std::unique_ptr<std::array<uint64_t, ops * ops>> bigrams = std::make_unique<std::array<uint64_t, ops * ops>>();
+        int last = -1; //op dispatched last, -1 when no op is running
+        uint64_t lastTicks = 0;
+
+    public:
+        std::array<uint64_t, ops> counts{};
+        std::array<uint64_t, ops> cycles{};
+
+        static uint64_t ticks() {
+#if defined(__x86_64__) || defined(_M_X64)
+            return __rdtsc();
+#elif defined(__aarch64__)
+            uint64_t value;
+            asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+            return value;
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        /**
+         * `op` is about to be executed.
+         */
+        void step(unsigned char op) {
+            auto now = ticks();
+            if (last >= 0) {
+                cycles[last] += now - lastTicks;
+                (*bigrams)[last * ops + op]++;
+            }
+            counts[op]++;
+            last = op;
+            lastTicks = now;
+        }
+
+        //op whose handler entered process() again, -1 if none
+        int running() const {
+            return last;
+        }
+
+        /**
+         * process() returns to `resume`, the handler that called it, or to outside the VM (-1), whose time is not
+         * spent in any op.
+         */
+        void stop(int resume = -1) {
+            auto now = ticks();
+            if (last >= 0) cycles[last] += now - lastTicks;
+            last = resume;
+            lastTicks = now;
+        }
+
+        uint64_t bigram(OP previous, OP next) const {
+            return (*bigrams)[(unsigned char) previous * ops + (unsigned char) next];
+        }
+
+        void clear() {
+            counts.fill(0);
+            cycles.fill(0);
+            bigrams->fill(0);
+            last = -1;
+        }
+
+        //e.g. of the VMs of all workers
+        void merge(const OpProfile &other) {
+            for (unsigned int i = 0; i < ops; i++) {
+                counts[i] += other.counts[i];
+                cycles[i] += other.cycles[i];
+            }
+            for (unsigned int i = 0; i < ops * ops; i++) (*bigrams)[i] += (*other.bigrams)[i];
+        }
+
+        /**
+         * Ops by cycles and the `top` most frequent bigrams, the candidates for superinstructions.
+         */
+        string report(unsigned int top = 20) const {
+            std::vector<unsigned int> byCycles;
+            uint64_t totalCycles = 0;
+            for (unsigned int i = 0; i < ops; i++) {
+                if (counts[i]) byCycles.push_back(i);
+                totalCycles += cycles[i];
+            }
+            std::sort(byCycles.begin(), byCycles.end(), [this](auto a, auto b) { return cycles[a] > cycles[b]; });
+
+            string out = fmt::format("{:<24} {:>12} {:>14} {:>10} {:>7}\n", "op", "count", "cycles", "cycles/op", "share");
+            for (auto i: byCycles) {
+                out += fmt::format("{:<24} {:>12} {:>14} {:>10.1f} {:>6.2f}%\n", (OP) i, counts[i], cycles[i],
+                                   (double) cycles[i] / counts[i], totalCycles ? 100.0 * cycles[i] / totalCycles : 0.0);
+            }
+
+            std::vector<unsigned int> byCount;
+            for (unsigned int i = 0; i < ops * ops; i++) if ((*bigrams)[i]) byCount.push_back(i);
+            std::sort(byCount.begin(), byCount.end(), [this](auto a, auto b) { return (*bigrams)[a] > (*bigrams)[b]; });
+            if (byCount.size() > top) byCount.resize(top);
+            out += fmt::format("\n{:<49} {:>12}\n", "bigram", "count");
+            for (auto i: byCount) {
+                out += fmt::format("{:<49} {:>12}\n", fmt::format("{} -> {}", (OP) (i / ops), (OP) (i % ops)), (*bigrams)[i]);
+            }
+            return out;
+        }
+
+        /**
+         * {"ops": [{"op", "count", "cycles"}], "bigrams": [{"from", "to", "count"}]} of all ops that ran.
+         */
+        string json() const {
+            string out = "{\"ops\": [";
+            auto first = true;
+            for (unsigned int i = 0; i < ops; i++) {
+                if (!counts[i]) continue;
+                out += fmt::format("{}{{\"op\": \"{}\", \"count\": {}, \"cycles\": {}}}", first ? "" : ", ", (OP) i, counts[i], cycles[i]);
+                first = false;
+            }
+            out += "], \"bigrams\": [";
+            first = true;
+            for (unsigned int i = 0; i < ops * ops; i++) {
+                if (!(*bigrams)[i]) continue;
+                out += fmt::format("{}{{\"from\": \"{}\", \"to\": \"{}\", \"count\": {}}}", first ? "" : ", ", (OP) (i / ops), (OP) (i % ops), (*bigrams)[i]);
+                first = false;
+            }
+            return out + "]}";
+        }
+    };
+
+    /**
+     * Calls, inclusive and exclusive ticks (see OpProfile::ticks()) and allocated types per ModuleSubroutine, plus the
+     * same per call stack as folded stacks for flamegraph tools. Recorded by VM::pushSubroutine(), tail calls and
+     * OP::Return when built with TYPERUNNER_PROFILE.
+     *
+     * Routines are named `name (file:line:column)` after the first op of their body with a source map entry, main
+     * after the file. Calls answered from a cached result or instantiation do not enter the routine and are not
+     * counted. Inclusive ticks of recursive routines are only counted for their outermost call.
+     */
+    class SubroutineProfile {
+    public:
+        struct Stats {
+            string name;
+            uint64_t calls = 0;
+            uint64_t inclusive = 0;
+            uint64_t exclusive = 0;
+            uint64_t allocations = 0; //types allocated while the routine itself ran, not its callees
+        };
+
+    private:
+        struct Node {
+            unsigned int stats = 0;
+            std::unordered_map<unsigned int, unsigned int> children; //node by stats
+            uint64_t exclusive = 0;
+        };
+
+        struct Frame {
+            unsigned int stats;
+            unsigned int node;
+            uint64_t start;
+            uint64_t children = 0; //inclusive ticks of callees
+            uint64_t allocations; //`allocations` when entered
+            uint64_t childAllocations = 0;
+        };
+
+        vector<Stats> all;
+        std::unordered_map<string, unsigned int> byName;
+        //of the module of the current run, cleared when another module runs since its routines come and go with it
+        std::unordered_map<const ModuleSubroutine *, unsigned int> byRoutine;
+        const Module *module = nullptr;
+        vector<unsigned int> active; //running calls per stats, for recursion
+        vector<Node> nodes = vector<Node>(1); //0 is the root above main
+        vector<Frame> frames;
+
+        unsigned int statsOf(const string &name) {
+            auto [it, inserted] = byName.try_emplace(name, all.size());
+            if (inserted) {
+                all.push_back({.name = name});
+                active.push_back(0);
+            }
+            return it->second;
+        }
+
+        unsigned int nodeOf(unsigned int parent, unsigned int stats) {
+            auto [it, inserted] = nodes[parent].children.try_emplace(stats, nodes.size());
+            auto node = it->second;
+            if (inserted) nodes.push_back({.stats = stats});
+            return node;
+        }
+
+        static string label(Module *module, const ModuleSubroutine *routine) {
+            if (routine->main) return module->fileName;
+            auto name = routine->name.empty() ? string("<anonymous>") : string(routine->name);
+            auto &bin = module->bin;
+            for (unsigned int ip = routine->address, i = 0; ip < bin.size() && i < 256; ip++, i++) {
+                auto map = module->findNormalizedMap(ip);
+                if (map.found()) {
+                    auto position = module->mapToLineCharacter(map);
+                    return fmt::format("{} ({}:{}:{})", name, module->fileName, position.line + 1, position.pos + 1);
+                }
+                auto op = (OP) bin[ip];
+                if (op == OP::Return) break;
+                vm::eatParams(op, &ip);
+            }
+            return fmt::format("{} ({})", name, module->fileName);
+        }
+
+        void folded(unsigned int node, const string &stack, string &out) const {
+            for (auto &&[stats, child]: nodes[node].children) {
+                auto path = stack.empty() ? all[stats].name : stack + ";" + all[stats].name;
+                if (nodes[child].exclusive) out += fmt::format("{} {}\n", path, nodes[child].exclusive);
+                folded(child, path, out);
+            }
+        }
+
+        void merge(const SubroutineProfile &other, unsigned int otherNode, unsigned int node) {
+            for (auto &&[otherStats, otherChild]: other.nodes[otherNode].children) {
+                auto child = nodeOf(node, statsOf(other.all[otherStats].name));
+                nodes[child].exclusive += other.nodes[otherChild].exclusive;
+                merge(other, otherChild, child);
+            }
+        }
+
+    public:
+        uint64_t allocations = 0; //types allocated by VM::allocate() so far
+
+        /**
+         * A run of `module` starts, frames of an aborted run are closed.
+         */
+        void begin(Module *module) {
+            end();
+            if (this->module != module) byRoutine.clear();
+            this->module = module;
+        }
+
+        void enter(Module *module, const ModuleSubroutine *routine) {
+            auto found = byRoutine.find(routine);
+            auto stats = found != byRoutine.end() ? found->second : byRoutine[routine] = statsOf(label(module, routine));
+            auto node = nodeOf(frames.empty() ? 0 : frames.back().node, stats);
+            all[stats].calls++;
+            active[stats]++;
+            frames.push_back({.stats = stats, .node = node, .start = OpProfile::ticks(), .allocations = allocations});
+        }
+
+        //the innermost routine returned
+        void exit() {
+            if (frames.empty()) return;
+            auto frame = frames.back();
+            frames.pop_back();
+            auto total = OpProfile::ticks() - frame.start;
+            auto allocated = allocations - frame.allocations;
+            auto &stats = all[frame.stats];
+            stats.exclusive += total - frame.children;
+            stats.allocations += allocated - frame.childAllocations;
+            nodes[frame.node].exclusive += total - frame.children;
+            if (--active[frame.stats] == 0) stats.inclusive += total;
+            if (!frames.empty()) {
+                frames.back().children += total;
+                frames.back().childAllocations += allocated;
+            }
+        }
+
+        //main returned
+        void end() {
+            while (!frames.empty()) exit();
+        }
+
+        const vector<Stats> &stats() const {
+            return all;
+        }
+
+        /**
+         * Calls of each subroutine of `module` by index, for checker::Program::build() of the same source, see
+         * Program::layout(). Routines are looked up by name, so calls recorded for an earlier image of the file count.
+         */
+        vector<uint64_t> weights(Module *module) const {
+            vector<uint64_t> result(module->subroutines.size());
+            for (unsigned int i = 0; i < result.size(); i++) {
+                auto found = byName.find(label(module, &module->subroutines[i]));
+                if (found != byName.end()) result[i] = all[found->second].calls;
+            }
+            return result;
+        }
+
+        void clear() {
+            all.clear();
+            byName.clear();
+            byRoutine.clear();
+            active.clear();
+            nodes = vector<Node>(1);
+            frames.clear();
+        }
+
+        //e.g. of the VMs of all workers
+        void merge(const SubroutineProfile &other) {
+            for (auto &&stats: other.all) {
+                auto &own = all[statsOf(stats.name)];
+                own.calls += stats.calls;
+                own.inclusive += stats.inclusive;
+                own.exclusive += stats.exclusive;
+                own.allocations += stats.allocations;
+            }
+            merge(other, 0, 0);
+        }
+
+        /**
+         * The `top` routines by exclusive ticks.
+         */
+        string report(unsigned int top = 30) const {
+            vector<unsigned int> byExclusive;
+            for (unsigned int i = 0; i < all.size(); i++) byExclusive.push_back(i);
+            std::sort(byExclusive.begin(), byExclusive.end(), [this](auto a, auto b) { return all[a].exclusive > all[b].exclusive; });
+            if (byExclusive.size() > top) byExclusive.resize(top);
+
+            string out = fmt::format("{:>14} {:>14} {:>10} {:>12}  {}\n", "exclusive", "inclusive", "calls", "allocations", "subroutine");
+            for (auto i: byExclusive) {
+                out += fmt::format("{:>14} {:>14} {:>10} {:>12}  {}\n", all[i].exclusive, all[i].inclusive, all[i].calls, all[i].allocations, all[i].name);
+            }
+            return out;
+        }
+
+        /**
+         * One line `main;caller;callee <exclusive ticks>` per call stack, as read by flamegraph.pl, speedscope or inferno.
+         */
+        string folded() const {
+            string out;
+            folded(0, "", out);
+            return out;
+        }
+    };
+}
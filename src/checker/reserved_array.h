@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Array of up to MaxSize elements in reserved address space.
+ *
+ * Only the first ChunkBytes are committed upfront, the rest is committed in chunks when ensure() asks for more.
+ * A typical run keeps a small resident footprint, deep ones still work, and since nothing is ever moved
+ * pointers into the array stay valid while it grows. ensure() is a single compare on the fast path.
+ *
+ * Elements are default constructed when their memory is committed and destructed when it is released.
+ */
+template<typename T, size_t MaxSize, size_t ChunkBytes = 64 * 1024>
+class ReservedArray {
+    T *values = nullptr;
+    size_t committed = 0; //constructed elements
+    size_t committedBytes = 0;
+    size_t reservedBytes = 0;
+
+    static size_t pageSize() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    static size_t roundUp(size_t bytes, size_t to) {
+        return (bytes + to - 1) / to * to;
+    }
+
+    char *bytes() {
+        return reinterpret_cast<char *>(values);
+    }
+
+    void commit(size_t bytes) {
+        if (bytes>reservedBytes) bytes = reservedBytes;
+        if (bytes<=committedBytes) return;
+#if defined(_WIN32)
+        if (!VirtualAlloc(this->bytes() + committedBytes, bytes - committedBytes, MEM_COMMIT, PAGE_READWRITE)) throw std::bad_alloc();
+#else
+        if (mprotect(this->bytes() + committedBytes, bytes - committedBytes, PROT_READ | PROT_WRITE)) throw std::bad_alloc();
+#endif
+        committedBytes = bytes;
+        auto size = committedBytes / sizeof(T);
+        for (auto i = committed; i<size; i++) new(values + i) T();
+        committed = size;
+    }
+
+    void decommit(size_t bytes) {
+        if (bytes>=committedBytes) return;
+        auto size = bytes / sizeof(T);
+        for (auto i = size; i<committed; i++) values[i].~T();
+        committed = size;
+#if defined(_WIN32)
+        VirtualFree(this->bytes() + bytes, committedBytes - bytes, MEM_DECOMMIT);
+#else
+        madvise(this->bytes() + bytes, committedBytes - bytes, MADV_DONTNEED);
+        mprotect(this->bytes() + bytes, committedBytes - bytes, PROT_NONE);
+#endif
+        committedBytes = bytes;
+    }
+
+    void grow(size_t size) {
+        if (size>MaxSize) throw std::runtime_error("Stack overflow");
+        commit(roundUp(size * sizeof(T), ChunkBytes));
+    }
+
+public:
+    ReservedArray() {
+        reservedBytes = roundUp(MaxSize * sizeof(T), roundUp(ChunkBytes, pageSize()));
+#if defined(_WIN32)
+        values = reinterpret_cast<T *>(VirtualAlloc(nullptr, reservedBytes, MEM_RESERVE, PAGE_NOACCESS));
+        if (!values) throw std::bad_alloc();
+#else
+        auto memory = mmap(nullptr, reservedBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED) throw std::bad_alloc();
+        values = reinterpret_cast<T *>(memory);
+#endif
+        commit(ChunkBytes);
+    }
+
+    ReservedArray(const ReservedArray &) = delete;
+    ReservedArray &operator=(const ReservedArray &) = delete;
+
+    ~ReservedArray() {
+        for (size_t i = 0; i<committed; i++) values[i].~T();
+#if defined(_WIN32)
+        VirtualFree(values, 0, MEM_RELEASE);
+#else
+        munmap(values, reservedBytes);
+#endif
+    }
+
+    T &operator[](size_t pos) {
+        return values[pos];
+    }
+
+    T *data() {
+        return values;
+    }
+
+    /**
+     * Elements that can be accessed without calling ensure().
+     */
+    size_t capacity() const {
+        return committed;
+    }
+
+    /**
+     * Makes the first `size` elements accessible. Throws when more than MaxSize are requested.
+     */
+    void ensure(size_t size) {
+        if (size>committed) [[unlikely]] grow(size);
+    }
+
+    /**
+     * Gives memory committed by a deep run back to the OS, keeping only the first chunk.
+     */
+    void shrink() {
+        decommit(ChunkBytes);
+    }
+};
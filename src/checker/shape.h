@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "../hash.h"
+#include "./simd.h"
+
+namespace tr::vm2 {
+    /**
+     * Property layout of object literals, similar to hidden classes: the Type::hash of each member in member order
+     * (= slot), shared by all object literals with the same keys. A member is then the child ref at its slot, see
+     * findChild(), and two objects of the same shape compare slot by slot, see isExtendable().
+     *
+     * Immutable and owned by Shapes. Members with the same key keep their order, find() returns the first.
+     */
+    struct Shape {
+        //more keys get an index, fewer are scanned by simd::findHash()
+        static constexpr unsigned int indexThreshold = 16;
+
+        uint64_t hash;
+        std::vector<uint64_t> keys;
+        //open addressing, slot + 1 per bucket and 0 for empty ones, a power of two with at least twice as many buckets as keys
+        std::vector<uint32_t> index;
+
+        explicit Shape(uint64_t hash, std::span<const uint64_t> keys): hash(hash), keys(keys.begin(), keys.end()) {
+            if (keys.size()<=indexThreshold) return;
+            size_t buckets = 1;
+            while (buckets<keys.size() * 2) buckets <<= 1;
+            index.resize(buckets);
+            auto mask = buckets - 1;
+            for (uint32_t slot = 0; slot<keys.size(); slot++) {
+                auto i = keys[slot] & mask;
+                while (index[i]) i = (i + 1) & mask;
+                index[i] = slot + 1;
+            }
+        }
+
+        unsigned int size() const {
+            return keys.size();
+        }
+
+        //slot of the first member with Type::hash `key`, size() if there is none
+        unsigned int find(uint64_t key) const {
+            if (index.empty()) return simd::findHash(keys.data(), keys.size(), key);
+            auto mask = index.size() - 1;
+            for (auto i = key & mask;; i = (i + 1) & mask) {
+                auto slot = index[i];
+                if (!slot) return keys.size();
+                if (keys[slot - 1] == key) return slot - 1;
+            }
+        }
+    };
+
+    /**
+     * Interned shapes of a VM. They reference no types, so they outlive VM::run() and all types pointing to them,
+     * also pinned ones. Instantiations of the same object type ask for the same keys over and over, so the last shape
+     * is checked before the table.
+     */
+    class Shapes {
+        std::unordered_multimap<uint64_t, std::unique_ptr<Shape>> shapes;
+        const Shape *last = nullptr;
+
+        static bool matches(const Shape *shape, uint64_t hash, std::span<const uint64_t> keys) {
+            return shape->hash == hash && std::equal(shape->keys.begin(), shape->keys.end(), keys.begin(), keys.end());
+        }
+
+    public:
+        Shapes() = default;
+        Shapes(const Shapes &) = delete;
+        Shapes &operator=(const Shapes &) = delete;
+
+        const Shape *intern(std::span<const uint64_t> keys) {
+            auto hash = hash::const_hash("shape");
+            for (auto key: keys) hash = hash::combine(hash, key);
+            if (last && matches(last, hash, keys)) return last;
+
+            auto [begin, end] = shapes.equal_range(hash);
+            for (auto it = begin; it != end; ++it) {
+                if (matches(it->second.get(), hash, keys)) return last = it->second.get();
+            }
+            return last = shapes.emplace(hash, std::make_unique<Shape>(hash, keys))->second.get();
+        }
+
+        size_t size() const {
+            return shapes.size();
+        }
+    };
+}
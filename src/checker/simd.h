@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TYPERUNNER_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TYPERUNNER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**
+ * findHash(hashes, size, hash, from) is the index of the first of `hashes[from..size)` equal to `hash`, `size` if there
+ * is none. It compares 4 hashes per instruction with AVX2 (chosen at runtime, so the build needs no -mavx2) and 2 with
+ * NEON, everything else and the tail are scalar.
+ */
+namespace tr::vm2::simd {
+    inline unsigned int findHashScalar(const uint64_t *hashes, unsigned int size, uint64_t hash, unsigned int i) {
+        for (; i<size; i++) if (hashes[i] == hash) return i;
+        return size;
+    }
+
+#if TYPERUNNER_SIMD_AVX2
+    __attribute__((target("avx2")))
+    inline unsigned int findHashAvx2(const uint64_t *hashes, unsigned int size, uint64_t hash, unsigned int i) {
+        auto needle = _mm256_set1_epi64x((long long) hash);
+        for (; i + 4<=size; i += 4) {
+            auto block = _mm256_loadu_si256((const __m256i *) (hashes + i));
+            auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(block, needle)));
+            if (mask) return i + __builtin_ctz(mask);
+        }
+        return findHashScalar(hashes, size, hash, i);
+    }
+
+    inline unsigned int findHash(const uint64_t *hashes, unsigned int size, uint64_t hash, unsigned int from = 0) {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2 ? findHashAvx2(hashes, size, hash, from) : findHashScalar(hashes, size, hash, from);
+    }
+#elif TYPERUNNER_SIMD_NEON
+    inline unsigned int findHash(const uint64_t *hashes, unsigned int size, uint64_t hash, unsigned int i = 0) {
+        auto needle = vdupq_n_u64(hash);
+        for (; i + 4<=size; i += 4) {
+            auto a = vceqq_u64(vld1q_u64(hashes + i), needle);
+            auto b = vceqq_u64(vld1q_u64(hashes + i + 2), needle);
+            //any lane set
+            if (vmaxvq_u32(vreinterpretq_u32_u64(vorrq_u64(a, b)))) return findHashScalar(hashes, i + 4, hash, i);
+        }
+        return findHashScalar(hashes, size, hash, i);
+    }
+#else
+    inline unsigned int findHash(const uint64_t *hashes, unsigned int size, uint64_t hash, unsigned int from = 0) {
+        return findHashScalar(hashes, size, hash, from);
+    }
+#endif
+}
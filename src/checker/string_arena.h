@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace tr::vm2 {
+    /**
+     * Storage of literal texts a VM computes at runtime (template literals, `length` of tuples), instead of a heap
+     * string per literal. Texts are carved out of chunks and live until clear(), which the VM calls together with
+     * pool.clear(). Chunks are kept for the next run, see trim().
+     *
+     * append() extends the text in place when it is the last one stored, so building a template literal piece by
+     * piece copies each piece once.
+     */
+    class StringArena {
+        static constexpr std::size_t chunkSize = 16 * 1024;
+
+        struct Chunk {
+            std::unique_ptr<char[]> data;
+            std::size_t size;
+        };
+
+        std::vector<Chunk> chunks;
+        unsigned int chunk = 0; //index of the chunk `cursor` points into
+        char *cursor = nullptr;
+        std::size_t left = 0;
+        std::size_t used = 0;
+
+        //makes room for `size` characters at `cursor`
+        void reserve(std::size_t size) {
+            if (size<=left) return;
+            auto next = chunks.empty() ? 0 : chunk + 1;
+            if (next>=chunks.size() || chunks[next].size<size) {
+                //a text that outgrows a chunk gets one with room to grow further
+                auto bytes = std::max(chunkSize, size * 2);
+                chunks.insert(chunks.begin() + next, Chunk{std::make_unique<char[]>(bytes), bytes});
+            }
+            chunk = next;
+            cursor = chunks[chunk].data.get();
+            left = chunks[chunk].size;
+        }
+
+        bool isLast(std::string_view text) const {
+            if (text.empty() || chunks.empty()) return false;
+            auto base = chunks[chunk].data.get();
+            return text.data()>=base && text.data() + text.size() == cursor;
+        }
+
+    public:
+        StringArena() = default;
+        StringArena(const StringArena &) = delete;
+        StringArena &operator=(const StringArena &) = delete;
+
+        std::string_view store(std::string_view value) {
+            reserve(value.size());
+            auto result = cursor;
+            if (!value.empty()) std::memcpy(cursor, value.data(), value.size());
+            cursor += value.size();
+            left -= value.size();
+            used += value.size();
+            return {result, value.size()};
+        }
+
+        /**
+         * `text` followed by `value`. `text` is either the last text returned by this arena, then it grows in place,
+         * or any other text (e.g. of the bytecode), which is copied first.
+         */
+        std::string_view append(std::string_view text, std::string_view value) {
+            if (isLast(text) && value.size()<=left) {
+                std::memcpy(cursor, value.data(), value.size());
+                cursor += value.size();
+                left -= value.size();
+                used += value.size();
+                return {text.data(), text.size() + value.size()};
+            }
+            reserve(text.size() + value.size());
+            auto result = cursor;
+            if (!text.empty()) std::memcpy(cursor, text.data(), text.size());
+            if (!value.empty()) std::memcpy(cursor + text.size(), value.data(), value.size());
+            auto size = text.size() + value.size();
+            cursor += size;
+            left -= size;
+            used += size;
+            return {result, size};
+        }
+
+        //all texts are gone, chunks are reused
+        void clear() {
+            chunk = 0;
+            used = 0;
+            cursor = chunks.empty() ? nullptr : chunks[0].data.get();
+            left = chunks.empty() ? 0 : chunks[0].size;
+        }
+
+        /**
+         * Releases the chunks after the current one, returns the released bytes.
+         */
+        std::size_t trim() {
+            std::size_t released = 0;
+            while (chunks.size()>chunk + 1) {
+                released += chunks.back().size;
+                chunks.pop_back();
+            }
+            return released;
+        }
+
+        //characters of all texts since the last clear()
+        std::size_t size() const {
+            return used;
+        }
+
+        //of all chunks
+        std::size_t bytes() const {
+            std::size_t bytes = 0;
+            for (auto &&c: chunks) bytes += c.size;
+            return bytes;
+        }
+    };
+}
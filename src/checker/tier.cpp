@@ -0,0 +1,9 @@
+#include "./tier.h"
+#include "./vm2.h"
+
+namespace tr::vm2::tier {
+    void HandlerList::run(VM *vm) const {
+        for (auto &&instruction: code) instruction.handler(vm, instruction.a, instruction.b);
+        vm->subroutine->ip = returnIp;
+    }
+}
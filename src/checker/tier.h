@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tr::vm2 {
+    class VM;
+}
+
+/**
+ * Second tier for hot subroutines, interpreted: no native code is emitted.
+ *
+ * Each VM counts calls per subroutine of the running module. Once a subroutine hits VM::tierThreshold and its body only
+ * consists of type constructors (primitives, literals, unions, tuples, object literals, type arguments, ...) up to its
+ * OP::Return, which is the shape of most generic type aliases, its operands are decoded once into a HandlerList. Running
+ * it is a flat loop over calls into the same handlers the interpreter uses, without reading and decoding the bytecode
+ * again. The interpreter continues at OP::Return. Handler lists are immutable and kept in Module::handlerLists, shared by
+ * all VMs.
+ */
+namespace tr::vm2::tier {
+    //calls after which a subroutine gets a handler list. 0 disables the tier.
+    constexpr unsigned int defaultThreshold = 64;
+
+    //the handlers, defined next to the interpreter in vm2.cpp
+    struct Ops;
+
+    using Handler = void (*)(VM *vm, uint32_t a, uint32_t b);
+
+    struct Instruction {
+        Handler handler;
+        uint32_t a = 0;
+        uint32_t b = 0;
+    };
+
+    struct HandlerList {
+        std::vector<Instruction> code;
+        unsigned int returnIp = 0; //ip of the subroutine's OP::Return
+
+        /**
+         * Executes the decoded body in the active subroutine of `vm` and moves its ip to OP::Return.
+         */
+        void run(VM *vm) const;
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "./instructions.h"
+
+namespace tr::vm2 {
+    using instructions::OP;
+    using std::vector;
+
+    struct Module;
+
+    /**
+     * One process<Stepping>() call. Types are not recorded, their memory is reused long before a trace is looked at,
+     * so a step is its position (module, ip, frame), the stack pointer and its delta, and how long it took.
+     */
+    struct TraceStep {
+        unsigned int ip;
+        unsigned int sp; //after the step
+        int stackDelta;
+        unsigned int nanoseconds;
+        uint16_t frame; //index in VM::activeSubroutines when the step started
+        uint8_t module; //index in Trace::modules()
+        uint8_t op; //OP at ip
+    };
+
+    static_assert(sizeof(TraceStep) == 20);
+
+    //steps and time spent at one ip, see Trace::hotspots()
+    struct TraceHotspot {
+        const Module *module;
+        unsigned int ip;
+        OP op;
+        uint64_t steps = 0;
+        uint64_t nanoseconds = 0;
+    };
+
+    /**
+     * Ring buffer of the last `capacity` steps of a VM that runs with process<Stepping>(), set with VM::trace.
+     * Batch runs (run(), call()) contain no tracing code. A debugger scrubs through it forwards and backwards
+     * without executing again and finds slow spots with hotspots().
+     *
+     * Modules are referenced by address, they have to outlive the trace or be cleared with it.
+     */
+    class Trace {
+        vector<TraceStep> steps;
+        uint64_t recorded = 0;
+        vector<const Module *> moduleTable;
+
+    public:
+        explicit Trace(unsigned int capacity = 1 << 20): steps(std::max(1u, capacity)) {}
+
+        void record(const TraceStep &step) {
+            steps[recorded++ % steps.size()] = step;
+        }
+
+        //index to store in TraceStep::module, the last one is reused for modules after 255
+        uint8_t moduleIndex(const Module *module) {
+            for (unsigned int i = moduleTable.size(); i > 0; i--) {
+                if (moduleTable[i - 1] == module) return i - 1;
+            }
+            if (moduleTable.size() < 256) moduleTable.push_back(module);
+            return moduleTable.size() - 1;
+        }
+
+        const vector<const Module *> &modules() const {
+            return moduleTable;
+        }
+
+        //steps still in the buffer
+        size_t size() const {
+            return std::min<uint64_t>(recorded, steps.size());
+        }
+
+        size_t capacity() const {
+            return steps.size();
+        }
+
+        //all steps recorded since the last clear(), also the overwritten ones
+        uint64_t total() const {
+            return recorded;
+        }
+
+        //step number of operator[](0), the oldest step still in the buffer
+        uint64_t first() const {
+            return recorded - size();
+        }
+
+        //0 is the oldest step still in the buffer, size() - 1 the last one
+        const TraceStep &operator[](size_t i) const {
+            return steps[(first() + i) % steps.size()];
+        }
+
+        const TraceStep &back() const {
+            return (*this)[size() - 1];
+        }
+
+        void clear() {
+            recorded = 0;
+            moduleTable.clear();
+        }
+
+        /**
+         * The `limit` ips with the most time spent in the steps still in the buffer, slowest first.
+         */
+        vector<TraceHotspot> hotspots(unsigned int limit = 20) const {
+            std::unordered_map<uint64_t, TraceHotspot> byIp;
+            for (size_t i = 0; i < size(); i++) {
+                auto &step = (*this)[i];
+                auto &spot = byIp.try_emplace(((uint64_t) step.module << 32) | step.ip, TraceHotspot{moduleTable[step.module], step.ip, (OP) step.op}).first->second;
+                spot.steps++;
+                spot.nanoseconds += step.nanoseconds;
+            }
+            vector<TraceHotspot> result;
+            result.reserve(byIp.size());
+            for (auto &&[key, spot]: byIp) result.push_back(spot);
+            std::sort(result.begin(), result.end(), [](auto &a, auto &b) { return a.nanoseconds > b.nanoseconds || (a.nanoseconds == b.nanoseconds && a.ip < b.ip); });
+            if (result.size() > limit) result.resize(limit);
+            return result;
+        }
+    };
+}
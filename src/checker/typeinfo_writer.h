@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../core.h"
+#include "../typeinfo.h"
+#include "./module2.h"
+#include "./pinned.h"
+#include "./types2.h"
+#include "./vm2.h"
+
+namespace tr::vm2 {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * Writes resolved types as type info, see typeinfo.h. Types are hash-consed bottom up: a type whose kind, flags,
+     * text and child ids equal those of one written before gets its id, so equal types of different declarations (and
+     * of different VMs) are stored once. Strings are interned the same way.
+     */
+    class TypeInfoWriter {
+        struct Record {
+            typeinfo::Kind kind;
+            uint8_t flags;
+            uint32_t text;
+            uint32_t textLength;
+            uint32_t edge;
+            uint32_t edgeCount;
+        };
+
+        vector<Record> records;
+        vector<uint32_t> edges;
+        vector<std::pair<uint32_t, uint32_t>> names; //string offset and length
+        vector<uint32_t> roots;
+        string strings;
+        std::unordered_map<string, uint32_t> internedStrings;
+        //kind, flags, text and child ids of each record, see type()
+        std::unordered_map<string, uint32_t> internedTypes;
+        //of the VM types added so far, only valid as long as they live
+        std::unordered_map<const Type *, uint32_t> ids;
+
+        uint32_t intern(string_view text) {
+            auto [it, inserted] = internedStrings.try_emplace(string(text), strings.size());
+            if (inserted) strings.append(text);
+            return it->second;
+        }
+
+        static typeinfo::Kind kindOf(Type *type) {
+            using typeinfo::Kind;
+            switch (type->kind) {
+                case TypeKind::Unknown: return Kind::Unknown;
+                case TypeKind::Never: return Kind::Never;
+                case TypeKind::Any: return Kind::Any;
+                case TypeKind::Null: return Kind::Null;
+                case TypeKind::Undefined: return Kind::Undefined;
+                case TypeKind::String: return Kind::String;
+                case TypeKind::Number: return Kind::Number;
+                case TypeKind::BigInt: return Kind::BigInt;
+                case TypeKind::Boolean: return Kind::Boolean;
+                case TypeKind::Symbol: return Kind::Symbol;
+                case TypeKind::Literal: {
+                    if (type->flag & TypeFlag::StringLiteral) return Kind::StringLiteral;
+                    if (type->flag & TypeFlag::NumberLiteral) return Kind::NumberLiteral;
+                    if (type->flag & TypeFlag::BigIntLiteral) return Kind::BigIntLiteral;
+                    return type->flag & TypeFlag::True ? Kind::True : Kind::False;
+                }
+                case TypeKind::Union: return Kind::Union;
+                case TypeKind::ObjectLiteral: return Kind::Object;
+                case TypeKind::PropertySignature: return Kind::PropertySignature;
+                case TypeKind::Method:
+                case TypeKind::MethodSignature: return Kind::MethodSignature;
+                case TypeKind::Tuple: return Kind::Tuple;
+                case TypeKind::TupleMember: return Kind::TupleMember;
+                case TypeKind::Array: return Kind::Array;
+                case TypeKind::Rest: return Kind::Rest;
+                case TypeKind::TemplateLiteral: return Kind::TemplateLiteral;
+                case TypeKind::Function: return Kind::Function;
+                case TypeKind::Parameter: return Kind::Parameter;
+                case TypeKind::Class: return Kind::Class;
+            }
+            return Kind::Opaque;
+        }
+
+        uint32_t type(Type *type) {
+            if (auto it = ids.find(type); it != ids.end()) return it->second;
+
+            auto kind = kindOf(type);
+            uint8_t flags = 0;
+            if (type->flag & TypeFlag::Readonly) flags |= typeinfo::Flag::Readonly;
+            if (type->flag & TypeFlag::Optional) flags |= typeinfo::Flag::Optional;
+            if (type->flag & TypeFlag::Static) flags |= typeinfo::Flag::Static;
+
+            //children first, so they have ids for the key
+            vector<uint32_t> childIds;
+            if (kind != typeinfo::Kind::Opaque) {
+                if (pinned::hasChildType(type->kind)) {
+                    if (type->type) childIds.push_back(this->type((Type *) type->type));
+                } else if (pinned::hasChildRefs(type->kind) || type->kind == TypeKind::Method || type->kind == TypeKind::Class) {
+                    forEachChild(type, [this, &childIds](Type *child, auto &) { childIds.push_back(this->type(child)); });
+                }
+            }
+
+            auto text = type->text();
+            string key;
+            key.reserve(6 + text.size() + childIds.size() * 4);
+            key.push_back((char) kind);
+            key.push_back((char) flags);
+            uint32_t length = text.size();
+            key.append((const char *) &length, 4);
+            key.append(text);
+            key.append((const char *) childIds.data(), childIds.size() * 4);
+
+            auto [it, inserted] = internedTypes.try_emplace(std::move(key), records.size());
+            if (inserted) {
+                records.push_back({kind, flags, text.empty() ? 0 : intern(text), length, (uint32_t) edges.size(), (uint32_t) childIds.size()});
+                edges.insert(edges.end(), childIds.begin(), childIds.end());
+            }
+            ids[type] = it->second;
+            return it->second;
+        }
+
+    public:
+        /**
+         * Adds `type` as root `name`. `type` and its children only have to live during the call.
+         */
+        void add(string_view name, Type *type) {
+            auto id = this->type(type);
+            //pointers of types that are collected afterwards could be reused for other types
+            ids.clear();
+            names.emplace_back(intern(name), name.size());
+            roots.push_back(id);
+        }
+
+        //number of distinct types added so far
+        size_t size() const {
+            return records.size();
+        }
+
+        string data() const {
+            string out;
+            out.reserve(typeinfo::headerSize + records.size() * typeinfo::typeSize + edges.size() * 4 + roots.size() * typeinfo::rootSize + strings.size());
+            auto put32 = [&out](uint32_t value) { out.append((const char *) &value, 4); };
+            put32(typeinfo::magic);
+            put32(typeinfo::version);
+            put32(records.size());
+            put32(edges.size());
+            put32(roots.size());
+            put32(strings.size());
+            put32(0);
+            put32(0);
+            for (auto &&record: records) {
+                out.push_back((char) record.kind);
+                out.push_back((char) record.flags);
+                out.append(2, '\0');
+                put32(record.text);
+                put32(record.textLength);
+                put32(record.edge);
+                put32(record.edgeCount);
+            }
+            for (auto edge: edges) put32(edge);
+            for (unsigned int i = 0; i < roots.size(); i++) {
+                put32(names[i].first);
+                put32(names[i].second);
+                put32(roots[i]);
+            }
+            out.append(strings);
+            return out;
+        }
+    };
+
+    /**
+     * Type info of all exported (non-generic) declarations of `module`, computed with VM::resolveExport() so `module`
+     * does not have to be run before.
+     */
+    inline string typeInfo(VM &vm, shared<Module> &module) {
+        TypeInfoWriter writer;
+        parseHeader(module);
+        for (auto &&routine: module->subroutines) {
+            if (!routine.exported) continue;
+            if (auto type = vm.resolveExport(module, routine.name)) writer.add(routine.name, type);
+        }
+        return writer.data();
+    }
+}
@@ -4,14 +4,19 @@
 #include <functional>
 #include <array>
 #include <vector>
+#include <span>
+#include <unordered_map>
+#include <fmt/format.h>
 #include "../enum.h"
 #include "../hash.h"
+#include "./shape.h"
+#include "./string_arena.h"
 
 namespace tr::vm2 {
     using std::string;
     using std::string_view;
 
-    enum class TypeKind: unsigned int {
+    enum class TypeKind: uint8_t {
         Unknown,
         Never,
         Any,
@@ -57,6 +62,10 @@ namespace tr::vm2 {
         RestReuse = 1<<9, //allow to reuse/steal T in ...T
         Deleted = 1<<10, //for debugging purposes
         Static = 1<<11,
+        Immortal = 1<<12, //never collected nor reference counted, see ImmortalTypes and Prelude
+        ChildrenArray = 1<<13, //child TypeRefs are one PoolArray allocation of `size` entries (still linked via next), see VM::allocateChildren
+        MemberHashes = 1<<14, //a union has Type::hash of each member next to its hash table, see Type::memberHashes()
+        LiteralMembers = 1<<15, //all members of a union are literals
     };
 
     struct Type;
@@ -131,49 +140,82 @@ namespace tr::vm2 {
         explicit TypeRef(Type *type, TypeRef *next = nullptr): type(type), next(next) {}
     };
 
+    /**
+     * Fields touched by every op come first. Kind specific data shares storage: `size` is the member count of
+     * composite types, the address of FunctionRef/ClassRef, and the text length of literals and parameters.
+     */
     struct Type {
         TypeKind kind;
 
-        //used to map type to sourcecode
-        unsigned int ip;
-
         /** see TypeFlag */
-        unsigned int flag = 0;
+        unsigned int flag: 24 = 0;
 
         //ref counter for garbage collection
         unsigned int refCount = 0;
 
-        string_view text;
         uint64_t hash = 0;
 
-        //used as address for FunctionRef
-        unsigned int size = 0;
-
-        //either Type* or TypeRef* or string* depending on kind
+        //either Type* or TypeRef* depending on kind
         void *type = nullptr;
 
-        std::span<TypeRef> children;
+        unsigned int size = 0;
 
-        Type(TypeKind kind, uint64_t hash): kind(kind), hash(hash) {}
+        //used to map type to sourcecode
+        unsigned int ip;
 
-        ~Type() {
-            if (kind == TypeKind::Literal && type) delete (string *) type;
+        union {
+            //hash table of unions and classes with `size` buckets, see children()
+            TypeRef *table = nullptr;
+            //of object literals and class instances whose children are a ChildrenArray, see findChild()
+            const Shape *shape;
+            //text of literals and parameters with `size` characters, see text()
+            const char *textData;
         };
 
+        Type(TypeKind kind, uint64_t hash): kind(kind), hash(hash) {}
+
         bool isDeleted() {
             return flag & TypeFlag::Deleted;
         }
 
+        string_view text() const {
+            if ((kind == TypeKind::Literal || kind == TypeKind::Parameter) && textData) return {textData, size};
+            return {};
+        }
+
+        void setText(string_view value) {
+            textData = value.data();
+            size = value.size();
+        }
+
+        /**
+         * Type::hash of each member of a union in member order, stored after the buckets of its hash table, see
+         * VM::unionOf(). Empty for unions without and for all other kinds.
+         */
+        std::span<const uint64_t> memberHashes() const {
+            if (kind == TypeKind::Union && flag & TypeFlag::MemberHashes) return {(const uint64_t *) (table + size), size};
+            return {};
+        }
+
+        /**
+         * Member hash table of unions (more than 5 members) and classes. Empty for all other kinds, object literals
+         * and class instances have a Shape instead. The `type` of a class is its ClassInstance, see VM::handleClass().
+         */
+        std::span<TypeRef> children() const {
+            switch (kind) {
+                case TypeKind::Union:
+                case TypeKind::Class: {
+                    if (table) return {table, size};
+                }
+            }
+            return {};
+        }
+
         void fromLiteral(Type *literal) {
             flag = literal->flag;
-            if (literal->type) {
-                //dynamic value, so copy it
-                setDynamicText(literal->text, literal->hash);
-            } else {
-                //static value, safe reuse of string_view's reference
-                text = literal->text;
-                hash = literal->hash;
-            }
+            //static texts live as long as the module, dynamic ones as long as the VM's StringArena, so both can be shared
+            setText(literal->text());
+            hash = literal->hash;
         }
 
         /**
@@ -190,34 +232,23 @@ namespace tr::vm2 {
             return type ? ((TypeRef *) type)->type : nullptr;
         }
 
-        void appendLiteral(Type *literal) {
-            appendText(literal->text);
+        void appendLiteral(StringArena &strings, Type *literal) {
+            appendText(strings, literal->text());
         }
 
-        void appendText(string_view value) {
-            if (!type) {
-                setDynamicText(value);
-            } else {
-                ((string *) type)->append(value);
-                text = *(string *) type;
-                hash = hash::runtime_hash(text);
-            }
+        void appendText(StringArena &strings, string_view value) {
+            setText(strings.append(text(), value));
+            hash = hash::runtime_hash(text());
         }
 
-        void setDynamicText(string_view value, uint64_t hash = 0) {
-            if (!type) {
-                type = new string(value);
-            } else {
-                ((string *) type)->clear();
-                ((string *) type)->append(value);
-            }
-            text = *(string *) type;
-            this->hash = hash ? hash : hash::runtime_hash(text);
+        void setDynamicText(StringArena &strings, string_view value, uint64_t hash = 0) {
+            setText(strings.store(value));
+            this->hash = hash ? hash : hash::runtime_hash(text());
         }
 
-        void setDynamicLiteral(TypeFlag flag, string_view value) {
+        void setDynamicLiteral(StringArena &strings, TypeFlag flag, string_view value) {
             this->flag |= flag;
-            setDynamicText(value);
+            setDynamicText(strings, value);
         }
 
         Type *setFlag(TypeFlag flag) {
@@ -227,16 +258,19 @@ namespace tr::vm2 {
 
         Type *setLiteral(TypeFlag flag, string_view value) {
             this->flag |= flag;
-            text = value;
-            hash = hash::runtime_hash(text);
+            setText(value);
+            hash = hash::runtime_hash(value);
             return this;
         }
 
+        //walks to the last child, VM::appendChildRef() keeps a cursor instead when many children are appended
         void appendChild(TypeRef *ref) {
             if (!type) {
                 type = ref;
             } else {
-                ((TypeRef *) type)->next = ref;
+                auto last = (TypeRef *) type;
+                while (last->next) last = last->next;
+                last->next = ref;
             }
             size++;
         }
@@ -245,12 +279,25 @@ namespace tr::vm2 {
             //offset points to the start of the storage entry: its structure is: hash+size+data;
             hash = vm::readUint64(bin, offset);
             offset += 8;
-            text = vm::readStorage(bin, offset);
+            setText(vm::readStorage(bin, offset));
         }
     };
 
+    static_assert(sizeof(Type) == 40, "Type is allocated for every type node, keep it small");
+    static_assert(sizeof(TypeRef) == 2 * sizeof(uint64_t), "memberHashes() packs two hashes per TypeRef");
+
+    //TypeRefs of the hash table of a union with `size` members, including the room for its memberHashes()
+    inline unsigned int unionTableSize(unsigned int size) {
+        return size + (size + 1) / 2;
+    }
+
     inline Type *findChild(Type *type, uint64_t hash) {
-        if (type->children.empty()) {
+        if ((type->kind == TypeKind::ObjectLiteral || type->kind == TypeKind::ClassInstance) && type->shape) {
+            auto slot = type->shape->find(hash);
+            return slot<type->shape->size() ? ((TypeRef *) type->type)[slot].type : nullptr;
+        }
+        if (type->kind == TypeKind::Class && !type->table) return nullptr;
+        if (type->children().empty()) {
             auto current = (TypeRef *) type->type;
             while (current) {
                 if (current->type->hash == hash) return current->type;
@@ -258,7 +305,7 @@ namespace tr::vm2 {
             }
             return nullptr;
         } else {
-            TypeRef *entry = &type->children[hash % type->children.size()];
+            TypeRef *entry = &type->children()[hash % type->children().size()];
             if (!entry->type) return nullptr;
             while (entry && entry->type->hash != hash) {
                 //step through linked collisions
@@ -268,8 +315,13 @@ namespace tr::vm2 {
         }
     }
 
-    inline void forEachChild(Type *type, const std::function<void(Type *child, bool &stop)> &callback) {
-        if (type->type) {
+    /**
+     * Calls `callback(Type *child, bool &stop)` for each member, setting stop to true ends the iteration.
+     * A template so the callback is inlined into the hot VM paths, no std::function type erasure.
+     */
+    template<typename Callback>
+    inline void forEachChild(Type *type, Callback &&callback) {
+        if (type->type && type->kind != TypeKind::Class) {
             auto stop = false;
             auto current = (TypeRef *) type->type;
             while (!stop && current) {
@@ -279,9 +331,10 @@ namespace tr::vm2 {
         } else {
             auto stop = false;
             unsigned int i = 0;
-            unsigned int end = type->children.size();
+            auto children = type->children();
+            unsigned int end = children.size();
             while (!stop && i<end) {
-                auto child = type->children[i];
+                auto child = children[i];
                 //bucket could be empty
                 if (child.type) callback(child.type, stop);
                 if (child.next) {
@@ -297,12 +350,14 @@ namespace tr::vm2 {
         }
     }
 
-    inline void forEachHashTableChild(Type *type, const std::function<void(Type *child, bool &stop)> &callback) {
+    template<typename Callback>
+    inline void forEachHashTableChild(Type *type, Callback &&callback) {
         auto stop = false;
         unsigned int i = 0;
-        unsigned int end = type->children.size();
+        auto children = type->children();
+        unsigned int end = children.size();
         while (!stop && i<end) {
-            auto child = type->children[i];
+            auto child = children[i];
             //bucket could be empty
             if (child.type) callback(child.type, stop);
             if (child.next) {
@@ -317,183 +372,374 @@ namespace tr::vm2 {
         }
     }
 
-    inline Type *getPropertyOrMethodName(Type *type) {
-        return type->children[0].type;
-    }
-
-    inline Type *getPropertyOrMethodType(Type *type) {
-        return type->children[1].type;
+    /**
+     * Start value of Type::hash of composite types, see hashChild().
+     */
+    inline uint64_t seedHash(TypeKind kind) {
+        return hash::combine(hash::const_hash("type"), (uint64_t) kind);
     }
 
-    inline void stringifyType(Type *type, std::string &r) {
+    /**
+     * Hash over the structure of a type, equal for all types isSameType() considers equal.
+     *
+     * Composite types (unions, tuples, object literals, functions, ...) carry it already in Type::hash, since the VM
+     * folds each child into it when constructing them. Literals and property signatures keep their name/text hash in
+     * Type::hash for member lookup, so their structural hash is derived here, which is still constant time.
+     * Other kinds hash by identity.
+     */
+    inline uint64_t structuralHash(Type *type) {
         switch (type->kind) {
-            case TypeKind::Boolean: {
-                r += "boolean";
-                break;
+            case TypeKind::Unknown:
+            case TypeKind::Never:
+            case TypeKind::Any:
+            case TypeKind::Null:
+            case TypeKind::Undefined:
+            case TypeKind::String:
+            case TypeKind::Number:
+            case TypeKind::BigInt:
+            case TypeKind::Boolean:
+            case TypeKind::Symbol: {
+                return hash::combine(0, (uint64_t) type->kind);
             }
-            case TypeKind::Number: {
-                r += "number";
-                break;
-            }
-            case TypeKind::String: {
-                r += "string";
-                break;
+            case TypeKind::Literal: {
+                constexpr auto literalFlags = TypeFlag::StringLiteral | TypeFlag::NumberLiteral | TypeFlag::BigIntLiteral | TypeFlag::True | TypeFlag::False;
+                return hash::combine(hash::combine((uint64_t) type->kind, type->flag & literalFlags), type->hash);
             }
-            case TypeKind::Never: {
-                r += "never";
-                break;
+            case TypeKind::PropertySignature: {
+                auto name = (TypeRef *) type->type;
+                auto result = hash::combine((uint64_t) type->kind, type->flag & (TypeFlag::Optional | TypeFlag::Readonly));
+                return hash::combine(hash::combine(result, structuralHash(name->type)), structuralHash(name->next->type));
             }
-            case TypeKind::Any: {
-                r += "any";
-                break;
+            case TypeKind::Union:
+            case TypeKind::Tuple:
+            case TypeKind::TupleMember:
+            case TypeKind::Array:
+            case TypeKind::Rest:
+            case TypeKind::ObjectLiteral:
+            case TypeKind::TemplateLiteral:
+            case TypeKind::Function: {
+                return type->hash;
             }
-            case TypeKind::Unknown: {
-                r += "unknown";
-                break;
+        }
+        return hash::combine(0, (uint64_t) type);
+    }
+
+    /**
+     * Folds `child` into the hash of the composite `type`, in the order children are added.
+     */
+    inline void hashChild(Type *type, Type *child) {
+        type->hash = hash::combine(type->hash, structuralHash(child));
+    }
+
+    /**
+     * Recomputes the hash of a composite type from its children, for types whose children were modified while building it.
+     */
+    inline void hashChildren(Type *type) {
+        type->hash = seedHash(type->kind);
+        auto current = (TypeRef *) type->type;
+        while (current) {
+            hashChild(type, current->type);
+            current = current->next;
+        }
+    }
+
+    /**
+     * Structural equality matching structuralHash(). Member order matters, so `a | b` and `b | a` are not the same,
+     * which only costs a cache miss.
+     */
+    inline bool isSameType(Type *left, Type *right) {
+        if (left == right) return true;
+        if (left->kind != right->kind) return false;
+
+        switch (left->kind) {
+            case TypeKind::Unknown:
+            case TypeKind::Never:
+            case TypeKind::Any:
+            case TypeKind::Null:
+            case TypeKind::Undefined:
+            case TypeKind::String:
+            case TypeKind::Number:
+            case TypeKind::BigInt:
+            case TypeKind::Boolean:
+            case TypeKind::Symbol: {
+                return true;
             }
-            case TypeKind::PropertySignature: {
-                stringifyType(((TypeRef *) type->type)->type, r);
-                r += ": ";
-                stringifyType(((TypeRef *) type->type)->next->type, r);
-                break;
+            case TypeKind::Literal: {
+                constexpr auto literalFlags = TypeFlag::StringLiteral | TypeFlag::NumberLiteral | TypeFlag::BigIntLiteral | TypeFlag::True | TypeFlag::False;
+                return (left->flag & literalFlags) == (right->flag & literalFlags) && left->hash == right->hash;
             }
-            case TypeKind::ObjectLiteral: {
-                r += "{";
-                unsigned int i = 0;
-                forEachChild(type, [&i, &r](Type *child, auto stop) {
-                    if (i++>20) {
-                        r += "...";
-                        stop = true;
-                        return;
-                    }
-                    stringifyType(child, r);
-                    r + "; ";
-                });
-                r += "}";
-                break;
+            case TypeKind::Union:
+            case TypeKind::Tuple:
+            case TypeKind::ObjectLiteral:
+            case TypeKind::TemplateLiteral: {
+                auto leftCurrent = (TypeRef *) left->type;
+                auto rightCurrent = (TypeRef *) right->type;
+                while (leftCurrent && rightCurrent) {
+                    if (!isSameType(leftCurrent->type, rightCurrent->type)) return false;
+                    leftCurrent = leftCurrent->next;
+                    rightCurrent = rightCurrent->next;
+                }
+                return !leftCurrent && !rightCurrent;
             }
+            case TypeKind::Array:
+            case TypeKind::Rest:
             case TypeKind::TupleMember: {
-                if (r.empty()) r += "TupleMember:";
-                if (!type->text.empty()) {
-                    r += string(type->text);
-                    if (type->flag & TypeFlag::Optional) r += "?";
-                    r += ": ";
-                }
-                if (!type->type) {
-                    r += "UnknownTupleMember";
-                } else {
-                    stringifyType((Type *) type->type, r);
-                }
-                break;
+                constexpr auto flags = TypeFlag::Optional;
+                return (left->flag & flags) == (right->flag & flags) && isSameType((Type *) left->type, (Type *) right->type);
             }
-            case TypeKind::Array: {
-                r += "Array<";
-                stringifyType((Type *) type->type, r);
-                r += ">";
-                break;
+            case TypeKind::PropertySignature: {
+                constexpr auto flags = TypeFlag::Optional | TypeFlag::Readonly;
+                if ((left->flag & flags) != (right->flag & flags)) return false;
+                auto leftName = (TypeRef *) left->type;
+                auto rightName = (TypeRef *) right->type;
+                return isSameType(leftName->type, rightName->type) && isSameType(leftName->next->type, rightName->next->type);
             }
-            case TypeKind::Rest: {
-                r += "...";
-                stringifyType((Type *) type->type, r);
-                break;
+        }
+        return false;
+    }
+
+    inline Type *getPropertyOrMethodName(Type *type) {
+        return ((TypeRef *) type->type)->type;
+    }
+
+    inline Type *getPropertyOrMethodType(Type *type) {
+        return ((TypeRef *) type->type)->next->type;
+    }
+
+    /**
+     * Renders types as text into one buffer that is reused for every print(). Like tsc, types nested deeper than
+     * `maxDepth` and members of unions, tuples and objects after the first `maxMembers` are cut off with "...".
+     * Members of objects, tuples and functions are on the level of their parent, their types one below.
+     *
+     * Composite types are cached by their structuralHash(), so a big union mentioned by many errors (or shown again
+     * on every debugger refresh) is rendered once. clear() when the types go away, e.g. before the next run of the VM
+     * they live in, and after changing the limits.
+     */
+    class TypePrinter {
+        fmt::memory_buffer out;
+        //rendered text by structuralHash() and remaining depth, which decides where the text was cut off
+        std::unordered_map<uint64_t, string> cache;
+
+        static bool cacheable(Type *type) {
+            switch (type->kind) {
+                case TypeKind::Union:
+                case TypeKind::Tuple:
+                case TypeKind::ObjectLiteral:
+                case TypeKind::Array:
+                case TypeKind::TemplateLiteral:
+                case TypeKind::Function: return true;
+                default: return false;
             }
-            case TypeKind::Parameter: {
-                auto parameterType = (Type *) type->type;
-                r += type->text;
-                r += ": ";
-                stringifyType(parameterType, r);
-                break;
+        }
+
+        void append(string_view text) {
+            out.append(text.data(), text.data() + text.size());
+        }
+
+        void write(Type *type, unsigned int depth) {
+            if (depth>maxDepth) {
+                append("...");
+                return;
             }
-            case TypeKind::Tuple: {
-                r += "[";
-                auto current = (TypeRef *) type->type;
-                unsigned int i = 0;
-                while (current) {
-                    if (i++>20) {
-                        r += "...";
-                        break;
-                    }
-                    stringifyType(current->type, r);
-                    current = current->next;
-                    if (current) r += ", ";
+            uint64_t key = 0;
+            auto start = out.size();
+            if (cacheable(type)) {
+                key = hash::combine(structuralHash(type), maxDepth - depth);
+                if (auto it = cache.find(key); it != cache.end()) {
+                    append(it->second);
+                    return;
                 }
-                r += "]";
-                break;
             }
-            case TypeKind::Union: {
-                auto current = (TypeRef *) type->type;
-                unsigned int i = 0;
-                while (current) {
-                    if (i++>20) {
-                        r += "...";
-                        break;
-                    }
-                    stringifyType(current->type, r);
-                    current = current->next;
-                    if (current) r += " | ";
+
+            switch (type->kind) {
+                case TypeKind::Boolean: {
+                    append("boolean");
+                    break;
                 }
-                break;
-            }
-            case TypeKind::TemplateLiteral: {
-                r += "`";
-                auto current = (TypeRef *) type->type;
-                while (current) {
-                    if (current->type->kind != TypeKind::Literal) r += "${";
-                    if (current->type->flag & TypeFlag::StringLiteral) {
-                        r += current->type->text;
+                case TypeKind::Number: {
+                    append("number");
+                    break;
+                }
+                case TypeKind::String: {
+                    append("string");
+                    break;
+                }
+                case TypeKind::Never: {
+                    append("never");
+                    break;
+                }
+                case TypeKind::Any: {
+                    append("any");
+                    break;
+                }
+                case TypeKind::Unknown: {
+                    append("unknown");
+                    break;
+                }
+                case TypeKind::PropertySignature: {
+                    write(((TypeRef *) type->type)->type, depth);
+                    append(": ");
+                    write(((TypeRef *) type->type)->next->type, depth + 1);
+                    break;
+                }
+                case TypeKind::ClassInstance:
+                case TypeKind::ObjectLiteral: {
+                    append("{");
+                    unsigned int i = 0;
+                    forEachChild(type, [this, &i, depth](Type *child, bool &stop) {
+                        if (i++ == maxMembers) {
+                            append("...");
+                            stop = true;
+                            return;
+                        }
+                        write(child, depth);
+                    });
+                    append("}");
+                    break;
+                }
+                case TypeKind::TupleMember: {
+                    if (!out.size()) append("TupleMember:");
+                    if (!type->text().empty()) {
+                        append(type->text());
+                        if (type->flag & TypeFlag::Optional) append("?");
+                        append(": ");
+                    }
+                    if (!type->type) {
+                        append("UnknownTupleMember");
                     } else {
-                        stringifyType(current->type, r);
+                        write((Type *) type->type, depth + 1);
                     }
-                    if (current->type->kind != TypeKind::Literal) r += "}";
-                    current = current->next;
+                    break;
                 }
-                r += "`";
-                break;
-            }
-            case TypeKind::Function: {
-                auto first = (TypeRef *) type->type;
-                auto nameType = first->type;
-                auto second = (TypeRef *) first->next;
-                auto returnType = second->type;
-
-                r += "(";
-                auto current = (TypeRef *) second->next;
-                while (current) {
-                    stringifyType(current->type, r);
-                    current = current->next;
-                    if (current) r += ", ";
+                case TypeKind::Array: {
+                    append("Array<");
+                    write((Type *) type->type, depth + 1);
+                    append(">");
+                    break;
                 }
-                r += ") => (";
-                stringifyType(returnType, r);
-                r += ")";
-                break;
-            }
-            case TypeKind::Literal: {
-                if (type->flag & TypeFlag::StringLiteral) {
-                    r += "\"";
-                    r += type->text;
-                    r += "\"";
-                } else if (type->flag & TypeFlag::NumberLiteral) {
-                    r += type->text;
-                } else if (type->flag & TypeFlag::True) {
-                    r += "true";
-                } else if (type->flag & TypeFlag::False) {
-                    r += "false";
-                } else {
-                    r += "UnknownLiteral";
+                case TypeKind::Rest: {
+                    append("...");
+                    write((Type *) type->type, depth);
+                    break;
+                }
+                case TypeKind::Parameter: {
+                    auto parameterType = (Type *) type->type;
+                    append(type->text());
+                    append(": ");
+                    write(parameterType, depth + 1);
+                    break;
+                }
+                case TypeKind::Tuple: {
+                    append("[");
+                    auto current = (TypeRef *) type->type;
+                    unsigned int i = 0;
+                    while (current) {
+                        if (i++ == maxMembers) {
+                            append("...");
+                            break;
+                        }
+                        write(current->type, depth);
+                        current = current->next;
+                        if (current) append(", ");
+                    }
+                    append("]");
+                    break;
+                }
+                case TypeKind::Union: {
+                    auto current = (TypeRef *) type->type;
+                    unsigned int i = 0;
+                    while (current) {
+                        if (i++ == maxMembers) {
+                            append("...");
+                            break;
+                        }
+                        write(current->type, depth + 1);
+                        current = current->next;
+                        if (current) append(" | ");
+                    }
+                    break;
+                }
+                case TypeKind::TemplateLiteral: {
+                    append("`");
+                    auto current = (TypeRef *) type->type;
+                    while (current) {
+                        if (current->type->kind != TypeKind::Literal) append("${");
+                        if (current->type->flag & TypeFlag::StringLiteral) {
+                            append(current->type->text());
+                        } else {
+                            write(current->type, depth + 1);
+                        }
+                        if (current->type->kind != TypeKind::Literal) append("}");
+                        current = current->next;
+                    }
+                    append("`");
+                    break;
+                }
+                case TypeKind::Function: {
+                    auto first = (TypeRef *) type->type;
+                    auto nameType = first->type;
+                    auto second = (TypeRef *) first->next;
+                    auto returnType = second->type;
+
+                    append("(");
+                    auto current = (TypeRef *) second->next;
+                    while (current) {
+                        write(current->type, depth);
+                        current = current->next;
+                        if (current) append(", ");
+                    }
+                    append(") => (");
+                    write(returnType, depth + 1);
+                    append(")");
+                    break;
+                }
+                case TypeKind::Literal: {
+                    if (type->flag & TypeFlag::StringLiteral) {
+                        append("\"");
+                        append(type->text());
+                        append("\"");
+                    } else if (type->flag & TypeFlag::NumberLiteral) {
+                        append(type->text());
+                    } else if (type->flag & TypeFlag::True) {
+                        append("true");
+                    } else if (type->flag & TypeFlag::False) {
+                        append("false");
+                    } else {
+                        append("UnknownLiteral");
+                    }
+                    break;
+                }
+                default: {
+                    append("*notStringified*");
                 }
-                break;
-            }
-            default: {
-                r += "*notStringified*";
             }
+
+            if (key) cache.emplace(key, string(out.data() + start, out.size() - start));
         }
-    }
+
+    public:
+        unsigned int maxDepth = 16;
+        unsigned int maxMembers = 21;
+
+        //valid until the next print()
+        string_view print(Type *type) {
+            out.clear();
+            write(type, 0);
+            return {out.data(), out.size()};
+        }
+
+        void clear() {
+            cache.clear();
+        }
+
+        size_t cached() const {
+            return cache.size();
+        }
+    };
 
     inline string stringify(Type *type) {
-        std::string r;
-        stringifyType(type, r);
-        return r;
+        TypePrinter printer;
+        return string(printer.print(type));
     }
 
     inline bool isOptional(Type *type) {
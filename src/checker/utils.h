@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 #include <string>
@@ -7,6 +9,7 @@
 
 namespace tr::vm {
     using std::vector;
+    using std::string;
     using std::string_view;
 
     inline uint64_t readUint64(const vector<unsigned char> &bin, unsigned int offset) {
@@ -57,84 +60,268 @@ namespace tr::vm {
         *(uint16_t *) (bin.data() + offset) = value;
     }
 
+    inline void writeUint16(char *bin, unsigned int offset, uint16_t value) {
+        *(uint16_t *) (bin + offset) = value;
+    }
+
+    inline void writeUint32(char *bin, unsigned int offset, uint32_t value) {
+        *(uint32_t *) (bin + offset) = value;
+    }
+
+    inline void writeUint64(char *bin, unsigned int offset, uint64_t value) {
+        *(uint64_t *) (bin + offset) = value;
+    }
+
+    /**
+     * Unsigned LEB128: 7 bits per byte, lowest first, the high bit says another byte follows.
+     */
+    inline unsigned int varUintSize(uint32_t value) {
+        unsigned int size = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    //returns the offset after the written bytes
+    inline unsigned int writeVarUint(char *bin, unsigned int offset, uint32_t value) {
+        while (value >= 0x80) {
+            bin[offset++] = (char) (value | 0x80);
+            value >>= 7;
+        }
+        bin[offset++] = (char) value;
+        return offset;
+    }
+
+    inline uint32_t readVarUint(const string_view &bin, unsigned int &offset) {
+        uint32_t value = 0;
+        unsigned int shift = 0;
+        unsigned char byte;
+        do {
+            byte = bin[offset++];
+            value |= (uint32_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return value;
+    }
+
+    //small negative numbers to small unsigned ones: 0, -1, 1, -2 to 0, 1, 2, 3
+    inline uint32_t zigzag(int32_t value) {
+        return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t value) {
+        return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+    }
+
     inline string_view readStorage(const string_view &bin, const uint32_t offset) {
         const auto size = readUint16(bin, offset);
         return string_view(reinterpret_cast<const char *>(bin.data() + offset + 2), size);
     }
 
+    /**
+     * Fixed layout right after the initial OP::Jump of every image written by Program::build(). The jump goes over it,
+     * so walking the image op by op still works, while parseHeader() finds all sections without decoding anything.
+     * All fields are uint32 addresses/counts at the given offsets.
+     */
+    namespace header {
+        constexpr uint32_t magic = 0x32425354; //"TSB2"
+        //vm2::Prelude::snapshot() images, they have Magic and Version at the same offsets so the BytecodeCache holds them as well
+        constexpr uint32_t snapshotMagic = 0x31505354; //"TSP1"
+        constexpr uint32_t version = 4;
+        //bump when Program::build() emits different bytecode for the same source, invalidates the BytecodeCache
+        constexpr uint32_t compilerVersion = 9;
+
+        enum Field: unsigned int {
+            Magic = 5,
+            Version = 9,
+            Storage = 13, //first storage entry
+            SourceMap = 17, //first source map entry, after OP::SourceMap and its size
+            SourceMapEnd = 21,
+            Subroutines = 25, //first OP::Subroutine of the subroutine table
+            SubroutineCount = 29,
+            Main = 33, //OP::Main, the code of all subroutines follows
+            Flags = 37, //see Flag
+            Imports = 41, //first OP::ModuleImport of the import table, which follows the subroutine table
+            ImportCount = 45,
+        };
+
+        enum Flag: uint32_t {
+            //the source map is encoded as CompactSourceMapReader reads it instead of uint32 triples
+            CompactSourceMap = 1 << 0,
+            //the operands of the code after OP::Main are varints, see expandOperands()
+            CompactOperands = 1 << 1,
+        };
+
+        constexpr unsigned int size = 11 * 4;
+        constexpr unsigned int subroutineEntrySize = 1 + 4 + 4 + 1; //OP::Subroutine + uint32 name address + uint32 routine address + flags
+        constexpr unsigned int importEntrySize = 1 + 4 + 4; //OP::ModuleImport + uint32 specifier address + uint32 name address
+    }
+
+    /**
+     * Walks a source map written with header::CompactSourceMap. Each entry is three varints: the bytecode position as
+     * delta to the previous entry (the first one relative to the code after OP::Main), the source position as zigzag
+     * delta to the previous one, and end - pos zigzag encoded. Most entries fit in 3-4 bytes instead of 12.
+     */
+    struct CompactSourceMapReader {
+        string_view bin;
+        unsigned int offset;
+        unsigned int end;
+        uint32_t bytecodePos;
+        uint32_t sourcePos = 0;
+        uint32_t sourceEnd = 0;
+
+        CompactSourceMapReader(string_view bin, unsigned int start, unsigned int end, unsigned int codeStart): bin(bin), offset(start), end(end), bytecodePos(codeStart) {}
+
+        bool next() {
+            if (offset >= end) return false;
+            bytecodePos += readVarUint(bin, offset);
+            sourcePos += unzigzag(readVarUint(bin, offset));
+            sourceEnd = sourcePos + unzigzag(readVarUint(bin, offset));
+            return true;
+        }
+    };
+
     using tr::instructions::OP;
-    inline void eatParams(OP op, unsigned int *i) {
+
+    /**
+     * Sizes in bytes of the operands following `op`, in order, 0 past the last one. The offset of OP::Jump is the only
+     * signed operand (the jump at the end of a distribute section goes back), its size is negative.
+     */
+    inline std::array<int8_t, 3> operands(OP op) {
         switch (op) {
             case OP::TailCall:
-            case OP::Call: {
-                *i += 6;
-                break;
-            }
-            case OP::Subroutine: {
-                *i += 4 + 4 + 1;
-                break;
-            }
-            case OP::Main: {
-                break;
-            }
-            case OP::Jump: {
-                *i += 4;
-                break;
-            }
-            case OP::JumpCondition: {
-                *i += 4;
-                break;
-            }
-            case OP::Distribute: {
-                *i += 2 + 4;
-                break;
-            }
+            case OP::Call: return {4, 2};
+            case OP::Subroutine: return {4, 4, 1};
+            case OP::ModuleImport: return {4, 4};
+            case OP::Jump: return {-4};
+            case OP::JumpCondition:
+            case OP::ExtendsJump: return {4};
+            case OP::Distribute: return {2, 4};
             case OP::Set:
             case OP::CheckBody:
             case OP::InferBody:
             case OP::SelfCheck:
             case OP::Inline:
-            case OP::TypeArgumentDefault: {
-                *i += 4;
-                break;
-            }
+            case OP::TypeArgumentDefault: return {4};
             case OP::ClassRef:
-            case OP::FunctionRef: {
-                *i += 4;
-                break;
-            }
+            case OP::FunctionRef:
+            case OP::Prelude:
+            case OP::Import: return {4};
             case OP::New:
-            case OP::Instantiate: {
-                *i += 2;
-                break;
-            }
-            case OP::Error: {
-                *i += 2;
-                break;
-            }
+            case OP::Instantiate: return {2};
+            case OP::Error: return {2};
             case OP::Method:
             case OP::Function:
             case OP::Union:
+            case OP::Intersection:
             case OP::Tuple:
             case OP::TemplateLiteral:
             case OP::Class:
             case OP::ObjectLiteral:
             case OP::Slots:
-            case OP::CallExpression: {
-                *i += 2;
-                break;
-            }
-            case OP::Loads: {
-                *i += 4;
-                break;
-            }
+            case OP::CallExpression: return {2};
+            case OP::Loads:
+            case OP::LoadsIndexAccess: return {2, 2};
             case OP::Parameter:
             case OP::NumberLiteral:
             case OP::BigIntLiteral:
-            case OP::StringLiteral: {
-                *i += 4;
-                break;
+            case OP::StringLiteral: return {4};
+            default: return {};
+        }
+    }
+
+    inline void eatParams(OP op, unsigned int *i) {
+        for (auto size: operands(op)) *i += size<0 ? -size : size;
+    }
+
+    //an operand of `size` as in operands(), signed ones zigzag encoded
+    inline uint32_t readOperand(string_view bin, unsigned int offset, int8_t size) {
+        switch (size) {
+            case 1: return (unsigned char) bin[offset];
+            case 2: return readUint16(bin, offset);
+            case -4: return zigzag(readInt32(bin, offset));
+            default: return readUint32(bin, offset);
+        }
+    }
+
+    inline void writeOperand(char *bin, unsigned int offset, int8_t size, uint32_t value) {
+        switch (size) {
+            case 1: bin[offset] = (char) value; break;
+            case 2: writeUint16(bin, offset, value); break;
+            case -4: writeUint32(bin, offset, unzigzag(value)); break;
+            default: writeUint32(bin, offset, value); break;
+        }
+    }
+
+    /**
+     * header::CompactOperands writes the code after OP::Main with each operand as varint: OP::Loads 0 1 takes 3 bytes
+     * instead of 5, a storage address below 16k 2 instead of 4. All addresses of the image, jump offsets and the source
+     * map still refer to the fixed-width code, which expandOperands() restores byte for byte before the image is used.
+     * The VM, verifyBytecode() and the optimiser never see the compact form.
+     */
+    inline unsigned int compactOperandsSize(string_view code) {
+        unsigned int size = 0;
+        for (unsigned int i = 0; i<code.size();) {
+            auto op = (OP) code[i++];
+            size++;
+            for (auto operand: operands(op)) {
+                if (!operand) break;
+                size += varUintSize(readOperand(code, i, operand));
+                i += operand<0 ? -operand : operand;
+            }
+        }
+        return size;
+    }
+
+    //writes `code`, whole ops, compact at `offset` and returns the offset after it
+    inline unsigned int writeCompactOperands(char *bin, unsigned int offset, string_view code) {
+        for (unsigned int i = 0; i<code.size();) {
+            auto op = (OP) code[i];
+            bin[offset++] = code[i++];
+            for (auto operand: operands(op)) {
+                if (!operand) break;
+                offset = writeVarUint(bin, offset, readOperand(code, i, operand));
+                i += operand<0 ? -operand : operand;
+            }
+        }
+        return offset;
+    }
+
+    inline bool hasCompactOperands(string_view bin) {
+        return bin.size()>=5 + header::size && readUint32(bin, header::Magic) == header::magic && readUint32(bin, header::Flags) & header::CompactOperands;
+    }
+
+    /**
+     * The image written with header::CompactOperands with fixed-width operands again, as if it was written without.
+     * Throws for a truncated operand, anything else of corrupt bytecode is left to verifyBytecode().
+     */
+    inline string expandOperands(string_view bin) {
+        auto code = readUint32(bin, header::Main) + 1;
+        if (code>bin.size()) throw std::runtime_error("Invalid bytecode: no OP::Main");
+        string expanded(bin.substr(0, code));
+        expanded.reserve(bin.size() * 2);
+        writeUint32(expanded.data(), header::Flags, readUint32(bin, header::Flags) & ~header::CompactOperands);
+
+        char buffer[4];
+        for (unsigned int i = code; i<bin.size();) {
+            auto op = (OP) bin[i];
+            expanded += bin[i++];
+            for (auto operand: operands(op)) {
+                if (!operand) break;
+                uint32_t value = 0;
+                for (unsigned int shift = 0;; shift += 7) {
+                    if (i>=bin.size() || shift>28) throw std::runtime_error("Invalid bytecode: truncated operand at " + std::to_string(i));
+                    auto byte = (unsigned char) bin[i++];
+                    value |= (uint32_t) (byte & 0x7f) << shift;
+                    if (!(byte & 0x80)) break;
+                }
+                auto size = operand<0 ? -operand : operand;
+                writeOperand(buffer, 0, operand, value);
+                expanded.append(buffer, size);
             }
         }
+        return expanded;
     }
-}
\ No newline at end of file
+}
@@ -1,12 +1,49 @@
+#include <algorithm>
+#include <exception>
+#include <latch>
+#include <thread>
+#include <unordered_set>
 #include "./vm2.h"
 #include "../hash.h"
+#include "../number.h"
 #include "./check2.h"
 #include "./vm2_utils.h"
+#include "./prelude.h"
 #include "Tracy.hpp"
 
+//threaded dispatch via labels-as-values in VM::process(), MSVC falls back to the plain switch
+#ifndef TYPERUNNER_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define TYPERUNNER_COMPUTED_GOTO 1
+#else
+#define TYPERUNNER_COMPUTED_GOTO 0
+#endif
+#endif
+
+//records subroutine calls into VM::subroutineProfile, see SubroutineProfile
+#if TYPERUNNER_PROFILE
+#define VM_PROFILE_ROUTINE(call) subroutineProfile.call;
+#else
+#define VM_PROFILE_ROUTINE(call)
+#endif
+
+//sampled subroutine zones and plots, see VM::tracyEnter()
+#if TRACY_ENABLE
+#define VM_TRACY(call) call;
+#else
+#define VM_TRACY(call)
+#endif
+
 namespace tr::vm2 {
-    void prepare(shared<Module> &module) {
+    void VM::prepare(shared<Module> &module) {
         parseHeader(module);
+        tierModule = module.get();
+        tierCalls.assign(module->subroutines.size(), 0);
+        tierLists.assign(module->subroutines.size(), nullptr);
+        {
+            std::lock_guard lock(module->handlerListMutex);
+            for (auto &&[index, list]: module->handlerLists) tierLists[index] = list.get();
+        }
         subroutine = activeSubroutines.reset();
         subroutine->module = module.get();
         //first is main
@@ -14,23 +51,81 @@ namespace tr::vm2 {
         subroutine->ip = module->subroutines[0].address;
         subroutine->initialSp = sp;
         subroutine->depth = 0;
+        variableIPs.clear();
+        budget = 0;
+        halting = false;
+        VM_TRACY(tracyExitAll())
+        VM_PROFILE_ROUTINE(begin(module.get()))
+        VM_PROFILE_ROUTINE(enter(module.get(), subroutine->subroutine))
     }
 
-    inline Type *use(Type *type) {
+    //immortal types can be shared by several VMs (see Prelude), so their refCount is neither read nor written
+    inline Type *VM::use(Type *type) {
 //        debug("use refCount={} {} ref={}", type->refCount, stringify(type), (void *) type);
-        type->refCount++;
+        if (!(type->flag & TypeFlag::Immortal)) type->refCount++;
         return type;
     }
 
+    //gives up ownership without collecting the type
+    inline void VM::unuse(Type *type) {
+        if (!(type->flag & TypeFlag::Immortal)) type->refCount--;
+    }
+
+    //only written if not set already, pinned prelude types are Stored from the start and stay untouched
+    inline void VM::markStored(Type *type) {
+        if (!(type->flag & TypeFlag::Stored)) type->flag |= TypeFlag::Stored;
+    }
+
     // TypeRef is an owning reference
-    TypeRef *useAsRef(Type *type, TypeRef *next = nullptr) {
-        type->refCount++;
+    TypeRef *VM::useAsRef(Type *type, TypeRef *next) {
+        use(type);
         return poolRef.construct(type, next);
     }
 
-    void addHashChild(Type *type, Type *child, unsigned int size) {
+    /**
+     * Appends `child` to the children of `type` that is being constructed and folds it into its hash.
+     * `current` is the last appended ref, nullptr for the first.
+     */
+    inline void VM::appendChildRef(Type *type, TypeRef *&current, Type *child) {
+        if (type->flag & TypeFlag::ChildrenArray) {
+            current = current ? current + 1 : (TypeRef *) type->type;
+            current->type = use(child);
+        } else if (current) {
+            current = current->next = useAsRef(child);
+        } else {
+            type->type = current = useAsRef(child);
+        }
+        hashChild(type, child);
+    }
+
+    //frees refs without touching the types they point to. arraySize is 0 for a linked list of single refs.
+    inline void VM::freeRefs(TypeRef *refs, unsigned int arraySize) {
+        if (arraySize) {
+            poolRefs.gc({refs, arraySize});
+            return;
+        }
+        while (refs) {
+            auto next = refs->next;
+            poolRef.gc(refs);
+            refs = next;
+        }
+    }
+
+    //releases the children of a composite type
+    inline void VM::gcChildRefs(Type *type) {
+        auto current = (TypeRef *) type->type;
+        while (current) {
+            auto next = current->next;
+            unuse(current->type);
+            gc(current->type);
+            current = next;
+        }
+        freeRefs((TypeRef *) type->type, type->flag & TypeFlag::ChildrenArray ? type->size : 0);
+    }
+
+    void VM::addHashChild(Type *type, Type *child, unsigned int size) {
         auto bucket = child->hash % size;
-        auto &entry = type->children[bucket];
+        auto &entry = type->children()[bucket];
         if (entry.type) {
             //hash collision, prepend the list
             entry.next = useAsRef(child, entry.next);
@@ -39,9 +134,9 @@ namespace tr::vm2 {
         }
     }
 
-    void addHashChildWithoutRefCounter(Type *type, Type *child, unsigned int size) {
+    void VM::addHashChildWithoutRefCounter(Type *type, Type *child, unsigned int size) {
         auto bucket = child->hash % size;
-        auto &entry = type->children[bucket];
+        auto &entry = type->children()[bucket];
         if (entry.type) {
             //hash collision, append the list
             entry.next = poolRef.construct(child, entry.next);
@@ -50,22 +145,51 @@ namespace tr::vm2 {
         }
     }
 
-    Type *allocate(TypeKind kind, uint64_t hash) {
+    Type *VM::allocate(TypeKind kind, uint64_t hash) {
+        VM_PROFILE_ROUTINE(allocations++)
         return pool.construct(kind, hash);
     }
 
-    std::span<TypeRef> allocateRefs(unsigned int size) {
+    std::span<TypeRef> VM::allocateRefs(unsigned int size) {
         return poolRefs.construct(size);
     }
 
-    inline void gcWithoutChildren(Type *type) {
+    /**
+     * Allocates the child refs of a composite type of known size in one block, so walking them is a linear scan.
+     * The refs are linked in order, so code walking `next` does not care about the representation.
+     */
+    void VM::allocateChildren(Type *type, unsigned int size) {
+        if (size == 0) return;
+        auto refs = allocateRefs(size);
+        for (unsigned int i = 0; i<size - 1; i++) refs[i].next = &refs[i + 1];
+        type->type = refs.data();
+        type->flag |= TypeFlag::ChildrenArray;
+    }
+
+    inline void VM::gcWithoutChildren(Type *type) {
         //just for debugging
         if (type->flag & TypeFlag::Deleted) {
             throw std::runtime_error("Type already deleted");
         }
         type->flag |= TypeFlag::Deleted;
+        garbage.push_back(type);
+    }
 
-        pool.gc(type);
+    /**
+     * Releases the children of all types in `garbage` and hands them to the pool, iteratively: children whose
+     * refCount drops to 0 are appended to `garbage` by gc() instead of being collected recursively.
+     */
+    void VM::gcDrain() {
+        if (draining) return;
+        draining = true;
+        while (!garbage.empty()) {
+            auto type = garbage.back();
+            garbage.pop_back();
+            gcChildren(type);
+            //only now, a full gcQueue would hand out its slot again
+            pool.gc(type);
+        }
+        draining = false;
     }
 
     //void gc(TypeRef *type) {
@@ -74,33 +198,28 @@ namespace tr::vm2 {
     //    poolRef.gc(type);
     //}
 
-    void gcFlush() {
+    void VM::gcFlush() {
+        gcDrain();
         pool.gcFlush();
         poolRef.gcFlush();
     }
 
-    void gc(Type *type) {
+    void VM::gc(Type *type) {
         //debug("gc refCount={} {} ref={}", type->refCount, stringify(type), (void *) type);
-        if (type->refCount>0) return;
+        if (type->refCount>0 || type->flag & TypeFlag::Immortal) return;
         gcWithoutChildren(type);
+        if (!deferGc || garbage.size()>=gcBatch) gcDrain();
+    }
 
+    //gives up the references `type` holds on its children and frees its refs, see gcDrain()
+    void VM::gcChildren(Type *type) {
         switch (type->kind) {
             case TypeKind::Function:
+            case TypeKind::Method:
             case TypeKind::Tuple:
-            case TypeKind::TemplateLiteral: {
-                auto current = (TypeRef *) type->type;
-                while (current) {
-                    auto next = current->next;
-                    current->type->refCount--;
-                    gc(current->type);
-                    current = next;
-                }
-
-                current = (TypeRef *) type->type;
-                while (current) {
-                    poolRef.gc(current);
-                    current = current->next;
-                }
+            case TypeKind::TemplateLiteral:
+            case TypeKind::ClassInstance: {
+                gcChildRefs(type);
                 break;
             }
             case TypeKind::MethodSignature:
@@ -111,8 +230,8 @@ namespace tr::vm2 {
                 poolRef.gc(nameRef);
                 poolRef.gc(propTypeRef);
 
-                nameRef->type->refCount--;
-                propTypeRef->type->refCount--;
+                unuse(nameRef->type);
+                unuse(propTypeRef->type);
 
                 gc(nameRef->type);
                 gc(propTypeRef->type);
@@ -121,22 +240,11 @@ namespace tr::vm2 {
             }
             case TypeKind::Union:
             case TypeKind::ObjectLiteral: {
-                auto current = (TypeRef *) type->type;
-                while (current) {
-                    auto next = current->next;
-                    current->type->refCount--;
-                    gc(current->type);
-                    current = next;
-                }
-
-                current = (TypeRef *) type->type;
-                while (current) {
-                    poolRef.gc(current);
-                    current = current->next;
-                }
+                gcChildRefs(type);
 
-                if (!type->children.empty()) {
-                    for (auto &&child: type->children) {
+                auto children = type->children();
+                if (!children.empty()) {
+                    for (auto &&child: children) {
                         //collision list needs to be GC, too
                         auto current = child.next;
                         while (current) {
@@ -145,29 +253,48 @@ namespace tr::vm2 {
                             current = next;
                         }
                     }
-                    poolRefs.gc(type->children);
+                    poolRefs.gc({children.data(), type->flag & TypeFlag::MemberHashes ? unionTableSize(type->size) : type->size});
+                }
+                break;
+            }
+            case TypeKind::Class: {
+                //the shared instance and the static hash map of all members, both hold references, see handleClass()
+                drop((Type *) type->type);
+                auto children = type->children();
+                if (!children.empty()) {
+                    for (auto &&child: children) {
+                        auto current = child.next;
+                        while (current) {
+                            auto next = current->next;
+                            drop(current->type);
+                            poolRef.gc(current);
+                            current = next;
+                        }
+                        drop(child.type);
+                    }
+                    poolRefs.gc(children);
                 }
                 break;
             }
             case TypeKind::Array:
             case TypeKind::Rest:
             case TypeKind::TupleMember: {
-                ((Type *) type->type)->refCount--;
+                unuse((Type *) type->type);
                 gc((Type *) type->type);
                 break;
             }
         }
     }
 
-    void drop(std::span<TypeRef> types) {
+    void VM::drop(std::span<TypeRef> types) {
         for (auto &&type: types) {
             drop(type.type);
         }
         poolRefs.gc(types);
     }
 
-    void drop(Type *type) {
-        if (type == nullptr) return;
+    void VM::drop(Type *type) {
+        if (type == nullptr || type->flag & TypeFlag::Immortal) return;
 
         if (type->refCount == 0) {
             debug("type {} not used already!", stringify(type));
@@ -181,13 +308,14 @@ namespace tr::vm2 {
         }
     }
 
-    void gcStackAndFlush() {
+    void VM::gcStackAndFlush() {
         gcStack();
+        gcDrain();
         pool.gcFlush();
         poolRef.gcFlush();
     }
 
-    void gcStack() {
+    void VM::gcStack() {
         for (unsigned int i = 0; i<sp; i++) {
             gc(stack[i]);
         }
@@ -203,14 +331,14 @@ namespace tr::vm2 {
         BigInt = 1<<5,
     };
 
-    inline Type *_widen(Type *type) {
+    inline Type *VM::_widen(Type *type) {
         //see https://github.com/Microsoft/TypeScript/pull/10676
         switch (type->kind) {
             case TypeKind::Literal: {
-                if (type->flag & TypeFlag::StringLiteral) return allocate(TypeKind::String, hash::const_hash("string"));
-                if (type->flag & TypeFlag::NumberLiteral) return allocate(TypeKind::Number, hash::const_hash("number"));
-                if (type->flag & TypeFlag::BooleanLiteral) return allocate(TypeKind::Boolean, hash::const_hash("boolean"));
-                if (type->flag & TypeFlag::BigIntLiteral) return allocate(TypeKind::BigInt, hash::const_hash("bigint"));
+                if (type->flag & TypeFlag::StringLiteral) return &immortal.string;
+                if (type->flag & TypeFlag::NumberLiteral) return &immortal.number;
+                if (type->flag & TypeFlag::BooleanLiteral) return &immortal.boolean;
+                if (type->flag & TypeFlag::BigIntLiteral) return &immortal.bigint;
                 throw std::runtime_error("Invalid literal to widen");
             }
             case TypeKind::Union: {
@@ -234,39 +362,45 @@ namespace tr::vm2 {
                     //widen each literal in the union.
                     //remove duplicates (like "12" | "23" => string | string => string)
                     unsigned int flag = 0;
-                    auto newUnion = allocate(TypeKind::Union, hash::const_hash("union"));
+                    auto newUnion = allocate(TypeKind::Union, seedHash(TypeKind::Union));
 
                     while (current) {
                         switch (current->type->kind) {
                             case TypeKind::Null:
                             case TypeKind::Undefined: {
                                 if (!(flag & TypeWidenFlag::Any)) {
-                                    newUnion->appendChild(useAsRef(allocate(TypeKind::Any)));
+                                    newUnion->appendChild(useAsRef(&immortal.any));
+                                    hashChild(newUnion, &immortal.any);
                                     flag |= TypeWidenFlag::Any;
                                 }
                                 break;
                             }
                             case TypeKind::Literal: {
                                 if (current->type->flag & TypeFlag::StringLiteral && !(flag & TypeWidenFlag::String)) {
-                                    newUnion->appendChild(useAsRef(allocate(TypeKind::String)));
+                                    newUnion->appendChild(useAsRef(&immortal.string));
+                                    hashChild(newUnion, &immortal.string);
                                     flag |= TypeWidenFlag::String;
                                 }
                                 if (current->type->flag & TypeFlag::NumberLiteral && !(flag & TypeWidenFlag::Number)) {
-                                    newUnion->appendChild(useAsRef(allocate(TypeKind::Number)));
+                                    newUnion->appendChild(useAsRef(&immortal.number));
+                                    hashChild(newUnion, &immortal.number);
                                     flag |= TypeWidenFlag::Number;
                                 }
                                 if (current->type->flag & TypeFlag::BooleanLiteral && !(flag & TypeWidenFlag::Boolean)) {
-                                    newUnion->appendChild(useAsRef(allocate(TypeKind::Boolean)));
+                                    newUnion->appendChild(useAsRef(&immortal.boolean));
+                                    hashChild(newUnion, &immortal.boolean);
                                     flag |= TypeWidenFlag::Boolean;
                                 }
                                 if (current->type->flag & TypeFlag::BigIntLiteral && !(flag & TypeWidenFlag::BigInt)) {
-                                    newUnion->appendChild(useAsRef(allocate(TypeKind::BigInt)));
+                                    newUnion->appendChild(useAsRef(&immortal.bigint));
+                                    hashChild(newUnion, &immortal.bigint);
                                     flag |= TypeWidenFlag::BigInt;
                                 }
                                 break;
                             }
                             default: {
                                 newUnion->appendChild(useAsRef(current->type));
+                                hashChild(newUnion, current->type);
                                 break;
                             };
                         }
@@ -281,7 +415,7 @@ namespace tr::vm2 {
         return type;
     }
 
-    inline Type *widen(Type *type) {
+    inline Type *VM::widen(Type *type) {
         auto widened = _widen(type);
         if (type == widened) {
             return type;
@@ -294,29 +428,47 @@ namespace tr::vm2 {
     /**
      * Unuse all cached types of subroutines and make them available for GC.
      */
-    void clear(shared<tr::vm2::Module> &module) {
+    void VM::clear(shared<tr::vm2::Module> &module) {
         for (auto &&subroutine: module->subroutines) {
             if (subroutine.result) drop(subroutine.result);
             if (subroutine.narrowed) drop(subroutine.narrowed);
         }
+        for (auto &&[hash, instantiation]: instantiations) {
+            for (auto &&argument: instantiation.arguments) drop(argument);
+            drop(instantiation.result);
+        }
+        instantiations.clear();
+        for (auto &&[hash, intersection]: intersections) {
+            for (auto &&operand: intersection.operands) drop(operand);
+            drop(intersection.result);
+        }
+        intersections.clear();
+        checkState.clear();
+        releaseMessages(*module);
         module->clear();
     }
 
-    inline void push(Type *type) {
-        stack[sp++] = type; //reinterpret_cast<Type *>(type);
+    inline void VM::push(Type *type) {
+        stack.ensure(sp + 1);
+        stack[sp++] = type;
     }
 
-    inline Type *pop() {
+    inline Type *VM::pop() {
         return stack[--sp];
     }
 
-    inline void popFrameWithoutGC() {
+    inline std::span<Type *> VM::pop(unsigned int size) {
+        sp -= size;
+        return {stack.data() + sp, size};
+    }
+
+    inline void VM::popFrameWithoutGC() {
         throw std::runtime_error("deprecated");
         //sp = subroutine->initialSp;
         //frame = frames.pop();
     }
 
-    inline std::span<Type *> popFrame() {
+    std::span<Type *> VM::popFrame() {
         throw std::runtime_error("deprecated");
         //auto start = subroutine->initialSp + subroutine->variables;
         //std::span<Type *> sub{stack.data() + start, sp - start};
@@ -331,20 +483,70 @@ namespace tr::vm2 {
         //return sub;
     }
 
-    inline void report(DiagnosticMessage message) {
+    inline void VM::report(DiagnosticMessage message) {
         message.module = subroutine->module;
-        message.module->errors.push_back(message);
+        auto &errors = message.module->errors;
+        if (budget && errors.size() >= budget) return;
+        //rendered after the run, until then neither collected nor modified in place
+        for (auto type: message.types) {
+            if (!type) continue;
+            use(type);
+            markStored(type);
+        }
+        errors.push_back(std::move(message));
+        //checked by process() on the next call or return, not per op
+        if (budget && errors.size() >= budget) halting = stopped = true;
+    }
+
+    void VM::finishMessages(shared<Module> &module) {
+        if (!deferMessages) {
+            module->renderErrors(&printer);
+            releaseMessages(*module);
+        } else if (unrendered.empty() || unrendered.back().lock() != module) {
+            unrendered.push_back(module);
+        }
+    }
+
+    void VM::renderMessages() {
+        for (auto &&module: unrendered) {
+            if (auto alive = module.lock()) {
+                alive->renderErrors(&printer);
+                releaseMessages(*alive);
+            }
+        }
+        unrendered.clear();
+    }
+
+    //gives up the references report() took on the types of the messages of `module`
+    void VM::releaseMessages(Module &module) {
+        for (auto &&e: module.errors) {
+            for (auto type: e.types) {
+                if (!type) continue;
+                //the last reference, nothing else keeps it as cache or value
+                if (!(type->flag & TypeFlag::Immortal) && type->refCount == 1) type->flag &= ~TypeFlag::Stored;
+                drop(type);
+            }
+            e.types = {};
+        }
+    }
+
+    //drops all frames of a run that reached its error budget
+    void VM::stop() {
+        gcStackAndFlush();
+        subroutine = activeSubroutines.reset();
+        loops.reset();
+        VM_TRACY(tracyExitAll())
     }
 
-    inline void report(const string &message, Type *node) {
+    inline void VM::report(const string &message, Type *node) {
         report(DiagnosticMessage(message, node->ip));
     }
 
-    inline void report(const string &message) {
+    inline void VM::report(const string &message) {
         report(DiagnosticMessage(message, subroutine->ip));
     }
 
-    inline void report(const string &message, unsigned int ip) {
+    inline void VM::report(const string &message, unsigned int ip) {
         report(DiagnosticMessage(message, ip));
     }
 
@@ -358,8 +560,178 @@ namespace tr::vm2 {
 //        frame = next;
 //    }
 
+    /**
+     * Whether the result of `routine` only depends on its type arguments, so that VM::call can cache it by arguments.
+     * Rejects subroutines that report, narrow, read variables of outer frames, or call something that does.
+     */
+    bool VM::isMemoizable(ModuleSubroutine *routine) {
+        if (routine->memoize != MemoizeState::Unknown) return routine->memoize == MemoizeState::Cacheable;
+        //pessimistic while scanning, so (mutually) recursive subroutines are not cached
+        routine->memoize = MemoizeState::Uncacheable;
+
+        auto module = subroutine->module;
+        const auto &bin = module->bin;
+        for (unsigned int ip = routine->address; ip < bin.size(); ip++) {
+            const auto op = (OP) bin[ip];
+            switch (op) {
+                case OP::Return: {
+                    routine->memoize = MemoizeState::Cacheable;
+                    return true;
+                }
+                case OP::Loads:
+                case OP::LoadsIndexAccess: {
+                    if (vm::readUint16(bin, ip + 1) != 0) return false;
+                    break;
+                }
+                case OP::Call:
+                case OP::TailCall:
+                case OP::TypeArgumentDefault: {
+                    if (!isMemoizable(module->getSubroutine(vm::readUint32(bin, ip + 1)))) return false;
+                    break;
+                }
+                case OP::Error:
+                case OP::Set:
+                case OP::Assign:
+                case OP::Instantiate:
+                case OP::New:
+                case OP::CallExpression:
+                case OP::TypeArgumentConstraint:
+                case OP::CheckBody:
+                case OP::InferBody:
+                case OP::ReturnStatement:
+                case OP::UnwrapInferBody:
+                case OP::SelfCheck: {
+                    return false;
+                }
+            }
+            vm::eatParams(op, &ip);
+        }
+        return false;
+    }
+
+    /**
+     * How many frames above its own `routine` reads variables of, directly or through the subroutines it calls.
+     * Variables are found by frame offset, so a callee reading n frames up reads n - 1 frames above its caller.
+     */
+    unsigned int VM::outerFrames(ModuleSubroutine *routine) {
+        if (routine->outerFrames >= 0) return routine->outerFrames;
+        //recursive calls add nothing
+        routine->outerFrames = 0;
+
+        auto module = subroutine->module;
+        const auto &bin = module->bin;
+        unsigned int result = 0;
+        for (unsigned int ip = routine->address; ip < bin.size(); ip++) {
+            const auto op = (OP) bin[ip];
+            switch (op) {
+                case OP::Return: {
+                    routine->outerFrames = result;
+                    return result;
+                }
+                case OP::Loads:
+                case OP::LoadsIndexAccess: {
+                    result = std::max<unsigned int>(result, vm::readUint16(bin, ip + 1));
+                    break;
+                }
+                case OP::Call:
+                case OP::TailCall:
+                case OP::TypeArgumentDefault:
+                case OP::CheckBody:
+                case OP::InferBody:
+                case OP::SelfCheck:
+                case OP::FunctionRef:
+                case OP::ClassRef: {
+                    auto callee = outerFrames(module->getSubroutine(vm::readUint32(bin, ip + 1)));
+                    if (callee>1) result = std::max(result, callee - 1);
+                    break;
+                }
+            }
+            vm::eatParams(op, &ip);
+        }
+        routine->outerFrames = result;
+        return result;
+    }
+
+    /**
+     * Whether the type inferred from the function body `body` (OP::InferBody) can be kept in its ModuleSubroutine::result
+     * for all further calls. Not if it reads a frame with type arguments, e.g. `return a` of `function f<T>(a: T)`,
+     * each instantiation infers its own then.
+     */
+    bool VM::isInferenceCacheable(ModuleSubroutine *body) {
+        auto frames = outerFrames(body);
+        //the body frame is pushed on top of the current one, so its frame offset 1 is the current one
+        for (unsigned int i = 0; i<frames && i<=activeSubroutines.index(); i++) {
+            auto frame = activeSubroutines.at(activeSubroutines.index() - i);
+            //an InferBody frame's first type argument only collects its return statements
+            if (frame->typeArguments > (frame->flags & SubroutineFlag::InferBody ? 1 : 0)) return false;
+        }
+        return true;
+    }
+
+    //hash of routine<arguments> with the arguments being the top of the stack
+    uint64_t VM::instantiationHash(ModuleSubroutine *routine, unsigned int arguments) {
+        auto hash = hash::combine(0, (uint64_t) routine);
+        for (unsigned int i = 0; i<arguments; i++) {
+            hash = hash::combine(hash, structuralHash(stack[sp - arguments + i]));
+        }
+        return hash;
+    }
+
+    Type *VM::findInstantiation(ModuleSubroutine *routine, unsigned int arguments, uint64_t hash) {
+        auto [begin, end] = instantiations.equal_range(hash);
+        for (auto it = begin; it != end; ++it) {
+            auto &instantiation = it->second;
+            if (instantiation.routine != routine || instantiation.generation != subroutine->module->generation || instantiation.arguments.size() != arguments) continue;
+            bool same = true;
+            for (unsigned int i = 0; same && i<arguments; i++) {
+                same = isSameType(instantiation.arguments[i], stack[sp - arguments + i]);
+            }
+            if (same) return instantiation.result;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Looks up routine<arguments> in instantiations. On a hit the arguments on the stack are replaced by the cached result
+     * and true is returned. Otherwise `hash` is set to the key when the call can be cached, so the caller marks the new frame with
+     * SubroutineFlag::Memoize and OP::Return stores its result.
+     */
+    bool VM::memoize(ModuleSubroutine *routine, unsigned int arguments, uint64_t &hash) {
+        hash = 0;
+        if (!arguments || instantiations.size() >= instantiationCacheSize || !isMemoizable(routine)) return false;
+
+        auto key = instantiationHash(routine, arguments);
+        if (auto result = findInstantiation(routine, arguments, key)) {
+            //arguments are not used yet (that happens in pushSubroutine), so they are collected if nothing else holds them
+            for (unsigned int i = 0; i<arguments; i++) gc(stack[sp - i - 1]);
+            sp -= arguments;
+            push(result);
+            return true;
+        }
+
+        //only arguments something else keeps alive (a subroutine result, immortals) become part of a key, so the cache
+        //neither extends their lifetime nor has to protect them from OP::RestReuse
+        for (unsigned int i = 0; i<arguments; i++) {
+            if (!(stack[sp - i - 1]->flag & (TypeFlag::Stored | TypeFlag::Immortal))) return false;
+        }
+        hash = key;
+        return false;
+    }
+
+    //Called in OP::Return of a frame with SubroutineFlag::Memoize, the result is on top of the stack.
+    void VM::storeInstantiation() {
+        if (instantiations.size() >= instantiationCacheSize) return;
+        Instantiation instantiation{subroutine->subroutine, {}, use(stack[sp - 1]), subroutine->module->generation};
+        markStored(instantiation.result);
+        instantiation.arguments.reserve(subroutine->arguments);
+        for (unsigned int i = 0; i<subroutine->arguments; i++) {
+            instantiation.arguments.push_back(use(stack[subroutine->initialSp + i]));
+        }
+        instantiations.emplace(subroutine->instantiation, std::move(instantiation));
+    }
+
     //Returns true if it actually jumped to another subroutine, false if it just pushed its cached type.
-    inline bool tailCall(unsigned int address, unsigned int arguments) {
+    inline bool VM::tailCall(unsigned int address, unsigned int arguments) {
         auto routine = subroutine->module->getSubroutine(address);
         if (routine->narrowed) {
             push(routine->narrowed);
@@ -369,6 +741,8 @@ namespace tr::vm2 {
             push(routine->result);
             return false;
         }
+        uint64_t instantiation;
+        if (memoize(routine, arguments, instantiation)) return false;
 
         //first make sure all arguments get refCount++ so they won't be GC in next step
         for (unsigned int i = 0; i<arguments; i++) {
@@ -402,15 +776,25 @@ namespace tr::vm2 {
         subroutine->ip = routine->address;
         subroutine->module = subroutine->module;
         subroutine->subroutine = routine;
+        VM_PROFILE_ROUTINE(exit())
+        VM_PROFILE_ROUTINE(enter(subroutine->module, routine))
         subroutine->depth = subroutine->depth + 1;
         subroutine->typeArguments = 0;
+        subroutine->arguments = arguments;
+        //a pending instantiation of the replaced subroutine is lost, its arguments are gone
+        subroutine->flags &= ~SubroutineFlag::Memoize;
+        if (instantiation) {
+            subroutine->flags |= SubroutineFlag::Memoize;
+            subroutine->instantiation = instantiation;
+        }
+        tierUp(routine);
 
         //debug("[{}] TailCall", subroutine->ip - 4 - 2);
         //printStack();
         return true;
     }
 
-    inline ActiveSubroutine *pushSubroutine(ModuleSubroutine *routine, unsigned int arguments) {
+    inline ActiveSubroutine *VM::pushSubroutine(ModuleSubroutine *routine, unsigned int arguments) {
         if (!routine) throw std::runtime_error("no routine given");
         auto nextSubroutine = activeSubroutines.push(); //&activeSubroutines[++activeSubroutineIdx];
         //important to reset necessary stuff, since we reuse
@@ -419,17 +803,48 @@ namespace tr::vm2 {
         nextSubroutine->subroutine = routine;
         nextSubroutine->depth = subroutine->depth + 1;
         nextSubroutine->typeArguments = 0;
+        nextSubroutine->arguments = arguments;
         nextSubroutine->variables = 0;
+        nextSubroutine->flags = 0;
         subroutine = nextSubroutine;
+        VM_PROFILE_ROUTINE(enter(subroutine->module, routine))
+        VM_TRACY(tracyEnter(routine))
 
         //we move x arguments from the old stack frame to the new one
         subroutine->initialSp = sp - arguments;
         for (unsigned int i = 0; i<arguments; i++) {
             use(stack[subroutine->initialSp + i]);
         }
+        return subroutine;
+    }
+
+    Type *VM::call(shared<Module> &module, unsigned int index, unsigned int arguments) {
+        sp -= arguments;
+        prepare(module);
+        sp += arguments;
+        //main waits on its final OP::Return, which ends process() once the routine returned to it
+        unsigned int mainEnd = module->bin.size();
+        for (auto &&routine: module->subroutines) {
+            if (routine.address > subroutine->ip && routine.address < mainEnd) mainEnd = routine.address;
+        }
+        subroutine->ip = mainEnd - 1;
+        pushSubroutine(module->getSubroutine(index), arguments);
+        process();
+        finishMessages(module);
+        return pop();
+    }
+
+    Type *VM::resolveExport(shared<Module> &module, string_view name) {
+        parseHeader(module);
+        for (unsigned int i = 0; i < module->subroutines.size(); i++) {
+            auto &routine = module->subroutines[i];
+            if (!routine.exported || routine.name != name) continue;
+            return routine.result ? routine.result : call(module, i);
+        }
+        return nullptr;
     }
 
-    inline bool call(unsigned int address, unsigned int arguments) {
+    inline bool VM::call(unsigned int address, unsigned int arguments) {
         auto routine = subroutine->module->getSubroutine(address);
         if (routine->narrowed) {
             push(routine->narrowed);
@@ -439,9 +854,16 @@ namespace tr::vm2 {
             push(routine->result);
             return false;
         }
+        uint64_t instantiation;
+        if (memoize(routine, arguments, instantiation)) return false;
 
         subroutine->ip++;
         pushSubroutine(routine, arguments);
+        if (instantiation) {
+            subroutine->flags |= SubroutineFlag::Memoize;
+            subroutine->instantiation = instantiation;
+        }
+        tierUp(routine);
         return true;
     }
 
@@ -458,12 +880,12 @@ namespace tr::vm2 {
         return i;
     }
 
-    Type *resolveObjectIndexType(Type *object, Type *index) {
+    Type *VM::resolveObjectIndexType(Type *object, Type *index) {
         switch (index->kind) {
             case TypeKind::Literal: {
                 auto member = findChild(object, index->hash);
                 if (!member) {
-                    return allocate(TypeKind::Never);
+                    return &immortal.never;
                 }
                 switch (member->kind) {
                     case TypeKind::Method:
@@ -471,13 +893,15 @@ namespace tr::vm2 {
                     case TypeKind::Property:
                     case TypeKind::PropertySignature: {
                         if (object->kind == TypeKind::Class && !(member->flag & TypeFlag::Static)) break;
+                        //the shape found it by the hash of its name already
+                        if (object->kind != TypeKind::Class && object->shape) return member;
                         auto first = (TypeRef *) member->type;
                         //first->type == index compares unique symbol equality
                         if (first->type == index || first->type->hash == index->hash) return member;
                         break;
                     }
                 }
-                return allocate(TypeKind::Never);
+                return &immortal.never;
             }
             case TypeKind::Number:
             case TypeKind::BigInt:
@@ -495,9 +919,11 @@ namespace tr::vm2 {
                     }
                     current = current->next;
                 }
-                return allocate(TypeKind::Never);
+                return &immortal.never;
             }
         }
+        //only literal and primitive indices are passed, anything else has no member either
+        return &immortal.never;
     }
 
     /**
@@ -512,17 +938,33 @@ namespace tr::vm2 {
      */
     inline uint64_t lengthHash = hash::const_hash("length");
 
-    inline Type *indexAccess(Type *container, Type *index) {
+    //`length` of a tuple, short tuples get an interned literal of ImmortalTypes
+    inline Type *VM::lengthOf(Type *tuple) {
+        if (auto literal = immortal.numberLiteral(tuple->size)) return literal;
+        auto t = allocate(TypeKind::Literal);
+        t->setDynamicLiteral(strings, TypeFlag::NumberLiteral, std::to_string(tuple->size));
+        return t;
+    }
+
+    inline Type *VM::indexAccess(Type *container, Type *index) {
         switch (container->kind) {
             case TypeKind::Array: {
                 throw std::runtime_error("Not implemented");
                 break;
             }
             case TypeKind::Tuple: {
-                if (index->hash == lengthHash) {
-                    auto t = allocate(TypeKind::Literal);
-                    t->setDynamicLiteral(TypeFlag::NumberLiteral, std::to_string(container->size));
-                    return t;
+                if (index->hash == lengthHash) return lengthOf(container);
+                if (index->kind == TypeKind::Literal && index->flag & TypeFlag::NumberLiteral) {
+                    //number literals carry their canonical text (formatNumber()), so `T[0]`, `T[0.0]` and `T[0x0]` are the same
+                    auto position = parseNumber(index->text());
+                    auto current = (TypeRef *) container->type;
+                    for (unsigned int i = 0; current; i++, current = current->next) {
+                        auto member = (Type *) current->type->type;
+                        //members after a rest element have no fixed position
+                        if (member->kind == TypeKind::Rest) throw std::runtime_error("Not implemented");
+                        if (i == position) return member;
+                    }
+                    return &immortal.undefined;
                 }
                 throw std::runtime_error("Not implemented");
                 break;
@@ -555,7 +997,7 @@ namespace tr::vm2 {
                         break;
                     }
                     default: {
-                        return allocate(TypeKind::Never);
+                        return &immortal.never;
                     }
                 }
             }
@@ -564,11 +1006,7 @@ namespace tr::vm2 {
 //            if ((index.kind == TypeKind::literal && 'number' == typeof index.literal) || index.kind == TypeKind::number) return container.type;
 //            if (index.kind == TypeKind::literal && index.literal == 'length') return { kind: TypeKind::number };
         } else if (container->kind == TypeKind::Tuple) {
-            if (index->hash == lengthHash) {
-                auto t = allocate(TypeKind::Literal);
-                t->setDynamicLiteral(TypeFlag::NumberLiteral, std::to_string(container->size));
-                return t;
-            }
+            if (index->hash == lengthHash) return lengthOf(container);
 
 //            if (index.kind == TypeKind::literal && 'number' == typeof index.literal && index.literal < 0) {
 //                index = { kind: TypeKind::number };
@@ -653,12 +1091,12 @@ namespace tr::vm2 {
 //        } else if (container.kind == TypeKind::any) {
 //            return container;
         }
-        return allocate(TypeKind::Never); //make_shared<TypeNever>();
+        return &immortal.never; //make_shared<TypeNever>();
     }
 
-    void handleTemplateLiteral() {
+    void VM::handleTemplateLiteral() {
         auto size = subroutine->parseUint16();
-        auto types = subroutine->pop(size);
+        auto types = pop(size);
 
         //short path for `{'asd'}`
         auto first = types[0];
@@ -684,53 +1122,85 @@ namespace tr::vm2 {
             }
         }
 
-        CartesianProduct cartesian;
+        CartesianProduct cartesian(*this);
         for (auto &&type: types) {
             cartesian.add(type);
         }
-        auto product = cartesian.calculate();
-
-        auto result = allocate(TypeKind::Union);
-        for (auto &&combination: product) {
-            auto templateType = allocate(TypeKind::TemplateLiteral);
-            bool hasPlaceholder = false;
-//                let lastLiteral: { kind: TypeKind::literal, literal: string, parent?: Type } | undefined = undefined;
-            Type *lastLiteral = nullptr;
+        if (cartesian.size()>templateLiteralLimit) {
+            report("Expression produces a union type that is too complex to represent.");
+            for (auto &&type: types) gc(type);
+            push(&immortal.any);
+            return;
+        }
 
+        auto result = allocate(TypeKind::Union, seedHash(TypeKind::Union));
+        TypeRef *last = nullptr;
+        //structural hashes of the members of result, so that each is added once
+        std::unordered_set<uint64_t> members;
+        auto add = [&](Type *member) {
+            if (!members.insert(structuralHash(member)).second) return false;
+            appendChildRef(result, last, member);
+            result->size++;
+            return true;
+        };
+        auto literal = [this](string_view text) {
+            return allocate(TypeKind::Literal)->setLiteral(TypeFlag::StringLiteral, text);
+        };
+
+        while (cartesian.next()) {
             //merge a combination of types, e.g. [string, 'abc', '3'] as template literal => `${string}abc3`.
-            for (auto &&item: combination) {
+            //Adjacent literals are joined in `text`, a TemplateLiteral is only allocated when there is a placeholder.
+            Type *templateType = nullptr;
+            TypeRef *current = nullptr;
+            string_view text;
+            auto hasText = false;
+            auto skip = false;
+            auto part = [&](Type *child) {
+                appendChildRef(templateType, current, child);
+                templateType->size++;
+            };
+
+            for (auto &&item: cartesian.row()) {
                 if (item->kind == TypeKind::Never) {
                     //template literals that contain a never like `prefix.${never}` are completely ignored
-                    goto next;
+                    skip = true;
+                    break;
                 }
 
-                if (item->kind == TypeKind::Literal) {
-                    if (lastLiteral) {
-                        lastLiteral->appendLiteral(item);
-                    } else {
-                        lastLiteral = allocate(TypeKind::Literal);
-                        lastLiteral->setLiteral(TypeFlag::StringLiteral, item->text);
-                        templateType->appendChild(useAsRef(lastLiteral));
-                    }
-                } else {
-                    hasPlaceholder = true;
-                    lastLiteral = nullptr;
-                    templateType->appendChild(useAsRef(item));
+                if (item->kind == TypeKind::Literal || item->kind == TypeKind::Null || item->kind == TypeKind::Undefined) {
+                    string_view value = item->kind == TypeKind::Null ? "null" : item->kind == TypeKind::Undefined ? "undefined"
+                        : item->flag & TypeFlag::True ? "true" : item->flag & TypeFlag::False ? "false" : item->text();
+                    text = hasText ? strings.append(text, value) : value;
+                    hasText = true;
+                    continue;
                 }
+
+                if (!templateType) templateType = allocate(TypeKind::TemplateLiteral, seedHash(TypeKind::TemplateLiteral));
+                if (hasText) part(literal(text));
+                hasText = false;
+                part(item);
             }
 
-            if (hasPlaceholder) {
+            if (skip) {
+                if (templateType) gc(templateType);
+                continue;
+            }
+
+            if (!templateType) {
+                //only literals
+                auto member = literal(text);
+                if (!add(member)) gc(member);
+                continue;
+            }
+            if (hasText) part(literal(text));
+
+            if (templateType->singleChild() && templateType->child()->kind == TypeKind::String) {
                 // `${string}` -> string
-                if (templateType->singleChild() && templateType->child()->kind == TypeKind::String) {
-                    result->appendChild(useAsRef(templateType->child()));
-                    gc(templateType);
-                } else {
-                    result->appendChild(useAsRef(templateType));
-                }
-            } else if (lastLiteral) {
-                result->appendChild(useAsRef(lastLiteral));
+                add(templateType->child());
+                gc(templateType);
+            } else {
+                if (!add(templateType)) gc(templateType);
             }
-            next:;
         }
 
 //        auto t = vm::unboxUnion(result);
@@ -739,7 +1209,7 @@ namespace tr::vm2 {
         push(result);
     }
 
-    void printStack() {
+    void VM::printStack() {
         debug("");
         debug("~~~~~~~~~~~~~~~");
         debug("Stack sp={}", sp);
@@ -785,128 +1255,891 @@ namespace tr::vm2 {
         debug("");
     }
 
-    inline void print(Type *type, char *title = "") {
-        debug("[{}] {} refCount={} {} ref={}", subroutine->ip, title, type->refCount, stringify(type), (void *) type);
+    inline void VM::print(Type *type, const char *title) {
+        debug("[{}] {} refCount={} {} ref={}", subroutine->ip, title, type->refCount, printer.print(type), (void *) type);
     }
 
-    Type *handleFunction(TypeKind kind) {
+    Type *VM::handleFunction(TypeKind kind) {
         const auto size = subroutine->parseUint16();
 
         auto name = pop();
         auto type = allocate(kind, name->hash);
-        //first is the name
+        auto types = pop(size);
+
+        //first is the name, second is always the return type, followed by the parameters
+        type->size = size + 1;
+        allocateChildren(type, type->size);
+        TypeRef *current = nullptr;
+        appendChildRef(type, current, name);
+        for (auto &&v: types) appendChildRef(type, current, v);
+
+        //methods are looked up by name, function types are compared by signature
+        if (kind != TypeKind::Function) type->hash = name->hash;
+        push(type);
+        return type;
+    }
+
+    inline void VM::handleOptional() {
+        auto type = stack[sp - 1];
+        if (type->flag & TypeFlag::Optional) return;
+        type->flag |= TypeFlag::Optional;
+        //property signatures derive their structural hash from the flag, see structuralHash()
+        if (type->kind == TypeKind::TupleMember) type->hash = hash::combine(type->hash, hash::const_hash("?"));
+    }
+
+    inline Type *VM::loads(unsigned int frameOffset, unsigned int varIndex) {
+        if (frameOffset == 0) return stack[subroutine->initialSp + varIndex];
+        return stack[activeSubroutines.at(activeSubroutines.index() - frameOffset)->initialSp + varIndex];
+    }
+
+    inline void VM::handleLoads(unsigned int frameOffset, unsigned int varIndex) {
+        push(loads(frameOffset, varIndex));
+    }
+
+    inline void VM::handleTypeArgument() {
+        if (frameSize(subroutine)<=subroutine->typeArguments) {
+            //all variables will be dropped at the end of the subroutine
+            push(use(&immortal.unknown));
+        } else {
+            //for provided argument we do not increase refCount, because it's the caller's job
+            //check constraints
+        }
+        subroutine->typeArguments++;
+        subroutine->variables++;
+    }
+
+    inline void VM::handlePropertySignature() {
+        auto name = pop();
+        auto propertyType = pop();
+        //PropertySignature has a linked list of name->type
+        auto type = allocate(TypeKind::PropertySignature);
         type->type = useAsRef(name);
+        ((TypeRef *) type->type)->next = useAsRef(propertyType);
+        type->hash = name->hash;
+        push(type);
+    }
 
-        auto types = subroutine->pop(size);
-        auto current = (TypeRef *) type->type;
+    inline void VM::handleObjectLiteral(unsigned int size) {
+        auto type = allocate(TypeKind::ObjectLiteral, seedHash(TypeKind::ObjectLiteral));
+        if (!size) {
+            push(type);
+            return;
+        }
 
-        //second is always the return type
-        current->next = useAsRef(types[0]);
-        current = current->next;
+        type->size = size;
+        auto types = pop(size);
+
+        //with a spread the member count is only known while resolving it, so those stay a linked list
+        bool spread = false;
+        for (auto &&member: types) spread |= member->kind == TypeKind::Rest;
+        if (!spread) allocateChildren(type, size);
+
+        TypeRef *current = nullptr;
+        for (auto &&member: types) {
+            if (member->kind == TypeKind::Rest) {
+                //todo: check if ObjectLiteral, otherwise report error
+                forEachChild(member, [this, &type, &current](Type *child, auto) {
+                    appendChildRef(type, current, child);
+                });
+                gc(member);
+            } else {
+                appendChildRef(type, current, member);
+            }
+        }
 
-        if (types.size()>1) {
-            for_each(++types.begin(), types.end(), [&current](auto v) {
-                current->next = useAsRef(v);
-                current = current->next;
-            });
-            current->next = nullptr;
+        if (!spread) {
+            auto &keys = shapeKeys;
+            keys.clear();
+            for (auto &&member: types) keys.push_back(member->hash);
+            type->shape = shapes.intern(keys);
+        }
+        push(type);
+    }
+
+    /**
+     * The union of `types`, which are owned by nobody but the caller (e.g. just popped), in their order. Members of
+     * nested unions are inlined, never and duplicates (by structural hash) are dropped, and so are literals whose
+     * widened primitive is a member as well: 'a' | string is string. Dropped types are collected.
+     *
+     * A single remaining member is returned as is, none is never. The result is not used by anyone.
+     */
+    Type *VM::unionOf(std::span<Type *> types) {
+        auto &members = unionMembers;
+        members.clear();
+        //widened primitives among the members
+        bool hasString = false, hasNumber = false, hasBoolean = false, hasBigint = false;
+        auto collect = [&](Type *member) {
+            switch (member->kind) {
+                case TypeKind::Never: return;
+                case TypeKind::String: hasString = true; break;
+                case TypeKind::Number: hasNumber = true; break;
+                case TypeKind::Boolean: hasBoolean = true; break;
+                case TypeKind::BigInt: hasBigint = true; break;
+            }
+            members.push_back(member);
+        };
+        for (auto &&child: types) {
+            if (child->kind == TypeKind::Union) {
+                forEachChild(child, [&collect](Type *member, auto) { collect(member); });
+            } else {
+                collect(child);
+            }
+        }
+
+        //small unions compare linearly, big ones through a set
+        auto &hashes = unionHashes;
+        hashes.clear();
+        auto big = members.size()>16;
+        if (big) unionSeen.clear();
+        unsigned int count = 0;
+        for (auto &&member: members) {
+            if (member->kind == TypeKind::Literal) {
+                if (hasString && member->flag & TypeFlag::StringLiteral) continue;
+                if (hasNumber && member->flag & TypeFlag::NumberLiteral) continue;
+                if (hasBoolean && member->flag & (TypeFlag::True | TypeFlag::False)) continue;
+                if (hasBigint && member->flag & TypeFlag::BigIntLiteral) continue;
+            } else if (member->kind == TypeKind::TemplateLiteral && hasString) {
+                continue;
+            }
+            auto hash = structuralHash(member);
+            if (big ? !unionSeen.insert(hash).second : std::find(hashes.begin(), hashes.end(), hash) != hashes.end()) continue;
+            hashes.push_back(hash);
+            members[count++] = member;
+        }
+        members.resize(count);
+
+        if (count<=1) {
+            auto result = count ? members[0] : &immortal.never;
+            //nested unions and dropped members go, the result stays. With deferGc they would only release their
+            //reference on result in a later gcDrain(), which would then collect result while it is on the stack
+            use(result);
+            for (auto &&child: types) gc(child);
+            if (deferGc) gcDrain();
+            unuse(result);
+            return result;
+        }
+
+        auto type = allocate(TypeKind::Union, seedHash(TypeKind::Union));
+        type->size = count;
+        allocateChildren(type, count);
+        TypeRef *current = nullptr;
+        auto literals = true;
+        for (auto &&member: members) {
+            appendChildRef(type, current, member);
+            literals &= member->kind == TypeKind::Literal;
+        }
+        for (auto &&child: types) gc(child);
+        if (literals) type->flag |= TypeFlag::LiteralMembers;
+
+        if (count>5) {
+            //the buckets, then Type::hash of each member for simd::findHash(), see Type::memberHashes()
+            type->table = allocateRefs(unionTableSize(count)).data();
+            type->flag |= TypeFlag::MemberHashes;
+            auto hashes = (uint64_t *) (type->table + count);
+            unsigned int i = 0;
+            auto ref = (TypeRef *) type->type;
+            while (ref) {
+                addHashChildWithoutRefCounter(type, ref->type, count);
+                hashes[i++] = ref->type->hash;
+                ref = ref->next;
+            }
         }
-        stack[sp++] = type;
         return type;
     }
 
-    inline auto start = std::chrono::high_resolution_clock::now();
-    //string_view frameName;
-    void process() {
-        ZoneScoped;
-        start:
-        auto &bin = subroutine->module->bin;
-        while (true) {
-            ZoneScoped;
-            //std::chrono::duration<double, std::milli> took = std::chrono::high_resolution_clock::now() - start;
-            //fmt::print(" - took {:.9f}ms\n", took.count());
-            //start = std::chrono::high_resolution_clock::now();
-            //fmt::print("[{}:{}] OP {} {}\n", subroutine->depth, subroutine->depth, subroutine->ip, (OP) bin[subroutine->ip]);
-            //auto frameName = new string_view(fmt::format("[{}] {}", subroutine->ip, (OP) bin[subroutine->ip]));
-            //ZoneName(frameName->begin(), frameName->size());
+    inline void VM::handleUnion(unsigned int size) {
+        if (!size) {
+            push(allocate(TypeKind::Union, seedHash(TypeKind::Union)));
+            return;
+        }
+        push(unionOf(pop(size)));
+    }
 
-            auto ip = subroutine->ip;
-            auto op = (OP) bin[subroutine->ip];
-            switch (op) {
-                case OP::Halt: {
-//                    subroutine = activeSubroutines.reset();
-//                    frame = frames.reset();
-//                    gcStack();
-//                    gcFlush();
-//                    printStack();
-                    return;
-                }
-                case OP::Error: {
-                    auto ip = subroutine->ip;
-                    const auto code = (instructions::ErrorCode) subroutine->parseUint16();
-                    switch (code) {
-                        case instructions::ErrorCode::CannotFind: {
-                            report(DiagnosticMessage(fmt::format("Cannot find name '{}'", subroutine->module->findIdentifier(ip)), ip));
-                            break;
-                        }
-                        default: {
-                            report(DiagnosticMessage(fmt::format("{}", code), ip));
-                        }
-                    }
-                    break;
+    //primitives and their literals, which `&` narrows to the most narrow one instead of merging
+    inline bool isNarrowable(Type *type) {
+        switch (type->kind) {
+            case TypeKind::Null:
+            case TypeKind::Undefined:
+            case TypeKind::String:
+            case TypeKind::Number:
+            case TypeKind::BigInt:
+            case TypeKind::Boolean:
+            case TypeKind::Symbol:
+            case TypeKind::Literal:
+            case TypeKind::TemplateLiteral: return true;
+        }
+        return false;
+    }
+
+    //types with exactly one value, members of those are discriminants
+    inline bool isUnitType(Type *type) {
+        return type->kind == TypeKind::Literal || type->kind == TypeKind::Null || type->kind == TypeKind::Undefined;
+    }
+
+    /**
+     * The property `left & right` with the same name, its type being the intersection of both. Nobody uses the result.
+     * `left` is collected, it is either a member of an operand or the result of an earlier call.
+     */
+    Type *VM::intersectProperties(Type *left, Type *right) {
+        Type *types[] = {getPropertyOrMethodType(left), getPropertyOrMethodType(right)};
+        auto name = getPropertyOrMethodName(left);
+        auto type = allocate(TypeKind::PropertySignature);
+        type->type = useAsRef(name);
+        ((TypeRef *) type->type)->next = useAsRef(intersect(types));
+        type->hash = name->hash;
+        type->flag |= (left->flag & right->flag & TypeFlag::Optional) | ((left->flag | right->flag) & TypeFlag::Readonly);
+        gc(left);
+        return type;
+    }
+
+    /**
+     * Intersection of `types`, which stay untouched. Nobody uses the result, it is either new or one of `types`
+     * (or their members).
+     *
+     *  - never wins, then any, unknown is dropped and nothing left is unknown
+     *  - unions distribute: (a | b) & c is (a & c) | (b & c)
+     *  - primitives narrow to the most narrow one: string & 'a' is 'a', string & number is never
+     *  - object literals merge into one with a new shape, members of the same name intersect. A discriminant that
+     *    becomes never makes the whole intersection never, {kind: 'a'} & {kind: 'b'} is never.
+     *
+     * Intersections that have no type of their own yet resolve to their most specific operand: a primitive
+     * (null & {} is never, branded string & {__brand: 'x'} is string), then a tuple, function, class, ... and the
+     * object literals are dropped.
+     */
+    Type *VM::intersect(std::span<Type *> types) {
+        for (unsigned int i = 0; i<types.size(); i++) {
+            if (types[i]->kind != TypeKind::Union) continue;
+            vector<Type *> operands(types.begin(), types.end());
+            vector<Type *> results;
+            results.reserve(types[i]->size);
+            forEachChild(types[i], [this, i, &operands, &results](Type *member, auto) {
+                operands[i] = member;
+                results.push_back(intersect(operands));
+            });
+            return unionOf(results);
+        }
+
+        bool any = false;
+        Type *primitive = nullptr;
+        Type *other = nullptr;
+        Type *object = nullptr;
+        unsigned int objects = 0;
+        for (auto &&type: types) {
+            switch (type->kind) {
+                case TypeKind::Never: return &immortal.never;
+                case TypeKind::Any: any = true; continue;
+                case TypeKind::Unknown: continue;
+                case TypeKind::ObjectLiteral: {
+                    //{} adds nothing
+                    if (!type->size) continue;
+                    if (!object || !isSameType(object, type)) objects++;
+                    object = type;
+                    continue;
                 }
-                case OP::Pop: {
-                    auto type = pop();
-                    gc(type);
-                    break;
+            }
+            if (!isNarrowable(type)) {
+                if (!other) other = type;
+            } else if (!primitive || extends(type, primitive, checkState)) {
+                primitive = type;
+            } else if (!extends(primitive, type, checkState)) {
+                return &immortal.never;
+            }
+        }
+        if (any) return &immortal.any;
+        if (primitive) {
+            if (object && (primitive->kind == TypeKind::Null || primitive->kind == TypeKind::Undefined)) return &immortal.never;
+            return primitive;
+        }
+        if (other) return other;
+        if (!objects) {
+            //{} & unknown is {}
+            for (auto &&type: types) if (type->kind == TypeKind::ObjectLiteral) return type;
+            return &immortal.unknown;
+        }
+        if (objects == 1) return object;
+
+        vector<Type *> members;
+        auto never = false;
+        for (auto &&type: types) {
+            if (type->kind != TypeKind::ObjectLiteral) continue;
+            forEachChild(type, [this, &members, &never](Type *member, auto &stop) {
+                if (member->kind == TypeKind::PropertySignature) {
+                    for (auto &&existing: members) {
+                        if (existing->kind != TypeKind::PropertySignature || existing->hash != member->hash) continue;
+                        if (!isSameType(getPropertyOrMethodName(existing), getPropertyOrMethodName(member))) continue;
+                        auto left = getPropertyOrMethodType(existing);
+                        auto right = getPropertyOrMethodType(member);
+                        auto unit = isUnitType(left) && isUnitType(right);
+                        existing = intersectProperties(existing, member);
+                        if (unit && getPropertyOrMethodType(existing)->kind == TypeKind::Never) stop = never = true;
+                        return;
+                    }
                 }
-                case OP::Never: {
-                    stack[sp++] = allocate(TypeKind::Never, hash::const_hash("never"));
-                    break;
+                members.push_back(member);
+            });
+            if (never) {
+                //only merged properties are unused
+                for (auto &&member: members) gc(member);
+                return &immortal.never;
+            }
+        }
+
+        auto result = allocate(TypeKind::ObjectLiteral, seedHash(TypeKind::ObjectLiteral));
+        result->size = members.size();
+        allocateChildren(result, result->size);
+        auto &keys = shapeKeys;
+        keys.clear();
+        TypeRef *current = nullptr;
+        for (auto &&member: members) {
+            appendChildRef(result, current, member);
+            keys.push_back(member->hash);
+        }
+        result->shape = shapes.intern(keys);
+        return result;
+    }
+
+    /**
+     * Like unionOf(): `types` are owned by nobody but the caller and collected, the result is not used by anyone.
+     */
+    Type *VM::intersectionOf(std::span<Type *> types) {
+        auto result = intersect(types);
+        use(result);
+        for (auto &&type: types) gc(type);
+        unuse(result);
+        return result;
+    }
+
+    Type *VM::findIntersection(std::span<Type *> types, uint64_t hash) {
+        auto [begin, end] = intersections.equal_range(hash);
+        for (auto it = begin; it != end; ++it) {
+            auto &operands = it->second.operands;
+            if (operands.size() != types.size()) continue;
+            bool same = true;
+            for (unsigned int i = 0; same && i<types.size(); i++) same = isSameType(operands[i], types[i]);
+            if (same) return it->second.result;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Generic helpers intersect the same operands over and over, so results are cached by the structural hash of the
+     * operands in their order. A hit costs the hash and an isSameType() per operand instead of a merge.
+     */
+    inline void VM::handleIntersection(unsigned int size) {
+        if (!size) {
+            push(&immortal.unknown);
+            return;
+        }
+        auto types = pop(size);
+        auto hash = hash::const_hash("intersection");
+        for (auto &&type: types) hash = hash::combine(hash, structuralHash(type));
+        if (auto result = findIntersection(types, hash)) {
+            for (auto &&type: types) gc(type);
+            push(result);
+            return;
+        }
+
+        auto result = intersect(types);
+        if (intersections.size()<intersectionCacheSize) {
+            CachedIntersection intersection{{}, use(result)};
+            markStored(result);
+            intersection.operands.reserve(size);
+            for (auto &&type: types) {
+                markStored(type);
+                intersection.operands.push_back(use(type));
+            }
+            intersections.emplace(hash, std::move(intersection));
+        }
+        use(result);
+        for (auto &&type: types) gc(type);
+        unuse(result);
+        push(result);
+    }
+
+    /**
+     * A class with `size` members on the stack. All members go into its hash table for static access, the instance
+     * members are filtered into its ClassInstance right away, with an interned shape like an object literal of the
+     * same members. OP::New then only pushes that instance, however many `new` expressions there are.
+     */
+    inline void VM::handleClass(unsigned int size) {
+        auto type = allocate(TypeKind::Class);
+        auto instance = allocate(TypeKind::ClassInstance, seedHash(TypeKind::ClassInstance));
+        type->type = use(instance);
+        if (!size) {
+            push(type);
+            return;
+        }
+
+        //for class type->children() acts as static hash map
+        type->size = size;
+        type->table = allocateRefs(size).data();
+        auto types = pop(size);
+        for (unsigned int i = 0; i<size; i++) {
+            addHashChild(type, types[i], size);
+            if (!(types[i]->flag & TypeFlag::Static)) instance->size++;
+        }
+
+        allocateChildren(instance, instance->size);
+        auto &keys = shapeKeys;
+        keys.clear();
+        TypeRef *current = nullptr;
+        for (auto &&member: types) {
+            if (member->flag & TypeFlag::Static) continue;
+            appendChildRef(instance, current, member);
+            keys.push_back(member->hash);
+        }
+        if (instance->size) instance->shape = shapes.intern(keys);
+        push(type);
+    }
+
+    inline void VM::handleTuple(unsigned int size) {
+        if (size == 0) {
+            auto item = allocate(TypeKind::Tuple, seedHash(TypeKind::Tuple));
+            item->type = nullptr;
+            push(item);
+            return;
+        }
+
+        auto types = pop(size);
+
+        //members of ...T are inlined, count them first so all refs are allocated at once
+        unsigned int count = 0;
+        for (auto &&tupleMember: types) {
+            auto type = (Type *) tupleMember->type;
+            if (type->kind != TypeKind::Rest) {
+                count++;
+                continue;
+            }
+            auto T = (Type *) type->type;
+            if (T->kind == TypeKind::Array) {
+                //type T = number[];
+                //type New = [...T, x]; => [...number[], x];
+                throw std::runtime_error("assigning array rest in tuple not supported");
+            }
+            if (T->kind == TypeKind::Tuple) {
+                //the size of an array of refs is known, see freeRefs()
+                count += T->flag & TypeFlag::ChildrenArray ? T->size : refLength((TypeRef *) T->type);
+            }
+        }
+
+        Type *item = nullptr;
+        TypeRef *current = nullptr;
+        auto firstTupleMember = types[0];
+        auto firstType = (Type *) firstTupleMember->type;
+        if (firstType->kind == TypeKind::Rest) {
+            //[...T, x]
+            Type *T = (Type *) firstType->type;
+            //if type has no owner, we can just use it as the new type
+            //T.refCount is minimum 1, because the T is owned by Rest, and Rest owned by TupleMember, and TupleMember by nobody,
+            //if T comes from a type argument, it is 2 since argument belongs to the caller.
+            //thus an expression of [...T] yields always T.refCount >= 2.
+            if (T->kind == TypeKind::Tuple && T->refCount == 2 && firstType->flag & TypeFlag::RestReuse && !(firstType->flag & TypeFlag::Stored)) {
+                item = T;
+                auto oldRefs = (TypeRef *) T->type;
+                auto oldSize = T->size;
+                auto oldArray = T->flag & TypeFlag::ChildrenArray;
+                std::span<TypeRef> refs{oldRefs, oldSize};
+                if (oldArray && poolRefs.grow(refs, count)) {
+                    //the slot of its refs has room for the rest (see PoolArray::grow()), so they stay and the hash
+                    //continues from its last member. Recursive [...T, x] copies only when crossing a size class.
+                    for (unsigned int i = oldSize; i<count; i++) refs[i - 1].next = &refs[i];
+                    refs[count - 1].next = nullptr;
+                    current = &refs[oldSize - 1];
+                } else {
+                    //its members move into a new list that has room for the rest
+                    item->type = nullptr;
+                    item->flag &= ~TypeFlag::ChildrenArray;
+                    item->hash = seedHash(TypeKind::Tuple);
+                    allocateChildren(item, count);
+                    for (auto ref = oldRefs; ref; ref = ref->next) {
+                        appendChildRef(item, current, ref->type);
+                        unuse(ref->type); //the old list does not own it anymore
+                    }
+                    freeRefs(oldRefs, oldArray ? oldSize : 0);
                 }
-                case OP::Any: {
-                    stack[sp++] = allocate(TypeKind::Any, hash::const_hash("any"));
-                    break;
+                //print(item, "reuse tuple");
+            }
+        }
+
+        if (!item) {
+            item = allocate(TypeKind::Tuple, seedHash(TypeKind::Tuple));
+            allocateChildren(item, count);
+        }
+        item->size = count;
+
+        for (unsigned int i = 0; i<types.size(); i++) {
+            auto tupleMember = types[i];
+            auto type = (Type *) tupleMember->type;
+            if (type->kind == TypeKind::Rest) {
+                //type T = [y, z];
+                //type New = [...T, x]; => [y, z, x];
+                Type *T = (Type *) type->type;
+                if (T->kind == TypeKind::Tuple) {
+                    //a reused T was already moved
+                    if (T != item) {
+                        //we reuse the tuple member and increase its refCount.
+                        for (auto ref = (TypeRef *) T->type; ref; ref = ref->next) appendChildRef(item, current, ref->type);
+                    }
+                } else {
+                    debug("Error: [...T] where T is not an array/tuple.");
+                }
+                //drop Rest operator, since it was consumed now, so its resources are freed.
+                //the tuple member has refCount=0 in a [...T] operation, so it also GCs its REST type.
+                //decreases T->refCount.
+                gc(tupleMember);
+            } else {
+                appendChildRef(item, current, tupleMember);
+            }
+        }
+        push(item);
+    }
+
+    /**
+     * Handlers for tier::HandlerList. Same semantics as their VM_OP() in process(), but with operands decoded upfront.
+     */
+    struct tier::Ops {
+        template<Type ImmortalTypes::*type>
+        static void immortal(VM *vm, uint32_t, uint32_t) {
+            vm->push(&(vm->immortal.*type));
+        }
+
+        static void literal(VM *vm, uint32_t address, uint32_t flag) {
+            auto item = vm->allocate(TypeKind::Literal);
+            item->readStorage(vm->subroutine->module->bin, address);
+            item->flag |= flag;
+            vm->push(item);
+        }
+
+        static void wrap(VM *vm, uint32_t kind, uint32_t flag) {
+            auto item = vm->allocate((TypeKind) kind, seedHash((TypeKind) kind));
+            item->flag |= flag;
+            item->type = vm->use(vm->pop());
+            hashChild(item, (Type *) item->type);
+            vm->push(item);
+        }
+
+        static void pop(VM *vm, uint32_t, uint32_t) {
+            vm->gc(vm->pop());
+        }
+
+        static void optional(VM *vm, uint32_t, uint32_t) {
+            vm->handleOptional();
+        }
+
+        static void slots(VM *vm, uint32_t size, uint32_t) {
+            vm->subroutine->variables += size;
+            vm->stack.ensure(vm->sp + size);
+            vm->sp += size;
+        }
+
+        static void loads(VM *vm, uint32_t frameOffset, uint32_t varIndex) {
+            vm->handleLoads(frameOffset, varIndex);
+        }
+
+        static void typeArgument(VM *vm, uint32_t, uint32_t) {
+            vm->handleTypeArgument();
+        }
+
+        static void propertySignature(VM *vm, uint32_t, uint32_t) {
+            vm->handlePropertySignature();
+        }
+
+        static void objectLiteral(VM *vm, uint32_t size, uint32_t) {
+            vm->handleObjectLiteral(size);
+        }
+
+        static void union_(VM *vm, uint32_t size, uint32_t) {
+            vm->handleUnion(size);
+        }
+
+        static void intersection(VM *vm, uint32_t size, uint32_t) {
+            vm->handleIntersection(size);
+        }
+
+        static void tuple(VM *vm, uint32_t size, uint32_t) {
+            vm->handleTuple(size);
+        }
+
+        /**
+         * Returns nullptr if the subroutine contains an op that is not supported (anything that jumps, calls, reports, ...).
+         */
+        static std::unique_ptr<tier::HandlerList> decode(const string_view &bin, unsigned int address) {
+            auto list = std::make_unique<tier::HandlerList>();
+            auto &code = list->code;
+            for (unsigned int ip = address; ip < bin.size(); ip++) {
+                const auto op = (OP) bin[ip];
+                switch (op) {
+                    case OP::Return: {
+                        list->returnIp = ip;
+                        return list;
+                    }
+                    case OP::Never: code.push_back({immortal<&ImmortalTypes::never>}); break;
+                    case OP::Any: code.push_back({immortal<&ImmortalTypes::any>}); break;
+                    case OP::Undefined: code.push_back({immortal<&ImmortalTypes::undefined>}); break;
+                    case OP::Null: code.push_back({immortal<&ImmortalTypes::null>}); break;
+                    case OP::Unknown: code.push_back({immortal<&ImmortalTypes::unknown>}); break;
+                    case OP::String: code.push_back({immortal<&ImmortalTypes::string>}); break;
+                    case OP::Number: code.push_back({immortal<&ImmortalTypes::number>}); break;
+                    case OP::Boolean: code.push_back({immortal<&ImmortalTypes::boolean>}); break;
+                    case OP::True: code.push_back({immortal<&ImmortalTypes::literalTrue>}); break;
+                    case OP::False: code.push_back({immortal<&ImmortalTypes::literalFalse>}); break;
+                    case OP::StringLiteral: code.push_back({literal, vm::readUint32(bin, ip + 1), TypeFlag::StringLiteral}); break;
+                    case OP::NumberLiteral: code.push_back({literal, vm::readUint32(bin, ip + 1), TypeFlag::NumberLiteral}); break;
+                    case OP::Array: code.push_back({wrap, (uint32_t) TypeKind::Array}); break;
+                    case OP::Rest: code.push_back({wrap, (uint32_t) TypeKind::Rest}); break;
+                    case OP::RestReuse: code.push_back({wrap, (uint32_t) TypeKind::Rest, TypeFlag::RestReuse}); break;
+                    case OP::TupleMember: code.push_back({wrap, (uint32_t) TypeKind::TupleMember}); break;
+                    case OP::Pop: code.push_back({pop}); break;
+                    case OP::Optional: code.push_back({optional}); break;
+                    case OP::Slots: code.push_back({slots, vm::readUint16(bin, ip + 1)}); break;
+                    case OP::Loads: code.push_back({loads, vm::readUint16(bin, ip + 1), vm::readUint16(bin, ip + 3)}); break;
+                    case OP::TypeArgument: code.push_back({typeArgument}); break;
+                    case OP::PropertySignature: code.push_back({propertySignature}); break;
+                    case OP::ObjectLiteral: code.push_back({objectLiteral, vm::readUint16(bin, ip + 1)}); break;
+                    case OP::Union: code.push_back({union_, vm::readUint16(bin, ip + 1)}); break;
+                    case OP::Intersection: code.push_back({intersection, vm::readUint16(bin, ip + 1)}); break;
+                    case OP::Tuple: code.push_back({tuple, vm::readUint16(bin, ip + 1)}); break;
+                    default: return nullptr;
+                }
+                vm::eatParams(op, &ip);
+            }
+            return nullptr;
+        }
+    };
+
+#if TRACY_ENABLE
+    /**
+     * `routine` was just entered. Every tracySampleRate-th call opens a zone for the frame, which tracyExit() closes
+     * when the frame returns (tail calls reuse the frame and stay in its zone). Sampling keeps the overhead of zone
+     * events away from hot subroutines while still showing where time goes. The plots follow the pools and the stack.
+     */
+    void VM::tracyEnter(ModuleSubroutine *routine) {
+        if (++tracyCalls < tracySampleRate) return;
+        tracyCalls = 0;
+        auto &file = subroutine->module->fileName;
+        auto name = routine->name.empty() ? string_view("(anonymous)") : routine->name;
+        auto location = ___tracy_alloc_srcloc_name(0, file.data(), file.size(), name.data(), name.size(), name.data(), name.size());
+        tracyZones.push_back({___tracy_emit_zone_begin_alloc(location, 1), activeSubroutines.index()});
+        TracyPlot("vm types", (int64_t) pool.active);
+        TracyPlot("vm refs", (int64_t) poolRef.active);
+        TracyPlot("vm ref arrays", (int64_t) poolRefs.active);
+        TracyPlot("vm frames", (int64_t) activeSubroutines.index());
+        TracyPlot("vm stack", (int64_t) sp);
+    }
+
+    //the current frame returns
+    void VM::tracyExit() {
+        if (tracyZones.empty() || tracyZones.back().frame != activeSubroutines.index()) return;
+        ___tracy_emit_zone_end(tracyZones.back().zone);
+        tracyZones.pop_back();
+    }
+
+    //main returned, or a run ended early (e.g. threw) and the next one starts
+    void VM::tracyExitAll() {
+        while (!tracyZones.empty()) {
+            ___tracy_emit_zone_end(tracyZones.back().zone);
+            tracyZones.pop_back();
+        }
+    }
+#endif
+
+    /**
+     * Called when `routine` was just entered. Runs its handler list if there is one, decodes it when it became hot.
+     * Calls are counted per VM, the list is shared through Module::handlerLists by all VMs running the module.
+     */
+    void VM::tierUp(ModuleSubroutine *routine) {
+        if (!tierThreshold) return;
+        auto module = subroutine->module;
+        if (module != tierModule) return;
+        unsigned int index = routine - module->subroutines.data();
+        auto &list = tierLists[index];
+        if (!list && ++tierCalls[index] == tierThreshold) {
+            std::lock_guard lock(module->handlerListMutex);
+            auto it = module->handlerLists.find(index);
+            if (it == module->handlerLists.end()) {
+                it = module->handlerLists.emplace(index, tier::Ops::decode(module->bin, routine->address)).first;
+            }
+            list = it->second.get();
+        }
+        if (list) list->run(this);
+    }
+
+    inline auto start = std::chrono::high_resolution_clock::now();
+
+    /**
+     * Every op with a VM_OP() handler in VM::process(). With TYPERUNNER_COMPUTED_GOTO these get a direct entry
+     * in the dispatch table, all other ops go through the switch.
+     */
+#define TYPERUNNER_VM_OPS(X) \
+    X(Halt) X(Error) X(Pop) X(Never) X(Any) X(Undefined) X(Null) X(Unknown) X(Parameter) X(Function) X(FunctionRef) \
+    X(ClassRef) X(Instantiate) X(New) X(Static) X(Optional) X(CallExpression) X(Widen) X(Set) X(Assign) X(Return) \
+    X(Inline) X(TailCall) X(UnwrapInferBody) X(ReturnStatement) X(CheckBody) X(InferBody) X(SelfCheck) X(Call) X(Jump) \
+    X(JumpCondition) X(Extends) X(ExtendsJump) X(TemplateLiteral) X(Distribute) X(Loads) X(Slots) \
+    X(TypeArgumentConstraint) X(TypeArgument) X(TypeArgumentDefault) X(Length) X(IndexAccess) X(LoadsIndexAccess) X(String) X(Number) X(Boolean) X(NumberLiteral) \
+    X(StringLiteral) X(False) X(True) X(PropertyAccess) X(Method) X(PropertySignature) X(Class) X(ObjectLiteral) \
+    X(Union) X(Intersection) X(Array) X(RestReuse) X(Rest) X(TupleMember) X(Tuple) X(Prelude) X(Import)
+
+#if TYPERUNNER_PROFILE
+#define VM_PROFILE_STEP(op) profile.step((unsigned char) (op));
+#else
+#define VM_PROFILE_STEP(op)
+#endif
+
+#if TYPERUNNER_COMPUTED_GOTO
+    //direct threaded: each handler ends with its own indirect jump to the next handler instead of going back to the switch
+#define VM_OP(name) case OP::name: op_##name:
+#define VM_NEXT { if constexpr (Policy::stepping) goto next; subroutine->ip++; VM_PROFILE_STEP(bin[subroutine->ip]) goto *dispatch[(unsigned char) bin[subroutine->ip]]; }
+#define VM_DISPATCH_ENTRY(name) table[(unsigned char) OP::name] = &&op_##name;
+#else
+#define VM_OP(name) case OP::name:
+#define VM_NEXT break
+#endif
+
+    //string_view frameName;
+    template<typename Policy>
+    void VM::process() {
+        //stepping returns mid-run, with subroutine zones open, so only whole runs get a zone
+        ZoneNamedN(processZone, "process", !Policy::stepping);
+#if TYPERUNNER_COMPUTED_GOTO
+        //label addresses only exist inside this function, so the table is filled by a statement expression on the
+        //first call of each instantiation instead of on every call
+        static void *const *const dispatch = ({
+            static void *table[256];
+            for (auto &&entry: table) entry = &&dispatchSwitch;
+            TYPERUNNER_VM_OPS(VM_DISPATCH_ENTRY)
+            table;
+        });
+#endif
+#if TYPERUNNER_PROFILE
+        //on every return, also when process() was entered again by a handler
+        struct StopProfile {
+            OpProfile &profile;
+            int resume;
+            ~StopProfile() { profile.stop(resume); }
+        } stopProfile{profile, profile.running()};
+#endif
+        //one TraceStep per process<Stepping>() call, recorded however it returns
+        struct TraceScope {
+            VM &vm;
+            TraceStep step{};
+            unsigned int sp;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            explicit TraceScope(VM &vm): vm(vm), sp(vm.sp) {
+                step.ip = vm.subroutine->ip;
+                step.op = (unsigned char) vm.subroutine->module->bin[step.ip];
+                step.frame = vm.activeSubroutines.index();
+                step.module = vm.trace->moduleIndex(vm.subroutine->module);
+            }
+
+            ~TraceScope() {
+                step.sp = vm.sp;
+                step.stackDelta = (int) vm.sp - (int) sp;
+                auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                step.nanoseconds = std::min<int64_t>(took, UINT32_MAX);
+                vm.trace->record(step);
+            }
+        };
+        [[maybe_unused]] std::conditional_t<Policy::stepping, std::optional<TraceScope>, std::nullptr_t> traceScope{};
+        if constexpr (Policy::stepping) {
+            if (trace && subroutine) traceScope.emplace(*this);
+        }
+        start:
+        if (halting) {
+            stop();
+            return;
+        }
+        auto &bin = subroutine->module->bin;
+        while (true) {
+            //VM_NEXT steps itself before jumping to the next handler or to dispatchSwitch
+            VM_PROFILE_STEP(bin[subroutine->ip])
+#if TYPERUNNER_COMPUTED_GOTO
+            dispatchSwitch:
+#endif
+            //std::chrono::duration<double, std::milli> took = std::chrono::high_resolution_clock::now() - start;
+            //fmt::print(" - took {:.9f}ms\n", took.count());
+            //start = std::chrono::high_resolution_clock::now();
+            //fmt::print("[{}:{}] OP {} {}\n", subroutine->depth, subroutine->depth, subroutine->ip, (OP) bin[subroutine->ip]);
+            //auto frameName = new string_view(fmt::format("[{}] {}", subroutine->ip, (OP) bin[subroutine->ip]));
+            //ZoneName(frameName->begin(), frameName->size());
+
+            auto ip = subroutine->ip;
+            auto op = (OP) bin[subroutine->ip];
+            switch (op) {
+                VM_OP(Halt) {
+//                    subroutine = activeSubroutines.reset();
+//                    frame = frames.reset();
+//                    gcStack();
+//                    gcFlush();
+//                    printStack();
+                    return;
                 }
-                case OP::Undefined: {
-                    stack[sp++] = allocate(TypeKind::Undefined, hash::const_hash("undefined"));
-                    break;
+                VM_OP(Error) {
+                    auto ip = subroutine->ip;
+                    const auto code = (instructions::ErrorCode) subroutine->parseUint16();
+                    switch (code) {
+                        case instructions::ErrorCode::CannotFind: {
+                            report(DiagnosticMessage(DiagnosticCode::CannotFindName, ip));
+                            break;
+                        }
+                        default: {
+                            report(DiagnosticMessage(fmt::format("{}", code), ip));
+                        }
+                    }
+                    VM_NEXT;
                 }
-                case OP::Null: {
-                    stack[sp++] = allocate(TypeKind::Null, hash::const_hash("null"));
-                    break;
+                VM_OP(Pop) {
+                    auto type = pop();
+                    gc(type);
+                    VM_NEXT;
                 }
-                case OP::Unknown: {
-                    stack[sp++] = allocate(TypeKind::Unknown, hash::const_hash("unknown"));
-                    break;
+                VM_OP(Never) {
+                    push(&immortal.never);
+                    VM_NEXT;
+                }
+                VM_OP(Any) {
+                    push(&immortal.any);
+                    VM_NEXT;
                 }
-                case OP::Parameter: {
+                VM_OP(Undefined) {
+                    push(&immortal.undefined);
+                    VM_NEXT;
+                }
+                VM_OP(Null) {
+                    push(&immortal.null);
+                    VM_NEXT;
+                }
+                VM_OP(Unknown) {
+                    push(&immortal.unknown);
+                    VM_NEXT;
+                }
+                VM_OP(Parameter) {
                     const auto address = subroutine->parseUint32();
                     auto type = allocate(TypeKind::Parameter);
                     type->readStorage(bin, address);
                     type->type = pop();
-                    stack[sp++] = type;
-                    break;
+                    push(type);
+                    VM_NEXT;
                 }
-                case OP::Function: {
+                VM_OP(Function) {
                     handleFunction(TypeKind::Function);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::FunctionRef: {
+                VM_OP(FunctionRef) {
                     const auto address = subroutine->parseUint32();
                     auto type = allocate(TypeKind::FunctionRef, hash::const_hash("function"));
                     type->size = address;
-                    stack[sp++] = type;
-                    break;
+                    push(type);
+                    VM_NEXT;
                 }
-                case OP::ClassRef: {
+                VM_OP(ClassRef) {
                     const auto address = subroutine->parseUint32();
                     auto type = allocate(TypeKind::ClassRef, hash::const_hash("class"));
                     type->size = address;
-                    stack[sp++] = type;
-                    break;
+                    push(type);
+                    VM_NEXT;
                 }
-                case OP::Instantiate: {
+                VM_OP(Instantiate) {
                     const auto arguments = subroutine->parseUint16();
                     auto ref = pop(); //FunctionRef/Class
 
@@ -923,36 +2156,44 @@ namespace tr::vm2 {
                             throw std::runtime_error(fmt::format("Can not instantiate {}", ref->kind));
                         }
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::New: {
+                VM_OP(New) {
                     const auto arguments = subroutine->parseUint16();
+                    //todo: check arguments against the constructor
+                    for (auto &&argument: pop(arguments)) gc(argument);
                     auto ref = pop(); //Class/Object with constructor signature
 
                     switch (ref->kind) {
+                        case TypeKind::Class: {
+                            //all instances of a class are the same type, it owns it
+                            push((Type *) ref->type);
+                            break;
+                        }
                         case TypeKind::ClassInstance: {
                             report("Can not call new on a class instance.");
+                            push(&immortal.any);
                             break;
                         }
-                        case TypeKind::Class: {
-                            //todo: convert to ClassInstance. Do we really have to copy all TypeRef?
-                            //push()
+                        default: {
+                            report(DiagnosticMessage(DiagnosticCode::NotConstructable, subroutine->ip - 2));
+                            push(&immortal.any);
                         }
                     }
-                    break;
+                    gc(ref);
+                    VM_NEXT;
                 }
-                case OP::Static: {
+                VM_OP(Static) {
                     stack[sp - 1]->flag |= TypeFlag::Static;
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Optional: {
-                    stack[sp - 1]->flag |= TypeFlag::Optional;
-                    break;
-                    break;
+                VM_OP(Optional) {
+                    handleOptional();
+                    VM_NEXT;
                 }
-                case OP::CallExpression: {
+                VM_OP(CallExpression) {
                     const auto parameterAmount = subroutine->parseUint16();
-                    auto parameters = subroutine->pop(parameterAmount);
+                    auto parameters = pop(parameterAmount);
                     auto typeToCall = pop();
 
                     switch (typeToCall->kind) {
@@ -973,17 +2214,17 @@ namespace tr::vm2 {
                                 if (i>parameters.size() - 1) {
                                     //parameter not provided
                                     if (!optional && !parameter->type) {
-                                        report(fmt::format("An argument for '{}' was not provided.", parameter->text), parameter);
+                                        report(DiagnosticMessage(DiagnosticCode::ArgumentNotProvided, parameter->ip, parameter));
                                     }
                                     break;
                                 }
                                 auto lvalue = parameters[i];
                                 //auto rvalue = reinterpret_pointer_cast<Type>(parameter);
                                 //ExtendableStack stack;
-                                if (!extends(lvalue, parameter)) {
+                                if (!extends(lvalue, parameter, checkState)) {
                                     //rerun again with
                                     //report(stack.errorMessage());
-                                    report(fmt::format("Argument of type '{}' is not assignable to parameter '{}' of type '{}'", stringify(lvalue), parameter->text, stringify(parameter)));
+                                    report(DiagnosticMessage(DiagnosticCode::ArgumentNotAssignable, subroutine->ip, lvalue, parameter));
                                 }
                                 gc(parameter);
                             }
@@ -999,33 +2240,42 @@ namespace tr::vm2 {
                             gc(typeToCall);
                             break;
                         }
+                        case TypeKind::Never: {
+                            //e.g. a member an instance does not have, like a static one
+                            //at the op, skipping its parameter
+                            report(DiagnosticMessage(DiagnosticCode::NotCallable, subroutine->ip - 2));
+                            for (auto &&parameter: parameters) gc(parameter);
+                            push(&immortal.never);
+                            break;
+                        }
                         default: {
                             throw std::runtime_error(fmt::format("CallExpression on {} not handled", typeToCall->kind));
                         }
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Widen: {
+                VM_OP(Widen) {
                     stack[sp - 1] = widen(stack[sp - 1]);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Set: {
+                VM_OP(Set) {
                     const auto address = subroutine->parseUint32();
                     auto type = pop();
                     auto subroutineToSet = subroutine->module->getSubroutine(address);
                     if (subroutineToSet->narrowed) drop(subroutineToSet->narrowed);
                     subroutineToSet->narrowed = use(type);
                     push(type);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Assign: {
+                VM_OP(Assign) {
                     auto rvalue = pop();
                     auto lvalue = pop();
                     //debug("assign {} = {}", stringify(rvalue), stringify(lvalue));
-                    if (!extends(lvalue, rvalue)) {
+                    auto assignable = extends(lvalue, rvalue, checkState);
+                    if (!assignable) {
 //                        auto error = stack.errorMessage();
 //                        error.ip = ip;
-                        report(fmt::format("Type '{}' is not assignable to type '{}'", stringify(lvalue), stringify(rvalue)));
+                        report(DiagnosticMessage(DiagnosticCode::NotAssignable, subroutine->ip, lvalue, rvalue));
                     }
 //                    ExtendableStack stack;
 //                    if (!isExtendable(lvalue, rvalue, stack)) {
@@ -1035,16 +2285,24 @@ namespace tr::vm2 {
 //                    }
                     gc(lvalue);
                     gc(rvalue);
-                    break;
+                    //the most common error, so the budget stops right here instead of on the next call
+                    if (!assignable && halting) goto start;
+                    VM_NEXT;
                 }
-                case OP::Return: {
+                VM_OP(Return) {
+                    VM_PROFILE_ROUTINE(exit())
                     if (subroutine->isMain()) {
+                        VM_TRACY(tracyExitAll())
+                        gcDrain();
                         activeSubroutines.reset();
                         subroutine = nullptr;
                         return;
                     }
 
                     //printStack();
+                    //before the parameters are dropped, they are the key
+                    if (subroutine->flags & SubroutineFlag::Memoize) storeInstantiation();
+
                     //gc all parameters
                     for (unsigned int i = 0; i<subroutine->typeArguments; i++) {
                         if (stack[subroutine->initialSp + i] != stack[sp - 1]) {
@@ -1052,31 +2310,34 @@ namespace tr::vm2 {
                             drop(stack[subroutine->initialSp + i]);
                         } else {
                             //we decrease refCount for return value though, to remove ownership. The callee is responsible to clean it up now
-                            stack[subroutine->initialSp + i]->refCount--;
+                            unuse(stack[subroutine->initialSp + i]);
                         }
                     }
                     //the current frame could not only have the return value, but variables and other stuff,
                     //which we don't want. So if size is bigger than 1, we move last stack entry to first
                     // | [T] [T] [R] |
-                    if (subroutine->size()>1) {
+                    if (frameSize(subroutine)>1) {
                         stack[subroutine->initialSp] = stack[sp - 1];
                     }
 
                     sp = subroutine->initialSp + 1;
-                    if (subroutine->typeArguments == 0 || subroutine->flags & SubroutineFlag::InferBody) {
+                    //what the frame left behind goes in one batch
+                    if (deferGc) gcDrain();
+                    if (!(subroutine->flags & SubroutineFlag::Uncached) && (subroutine->typeArguments == 0 || subroutine->flags & SubroutineFlag::InferBody)) {
 //                        debug("keep type result {}", subroutine->subroutine->name);
                         subroutine->subroutine->result = use(stack[sp - 1]);
-                        subroutine->subroutine->result->flag |= TypeFlag::Stored;
+                        markStored(subroutine->subroutine->result);
                     }
+                    VM_TRACY(tracyExit())
                     subroutine = activeSubroutines.pop(); //&activeSubroutines[--activeSubroutineIdx];
                     goto start;
                 }
-                case OP::Inline: {
+                VM_OP(Inline) {
                     const auto address = subroutine->parseUint32();
                     auto routine = subroutine->module->getSubroutine(address);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::TailCall: {
+                VM_OP(TailCall) {
                     const auto address = subroutine->parseUint32();
                     const auto arguments = subroutine->parseUint16();
                     //if (subroutine->flag & ActiveSubroutineFlag::BlockTailCall) {
@@ -1088,10 +2349,10 @@ namespace tr::vm2 {
                     if (tailCall(address, arguments)) {
                         goto start;
                     }
-                    break;
+                    VM_NEXT;
                     //}
                 }
-                case OP::UnwrapInferBody: {
+                VM_OP(UnwrapInferBody) {
                     auto returnType = stack[sp - 1];
                     if (returnType->size == 0) {
                         returnType->kind = TypeKind::Never;
@@ -1103,65 +2364,92 @@ namespace tr::vm2 {
                         //We do not gc(returnType) since it was loaded from TypeArgument which will be drop() later in ::Return
                         stack[sp - 1] = widen(returnType);
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::ReturnStatement: {
+                VM_OP(ReturnStatement) {
                     if (subroutine->flags & SubroutineFlag::InferBody) {
                         //first entry in the new stack frame is for getting all ReturnStatement calls in a union.
                         auto returnType = stack[subroutine->initialSp];
                         auto type = pop();
                         returnType->appendChild(useAsRef(type));
+                        hashChild(returnType, type);
                     } else {
 
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::CheckBody: {
+                VM_OP(CheckBody) {
                     const auto address = subroutine->parseUint32();
                     auto expectedType = stack[sp - 1];
                     //todo implement
                     //report("Nope");
-                    break;
+                    VM_NEXT;
                 }
-                case OP::InferBody: {
+                VM_OP(InferBody) {
                     const auto address = subroutine->parseUint32();
                     auto routine = subroutine->module->getSubroutine(address);
-                    if (routine->result) {
+                    //inferred once for all calls, unless it depends on type arguments
+                    auto cacheable = isInferenceCacheable(routine);
+                    if (cacheable && routine->result) {
                         push(routine->result);
-                        break;
+                        VM_NEXT;
                     }
                     subroutine->ip++;
                     pushSubroutine(routine, 0);
                     //subroutine is now set to a new one.
                     //If this is set, OP::ReturnStatement acts different
                     subroutine->flags |= SubroutineFlag::InferBody;
+                    if (!cacheable) subroutine->flags |= SubroutineFlag::Uncached;
 
                     //first entry in the new stack frame is for getting all ReturnStatement calls in a union.
                     //use() since it is in the place of TypeArgument, we are the owner. Will be dropped in ::Return.
-                    push(use(allocate(TypeKind::Union)));
+                    push(use(allocate(TypeKind::Union, seedHash(TypeKind::Union))));
                     goto start;
                 }
-                case OP::SelfCheck: {
+                VM_OP(SelfCheck) {
                     const auto address = subroutine->parseUint32();
                     //todo: this needs more definition: A type alias like `type a<T> = T`; needs to type check as well without throwing `Generic type 'a' requires 1 type argument(s).`
                     auto routine = subroutine->module->getSubroutine(address);
-                    if (routine->result) break;
+                    if (routine->result) VM_NEXT;
 
                     if (call(address, 0)) {
                         goto start;
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Call: {
+                VM_OP(Call) {
                     const auto address = subroutine->parseUint32();
                     const auto arguments = subroutine->parseUint16();
                     if (call(address, arguments)) {
                         goto start;
                     }
-                    break;
+                    VM_NEXT;
+                }
+                VM_OP(Prelude) {
+                    const auto index = subroutine->parseUint32();
+                    if (!prelude || index >= prelude->types.size()) throw std::runtime_error("Module was compiled against a prelude the VM does not have");
+                    push(prelude->types[index]);
+                    VM_NEXT;
+                }
+                VM_OP(Import) {
+                    auto ip = subroutine->ip;
+                    const auto index = subroutine->parseUint32();
+                    //in range, see verifyBytecode()
+                    auto &import = subroutine->module->imports[index];
+                    if (import.type) {
+                        push(import.type);
+                    } else {
+                        if (import.resolved) {
+                            report(DiagnosticMessage(DiagnosticCode::NoExportedMember, ip, import.specifier, import.name));
+                        } else {
+                            report(DiagnosticMessage(DiagnosticCode::CannotFindModule, ip, import.specifier));
+                        }
+                        push(&immortal.any);
+                    }
+                    VM_NEXT;
                 }
                     //case OP::FrameReturnJump: {
-                    //    if (subroutine->size()>subroutine->variables) {
+                    //    if (frameSize(subroutine)>subroutine->variables) {
                     //        //there is a return value on the stack, which we need to preserve
                     //        auto ret = pop();
                     //        popFrame();
@@ -1175,13 +2463,13 @@ namespace tr::vm2 {
                     //    subroutine->ip += address - 4; //decrease by uint32 too
                     //    goto start;
                     //}
-                case OP::Jump: {
+                VM_OP(Jump) {
                     const auto address = subroutine->parseInt32();
                     //debug("Jump to {} ({})", subroutine->ip + address - 4, address);
                     subroutine->ip += address - 4;
                     goto start;
                 }
-                case OP::JumpCondition: {
+                VM_OP(JumpCondition) {
                     auto condition = pop();
                     const auto rightProgram = subroutine->parseUint32();
                     auto valid = isConditionTruthy(condition);
@@ -1191,26 +2479,36 @@ namespace tr::vm2 {
                         subroutine->ip += rightProgram - 4;
                         goto start;
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Extends: {
+                VM_OP(Extends) {
                     auto right = pop();
                     auto left = pop();
                     //debug("{} extends {} => {}", stringify(left), stringify(right), extends(left, right));
-                    const auto valid = extends(left, right);
-                    auto item = allocate(TypeKind::Literal);
-                    item->flag |= TypeFlag::BooleanLiteral;
-                    item->flag |= valid ? TypeFlag::True : TypeFlag::False;
-                    push(item);
+                    const auto valid = extends(left, right, checkState);
+                    push(immortal.booleanLiteral(valid));
                     gc(right);
                     gc(left);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::TemplateLiteral: {
+                VM_OP(ExtendsJump) {
+                    auto right = pop();
+                    auto left = pop();
+                    const auto valid = extends(left, right, checkState);
+                    gc(right);
+                    gc(left);
+                    const auto rightProgram = subroutine->parseUint32();
+                    if (!valid) {
+                        subroutine->ip += rightProgram - 4;
+                        goto start;
+                    }
+                    VM_NEXT;
+                }
+                VM_OP(TemplateLiteral) {
                     handleTemplateLiteral();
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Distribute: {
+                VM_OP(Distribute) {
                     auto slot = subroutine->parseUint16();
                     //if there is OP::Distribute, then there was always before this OP
                     //a OP::Loads to push the type on the stack.
@@ -1218,9 +2516,17 @@ namespace tr::vm2 {
                         //no loop for this distribute created yet
                         auto type = pop();
                         if (type->kind == TypeKind::Union) {
-                            subroutine->createLoop(subroutine->initialSp + slot, (TypeRef *) type->type);
+                            if constexpr (!Policy::stepping) {
+                                if (parallelDistributeThreshold && !distributeWorker && distributeInParallel(type, slot)) {
+                                    //the merged result is on the stack, continue after the section
+                                    const auto loopEnd = vm::readUint32(bin, subroutine->ip + 1);
+                                    subroutine->ip += loopEnd - 1 - 2;
+                                    VM_NEXT;
+                                }
+                            }
+                            createLoop(subroutine->initialSp + slot, (TypeRef *) type->type);
                         } else {
-                            subroutine->createEmptyLoop();
+                            createEmptyLoop();
                             stack[subroutine->initialSp + slot] = type;
                             //jump over parameters, right to the distribute section
                             subroutine->ip += 1 + 4;
@@ -1228,26 +2534,16 @@ namespace tr::vm2 {
                         }
                     }
 
-                    auto next = subroutine->loop->next();
+                    auto next = subroutine->loop->next(stack.data());
                     if (!next) {
                         //done
                         //printStack();
-                        auto types = subroutine->pop(sp - subroutine->loop->startSP);
-                        subroutine->popLoop();
-                        if (types.empty()) {
-                            push(allocate(TypeKind::Never));
-                        } else if (types.size() == 1) {
-                            push(types[0]);
-                        } else {
-                            auto result = allocate(TypeKind::Union);
-                            TypeRef *current = (TypeRef *) (result->type = useAsRef(types[0]));
-                            for_each(++types.begin(), types.end(), [&current](auto v) {
-                                current->next = useAsRef(v);
-                                current = current->next;
-                            });
-                            current->next = nullptr;
-                            push(result);
-                        }
+                        auto types = pop(sp - subroutine->loop->startSP);
+                        popLoop();
+                        //results of all members, deduplicated and flattened like T | U
+                        push(unionOf(types));
+                        //the chunk of distributeInParallel() is done, its result stays on the stack
+                        if (distributeWorker && !subroutine->loop) return;
                         const auto loopEnd = vm::readUint32(bin, subroutine->ip + 1);
                         subroutine->ip += loopEnd - 1 - 2;
                     } else {
@@ -1255,49 +2551,38 @@ namespace tr::vm2 {
                         subroutine->ip += 1 + 4;
                         goto start;
                     }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Loads: {
+                VM_OP(Loads) {
                     const auto frameOffset = subroutine->parseUint16();
                     const auto varIndex = subroutine->parseUint16();
-                    if (frameOffset == 0) {
-                        push(stack[subroutine->initialSp + varIndex]);
-                    } else {
-                        push(stack[activeSubroutines.at(activeSubroutines.index() - frameOffset)->initialSp + varIndex]);
-                    }
-                    break;
+                    handleLoads(frameOffset, varIndex);
+                    VM_NEXT;
                 }
-                case OP::Slots: {
+                VM_OP(Slots) {
                     auto size = subroutine->parseUint16();
                     subroutine->variables += size;
+                    stack.ensure(sp + size);
                     sp += size;
-                    break;
+                    VM_NEXT;
                 }
-                case OP::TypeArgumentConstraint: {
+                VM_OP(TypeArgumentConstraint) {
                     auto constraint = pop();
-                    if (subroutine->size() == subroutine->typeArguments) {
-                        auto argument = stack[subroutine->initialSp + subroutine->typeArguments];
-                        if (!extends(argument, constraint)) {
-                            report(fmt::format("Type '{}' does not satisfy the constraint '{}'", stringify(argument), stringify(constraint)));
+                    if (frameSize(subroutine) == subroutine->typeArguments) {
+                        auto argument = stack[subroutine->initialSp + subroutine->typeArguments - 1];
+                        if (!extends(argument, constraint, checkState)) {
+                            report(DiagnosticMessage(DiagnosticCode::ConstraintNotSatisfied, subroutine->ip, argument, constraint));
                         }
                     }
                     gc(constraint);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::TypeArgument: {
-                    if (subroutine->size()<=subroutine->typeArguments) {
-                        //all variables will be dropped at the end of the subroutine
-                        push(use(allocate(TypeKind::Unknown, hash::const_hash("unknown"))));
-                    } else {
-                        //for provided argument we do not increase refCount, because it's the caller's job
-                        //check constraints
-                    }
-                    subroutine->typeArguments++;
-                    subroutine->variables++;
-                    break;
+                VM_OP(TypeArgument) {
+                    handleTypeArgument();
+                    VM_NEXT;
                 }
-                case OP::TypeArgumentDefault: {
-                    if (subroutine->size()<=subroutine->typeArguments) {
+                VM_OP(TypeArgumentDefault) {
+                    if (frameSize(subroutine)<=subroutine->typeArguments) {
                         subroutine->typeArguments++;
                         subroutine->variables++;
                         //load default value
@@ -1313,7 +2598,7 @@ namespace tr::vm2 {
                         subroutine->typeArguments++;
                         subroutine->variables++;
                     }
-                    break;
+                    VM_NEXT;
 
 //                    auto t = stack[subroutine->initialSp + subroutine->typeArguments - 1];
 //                    //t is always set because TypeArgument ensures that
@@ -1329,24 +2614,14 @@ namespace tr::vm2 {
 //                    }
 //                    break;
                 }
-                case OP::Length: {
+                VM_OP(Length) {
                     auto container = pop();
-                    auto t = allocate(TypeKind::Literal);
-                    switch (container->kind) {
-                        case TypeKind::Tuple: {
-                            t->setDynamicLiteral(TypeFlag::NumberLiteral, std::to_string(container->size));
-                            break;
-                        }
-                        default: {
-                            t->setLiteral(TypeFlag::NumberLiteral, "0");
-                            break;
-                        }
-                    }
+                    auto t = container->kind == TypeKind::Tuple ? lengthOf(container) : immortal.numberLiteral(0);
                     gc(container);
                     push(t);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::IndexAccess: {
+                VM_OP(IndexAccess) {
                     auto right = pop();
                     auto left = pop();
 
@@ -1366,55 +2641,64 @@ namespace tr::vm2 {
                     gc(right);
                     push(t);
 //                            }
-                    break;
+                    VM_NEXT;
                 }
-                case OP::String: {
-                    stack[sp++] = allocate(TypeKind::String, hash::const_hash("string"));
-                    break;
+                VM_OP(LoadsIndexAccess) {
+                    const auto frameOffset = subroutine->parseUint16();
+                    const auto varIndex = subroutine->parseUint16();
+                    auto right = loads(frameOffset, varIndex);
+                    auto left = pop();
+                    auto t = indexAccess(left, right);
+                    gc(left);
+                    gc(right);
+                    push(t);
+                    VM_NEXT;
                 }
-                case OP::Number: {
-                    stack[sp++] = allocate(TypeKind::Number, hash::const_hash("number"));
-                    break;
+                VM_OP(String) {
+                    push(&immortal.string);
+                    VM_NEXT;
                 }
-                case OP::Boolean: {
-                    stack[sp++] = allocate(TypeKind::Boolean, hash::const_hash("boolean"));
-                    break;
+                VM_OP(Number) {
+                    push(&immortal.number);
+                    VM_NEXT;
                 }
-                case OP::NumberLiteral: {
+                VM_OP(Boolean) {
+                    push(&immortal.boolean);
+                    VM_NEXT;
+                }
+                VM_OP(NumberLiteral) {
                     auto item = allocate(TypeKind::Literal);
                     const auto address = subroutine->parseUint32();
                     item->readStorage(bin, address);
                     item->flag |= TypeFlag::NumberLiteral;
-                    stack[sp++] = item;
-                    break;
+                    push(item);
+                    VM_NEXT;
                 }
-                case OP::StringLiteral: {
+                VM_OP(StringLiteral) {
                     auto item = allocate(TypeKind::Literal);
                     const auto address = subroutine->parseUint32();
                     item->readStorage(bin, address);
                     item->flag |= TypeFlag::StringLiteral;
-                    stack[sp++] = item;
-                    break;
+                    push(item);
+                    VM_NEXT;
                 }
-                case OP::False: {
-                    auto item = allocate(TypeKind::Literal);
-                    item->flag |= TypeFlag::False;
-                    stack[sp++] = item;
-                    break;
+                VM_OP(False) {
+                    push(&immortal.literalFalse);
+                    VM_NEXT;
                 }
-                case OP::True: {
-                    auto item = allocate(TypeKind::Literal);
-                    item->flag |= TypeFlag::True;
-                    stack[sp++] = item;
-                    break;
+                VM_OP(True) {
+                    push(&immortal.literalTrue);
+                    VM_NEXT;
                 }
-                case OP::PropertyAccess: {
+                VM_OP(PropertyAccess) {
                     auto name = pop();
                     auto container = pop();
                     //e.g. container.name
                     switch (container->kind) {
-                        case TypeKind::Class: {
-                            //MyClass.name, static access
+                        case TypeKind::Class:
+                        case TypeKind::ClassInstance:
+                        case TypeKind::ObjectLiteral: {
+                            //MyClass.name (static), new MyClass().name or {name: T}.name
                             auto type = indexAccess(container, name);
                             push(type);
                             break;
@@ -1426,297 +2710,80 @@ namespace tr::vm2 {
 
                     gc(name);
                     gc(container);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::Method: {
+                VM_OP(Method) {
                     handleFunction(TypeKind::Method);
-                    break;
+                    VM_NEXT;
                 }
-                case OP::PropertySignature: {
-                    auto name = pop();
-                    auto propertyType = pop();
-                    //PropertySignature has a linked list of name->type
-                    auto type = allocate(TypeKind::PropertySignature);
-                    type->type = useAsRef(name);
-                    ((TypeRef *) type->type)->next = useAsRef(propertyType);
-                    type->hash = name->hash;
-                    push(type);
-                    break;
+                VM_OP(PropertySignature) {
+                    handlePropertySignature();
+                    VM_NEXT;
                 }
-                case OP::Class: {
-                    const auto size = subroutine->parseUint16();
-                    auto type = allocate(TypeKind::Class);
-                    if (!size) {
-                        push(type);
-                        break;
-                    }
-
-                    //for class type->children acts as static hash map
-                    type->children = allocateRefs(size);
-                    auto types = subroutine->pop(size);
-                    for (unsigned int i = 0; i<size; i++) {
-                        addHashChild(type, types[i], size);
-                    }
-                    push(type);
-                    break;
+                VM_OP(Class) {
+                    handleClass(subroutine->parseUint16());
+                    VM_NEXT;
                 }
-                case OP::ObjectLiteral: {
-                    const auto size = subroutine->parseUint16();
-                    auto type = allocate(TypeKind::ObjectLiteral, hash::const_hash("object"));
-                    if (!size) {
-                        push(type);
-                        break;
-                    }
-
-                    type->size = size;
-                    auto types = subroutine->pop(size);
-                    auto first = types[0];
-
-                    if (first->kind == TypeKind::Rest) {
-                        TypeRef *current = nullptr;
-                        //todo: check if ObjectLiteral, otherwise report error
-                        forEachChild(first, [&type, &current](Type *child, auto) {
-                            if (current) {
-                                current = current->next = useAsRef(child);
-                            } else {
-                                type->type = current = useAsRef(child);
-                            }
-                        });
-                        gc(first);
-                    } else {
-                        type->type = useAsRef(first);
-                    }
-
-                    auto current = (TypeRef *) type->type;
-                    for (unsigned int i = 1; i<size; i++) {
-                        if (types[i]->kind == TypeKind::Rest) {
-                            //todo: check if ObjectLiteral, otherwise report error
-                            forEachChild(types[i], [&current](Type *child, auto) {
-                                current = current->next = useAsRef(child);
-                            });
-                            gc(types[i]);
-                        } else {
-                            current = (current->next = useAsRef(types[i]));
-                        }
-                    }
-
-                    if (size>5) {
-                        type->children = allocateRefs(size);
-                        for (unsigned int i = 0; i<size; i++) {
-                            addHashChildWithoutRefCounter(type, types[i], size);
-                        }
-                    }
-                    push(type);
-                    break;
+                VM_OP(ObjectLiteral) {
+                    handleObjectLiteral(subroutine->parseUint16());
+                    VM_NEXT;
                 }
-                case OP::Union: {
-                    const auto size = subroutine->parseUint16();
-                    auto type = allocate(TypeKind::Union);
-                    if (!size) {
-                        push(type);
-                        break;
-                    }
-
-                    auto types = subroutine->pop(size);
-                    auto allocationSize = size;
-                    for (auto &&child: types) {
-                        if (child->kind == TypeKind::Union) allocationSize += child->size - 1;
-                    }
-
-                    type->size = allocationSize;
-                    auto first = types[0];
-
-                    if (first->kind == TypeKind::Union) {
-                        TypeRef *current = nullptr;
-                        forEachChild(first, [&type, &current](Type *child, auto) {
-                            if (current) {
-                                current = current->next = useAsRef(child);
-                            } else {
-                                type->type = current = useAsRef(child);
-                            }
-                        });
-                        gc(first);
-                    } else {
-                        type->type = useAsRef(first);
-                    }
-
-                    auto current = (TypeRef *) type->type;
-                    for (unsigned int i = 1; i<size; i++) {
-                        if (types[i]->kind == TypeKind::Union) {
-                            forEachChild(types[i], [&current](Type *child, auto) {
-                                current = current->next = useAsRef(child);
-                            });
-                            gc(types[i]);
-                        } else {
-                            current = (current->next = useAsRef(types[i]));
-                        }
-                    }
-
-                    if (allocationSize>5) {
-                        type->children = allocateRefs(allocationSize);
-                        for (unsigned int i = 0; i<size; i++) {
-                            if (types[i]->kind == TypeKind::Union) {
-                                forEachChild(types[i], [&allocationSize, &type](Type *child, auto) {
-                                    addHashChildWithoutRefCounter(type, child, allocationSize);
-                                });
-                            } else {
-                                addHashChildWithoutRefCounter(type, types[i], allocationSize);
-                            }
-                        }
-                    }
-                    push(type);
-                    break;
+                VM_OP(Union) {
+                    handleUnion(subroutine->parseUint16());
+                    VM_NEXT;
+                }
+                VM_OP(Intersection) {
+                    handleIntersection(subroutine->parseUint16());
+                    VM_NEXT;
                 }
-                case OP::Array: {
-                    auto item = allocate(TypeKind::Array);
+                VM_OP(Array) {
+                    auto item = allocate(TypeKind::Array, seedHash(TypeKind::Array));
                     item->type = use(pop());
-                    stack[sp++] = item;
-                    break;
+                    hashChild(item, (Type *) item->type);
+                    push(item);
+                    VM_NEXT;
                 }
-                case OP::RestReuse: {
-                    auto item = allocate(TypeKind::Rest);
+                VM_OP(RestReuse) {
+                    auto item = allocate(TypeKind::Rest, seedHash(TypeKind::Rest));
                     item->flag |= TypeFlag::RestReuse;
                     item->type = use(pop());
-                    stack[sp++] = item;
-                    break;
+                    hashChild(item, (Type *) item->type);
+                    push(item);
+                    VM_NEXT;
                 }
-                case OP::Rest: {
-                    auto item = allocate(TypeKind::Rest);
+                VM_OP(Rest) {
+                    auto item = allocate(TypeKind::Rest, seedHash(TypeKind::Rest));
                     item->type = use(pop());
-                    stack[sp++] = item;
-                    break;
+                    hashChild(item, (Type *) item->type);
+                    push(item);
+                    VM_NEXT;
                 }
-                case OP::TupleMember: {
-                    auto item = allocate(TypeKind::TupleMember);
+                VM_OP(TupleMember) {
+                    auto item = allocate(TypeKind::TupleMember, seedHash(TypeKind::TupleMember));
                     item->type = use(pop());
-                    stack[sp++] = item;
-                    break;
-                }
-                case OP::Tuple: {
-                    const auto size = subroutine->parseUint16();
-                    if (size == 0) {
-                        auto item = allocate(TypeKind::Tuple);
-                        item->type = nullptr;
-                        push(item);
-                        break;
-                    }
-
-                    auto types = subroutine->pop(size);
-                    Type *item;
-                    auto firstTupleMember = types[0];
-                    auto firstType = (Type *) firstTupleMember->type;
-                    if (firstType->kind == TypeKind::Rest) {
-                        //[...T, x]
-                        Type *T = (Type *) firstType->type;
-                        if (T->kind == TypeKind::Array) {
-                            item = allocate(TypeKind::Tuple);
-                            //type T = number[];
-                            //type New = [...T, x]; => [...number[], x];
-                            throw std::runtime_error("assigning array rest in tuple not supported");
-                        } else if (T->kind == TypeKind::Tuple) {
-                            //type T = [y, z];
-                            //type New = [...T, x]; => [y, z, x];
-                            //auto length = refLength((TypeRef *) T->type);
-                            //debug("...T of size {} with refCount={} *{}", T->size, T->refCount, (void *) T);
-
-                            //if type has no owner, we can just use it as the new type
-                            //T.refCount is minimum 1, because the T is owned by Rest, and Rest owned by TupleMember, and TupleMember by nobody,
-                            //if T comes from a type argument, it is 2 since argument belongs to the caller.
-                            //thus an expression of [...T] yields always T.refCount >= 2.
-                            if (T->refCount == 2 && firstType->flag & TypeFlag::RestReuse && !(firstType->flag & TypeFlag::Stored)) {
-                                item = T;
-                                //item = use(T);
-                                //print(item, "reuse tuple");
-                            } else {
-                                item = allocate(TypeKind::Tuple);
-                                TypeRef *newCurrent = nullptr;
-                                auto oldCurrent = (TypeRef *) T->type;
-                                while (oldCurrent) {
-                                    //we reuse the tuple member and increase its refCount.
-                                    auto tupleMember = useAsRef(oldCurrent->type);
-
-                                    item->size++;
-                                    if (newCurrent) {
-                                        newCurrent->next = tupleMember;
-                                        newCurrent = newCurrent->next;
-                                    } else {
-                                        newCurrent = (TypeRef *) (item->type = tupleMember);
-                                    }
-
-                                    oldCurrent = oldCurrent->next;
-                                }
-                                //print(item, "new tuple");
-                            }
-                        } else {
-                            item = allocate(TypeKind::Tuple);
-                            debug("Error: [...T] where T is not an array/tuple.");
-                        }
-//                            debug("...T after merge size {}", refLength((TypeRef *) item->type));
-                        //drop Rest operator, since it was consumed now, so its resources are freed.
-                        //the tuple member has refCount=0 in a [...T] operation, so it also GCs its REST type.
-                        //decreases T->refCount.
-                        //this tuple member ...T is not needed anymore, since it was consumed, so we GC it.
-                        gc(firstTupleMember);
-                    } else {
-                        item = allocate(TypeKind::Tuple);
-                        item->type = useAsRef(types[0]);
-                        item->size = 1;
-                    }
-
-                    if (types.size()>1) {
-                        //note item->type could still be null, when T is empty for [...T, 0]
-                        auto current = (TypeRef *) item->type;
-                        //set current to the end of the list
-                        while (current && current->next) current = current->next;
-
-                        for_each(++types.begin(), types.end(), [&current, &item](auto tupleMember) {
-                            auto type = (Type *) tupleMember->type;
-                            if (type->kind == TypeKind::Rest) {
-                                //[x, ...T]
-                                Type *T = (Type *) type->type;
-                                if (T->kind == TypeKind::Array) {
-                                    //type T = number[];
-                                    //type New = [...T, x]; => [...number[], x];
-                                    throw std::runtime_error("assigning array rest in tuple not supported");
-                                } else if (T->kind == TypeKind::Tuple) {
-                                    //type T = [y, z];
-                                    //type New = [...T, x]; => [y, z, x];
-                                    auto oldCurrent = (TypeRef *) T->type;
-                                    while (oldCurrent) {
-                                        //we reuse the tuple member and increase its refCount.
-                                        auto tupleMember = useAsRef(oldCurrent->type);
-                                        current->next = tupleMember;
-                                        current = current->next;
-                                        item->size++;
-                                        oldCurrent = oldCurrent->next;
-                                    }
-                                } else {
-                                    debug("Error: [...T] where T is not an array/tuple.");
-                                }
-                                //drop Rest operator, since it was consumed now, so its resources is freed
-                                gc(tupleMember);
-                            } else {
-                                item->size++;
-                                if (current) {
-                                    current->next = useAsRef(tupleMember);
-                                    current = current->next;
-                                } else {
-                                    current = (TypeRef *) (item->type = useAsRef(tupleMember));
-                                }
-                            }
-                        });
-                    }
+                    hashChild(item, (Type *) item->type);
                     push(item);
-                    break;
+                    VM_NEXT;
+                }
+                VM_OP(Tuple) {
+                    handleTuple(subroutine->parseUint16());
+                    VM_NEXT;
                 }
                 default: {
                     debug("[{}] OP {} not handled!", subroutine->ip, (OP) bin[subroutine->ip]);
                 }
             }
 
-            if (stepper) {
+#if TYPERUNNER_COMPUTED_GOTO
+            next:
+#endif
+            if constexpr (Policy::stepping) {
                 if (op == instructions::TypeArgument) {
-                    subroutine->variableIPs.push_back(ip);
+                    //handleTypeArgument() registered variable `variables - 1`
+                    auto frame = activeSubroutines.index();
+                    if (variableIPs.size()<=frame) variableIPs.resize(frame + 1);
+                    variableIPs[frame].resize(subroutine->variables);
+                    variableIPs[frame].back() = ip;
                 }
                 subroutine->ip++;
 ////                        debug("Routine {} (ended={})", subroutine->depth, subroutine->ip == subroutine->end);
@@ -1731,25 +2798,260 @@ namespace tr::vm2 {
         }
     }
 
-    LoopHelper *ActiveSubroutine::createLoop(unsigned int var1, TypeRef *type) {
+    template void VM::process<Batch>();
+    template void VM::process<Stepping>();
+
+#undef VM_OP
+#undef VM_NEXT
+#undef VM_DISPATCH_ENTRY
+#undef VM_PROFILE_STEP
+#undef VM_PROFILE_ROUTINE
+#undef VM_TRACY
+
+    //types VM::transfer() can copy into another VM
+    inline bool isTransferable(Type *type) {
+        if (type->flag & TypeFlag::Immortal) return true;
+        switch (type->kind) {
+            case TypeKind::Literal: return true;
+            case TypeKind::Union:
+            case TypeKind::Tuple: {
+                for (auto current = (TypeRef *) type->type; current; current = current->next) {
+                    if (!isTransferable(current->type)) return false;
+                }
+                return true;
+            }
+            case TypeKind::TupleMember:
+            case TypeKind::Array:
+            case TypeKind::Rest: return isTransferable((Type *) type->type);
+            default: return false;
+        }
+    }
+
+    /**
+     * A copy of `type` of another VM in the pools of this VM, for isTransferable() types only. Immortal types
+     * (ImmortalTypes, pinned types of the prelude) are shared by all VMs and stay as they are.
+     */
+    Type *VM::transfer(Type *type) {
+        if (type->flag & TypeFlag::Immortal) return type;
+        switch (type->kind) {
+            case TypeKind::Literal: {
+                auto item = allocate(TypeKind::Literal);
+                item->flag |= type->flag & (TypeFlag::StringLiteral | TypeFlag::NumberLiteral | TypeFlag::BigIntLiteral | TypeFlag::BooleanLiteral | TypeFlag::True | TypeFlag::False);
+                item->setDynamicText(strings, type->text(), type->hash);
+                item->ip = type->ip;
+                return item;
+            }
+            case TypeKind::Union: {
+                vector<Type *> members;
+                for (auto current = (TypeRef *) type->type; current; current = current->next) members.push_back(transfer(current->type));
+                return unionOf(members);
+            }
+            case TypeKind::Tuple: {
+                //structural hashes do not depend on the VM, so the copy keeps the one of `type`
+                auto item = allocate(TypeKind::Tuple, type->hash);
+                unsigned int count = 0;
+                for (auto current = (TypeRef *) type->type; current; current = current->next) count++;
+                allocateChildren(item, count);
+                item->size = count;
+                TypeRef *current = nullptr;
+                for (auto member = (TypeRef *) type->type; member; member = member->next) appendChildRef(item, current, transfer(member->type));
+                item->hash = type->hash;
+                return item;
+            }
+            case TypeKind::TupleMember:
+            case TypeKind::Array:
+            case TypeKind::Rest: {
+                auto item = allocate(type->kind, type->hash);
+                item->flag |= type->flag & (TypeFlag::Optional | TypeFlag::Readonly | TypeFlag::RestReuse);
+                item->type = use(transfer((Type *) type->type));
+                return item;
+            }
+            default: {
+                throw std::runtime_error(fmt::format("Type {} can not be transferred to another VM", (int) type->kind));
+            }
+        }
+    }
+
+    /**
+     * Whether the OP::Distribute section [start, end) can be evaluated by another VM: only ops that build types from
+     * literals and variables of the own frame, no calls, no errors, nothing that writes to the module. `variables`
+     * gets the loaded variables, without the slots the section assigns itself.
+     */
+    bool VM::isParallelSection(unsigned int start, unsigned int end, vector<unsigned int> &variables) {
+        auto &bin = subroutine->module->bin;
+        //the section jumps back to its OP::Distribute at the end
+        auto distribute = start - 7;
+        vector<unsigned int> slots{vm::readUint16(bin, distribute + 1)};
+        vector<unsigned int> loads;
+        for (unsigned int i = start; i<end; i++) {
+            auto op = (OP) bin[i];
+            switch (op) {
+                case OP::Never:
+                case OP::Any:
+                case OP::Undefined:
+                case OP::Null:
+                case OP::Unknown:
+                case OP::String:
+                case OP::Number:
+                case OP::Boolean:
+                case OP::NumberLiteral:
+                case OP::StringLiteral:
+                case OP::True:
+                case OP::False:
+                case OP::Pop:
+                case OP::Widen:
+                case OP::Optional:
+                case OP::Extends:
+                case OP::Union:
+                case OP::Array:
+                case OP::Rest:
+                case OP::TupleMember:
+                case OP::Tuple: {
+                    break;
+                }
+                case OP::Loads: {
+                    auto frameOffset = vm::readUint16(bin, i + 1);
+                    auto varIndex = vm::readUint16(bin, i + 3);
+                    if (frameOffset != 0 || varIndex>=subroutine->variables) return false;
+                    loads.push_back(varIndex);
+                    break;
+                }
+                case OP::Jump: {
+                    auto target = (int64_t) i + vm::readInt32(bin, i + 1);
+                    if (target<distribute || target>end) return false;
+                    break;
+                }
+                case OP::JumpCondition:
+                case OP::ExtendsJump: {
+                    if (i + vm::readUint32(bin, i + 1)>end) return false;
+                    break;
+                }
+                case OP::Distribute: {
+                    if (i + vm::readUint32(bin, i + 3)>end) return false;
+                    slots.push_back(vm::readUint16(bin, i + 1));
+                    break;
+                }
+                default: {
+                    return false;
+                }
+            }
+            vm::eatParams(op, &i);
+        }
+        for (auto &&index: loads) {
+            if (std::find(slots.begin(), slots.end(), index) == slots.end() && std::find(variables.begin(), variables.end(), index) == variables.end()) variables.push_back(index);
+        }
+        return true;
+    }
+
+    /**
+     * OP::Distribute of the union `type` into `slot` with the members split into chunks, one per worker VM and
+     * thread. Each worker gets a copy of its members and of the variables the section loads, runs the section and
+     * its results are copied back and merged into one union, in member order like the serial loop. False when the
+     * union is too small or the section not isParallelSection(), then nothing happened and the loop runs as usual.
+     *
+     * The chunks run on the process-wide distributePool(), not on a driver pool this VM may run on itself. Its tasks
+     * never wait on it in turn (workers do not distribute in parallel), so a distribution waiting for its chunks
+     * does not block the chunks of another. The worker VMs are reused by the next distribution.
+     */
+    Scheduler &VM::distributePool() {
+        static Scheduler pool;
+        return pool;
+    }
+
+    bool VM::distributeInParallel(Type *type, unsigned int slot) {
+        //counting stops at the threshold, most unions are far smaller
+        unsigned int count = 0;
+        for (auto current = (TypeRef *) type->type; current && count<parallelDistributeThreshold; current = current->next) count++;
+        if (count<parallelDistributeThreshold) return false;
+
+        vector<Type *> members;
+        for (auto current = (TypeRef *) type->type; current; current = current->next) members.push_back(current->type);
+        auto workers = parallelDistributeWorkers ? parallelDistributeWorkers : distributePool().size();
+        auto chunks = (unsigned int) std::min<size_t>(workers, members.size());
+        if (chunks<2) return false;
+
+        auto &bin = subroutine->module->bin;
+        auto ip = subroutine->ip - 2; //of the OP::Distribute
+        vector<unsigned int> variables;
+        if (!isParallelSection(ip + 7, ip + vm::readUint32(bin, ip + 3), variables)) return false;
+        for (auto &&member: members) {
+            if (!isTransferable(member)) return false;
+        }
+        for (auto &&index: variables) {
+            if (!isTransferable(stack[subroutine->initialSp + index])) return false;
+        }
+
+        while (distributeWorkers.size()<chunks) distributeWorkers.push_back(std::make_unique<VM>());
+        auto caller = subroutine;
+        vector<Type *> results(chunks);
+        vector<std::exception_ptr> errors(chunks);
+        //the pool is shared, so this distribution waits for its own chunks, not for the pool to be idle
+        std::latch done(chunks);
+        for (unsigned int c = 0; c<chunks; c++) {
+            distributePool().push([&, c] {
+                try {
+                    auto &worker = *distributeWorkers[c];
+                    worker.reset();
+                    worker.distributeWorker = true;
+                    worker.prelude = prelude;
+                    worker.deferGc = deferGc;
+                    worker.gcBatch = gcBatch;
+                    worker.tierThreshold = 0;
+
+                    //one frame like the caller's, variables it does not load stay unknown
+                    auto frame = worker.subroutine = worker.activeSubroutines.reset();
+                    *frame = ActiveSubroutine{.module = caller->module, .subroutine = caller->subroutine, .ip = ip, .depth = caller->depth};
+                    frame->variables = caller->variables;
+                    frame->typeArguments = caller->typeArguments;
+                    frame->arguments = caller->arguments;
+                    worker.stack.ensure(caller->variables + 1);
+                    for (unsigned int i = 0; i<caller->variables; i++) worker.stack[i] = &worker.immortal.unknown;
+                    for (auto &&index: variables) worker.stack[index] = worker.use(worker.transfer(stack[caller->initialSp + index]));
+                    worker.sp = caller->variables;
+
+                    vector<Type *> chunk;
+                    for (auto i = members.size() * c / chunks; i<members.size() * (c + 1) / chunks; i++) chunk.push_back(worker.transfer(members[i]));
+                    worker.push(worker.use(worker.unionOf(chunk)));
+                    worker.process();
+                    results[c] = worker.stack[worker.sp - 1];
+                } catch (...) {
+                    errors[c] = std::current_exception();
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+        for (auto &&error: errors) {
+            if (error) std::rethrow_exception(error);
+        }
+
+        for (unsigned int c = 0; c<chunks; c++) results[c] = transfer(results[c]);
+        push(unionOf(results));
+        parallelDistributions++;
+        //like after the last iteration of the loop
+        stack[subroutine->initialSp + slot] = members.back();
+        return true;
+    }
+
+    LoopHelper *VM::createLoop(unsigned int var1, TypeRef *type) {
         auto newLoop = loops.push();
         newLoop->set(var1, type);
-        newLoop->ip = ip;
+        newLoop->ip = subroutine->ip;
         newLoop->startSP = sp;
-        newLoop->previous = loop;
-        return loop = newLoop;
+        newLoop->previous = subroutine->loop;
+        return subroutine->loop = newLoop;
     }
 
-    LoopHelper *ActiveSubroutine::createEmptyLoop() {
+    LoopHelper *VM::createEmptyLoop() {
         auto newLoop = loops.push();
-        newLoop->ip = ip;
+        newLoop->ip = subroutine->ip;
         newLoop->startSP = sp;
-        newLoop->previous = loop;
-        return loop = newLoop;
+        newLoop->previous = subroutine->loop;
+        return subroutine->loop = newLoop;
     }
 
-    void ActiveSubroutine::popLoop() {
-        loop = loop->previous;
+    void VM::popLoop() {
+        subroutine->loop = subroutine->loop->previous;
         loops.pop();
     }
 };
\ No newline at end of file
@@ -1,18 +1,30 @@
 #pragma once
 
-#include <asmjit/a64.h>
 #include <stdio.h>
 #include "./pool_single.h"
 #include "./pool_array.h"
+#include "./reserved_array.h"
 #include <array>
 #include <string>
 #include <span>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include "../core.h"
+#include "../scheduler.h"
 #include "./utils.h"
 #include "./types2.h"
+#include "./pinned.h"
+#include "./check2.h"
 #include "./module2.h"
 #include "./instructions.h"
+#include "./trace.h"
+#if TYPERUNNER_PROFILE
+#include "./profiler.h"
+#endif
+#if TRACY_ENABLE
+#include "TracyC.h"
+#endif
 
 namespace tr::vm2 {
     using instructions::OP;
@@ -33,13 +45,9 @@ namespace tr::vm2 {
 //    };
 
     constexpr auto poolSize = 10000;
-    inline PoolSingle<Type, poolSize> pool;
-    inline PoolSingle<TypeRef, poolSize> poolRef;
-    inline PoolArray<TypeRef, poolSize> poolRefs;
-
-    // The stack does not own Type
-    inline std::array<Type *, 4069 * 10> stack;
-    inline unsigned int sp = 0;
+    //maximum entries of the operand stack and of the frame/loop stacks. Only address space is reserved upfront, see ReservedArray.
+    constexpr auto stackSize = 1<<24;
+    constexpr auto frameStackSize = 1<<18;
 
     struct LoopHelper {
         TypeRef *current = nullptr;
@@ -53,7 +61,10 @@ namespace tr::vm2 {
             current = typeRef;
         }
 
-        bool next() {
+        /**
+         * Writes the next union member into the loop variable slot of the given stack.
+         */
+        bool next(Type **stack) {
             if (!current) return false;
             stack[var1] = current->type;
             current = current->next;
@@ -63,6 +74,20 @@ namespace tr::vm2 {
 
     enum SubroutineFlag: uint16_t {
         InferBody = 1<<0,
+        Memoize = 1<<1, //OP::Return stores the result in VM::instantiations
+        Uncached = 1<<2, //OP::Return does not keep the result in ModuleSubroutine::result, see VM::isInferenceCacheable()
+    };
+
+    /**
+     * Execution policies of VM::process(). Batch runs a program to its end, Stepping executes one op per call and
+     * keeps what a debugger shows. Both are instantiated in vm2.cpp.
+     */
+    struct Batch {
+        static constexpr bool stepping = false;
+    };
+
+    struct Stepping {
+        static constexpr bool stepping = true;
     };
 
     /**
@@ -78,30 +103,19 @@ namespace tr::vm2 {
         //the amount of registered variable slots on the stack. will be subtracted when doing popFrame()
         //type arguments of type functions and variables like for mapped types
         unsigned int variables = 0;
-        vector<unsigned int> variableIPs; //only used when stepper is active
         uint16_t typeArguments = 0;
+        uint16_t arguments = 0; //type arguments provided by the caller
+
+        uint64_t instantiation = 0; //key into VM::instantiations, when SubroutineFlag::Memoize is set
 
         /** @see SubroutineFlag */
         uint16_t flags = 0;
         LoopHelper *loop = nullptr;
 
-        LoopHelper *createLoop(unsigned int var1, TypeRef *type);
-        LoopHelper *createEmptyLoop();
-
-        void popLoop();
-
-        unsigned int size() {
-            return sp - initialSp;
-        }
-
         OP op() {
             return (OP) module->bin[ip];
         }
 
-        std::span<Type *> pop(unsigned int size) {
-            sp -= size;
-            return {stack.data() + sp, size};
-        }
         uint32_t parseUint32() {
             auto val = vm::readUint32(module->bin, ip + 1);
             ip += 4;
@@ -128,8 +142,8 @@ namespace tr::vm2 {
     template<class T, int Size>
     class StackPool {
     private:
-        std::array<T, Size> values;
-        unsigned int i;
+        ReservedArray<T, Size> values;
+        unsigned int i = 0;
     public:
         T *at(unsigned int pos) {
             return &values[pos];
@@ -152,10 +166,13 @@ namespace tr::vm2 {
             return &values[0];
         }
 
+        //gives memory of a deep run back, only valid right after reset()
+        void shrink() {
+            values.shrink();
+        }
+
         T *push() {
-            if (i>=Size) {
-                throw std::runtime_error("Stack overflow");
-            }
+            values.ensure(i + 2);
             return &values[++i];
         }
 
@@ -167,50 +184,482 @@ namespace tr::vm2 {
         }
     };
 
-    constexpr auto stackSize = 1024;
-    //aka frames
-    inline StackPool<ActiveSubroutine, stackSize> activeSubroutines;
-    inline StackPool<LoopHelper, stackSize> loops;
+    /**
+     * Singletons for primitive types, true/false and the number literals 0 to maxNumber - 1 (lengths and indices of
+     * tuples). OP::String and friends push these instead of allocating, gc() and drop() skip them.
+     *
+     * One table for the whole process, built on first use and never written afterwards: like pinned types they are
+     * Immortal and Stored from the start and have pinned::refCount, so neither use() nor markStored() nor a "refCount
+     * is 0, modify it in place" fast path touches them. VMs on different threads read them without synchronisation
+     * and their cache lines stay shared instead of bouncing between cores.
+     */
+    struct ImmortalTypes {
+        constexpr static unsigned int maxNumber = 64;
+
+        Type never{TypeKind::Never, hash::const_hash("never")};
+        Type any{TypeKind::Any, hash::const_hash("any")};
+        Type unknown{TypeKind::Unknown, hash::const_hash("unknown")};
+        Type null{TypeKind::Null, hash::const_hash("null")};
+        Type undefined{TypeKind::Undefined, hash::const_hash("undefined")};
+        Type string{TypeKind::String, hash::const_hash("string")};
+        Type number{TypeKind::Number, hash::const_hash("number")};
+        Type boolean{TypeKind::Boolean, hash::const_hash("boolean")};
+        Type bigint{TypeKind::BigInt, hash::const_hash("bigint")};
+        Type literalTrue{TypeKind::Literal, hash::const_hash("true")};
+        Type literalFalse{TypeKind::Literal, hash::const_hash("false")};
+
+    private:
+        std::string numberTexts;
+        vector<Type> numbers;
+
+        static void pin(Type &type) {
+            type.flag |= TypeFlag::Immortal | TypeFlag::Stored;
+            type.refCount = pinned::refCount;
+        }
 
-    inline bool stepper = false;
-    inline ActiveSubroutine *subroutine = nullptr;
+        ImmortalTypes() {
+            literalTrue.flag |= TypeFlag::BooleanLiteral | TypeFlag::True;
+            literalFalse.flag |= TypeFlag::BooleanLiteral | TypeFlag::False;
+            for (auto &&type: all()) pin(*type);
 
-    void process();
+            //texts first, the literals point into them
+            vector<unsigned int> offsets;
+            for (unsigned int i = 0; i<maxNumber; i++) {
+                offsets.push_back(numberTexts.size());
+                numberTexts += std::to_string(i);
+            }
+            offsets.push_back(numberTexts.size());
+            numbers.reserve(maxNumber);
+            for (unsigned int i = 0; i<maxNumber; i++) {
+                auto &literal = numbers.emplace_back(TypeKind::Literal, 0);
+                literal.setLiteral(TypeFlag::NumberLiteral, string_view(numberTexts).substr(offsets[i], offsets[i + 1] - offsets[i]));
+                pin(literal);
+            }
+        }
 
-    void clear(shared<tr::vm2::Module> &module);
-    void prepare(shared<tr::vm2::Module> &module);
-    void drop(Type *type);
-    void drop(std::span<TypeRef> *types);
-    void gc(std::span<TypeRef> *types);
-    void gc(Type *type);
-    void gcFlush();
-    // Garbage collect whatever is left on the stack
-    void gcStack();
-    void gcStackAndFlush();
+    public:
+        ImmortalTypes(const ImmortalTypes &) = delete;
+        ImmortalTypes &operator=(const ImmortalTypes &) = delete;
 
-    Type *allocate(TypeKind kind, uint64_t hash = 0);
-    std::span<TypeRef> allocateRefs(unsigned int size);
+        //the table all VMs reference
+        static ImmortalTypes &shared() {
+            static ImmortalTypes types;
+            return types;
+        }
 
-    void addHashChild(Type *type, Type *child, unsigned int size);
+        std::array<Type *, 11> all() {
+            return {&never, &any, &unknown, &null, &undefined, &string, &number, &boolean, &bigint, &literalTrue, &literalFalse};
+        }
+
+        Type *booleanLiteral(bool value) {
+            return value ? &literalTrue : &literalFalse;
+        }
+
+        //the number literal `value`, nullptr from maxNumber on
+        Type *numberLiteral(unsigned int value) {
+            return value<maxNumber ? &numbers[value] : nullptr;
+        }
+    };
 
-    std::span<Type *> popFrame();
+    /**
+     * A cached call of a generic subroutine. Holds a reference on all types, so neither gets collected while it is
+     * cached. Arguments are Stored or immortal already, the result is marked Stored so OP::RestReuse can not steal it.
+     * `generation` is the Module::generation it was computed in, entries of an earlier one are not found anymore.
+     */
+    struct Instantiation {
+        ModuleSubroutine *routine;
+        vector<Type *> arguments;
+        Type *result;
+        unsigned int generation = 0;
+    };
 
-    static void run(shared<Module> module) {
-//        profiler.clear();
-//        pool = MemoryPool<Type, poolSize>();
-//        poolRef = MemoryPool<TypeRef, poolSize>();
-        pool.clear();
-        poolRef.clear();
-        poolRefs.clear();
+    /**
+     * A cached OP::Intersection, same ownership as Instantiation: operands and result are used and Stored.
+     */
+    struct CachedIntersection {
+        vector<Type *> operands;
+        Type *result;
+    };
 
-        sp = 0;
-        loops.reset();
+    class Prelude;
 
-        prepare(module);
-        process();
-    }
+    /**
+     * Snapshot of the memory pools of a VM, see memoryStats().
+     */
+    struct MemoryStats {
+        PoolStats types; //VM::pool
+        PoolStats refs; //VM::poolRef
+        std::array<PoolStats, PoolArray<TypeRef, poolSize>::poolAmount> refArrays; //VM::poolRefs, by size class
+        PoolStats largeRefArrays; //VM::poolRefs, above the biggest size class
+        std::size_t strings = 0; //bytes of VM::strings
+
+        std::size_t bytes() const {
+            auto bytes = types.bytes + refs.bytes + largeRefArrays.bytes + strings;
+            for (auto &&pool: refArrays) bytes += pool.bytes;
+            return bytes;
+        }
+    };
 
-    void call(shared<Module> &module, unsigned int index = 0, unsigned int arguments = 0);
+    /**
+     * A virtual machine instance with its own memory pools, stack and frames.
+     *
+     * Nothing is shared between instances, so each thread can run its own VM on its own module.
+     * Stack and frames live in reserved address space that is committed on demand, so deep recursion
+     * grows them instead of overflowing while a typical run only touches the first pages.
+     */
+    class VM {
+        //declared before the pools, so it is destroyed after them
+        std::unique_ptr<BlockSource> blockSource;
+
+    public:
+        PoolSingle<Type, poolSize> pool;
+        PoolSingle<TypeRef, poolSize> poolRef;
+        PoolArray<TypeRef, poolSize> poolRefs;
+        //texts of literals computed at runtime, cleared with the pools
+        StringArena strings;
+        //property layouts of object literals, kept across runs, see Shape
+        Shapes shapes;
+        //renders messages of errors and types for print() and the debugger, cleared each run
+        TypePrinter printer;
+        /**
+         * Types whose refCount dropped to 0 are released at the end of each subroutine (OP::Return) or once `gcBatch`
+         * piled up, instead of right away. Frees of deep type trees then happen in batches at frame boundaries, not in
+         * the middle of an op. Off, each collected type is released before gc() returns.
+         */
+        bool deferGc = false;
+        unsigned int gcBatch = 4096;
+
+        //combinations a template literal type may expand to, more are reported instead of built, see handleTemplateLiteral()
+        uint64_t templateLiteralLimit = 100000;
+
+        /**
+         * OP::Distribute over a union with at least this many members is split into chunks that worker VMs evaluate
+         * in parallel, see distributeInParallel(). Only for sections that are self-contained (no calls, no errors,
+         * only variables of the own frame), others and process<Stepping>() distribute one member after the other.
+         * 0 disables it.
+         */
+        unsigned int parallelDistributeThreshold = 4096;
+        //chunks of a parallel distribution, 0 for one per thread of distributePool()
+        unsigned int parallelDistributeWorkers = 0;
+        //distributions evaluated in parallel, of all runs
+        uint64_t parallelDistributions = 0;
+
+        // The stack does not own Type. Everything writing above sp calls stack.ensure() first, see push().
+        ReservedArray<Type *, stackSize> stack;
+        unsigned int sp = 0;
+
+        //aka frames
+        StackPool<ActiveSubroutine, frameStackSize> activeSubroutines;
+        StackPool<LoopHelper, frameStackSize> loops;
+
+        //shared by all VMs, see ImmortalTypes
+        ImmortalTypes &immortal = ImmortalTypes::shared();
+
+        ActiveSubroutine *subroutine = nullptr;
+
+        //only filled by process<Stepping>(): per frame index the ip of the OP::TypeArgument of each variable, see variableIP()
+        vector<vector<unsigned int>> variableIPs;
+        //each process<Stepping>() call is recorded into it when set, owned by the caller (e.g. the debugger)
+        Trace *trace = nullptr;
+
+        //calls after which a subroutine gets a tier::HandlerList, see tier.h. 0 disables it.
+        unsigned int tierThreshold = tier::defaultThreshold;
+        //per subroutine index of tierModule, the prepared one: calls so far and the handler list, see tierUp()
+        Module *tierModule = nullptr;
+        vector<unsigned int> tierCalls;
+        vector<const tier::HandlerList *> tierLists;
+
+        /**
+         * Error budget of run(): once the module has `maxErrors` errors (with failFast one), further errors are dropped
+         * and the run stops at the next subroutine call or return, its frames are unwound with gcStackAndFlush().
+         * Module::errors is then incomplete and `stopped` set. 0 and false check everything. call() ignores both.
+         */
+        unsigned int maxErrors = 0;
+        bool failFast = false;
+        //the last run() ended at the error budget
+        bool stopped = false;
+
+        /**
+         * Leaves messages of errors unrendered after run() and call(), see Module::renderErrors(). Their types stay
+         * referenced until this VM runs again or is destroyed, both render the modules that are still alive first.
+         * For runs that only count errors.
+         */
+        bool deferMessages = false;
+
+        //results of generic subroutines by structural hash of subroutine and arguments, see VM::call
+        std::unordered_multimap<uint64_t, Instantiation> instantiations;
+        //maximum entries in instantiations, once full new instantiations are not cached. 0 disables the cache.
+        unsigned int instantiationCacheSize = 4096;
+
+        //results of OP::Intersection by structural hash of the operands, see handleIntersection()
+        std::unordered_multimap<uint64_t, CachedIntersection> intersections;
+        //maximum entries in intersections, 0 disables the cache
+        unsigned int intersectionCacheSize = 4096;
+
+        //recursion guard and relation cache of extends()
+        check::State checkState;
+
+        //types OP::Prelude loads, has to be the prelude the module was compiled against. Shared, never modified.
+        shared<const Prelude> prelude;
+
+#if TYPERUNNER_PROFILE
+        //of all runs of this VM, see OpProfile and SubroutineProfile
+        OpProfile profile;
+        SubroutineProfile subroutineProfile;
+#endif
+#if TRACY_ENABLE
+        //every n-th subroutine call gets a Tracy zone named after the routine and updates the plots, see tracyEnter()
+        unsigned int tracySampleRate = 64;
+#endif
+
+        VM() = default;
+        ~VM() {
+            renderMessages();
+        }
+        VM(const VM &) = delete;
+        VM &operator=(const VM &) = delete;
+
+        void run(shared<Module> module) {
+            //the last messages reference types of the pools
+            renderMessages();
+            reset();
+
+            stopped = false;
+            prepare(module);
+            budget = failFast ? 1 : maxErrors;
+            process();
+            finishMessages(module);
+        }
+
+        /**
+         * Releases pool blocks above `keepBlocks` per pool (and per size class) that the current run did not touch,
+         * e.g. between runs of a long-lived VM after one module needed far more types than usual. Opt-in, since a
+         * released block is allocated again by the next run that needs it. Chunks of `strings` after the current one
+         * are released as well. Returns the released blocks.
+         */
+        unsigned int trim(unsigned int keepBlocks = 1) {
+            strings.trim();
+            return pool.trim(keepBlocks) + poolRef.trim(keepBlocks) + poolRefs.trim(keepBlocks);
+        }
+
+        /**
+         * Backs pool, poolRef and poolRefs with blocks of `source` (nullptr for operator new), e.g. a RegionBlockSource
+         * with huge pages on the NUMA node of the worker thread running this VM. The VM owns it. Only before the first
+         * run, see PoolSingle::setBlockSource().
+         */
+        void setBlockSource(std::unique_ptr<BlockSource> source) {
+            //poolRefs checks its own blocks before it takes the source
+            if (pool.blocks || poolRef.blocks) throw std::runtime_error("VM pools already have blocks, set the block source before the first run");
+            poolRefs.setBlockSource(source.get());
+            pool.setBlockSource(source.get());
+            poolRef.setBlockSource(source.get());
+            blockSource = std::move(source);
+        }
+
+        /**
+         * Runs until the main subroutine returned. With Stepping it returns after each op instead (the debugger calls
+         * it once per step) and records variableIPs. Batch, used by run() and call(), contains no stepping code at
+         * all, see VM_NEXT. Set tierThreshold to 0 while stepping, handler lists run in one go.
+         */
+        template<typename Policy = Batch>
+        void process();
+
+        //ip of the OP::TypeArgument that declared `variable` of `frame`, 0 if process<Stepping>() did not record one
+        unsigned int variableIP(ActiveSubroutine *frame, unsigned int variable) {
+            unsigned int index = frame - activeSubroutines.at(0);
+            if (index>=variableIPs.size() || variable>=variableIPs[index].size()) return 0;
+            return variableIPs[index][variable];
+        }
+
+        void clear(shared<tr::vm2::Module> &module);
+        void prepare(shared<tr::vm2::Module> &module);
+        void drop(Type *type);
+        void drop(std::span<TypeRef> types);
+        void gc(std::span<TypeRef> types);
+        void gc(Type *type);
+        void gcDrain();
+        void gcFlush();
+        // Garbage collect whatever is left on the stack
+        void gcStack();
+        void gcStackAndFlush();
+
+        Type *allocate(TypeKind kind, uint64_t hash = 0);
+        std::span<TypeRef> allocateRefs(unsigned int size);
+        void allocateChildren(Type *type, unsigned int size);
+
+        void addHashChild(Type *type, Type *child, unsigned int size);
+
+        std::span<Type *> popFrame();
+
+        /**
+         * Runs subroutine `index` of `module` on its own, with the top `arguments` types of the stack as type
+         * arguments, and returns its result. The result is not on the stack anymore and not owned by the caller.
+         */
+        Type *call(shared<Module> &module, unsigned int index = 0, unsigned int arguments = 0);
+
+        /**
+         * The type of the exported (non-generic) declaration `name` of `module`, nullptr if there is none. Only its
+         * subroutine and the ones it depends on run, main and with it the checks of all other declarations do not,
+         * so `module` does not have to be run before and its errors are not complete afterwards. Results are kept in
+         * ModuleSubroutine::result, so a second query for the same or a dependent declaration does not run again.
+         * Like call(), the types live in the pools of this VM until its next run().
+         */
+        Type *resolveExport(shared<Module> &module, string_view name);
+
+        /**
+         * The stack size of the given frame.
+         */
+        unsigned int frameSize(ActiveSubroutine *frame) {
+            return sp - frame->initialSp;
+        }
+
+        void printStack();
+
+        //reduced union of `types` without going through the stack, see vm2.cpp
+        Type *unionOf(std::span<Type *> types);
+        //normalised intersection of `types`, see vm2.cpp
+        Type *intersectionOf(std::span<Type *> types);
+
+    private:
+        friend struct tier::Ops;
+
+        //collected types whose children are not released yet, see gcDrain()
+        vector<Type *> garbage;
+        bool draining = false;
+
+        //empties pools, caches and stacks, all types of earlier runs are gone afterwards
+        void reset() {
+            printer.clear();
+            pool.clear();
+            poolRef.clear();
+            poolRefs.clear();
+            strings.clear();
+            //all types are gone with the pools and ModuleSubroutine is recreated in prepare()
+            instantiations.clear();
+            intersections.clear();
+            checkState.clear();
+            garbage.clear();
+            draining = false;
+
+            sp = 0;
+            loops.reset();
+            stack.shrink();
+            activeSubroutines.reset();
+            activeSubroutines.shrink();
+            loops.shrink();
+        }
+
+        //maxErrors of the current run(), 0 in call()
+        unsigned int budget = 0;
+        //the budget is reached, process() unwinds on the next call or return
+        bool halting = false;
+        void stop();
+
+        //modules with messages left for Module::renderErrors(), see deferMessages
+        vector<std::weak_ptr<Module>> unrendered;
+        void finishMessages(shared<Module> &module);
+        void renderMessages();
+        void releaseMessages(Module &module);
+
+#if TRACY_ENABLE
+        struct TracyZone {
+            TracyCZoneCtx zone;
+            unsigned int frame; //index in activeSubroutines
+        };
+        unsigned int tracyCalls = 0;
+        vector<TracyZone> tracyZones; //open, innermost last
+
+        void tracyEnter(ModuleSubroutine *routine);
+        void tracyExit();
+        void tracyExitAll();
+#endif
+
+        //scratch space of unionOf()
+        vector<Type *> unionMembers;
+        vector<uint64_t> unionHashes;
+        std::unordered_set<uint64_t> unionSeen;
+        //keys of the object literal being built, see handleObjectLiteral()
+        vector<uint64_t> shapeKeys;
+
+        Type *use(Type *type);
+        void unuse(Type *type);
+        void markStored(Type *type);
+        TypeRef *useAsRef(Type *type, TypeRef *next = nullptr);
+        void appendChildRef(Type *type, TypeRef *&current, Type *child);
+        void freeRefs(TypeRef *refs, unsigned int arraySize);
+        void gcChildRefs(Type *type);
+        void addHashChildWithoutRefCounter(Type *type, Type *child, unsigned int size);
+        void gcWithoutChildren(Type *type);
+        void gcChildren(Type *type);
+
+        Type *_widen(Type *type);
+        Type *widen(Type *type);
+
+        void push(Type *type);
+        Type *pop();
+        std::span<Type *> pop(unsigned int size);
+        void popFrameWithoutGC();
+
+        void report(DiagnosticMessage message);
+        void report(const string &message, Type *node);
+        void report(const string &message);
+        void report(const string &message, unsigned int ip);
+
+        bool tailCall(unsigned int address, unsigned int arguments);
+        ActiveSubroutine *pushSubroutine(ModuleSubroutine *routine, unsigned int arguments);
+        bool call(unsigned int address, unsigned int arguments);
+        void tierUp(ModuleSubroutine *routine);
+
+        bool isMemoizable(ModuleSubroutine *routine);
+        uint64_t instantiationHash(ModuleSubroutine *routine, unsigned int arguments);
+        Type *findInstantiation(ModuleSubroutine *routine, unsigned int arguments, uint64_t hash);
+        bool memoize(ModuleSubroutine *routine, unsigned int arguments, uint64_t &hash);
+        void storeInstantiation();
+        unsigned int outerFrames(ModuleSubroutine *routine);
+        bool isInferenceCacheable(ModuleSubroutine *body);
+
+        //worker VMs of distributeInParallel(), created on first use
+        vector<std::unique_ptr<VM>> distributeWorkers;
+        /**
+         * Threads the chunks of all VMs run on, one per core, created on first use. VMs on the threads of a driver
+         * Scheduler distributing at once queue their chunks here instead of each starting threads of their own.
+         */
+        static Scheduler &distributePool();
+        //evaluates a chunk of a parallel distribution, process() returns once its OP::Distribute is done. Never
+        //distributes in parallel itself, so parallel distributions do not nest
+        bool distributeWorker = false;
+        bool isParallelSection(unsigned int start, unsigned int end, vector<unsigned int> &variables);
+        bool distributeInParallel(Type *type, unsigned int slot);
+        Type *transfer(Type *type);
+
+        LoopHelper *createLoop(unsigned int var1, TypeRef *type);
+        LoopHelper *createEmptyLoop();
+        void popLoop();
+
+        Type *resolveObjectIndexType(Type *object, Type *index);
+        Type *lengthOf(Type *tuple);
+        Type *indexAccess(Type *container, Type *index);
+        void handleOptional();
+        Type *loads(unsigned int frameOffset, unsigned int varIndex);
+        void handleLoads(unsigned int frameOffset, unsigned int varIndex);
+        void handleTypeArgument();
+        void handlePropertySignature();
+        void handleObjectLiteral(unsigned int size);
+        void handleUnion(unsigned int size);
+        Type *intersect(std::span<Type *> types);
+        Type *intersectProperties(Type *left, Type *right);
+        Type *findIntersection(std::span<Type *> types, uint64_t hash);
+        void handleIntersection(unsigned int size);
+        void handleClass(unsigned int size);
+        void handleTuple(unsigned int size);
+        void handleTemplateLiteral();
+        Type *handleFunction(TypeKind kind);
+        void print(Type *type, const char *title = "");
+    };
+
+    inline MemoryStats memoryStats(const VM &vm) {
+        return {.types = vm.pool.stats(), .refs = vm.poolRef.stats(), .refArrays = vm.poolRefs.stats(), .largeRefArrays = vm.poolRefs.largeStats(), .strings = vm.strings.bytes()};
+    }
 
     struct CStack {
         vector<Type *> iterator;
@@ -218,88 +667,89 @@ namespace tr::vm2 {
         unsigned int round;
     };
 
+    /**
+     * Combinations of the members of the parts of a template literal: `${'a'|'b'}${'c'|'d'}` has ['a', 'c'],
+     * ['a', 'd'], ['b', 'c'] and ['b', 'd']. next() yields one combination after the other into row(), nothing is
+     * materialised, so size() can be checked against a limit before the first combination is built.
+     *
+     * Parts that are template literals are inlined into the row and boolean yields the immortal true and false
+     * literals, so no type is allocated.
+     */
     class CartesianProduct {
         vector<CStack> stack;
-    public:
-
-        Type *current(CStack &s) {
-            return s.iterator[s.i];
-        }
-
-        bool next(CStack &s) {
-            return (++s.i == s.iterator.size()) ? (s.i = 0, false) : true;
-        }
+        vector<Type *> buffer;
+        bool started = false;
+        VM &vm;
 
-        vector<Type *> toGroup(Type *type) {
+        void toGroup(Type *type, vector<Type *> &group) {
             if (type->kind == TypeKind::Boolean) {
-                return {allocate(TypeKind::Literal)->setFlag(TypeFlag::True), allocate(TypeKind::Literal)->setFlag(TypeFlag::False)};
-            } else if (type->kind == TypeKind::Null) {
-                return {allocate(TypeKind::Literal)->setLiteral(TypeFlag::StringLiteral, "null")};
-            } else if (type->kind == TypeKind::Undefined) {
-                return {allocate(TypeKind::Literal)->setLiteral(TypeFlag::StringLiteral, "undefined")};
-                // } else if (type->kind == TypeKind::templateLiteral) {
-                // //     //todo: this is wrong
-                // //     return type.types;
-                //     const result: Type[] = [];
-                //     for (const s of type.types) {
-                //         const g = this.toGroup(s);
-                //         result.push(...g);
-                //     }
-                //
-                //     return result;
+                group.push_back(&vm.immortal.literalTrue);
+                group.push_back(&vm.immortal.literalFalse);
             } else if (type->kind == TypeKind::Union) {
-                vector<Type *> result;
-                auto current = (TypeRef *) type->type;
-                while (current) {
-                    auto g = toGroup(current->type);
-                    for (auto &&s: g) result.push_back(s);
-                    current = current->next;
-                }
-
-                return result;
+                for (auto current = (TypeRef *) type->type; current; current = current->next) toGroup(current->type, group);
             } else {
-                return {type};
+                group.push_back(type);
             }
         }
 
+    public:
+        explicit CartesianProduct(VM &vm): vm(vm) {}
+
         void add(Type *item) {
-            stack.push_back({.iterator=toGroup(item), .i= 0, .round= 0});
+            auto &s = stack.emplace_back(CStack{.i = 0, .round = 0});
+            toGroup(item, s.iterator);
         }
 
-        vector<vector<Type *>> calculate() {
-            vector<vector<Type *>> result;
+        //number of combinations, saturates at UINT64_MAX
+        uint64_t size() const {
+            uint64_t size = 1;
+            for (auto &&s: stack) {
+                if (s.iterator.empty()) return 0;
+                if (size>UINT64_MAX / s.iterator.size()) return UINT64_MAX;
+                size *= s.iterator.size();
+            }
+            return size;
+        }
 
-            outer:
-            while (true) {
-                vector<Type *> row;
-                for (auto &&s: stack) {
-                    auto item = current(s);
-                    if (item->kind == TypeKind::TemplateLiteral) {
-                        auto current = (TypeRef *) item->type;
-                        while (current) {
-                            row.push_back(current->type);
-                            current = current->next;
-                        }
-                    } else {
-                        row.push_back(item);
-                    }
+        /**
+         * Advances to the next combination, the first call to the first one. False when all were yielded.
+         */
+        bool next() {
+            if (stack.empty()) return false;
+            if (!started) {
+                started = true;
+                if (size() == 0) return false;
+            } else {
+                //like counting, the last part changes fastest
+                auto i = stack.size();
+                while (true) {
+                    if (i == 0) return false;
+                    auto &s = stack[--i];
+                    if (++s.i<s.iterator.size()) break;
+                    s.i = 0;
                 }
-                result.push_back(row);
-
-                for (unsigned int i = stack.size() - 1; i>=0; i--) {
-                    auto active = next(stack[i]);
-                    //when that i stack is active, continue in main loop
-                    if (active) goto outer;
+            }
 
-                    //i stack was rewinded. If it's the first, it means we are done
-                    if (i == 0) {
-                        goto done;
-                    }
+            buffer.clear();
+            for (auto &&s: stack) {
+                auto item = s.iterator[s.i];
+                if (item->kind == TypeKind::TemplateLiteral) {
+                    for (auto current = (TypeRef *) item->type; current; current = current->next) buffer.push_back(current->type);
+                } else {
+                    buffer.push_back(item);
                 }
-                break;
             }
+            return true;
+        }
+
+        //the current combination, valid until the next call of next()
+        std::span<Type *> row() {
+            return buffer;
+        }
 
-            done:
+        vector<vector<Type *>> calculate() {
+            vector<vector<Type *>> result;
+            while (next()) result.emplace_back(buffer.begin(), buffer.end());
             return result;
         }
     };
@@ -35,6 +35,22 @@ namespace tr {
         return str.substr(start, len);
     }
 
+    string_view substring(string_view str, int start, optional<int> end) {
+        if (start < 0) start = 0;
+        int len = str.size();
+        if (end) {
+            if (*end < start) {
+                len = start - *end;
+                start = *end;
+            } else {
+                len = *end - start;
+            }
+        }
+        if (len < 0) len = 0;
+        if (start > str.size()) start = str.size();
+        return str.substr(start, len);
+    }
+
     string replaceLeading(const string &text, const string &from, const string &to) {
         if (0 == text.find(from)) {
             string str = text;
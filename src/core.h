@@ -22,6 +22,7 @@ namespace tr::Debug {
 
 namespace tr {
     using std::string;
+    using std::string_view;
     using std::vector;
     using std::function;
     using std::optional;
@@ -37,6 +38,9 @@ namespace tr {
     //compatible with JavaScript's String.substring
     string substring(const string &str, int start, optional<int> end = {});
 
+    //same, as view into str
+    string_view substring(string_view str, int start, optional<int> end = {});
+
     /**
      * shared_ptr has optional semantic already built-in, so we use it instead of std::optional<shared_ptr<>>,
      * but instead of using shared_ptr directly, we use sharedOpt<T> to make it clear that it can be empty.
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include "./core.h"
+#include "./fs.h"
+#include "./path.h"
+#include "./cache.h"
+#include "./scheduler.h"
+#include "./parser2.h"
+#include "./checker/compiler.h"
+#include "./checker/diagnostics.h"
+#include "./checker/linker.h"
+#include "./checker/module2.h"
+#include "./checker/prelude.h"
+#include "./checker/vm2.h"
+#include "Tracy.hpp"
+
+namespace tr::driver {
+    using std::string;
+    using std::vector;
+    using std::chrono::duration;
+    using Milliseconds = duration<double, std::milli>;
+
+    struct StageTimes {
+        Milliseconds read{};
+        Milliseconds parse{};
+        Milliseconds compile{};
+        Milliseconds build{};
+        Milliseconds check{};
+
+        Milliseconds total() const {
+            return read + parse + compile + build + check;
+        }
+
+        void operator+=(const StageTimes &other) {
+            read += other.read;
+            parse += other.parse;
+            compile += other.compile;
+            build += other.build;
+            check += other.check;
+        }
+    };
+
+    struct CheckedFile {
+        string file;
+        shared<vm2::Module> module;
+        StageTimes took;
+        bool cached = false; //bytecode came from the BytecodeCache, parse and compile were skipped
+        string error; //set when a stage threw, e.g. unsupported syntax in the parser
+        shared<const vm2::Exports> exports; //nullptr if the module exports nothing
+        bool reused = false; //Project::check() kept the diagnostics of the last check, the module did not run
+        bool stopped = false; //the run ended at the error budget, errors of the module are incomplete, see VM::maxErrors
+        string diagnostics; //formatted by the worker that ran the module if check() got a format, see vm2::DiagnosticWriter
+    };
+
+    struct Result {
+        vector<CheckedFile> files;
+        unsigned int threads = 0;
+        Milliseconds wall{};
+#if TYPERUNNER_PROFILE
+        vm2::OpProfile profile; //of all workers
+        vm2::SubroutineProfile subroutineProfile;
+#endif
+
+        unsigned int errors() const {
+            unsigned int count = 0;
+            for (auto &&file: files) count += file.module ? file.module->errors.size() : 0;
+            return count;
+        }
+
+        StageTimes stages() const {
+            StageTimes sum;
+            for (auto &&file: files) sum += file.took;
+            return sum;
+        }
+    };
+
+    /**
+     * Reads the file list of a manifest. Either a tsconfig-like JSON with a "files" array
+     * (paths relative to the manifest), or a plain text file with one path per line.
+     */
+    inline vector<string> readManifest(const string &path) {
+        if (!fileExists(path)) throw std::runtime_error("Manifest not found " + path);
+        auto content = fileRead(path);
+        auto base = std::filesystem::path(path).parent_path();
+        vector<string> files;
+
+        auto add = [&](string_view file) {
+            if (file.empty()) return;
+            auto p = std::filesystem::path(file);
+            files.push_back(p.is_absolute() ? p.string() : (base / p).string());
+        };
+
+        if (path.ends_with(".json")) {
+            auto key = content.find("\"files\"");
+            if (key == string::npos) throw std::runtime_error("Manifest " + path + " has no \"files\" array");
+            auto start = content.find('[', key);
+            auto end = content.find(']', start);
+            if (start == string::npos || end == string::npos) throw std::runtime_error("Manifest " + path + " has an invalid \"files\" array");
+            auto i = start + 1;
+            while (true) {
+                auto open = content.find('"', i);
+                if (open == string::npos || open > end) break;
+                auto close = content.find('"', open + 1);
+                if (close == string::npos || close > end) throw std::runtime_error("Manifest " + path + " has an unterminated string");
+                add(string_view(content).substr(open + 1, close - open - 1));
+                i = close + 1;
+            }
+        } else {
+            std::size_t pos = 0;
+            while (pos < content.size()) {
+                auto lineEnd = content.find('\n', pos);
+                if (lineEnd == string::npos) lineEnd = content.size();
+                auto line = string_view(content).substr(pos, lineEnd - pos);
+                while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+                if (!line.starts_with("#")) add(line);
+                pos = lineEnd + 1;
+            }
+        }
+        return files;
+    }
+
+    /**
+     * Parses, compiles and runs the declarations of `path` as prelude for check(). With a cache the prelude is restored
+     * from its vm2::Prelude::snapshot() instead of compiled and run, the first load stores it.
+     */
+    inline shared<const vm2::Prelude> loadPrelude(const string &path, BytecodeCache *cache = nullptr) {
+        if (!fileExists(path)) throw std::runtime_error("Prelude not found " + path);
+        auto code = fileRead(path);
+        constexpr auto snapshotSalt = hash::const_hash("prelude snapshot");
+        if (cache) {
+            if (auto image = cache->find(code, snapshotSalt)) {
+                try {
+                    return std::make_shared<const vm2::Prelude>(image->view());
+                } catch (const std::runtime_error &) {
+                    //compiled again below and overwritten
+                }
+            }
+        }
+        Parser parser;
+        auto sourceFile = parser.parseSourceFile(path, code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+        auto prelude = std::make_shared<const vm2::Prelude>(sourceFile, code, path);
+        if (cache) cache->store(code, prelude->snapshot(), snapshotSalt);
+        return prelude;
+    }
+
+    /**
+     * The file a relative import specifier of `importer` refers to: the path itself, or with .ts, .d.ts or /index.ts
+     * appended, whichever `exists`, into `out`. False if none does or the specifier is not relative (packages are
+     * not resolved). Candidates are built in `out`, so a reused buffer allocates nothing.
+     */
+    inline bool resolveModule(string &out, string_view importer, string_view specifier, const function<bool(const string &)> &exists) {
+        if (!specifier.starts_with("./") && !specifier.starts_with("../")) return false;
+        out.clear();
+        appendCombinedPath(out, getDirectoryPath(importer), specifier);
+        auto base = out.size();
+        for (auto suffix: {"", ".ts", ".d.ts", "/index.ts"}) {
+            out.resize(base);
+            out += suffix;
+            if (exists(out)) return true;
+        }
+        return false;
+    }
+
+    //empty if not resolved
+    inline string resolveModule(const string &importer, string_view specifier, const function<bool(const string &)> &exists) {
+        string out;
+        return resolveModule(out, importer, specifier, exists) ? out : string();
+    }
+
+    /**
+     * resolveModule() cached by directory of the importer and specifier: files import the same specifiers from the same
+     * directory over and over, and each import is resolved again when it is linked. Without `exists` files are probed
+     * on disk through a DirectoryListing. Not thread-safe, one per check.
+     */
+    class ModuleResolver {
+        function<bool(const string &)> exists;
+        DirectoryListing listing;
+        std::unordered_map<string, string> resolved;
+        string key, candidate; //reused
+
+    public:
+        explicit ModuleResolver(function<bool(const string &)> exists = nullptr): exists(std::move(exists)) {
+            if (!this->exists) this->exists = [this](const string &file) { return listing.exists(file); };
+        }
+
+        ModuleResolver(const ModuleResolver &) = delete;
+        ModuleResolver &operator=(const ModuleResolver &) = delete;
+
+        //empty if not resolved
+        const string &resolve(string_view importer, string_view specifier) {
+            key.assign(getDirectoryPath(importer));
+            key += '\0';
+            key += specifier;
+            auto it = resolved.find(key);
+            if (it != resolved.end()) return it->second;
+            if (!resolveModule(candidate, importer, specifier, exists)) candidate.clear();
+            return resolved.emplace(key, candidate).first->second;
+        }
+
+        size_t size() const {
+            return resolved.size();
+        }
+    };
+
+    inline Milliseconds since(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::high_resolution_clock::now() - start;
+    }
+
+    /**
+     * Runs the (linked) module of `out` and collects what it exports. With a `format` the diagnostics are formatted
+     * into `out.diagnostics` right away, while the module is still hot in the cache of this worker.
+     */
+    inline void runModule(vm2::VM &vm, CheckedFile &out, std::optional<vm2::DiagnosticFormat> format = std::nullopt) {
+        ZoneScopedN("check");
+        ZoneText(out.file.data(), out.file.size());
+        auto t = std::chrono::high_resolution_clock::now();
+        vm.run(out.module);
+        out.stopped = vm.stopped;
+        out.exports = nullptr;
+        for (auto &&routine: out.module->subroutines) {
+            if (!routine.exported) continue;
+            out.exports = std::make_shared<const vm2::Exports>(vm, out.module);
+            break;
+        }
+        out.diagnostics.clear();
+        if (format) vm2::formatDiagnostics(*out.module, *format, out.diagnostics);
+        out.took.check += since(t);
+    }
+
+    //state of one file while it travels through the stages
+    struct Job {
+        CheckedFile &out;
+        string code;
+        shared<SourceFile> sourceFile;
+        std::unique_ptr<checker::Program> program;
+        //shared with the background cache write
+        shared<const string> bin;
+        shared<MappedFile> cachedBin;
+
+        explicit Job(CheckedFile &out): out(out) {}
+    };
+
+    /**
+     * Checks all files on `threads` workers. Each stage (read, parse, compile+build, check) of a file is its own
+     * task, the next stage is pushed onto the same worker, so idle workers steal whole files or late stages
+     * from busy ones. Each worker owns one vm2::VM that is reused for all files it checks.
+     *
+     * Reads (and the cache lookup) of all files are queued at once on a separate pool of I/O threads, each hands its
+     * source to the workers when it completes, so waiting for the disk overlaps with parsing instead of running in
+     * front of it. With a `cache`, files whose bytecode is cached go straight from read to check, all others are
+     * written to the cache after build by the I/O threads in the background.
+     * Names a file does not declare itself are looked up in `prelude`, which all workers share.
+     *
+     * Files with imports are checked after that in waves: each wave links (see vm2::link()) and runs the files whose
+     * imported files are checked already, their vm2::Exports are computed once right after their own check. Imports of
+     * files that are not part of `files` are not resolved, cycles are checked in one last wave with what is linked so far.
+     *
+     * With a `format` each worker formats the diagnostics of the files it ran into CheckedFile::diagnostics. With
+     * `maxErrors` each file stops being checked once it has that many errors, see VM::maxErrors.
+     *
+     * With `hugePages` the pools of each VM are backed by a RegionBlockSource. Its regions are mapped by the first
+     * allocation, which happens on the worker owning the VM, so on multi-socket machines they land on that worker's node.
+     */
+    inline Result check(const vector<string> &files, unsigned int threads = std::thread::hardware_concurrency(), BytecodeCache *cache = nullptr, shared<const vm2::Prelude> prelude = nullptr,
+                        std::optional<vm2::DiagnosticFormat> format = std::nullopt, unsigned int maxErrors = 0, bool hugePages = false) {
+        ZoneScoped;
+        Result result;
+        result.files.resize(files.size());
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Scheduler scheduler(threads);
+        result.threads = scheduler.size();
+        //reads and cache writes, which mostly wait for the disk, so more of them than workers
+        Scheduler io(std::clamp(scheduler.size() * 2, 4u, 32u));
+        vector<std::unique_ptr<vm2::VM>> vms;
+        for (unsigned int i = 0; i < scheduler.size(); i++) {
+            vms.push_back(std::make_unique<vm2::VM>());
+            vms.back()->prelude = prelude;
+            vms.back()->maxErrors = maxErrors;
+            if (hugePages) vms.back()->setBlockSource(std::make_unique<RegionBlockSource>());
+        }
+        //bytecode compiled against a prelude is only valid with that one
+        auto salt = prelude ? prelude->hash : 0;
+
+        auto guarded = [](shared<Job> job, const function<void()> &stage) {
+            try {
+                stage();
+                return true;
+            } catch (std::exception &e) {
+                job->out.error = e.what();
+            }
+            return false;
+        };
+
+        //runs the module on the worker's VM
+        auto run = [&vms, format](CheckedFile &out) {
+            runModule(*vms[Scheduler::worker()], out, format);
+        };
+
+        auto checkStage = [run, guarded](shared<Job> job) {
+            return [run, guarded, job] {
+                guarded(job, [&] {
+                    auto code = std::make_shared<const string>(std::move(job->code));
+                    if (job->cachedBin) {
+                        job->out.module = std::make_shared<vm2::Module>(job->cachedBin, job->cachedBin->view(), job->out.file, code, *code);
+                    } else {
+                        job->out.module = std::make_shared<vm2::Module>(job->bin, *job->bin, job->out.file, code, *code);
+                        job->bin.reset();
+                    }
+                    vm2::parseHeader(job->out.module);
+                    //checked in a later wave, when its imports are
+                    if (job->out.module->imports.empty()) run(job->out);
+                });
+            };
+        };
+
+        //reads of all files are queued at once and each hands its buffer to a parse on the workers as it completes
+        for (unsigned int i = 0; i < files.size(); i++) {
+            result.files[i].file = files[i];
+            auto job = std::make_shared<Job>(result.files[i]);
+
+            io.push([&scheduler, &io, cache, salt, prelude, checkStage, guarded, job] {
+                auto read = guarded(job, [&] {
+                    ZoneScopedN("read");
+                    ZoneText(job->out.file.data(), job->out.file.size());
+                    auto t = std::chrono::high_resolution_clock::now();
+                    if (!fileExists(job->out.file)) throw std::runtime_error("File not found " + job->out.file);
+                    job->code = fileRead(job->out.file);
+                    job->out.took.read = since(t);
+                    if (cache) job->cachedBin = cache->find(job->code, salt);
+                });
+                if (!read) return;
+                if (job->cachedBin) {
+                    job->out.cached = true;
+                    scheduler.push(checkStage(job));
+                    return;
+                }
+
+                scheduler.push([&scheduler, &io, cache, salt, prelude, checkStage, guarded, job] {
+                    auto parsed = guarded(job, [&] {
+                        ZoneScopedN("parse");
+                        ZoneText(job->out.file.data(), job->out.file.size());
+                        auto t = std::chrono::high_resolution_clock::now();
+                        Parser parser;
+                        job->sourceFile = parser.parseSourceFile(job->out.file, job->code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+                        job->out.took.parse = since(t);
+                    });
+                    if (!parsed) return;
+
+                    scheduler.push([&scheduler, &io, cache, salt, prelude, checkStage, guarded, job] {
+                        auto compiled = guarded(job, [&] {
+                            {
+                                ZoneScopedN("compile");
+                                ZoneText(job->out.file.data(), job->out.file.size());
+                                auto t = std::chrono::high_resolution_clock::now();
+                                checker::Compiler compiler;
+                                if (prelude) compiler.prelude = &prelude->symbols;
+                                job->program = std::make_unique<checker::Program>(compiler.compileSourceFile(job->sourceFile));
+                                job->out.took.compile = since(t);
+                            }
+
+                            ZoneScopedN("build");
+                            ZoneText(job->out.file.data(), job->out.file.size());
+                            auto t = std::chrono::high_resolution_clock::now();
+                            job->program->compactSourceMap = true;
+                            job->bin = std::make_shared<const string>(job->program->build());
+                            job->out.took.build = since(t);
+                            job->program.reset();
+                            job->sourceFile.reset();
+                            if (cache) {
+                                io.push([cache, key = BytecodeCache::key(job->code, salt), bin = job->bin] {
+                                    ZoneScopedN("store");
+                                    cache->store(key, *bin);
+                                });
+                            }
+                        });
+                        if (!compiled) return;
+
+                        scheduler.push(checkStage(job));
+                    });
+                });
+            });
+        }
+
+        //reads push their parse before they finish, so once they are done all stages are queued
+        io.wait();
+        scheduler.wait();
+
+        std::unordered_map<string, unsigned int> indices;
+        for (unsigned int i = 0; i < files.size(); i++) indices.emplace(files[i], i);
+        ModuleResolver resolver([&indices](const string &file) { return indices.contains(file); });
+        //file index of each import, -1 if not resolved
+        std::unordered_map<unsigned int, vector<int>> pending;
+        for (unsigned int i = 0; i < files.size(); i++) {
+            auto &module = result.files[i].module;
+            if (!module || module->imports.empty()) continue;
+            auto &dependencies = pending[i];
+            for (auto &&import: module->imports) {
+                auto &file = resolver.resolve(files[i], import.specifier);
+                dependencies.push_back(file.empty() ? -1 : (int) indices[file]);
+            }
+        }
+
+        while (!pending.empty()) {
+            vector<unsigned int> wave;
+            for (auto &&[i, dependencies]: pending) {
+                auto ready = true;
+                for (auto dependency: dependencies) ready &= dependency < 0 || !pending.contains(dependency);
+                if (ready) wave.push_back(i);
+            }
+            //a cycle, the rest
+            if (wave.empty()) for (auto &&[i, dependencies]: pending) wave.push_back(i);
+
+            for (auto i: wave) {
+                auto &out = result.files[i];
+                vm2::link(out.module, [&](string_view specifier) -> shared<const vm2::Exports> {
+                    auto &file = resolver.resolve(out.file, specifier);
+                    if (file.empty()) return nullptr;
+                    auto &dependency = result.files[indices[file]];
+                    //an empty Exports for a resolved module without exports, so imports report the missing member
+                    if (!dependency.exports && dependency.module && !pending.contains(indices[file])) return std::make_shared<const vm2::Exports>();
+                    return dependency.exports;
+                });
+            }
+            for (auto i: wave) {
+                scheduler.push([&result, run, i] {
+                    try {
+                        run(result.files[i]);
+                    } catch (std::exception &e) {
+                        result.files[i].error = e.what();
+                    }
+                });
+            }
+            scheduler.wait();
+            for (auto i: wave) pending.erase(i);
+        }
+
+#if TYPERUNNER_PROFILE
+        for (auto &&vm: vms) {
+            result.profile.merge(vm->profile);
+            result.subroutineProfile.merge(vm->subroutineProfile);
+        }
+#endif
+        //cache writes still in flight
+        io.wait();
+        result.wall = since(start);
+        return result;
+    }
+
+    inline void printReport(const Result &result, std::ostream &out = std::cout) {
+        for (auto &&file: result.files) {
+            if (!file.error.empty()) {
+                out << red << "error" << reset << " " << file.file << ": " << file.error << "\n";
+            } else {
+                out << fmt::format("{}: {} errors{}, {:.3f}ms (parse {:.3f}ms, compile {:.3f}ms, build {:.3f}ms, check {:.3f}ms)\n",
+                                   file.file, file.module->errors.size(), file.stopped ? " (stopped)" : "", file.took.total().count(),
+                                   file.took.parse.count(), file.took.compile.count(), file.took.build.count(), file.took.check.count());
+            }
+        }
+
+        auto stages = result.stages();
+        unsigned int cached = 0, reused = 0;
+        for (auto &&file: result.files) cached += file.cached, reused += file.reused;
+        out << fmt::format("{} files ({} cached, {} reused), {} errors, {} threads: wall {:.3f}ms\n", result.files.size(), cached, reused, result.errors(), result.threads, result.wall.count());
+        out << fmt::format("  cumulative: read {:.3f}ms, parse {:.3f}ms, compile {:.3f}ms, build {:.3f}ms, check {:.3f}ms, total {:.3f}ms ({:.2f}x parallel)\n",
+                           stages.read.count(), stages.parse.count(), stages.compile.count(), stages.build.count(), stages.check.count(),
+                           stages.total().count(), result.wall.count() > 0 ? stages.total().count() / result.wall.count() : 0);
+    }
+}
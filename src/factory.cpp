@@ -1,5 +1,6 @@
 #include "factory.h"
 #include <fmt/core.h>
+#include "number.h"
 
 namespace tr {
     int Factory::propagatePropertyNameFlagsOfChild(shared<tr::Node> &node, int transformFlags) {
@@ -64,12 +65,15 @@ namespace tr {
     shared<NumericLiteral> Factory::createNumericLiteral(string value, int numericLiteralFlags) {
         auto node = createBaseLiteral<NumericLiteral>(SyntaxKind::NumericLiteral, std::move(value));
         node->numericLiteralFlags = numericLiteralFlags;
+        node->value = parseNumber(node->text);
         if (numericLiteralFlags & TokenFlags::BinaryOrOctalSpecifier) node->transformFlags |= (int) TransformFlags::ContainsES2015;
         return node;
     }
 
     shared<NumericLiteral> Factory::createNumericLiteral(double value, types::TokenFlags numericLiteralFlags) {
-        return createNumericLiteral(std::to_string(value), numericLiteralFlags);
+        auto node = createNumericLiteral(formatNumber(value), numericLiteralFlags);
+        node->value = value;
+        return node;
     }
 
     // @api
@@ -2606,7 +2610,7 @@ namespace tr {
     }
 
     shared<EmitNode> Factory::mergeEmitNode(shared<EmitNode> sourceEmitNode, sharedOpt<EmitNode> destEmitNode) {
-        if (!destEmitNode) destEmitNode = make_shared<EmitNode>();
+        if (!destEmitNode) destEmitNode = makeNode<EmitNode>();
         // We are using `.slice()` here in case `destEmitNode.leadingComments` is pushed to later.
         if (sourceEmitNode->leadingComments) destEmitNode->leadingComments = addRange<SynthesizedComment>(slice(sourceEmitNode->leadingComments), destEmitNode->leadingComments);
         if (sourceEmitNode->trailingComments) destEmitNode->trailingComments = addRange<SynthesizedComment>(slice(sourceEmitNode->trailingComments), destEmitNode->trailingComments);
@@ -3326,28 +3330,16 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportDeclaration(
-//            sharedOpt<NodeArray> decorators,
-//            sharedOpt<NodeArray> modifiers,
-//            importClause: ImportClause | undefined,
-//            moduleSpecifier: Expression,
-//            assertClause: AssertClause | undefined
-//        ): ImportDeclaration {
-//            auto node = createBaseDeclaration<ImportDeclaration>(
-//                SyntaxKind::ImportDeclaration,
-//                decorators,
-//                modifiers
-//            );
-//            node->importClause = importClause;
-//            node->moduleSpecifier = moduleSpecifier;
-//            node->assertClause = assertClause;
-//            node->transformFlags |=
-//                propagateChildFlags(node->importClause) |
-//                propagateChildFlags(node->moduleSpecifier);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<ImportDeclaration> Factory::createImportDeclaration(sharedOpt<NodeArray> decorators, sharedOpt<NodeArray> modifiers, sharedOpt<ImportClause> importClause, shared<Expression> moduleSpecifier, sharedOpt<AssertClause> assertClause) {
+        auto node = createBaseDeclaration<ImportDeclaration>(SyntaxKind::ImportDeclaration, decorators, modifiers);
+        node->importClause = importClause;
+        node->moduleSpecifier = moduleSpecifier;
+        node->assertClause = assertClause;
+        node->transformFlags |= propagateChildFlags(node->importClause) | propagateChildFlags(node->moduleSpecifier);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateImportDeclaration(
@@ -3367,21 +3359,17 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportClause(isTypeOnly: boolean, name: Identifier | undefined, namedBindings: NamedImportBindings | undefined): ImportClause {
-//            auto node = createBaseNode<ImportClause>(SyntaxKind::ImportClause);
-//            node->isTypeOnly = isTypeOnly;
-//            node->name = name;
-//            node->namedBindings = namedBindings;
-//            node->transformFlags |=
-//                propagateChildFlags(node->name) |
-//                propagateChildFlags(node->namedBindings);
-//            if (isTypeOnly) {
-//                node->transformFlags |= (int)TransformFlags::ContainsTypeScript;
-//            }
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<ImportClause> Factory::createImportClause(bool isTypeOnly, sharedOpt<Identifier> name, sharedOpt<NodeUnion(NamedImportBindings)> namedBindings) {
+        auto node = createBaseNode<ImportClause>(SyntaxKind::ImportClause);
+        node->isTypeOnly = isTypeOnly;
+        node->name = name;
+        node->namedBindings = namedBindings;
+        node->transformFlags |= propagateChildFlags(node->name) | propagateChildFlags(node->namedBindings);
+        if (isTypeOnly) node->transformFlags |= (int) TransformFlags::ContainsTypeScript;
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateImportClause(node: ImportClause, isTypeOnly: boolean, name: Identifier | undefined, namedBindings: NamedImportBindings | undefined) {
@@ -3442,14 +3430,14 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamespaceImport(name: Identifier): NamespaceImport {
-//            auto node = createBaseNode<NamespaceImport>(SyntaxKind::NamespaceImport);
-//            node->name = name;
-//            node->transformFlags |= propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<NamespaceImport> Factory::createNamespaceImport(shared<Identifier> name) {
+        auto node = createBaseNode<NamespaceImport>(SyntaxKind::NamespaceImport);
+        node->name = name;
+        node->transformFlags |= propagateChildFlags(node->name);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateNamespaceImport(node: NamespaceImport, name: Identifier) {
@@ -3458,16 +3446,14 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamespaceExport(name: Identifier): NamespaceExport {
-//            auto node = createBaseNode<NamespaceExport>(SyntaxKind::NamespaceExport);
-//            node->name = name;
-//            node->transformFlags |=
-//                propagateChildFlags(node->name) |
-//                (int)TransformFlags::ContainsESNext;
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<NamespaceExport> Factory::createNamespaceExport(shared<Identifier> name) {
+        auto node = createBaseNode<NamespaceExport>(SyntaxKind::NamespaceExport);
+        node->name = name;
+        node->transformFlags |= propagateChildFlags(node->name) | (int) TransformFlags::ContainsESNext;
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateNamespaceExport(node: NamespaceExport, name: Identifier) {
@@ -3476,14 +3462,14 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamedImports(elements: readonly ImportSpecifier[]): NamedImports {
-//            auto node = createBaseNode<NamedImports>(SyntaxKind::NamedImports);
-//            node->elements = createNodeArray(elements);
-//            node->transformFlags |= propagateChildrenFlags(node->elements);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<NamedImports> Factory::createNamedImports(shared<NodeArray> elements) {
+        auto node = createBaseNode<NamedImports>(SyntaxKind::NamedImports);
+        node->elements = createNodeArray(elements);
+        node->transformFlags |= propagateChildrenFlags(node->elements);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateNamedImports(node: NamedImports, elements: readonly ImportSpecifier[]) {
@@ -3492,18 +3478,16 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportSpecifier(isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
-//            auto node = createBaseNode<ImportSpecifier>(SyntaxKind::ImportSpecifier);
-//            node->isTypeOnly = isTypeOnly;
-//            node->propertyName = propertyName;
-//            node->name = name;
-//            node->transformFlags |=
-//                propagateChildFlags(node->propertyName) |
-//                propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<ImportSpecifier> Factory::createImportSpecifier(bool isTypeOnly, sharedOpt<Identifier> propertyName, shared<Identifier> name) {
+        auto node = createBaseNode<ImportSpecifier>(SyntaxKind::ImportSpecifier);
+        node->isTypeOnly = isTypeOnly;
+        node->propertyName = propertyName;
+        node->name = name;
+        node->transformFlags |= propagateChildFlags(node->propertyName) | propagateChildFlags(node->name);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateImportSpecifier(node: ImportSpecifier, isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
@@ -3549,30 +3533,17 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createExportDeclaration(
-//            sharedOpt<NodeArray> decorators,
-//            sharedOpt<NodeArray> modifiers,
-//            isTypeOnly: boolean,
-//            exportClause: NamedExportBindings | undefined,
-//            moduleSpecifier?: Expression,
-//            assertClause?: AssertClause
-//        ) {
-//            auto node = createBaseDeclaration<ExportDeclaration>(
-//                SyntaxKind::ExportDeclaration,
-//                decorators,
-//                modifiers
-//            );
-//            node->isTypeOnly = isTypeOnly;
-//            node->exportClause = exportClause;
-//            node->moduleSpecifier = moduleSpecifier;
-//            node->assertClause = assertClause;
-//            node->transformFlags |=
-//                propagateChildFlags(node->exportClause) |
-//                propagateChildFlags(node->moduleSpecifier);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<ExportDeclaration> Factory::createExportDeclaration(sharedOpt<NodeArray> decorators, sharedOpt<NodeArray> modifiers, bool isTypeOnly, sharedOpt<NodeUnion(NamedExportBindings)> exportClause, sharedOpt<Expression> moduleSpecifier, sharedOpt<AssertClause> assertClause) {
+        auto node = createBaseDeclaration<ExportDeclaration>(SyntaxKind::ExportDeclaration, decorators, modifiers);
+        node->isTypeOnly = isTypeOnly;
+        node->exportClause = exportClause;
+        node->moduleSpecifier = moduleSpecifier;
+        node->assertClause = assertClause;
+        node->transformFlags |= propagateChildFlags(node->exportClause) | propagateChildFlags(node->moduleSpecifier);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateExportDeclaration(
@@ -3594,14 +3565,14 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamedExports(elements: readonly ExportSpecifier[]) {
-//            auto node = createBaseNode<NamedExports>(SyntaxKind::NamedExports);
-//            node->elements = createNodeArray(elements);
-//            node->transformFlags |= propagateChildrenFlags(node->elements);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<NamedExports> Factory::createNamedExports(shared<NodeArray> elements) {
+        auto node = createBaseNode<NamedExports>(SyntaxKind::NamedExports);
+        node->elements = createNodeArray(elements);
+        node->transformFlags |= propagateChildrenFlags(node->elements);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateNamedExports(node: NamedExports, elements: readonly ExportSpecifier[]) {
@@ -3610,18 +3581,16 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createExportSpecifier(isTypeOnly: boolean, propertyName: string | Identifier | undefined, name: string | Identifier) {
-//            auto node = createBaseNode<ExportSpecifier>(SyntaxKind::ExportSpecifier);
-//            node->isTypeOnly = isTypeOnly;
-//            node->propertyName = asName(propertyName);
-//            node->name = asName(name);
-//            node->transformFlags |=
-//                propagateChildFlags(node->propertyName) |
-//                propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+    // @api
+    shared<ExportSpecifier> Factory::createExportSpecifier(bool isTypeOnly, sharedOpt<Identifier> propertyName, shared<Identifier> name) {
+        auto node = createBaseNode<ExportSpecifier>(SyntaxKind::ExportSpecifier);
+        node->isTypeOnly = isTypeOnly;
+        node->propertyName = propertyName;
+        node->name = name;
+        node->transformFlags |= propagateChildFlags(node->propertyName) | propagateChildFlags(node->name);
+        node->transformFlags &= ~(int) TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
+        return node;
+    }
 //
 //        // @api
 //        function updateExportSpecifier(node: ExportSpecifier, isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
@@ -74,14 +74,14 @@ namespace tr {
 
         template<class T>
         shared<T> createBaseNode() {
-            auto node = make_shared<T>();
+            auto node = makeNode<T>();
             node->kind = (types::SyntaxKind) T::KIND;
             return node;
         }
 
         template<class T>
         shared<T> createBaseNode(SyntaxKind kind) {
-            auto node = make_shared<T>();
+            auto node = makeNode<T>();
             node->kind = kind;
             return node;
         }
@@ -2522,28 +2522,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportDeclaration(
-//            sharedOpt<NodeArray> decorators,
-//            sharedOpt<NodeArray> modifiers,
-//            importClause: ImportClause | undefined,
-//            moduleSpecifier: Expression,
-//            assertClause: AssertClause | undefined
-//        ): ImportDeclaration {
-//            auto node = createBaseDeclaration<ImportDeclaration>(
-//                SyntaxKind::ImportDeclaration,
-//                decorators,
-//                modifiers
-//            );
-//            node->importClause = importClause;
-//            node->moduleSpecifier = moduleSpecifier;
-//            node->assertClause = assertClause;
-//            node->transformFlags |=
-//                propagateChildFlags(node->importClause) |
-//                propagateChildFlags(node->moduleSpecifier);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<ImportDeclaration> createImportDeclaration(sharedOpt<NodeArray> decorators, sharedOpt<NodeArray> modifiers, sharedOpt<ImportClause> importClause, shared<Expression> moduleSpecifier, sharedOpt<AssertClause> assertClause);
 //
 //        // @api
 //        function updateImportDeclaration(
@@ -2563,21 +2543,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportClause(isTypeOnly: boolean, name: Identifier | undefined, namedBindings: NamedImportBindings | undefined): ImportClause {
-//            auto node = createBaseNode<ImportClause>(SyntaxKind::ImportClause);
-//            node->isTypeOnly = isTypeOnly;
-//            node->name = name;
-//            node->namedBindings = namedBindings;
-//            node->transformFlags |=
-//                propagateChildFlags(node->name) |
-//                propagateChildFlags(node->namedBindings);
-//            if (isTypeOnly) {
-//                node->transformFlags |= (int)TransformFlags::ContainsTypeScript;
-//            }
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<ImportClause> createImportClause(bool isTypeOnly, sharedOpt<Identifier> name, sharedOpt<NodeUnion(NamedImportBindings)> namedBindings);
 //
 //        // @api
 //        function updateImportClause(node: ImportClause, isTypeOnly: boolean, name: Identifier | undefined, namedBindings: NamedImportBindings | undefined) {
@@ -2621,14 +2588,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamespaceImport(name: Identifier): NamespaceImport {
-//            auto node = createBaseNode<NamespaceImport>(SyntaxKind::NamespaceImport);
-//            node->name = name;
-//            node->transformFlags |= propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<NamespaceImport> createNamespaceImport(shared<Identifier> name);
 //
 //        // @api
 //        function updateNamespaceImport(node: NamespaceImport, name: Identifier) {
@@ -2637,16 +2598,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamespaceExport(name: Identifier): NamespaceExport {
-//            auto node = createBaseNode<NamespaceExport>(SyntaxKind::NamespaceExport);
-//            node->name = name;
-//            node->transformFlags |=
-//                propagateChildFlags(node->name) |
-//                (int)TransformFlags::ContainsESNext;
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<NamespaceExport> createNamespaceExport(shared<Identifier> name);
 //
 //        // @api
 //        function updateNamespaceExport(node: NamespaceExport, name: Identifier) {
@@ -2655,14 +2608,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamedImports(elements: readonly ImportSpecifier[]): NamedImports {
-//            auto node = createBaseNode<NamedImports>(SyntaxKind::NamedImports);
-//            node->elements = createNodeArray(elements);
-//            node->transformFlags |= propagateChildrenFlags(node->elements);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<NamedImports> createNamedImports(shared<NodeArray> elements);
 //
 //        // @api
 //        function updateNamedImports(node: NamedImports, elements: readonly ImportSpecifier[]) {
@@ -2671,18 +2618,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createImportSpecifier(isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
-//            auto node = createBaseNode<ImportSpecifier>(SyntaxKind::ImportSpecifier);
-//            node->isTypeOnly = isTypeOnly;
-//            node->propertyName = propertyName;
-//            node->name = name;
-//            node->transformFlags |=
-//                propagateChildFlags(node->propertyName) |
-//                propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<ImportSpecifier> createImportSpecifier(bool isTypeOnly, sharedOpt<Identifier> propertyName, shared<Identifier> name);
 //
 //        // @api
 //        function updateImportSpecifier(node: ImportSpecifier, isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
@@ -2728,30 +2665,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createExportDeclaration(
-//            sharedOpt<NodeArray> decorators,
-//            sharedOpt<NodeArray> modifiers,
-//            isTypeOnly: boolean,
-//            exportClause: NamedExportBindings | undefined,
-//            moduleSpecifier?: Expression,
-//            assertClause?: AssertClause
-//        ) {
-//            auto node = createBaseDeclaration<ExportDeclaration>(
-//                SyntaxKind::ExportDeclaration,
-//                decorators,
-//                modifiers
-//            );
-//            node->isTypeOnly = isTypeOnly;
-//            node->exportClause = exportClause;
-//            node->moduleSpecifier = moduleSpecifier;
-//            node->assertClause = assertClause;
-//            node->transformFlags |=
-//                propagateChildFlags(node->exportClause) |
-//                propagateChildFlags(node->moduleSpecifier);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<ExportDeclaration> createExportDeclaration(sharedOpt<NodeArray> decorators, sharedOpt<NodeArray> modifiers, bool isTypeOnly, sharedOpt<NodeUnion(NamedExportBindings)> exportClause, sharedOpt<Expression> moduleSpecifier = nullptr, sharedOpt<AssertClause> assertClause = nullptr);
 //
 //        // @api
 //        function updateExportDeclaration(
@@ -2773,14 +2688,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createNamedExports(elements: readonly ExportSpecifier[]) {
-//            auto node = createBaseNode<NamedExports>(SyntaxKind::NamedExports);
-//            node->elements = createNodeArray(elements);
-//            node->transformFlags |= propagateChildrenFlags(node->elements);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<NamedExports> createNamedExports(shared<NodeArray> elements);
 //
 //        // @api
 //        function updateNamedExports(node: NamedExports, elements: readonly ExportSpecifier[]) {
@@ -2789,18 +2698,8 @@ namespace tr {
 //                : node;
 //        }
 //
-//        // @api
-//        function createExportSpecifier(isTypeOnly: boolean, NameType propertyName, NameType name) {
-//            auto node = createBaseNode<ExportSpecifier>(SyntaxKind::ExportSpecifier);
-//            node->isTypeOnly = isTypeOnly;
-//            node->propertyName = asName(propertyName);
-//            node->name = asName(name);
-//            node->transformFlags |=
-//                propagateChildFlags(node->propertyName) |
-//                propagateChildFlags(node->name);
-//            node->transformFlags &= ~TransformFlags::ContainsPossibleTopLevelAwait; // always parsed in an Await context
-//            return node;
-//        }
+        // @api
+        shared<ExportSpecifier> createExportSpecifier(bool isTypeOnly, sharedOpt<Identifier> propertyName, shared<Identifier> name);
 //
 //        // @api
 //        function updateExportSpecifier(node: ExportSpecifier, isTypeOnly: boolean, propertyName: Identifier | undefined, name: Identifier) {
@@ -3579,7 +3478,7 @@ namespace tr {
             shared<EndOfFileToken> endOfFileToken,
             int flags
         ) {
-            auto node = make_shared<SourceFile>();
+            auto node = makeNode<SourceFile>();
             node->statements = createNodeArray(statements);
             node->endOfFileToken = endOfFileToken;
             node->flags |= (int)flags;
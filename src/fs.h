@@ -1,30 +1,153 @@
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using std::string;
 using std::string_view;
 
-inline auto fileRead(const string &file) {
-    std::ifstream t;
-    t.open(file);
+/**
+ * Whole file into a string. One open, fstat and read loop on POSIX, no stream buffering in between.
+ * A file that can not be opened reads as empty, like before, check fileExists() for a proper error.
+ * A read failing halfway throws instead of returning a truncated file.
+ */
+inline string fileRead(const string &file) {
+#if !defined(_WIN32)
+    auto fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return {};
+    string buffer;
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && info.st_size > 0) buffer.resize(info.st_size);
+    size_t size = 0;
+    while (true) {
+        //files growing since fstat() (or not telling their size, e.g. pipes) are read until EOF
+        if (size == buffer.size()) buffer.resize(std::max<size_t>(4096, buffer.size() * 2));
+        auto read = ::read(fd, buffer.data() + size, buffer.size() - size);
+        if (read < 0 && errno == EINTR) continue;
+        if (read < 0) {
+            auto error = errno;
+            close(fd);
+            throw std::runtime_error("Could not read " + file + ": " + std::strerror(error));
+        }
+        if (read == 0) break;
+        size += read;
+        if (size == (size_t) info.st_size && info.st_size > 0) break;
+    }
+    close(fd);
+    buffer.resize(size);
+    return buffer;
+#else
+    std::ifstream t(file, std::ios::binary);
     t.seekg(0, std::ios::end);
     size_t size = t.tellg();
     std::string buffer(size, ' ');
     t.seekg(0);
     t.read(&buffer[0], size);
-    return std::move(buffer);
+    return buffer;
+#endif
 }
 
 inline void fileWrite(const string &file, const string_view &content) {
-    std::ofstream t;
-    t.open(file);
-    t << content;
+    std::ofstream t(file, std::ios::binary | std::ios::trunc);
+    t.write(content.data(), content.size());
 }
 
 inline bool fileExists(const string &file) {
     std::ifstream infile(file);
     return infile.good();
-}
\ No newline at end of file
+}
+
+/**
+ * fileExists() for many files from one listing per directory, read on the first probe of each. For probing candidates
+ * like module resolution does, where most probes miss and siblings are probed right after each other.
+ * Files created later are not seen, use one listing per check.
+ */
+class DirectoryListing {
+    std::unordered_map<string, std::unordered_set<string>> directories;
+    string key; //reused for lookups
+
+public:
+    bool exists(string_view file) {
+        auto end = file.find_last_of('/');
+        key.assign(end == string_view::npos ? "." : file.substr(0, end ? end : 1));
+        auto name = end == string_view::npos ? file : file.substr(end + 1);
+        auto it = directories.find(key);
+        if (it == directories.end()) {
+            it = directories.emplace(key, std::unordered_set<string>{}).first;
+            std::error_code error;
+            for (auto &&entry: std::filesystem::directory_iterator(key, error)) {
+                if (!entry.is_directory(error)) it->second.insert(entry.path().filename().string());
+            }
+        }
+        key.assign(name);
+        return it->second.contains(key);
+    }
+
+    size_t size() const {
+        return directories.size();
+    }
+};
+
+/**
+ * Read-only view of a whole file. Maps the file where supported, so pages are faulted in on access
+ * instead of copying everything into a std::string upfront. Falls back to fileRead() otherwise.
+ */
+class MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    string buffer; //fallback when the file can not be mapped
+
+public:
+    explicit MappedFile(const string &file) {
+#if !defined(_WIN32)
+        auto fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open " + file);
+        struct stat info{};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            auto memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory != MAP_FAILED) {
+                data = static_cast<const char *>(memory);
+                size = info.st_size;
+            }
+        }
+        close(fd);
+        if (data || info.st_size == 0) return;
+#endif
+        buffer = fileRead(file);
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (data && data != buffer.data()) munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    string_view view() const {
+        return {data, size};
+    }
+};
+
+inline std::shared_ptr<MappedFile> fileMap(const string &file) {
+    return std::make_shared<MappedFile>(file);
+}
+
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "./core.h"
+#include "./fs.h"
+#include "./bench.h"
+
+namespace tr::benchmark {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * Parameters of a synthetic corpus, see generate(). Every declaration group uses each enabled feature once, a
+     * feature set to 0 is left out. Every group also has one assignment that does not type check, so diagnostics are
+     * part of the measurement.
+     */
+    struct Shape {
+        unsigned int files = 1;
+        unsigned int declarations = 10; //groups per file
+        unsigned int unionWidth = 8; //literal members of a union
+        unsigned int genericDepth = 4; //nested instantiations of a generic alias
+        unsigned int templateFanout = 4; //members of the union part of a template literal, times two combinations
+        unsigned int objectSize = 4; //properties of an object literal type
+        bool imports = true; //each file but the first imports a type of the previous one
+    };
+
+    /**
+     * The source of file `index` of `shape`.
+     */
+    inline string generate(const Shape &shape, unsigned int index) {
+        string code;
+        if (shape.imports && index > 0) code += fmt::format("import {{Shared{}}} from './file{}';\n", index - 1, index - 1);
+        code += fmt::format("export type Shared{} = string | number;\n", index);
+
+        for (unsigned int d = 0; d < shape.declarations; d++) {
+            if (shape.unionWidth) {
+                code += fmt::format("type U{} = ", d);
+                for (unsigned int i = 0; i < shape.unionWidth; i++) code += fmt::format("{}'u{}'", i ? " | " : "", i);
+                code += fmt::format(";\nconst u{0}: U{0} = 'u{1}';\nconst ue{0}: U{0} = 'none';\n", d, shape.unionWidth / 2);
+            }
+            if (shape.genericDepth) {
+                code += fmt::format("type G{}_0<T> = T | null;\n", d);
+                for (unsigned int i = 1; i <= shape.genericDepth; i++) code += fmt::format("type G{0}_{1}<T> = G{0}_{2}<[T]>;\n", d, i, i - 1);
+                code += fmt::format("const g{0}: G{0}_{1}<string> = null;\nconst ge{0}: G{0}_{1}<string> = 1;\n", d, shape.genericDepth);
+            }
+            if (shape.templateFanout) {
+                code += fmt::format("type T{} = `${{", d);
+                for (unsigned int i = 0; i < shape.templateFanout; i++) code += fmt::format("{}'t{}'", i ? " | " : "", i);
+                code += fmt::format("}}-${{'x' | 'y'}}`;\nconst t{0}: T{0} = 't0-y';\nconst te{0}: T{0} = 't0-z';\n", d);
+            }
+            if (shape.objectSize) {
+                string type, value;
+                for (unsigned int i = 0; i < shape.objectSize; i++) {
+                    type += fmt::format("{}p{}: {}", i ? ", " : "", i, i % 2 ? "number" : "string");
+                    value += fmt::format("{}p{}: {}", i ? ", " : "", i, i % 2 ? "1" : "'v'");
+                }
+                code += fmt::format("type O{0} = {{{1}}};\nconst o{0}: O{0} = {{{2}}};\nconst oe{0}: O{0} = {{p0: 1}};\n", d, type, value);
+            }
+            if (shape.imports && index > 0) code += fmt::format("const s{}: Shared{} = 'shared';\n", d, index - 1);
+        }
+        return code;
+    }
+
+    /**
+     * Writes the files of `shape` as `directory`/file0.ts, file1.ts, ... plus a files.txt manifest listing them (see
+     * driver::readManifest()). Returns the paths of the files.
+     */
+    inline vector<string> generate(const Shape &shape, const string &directory) {
+        std::filesystem::create_directories(directory);
+        vector<string> files;
+        string manifest;
+        for (unsigned int i = 0; i < shape.files; i++) {
+            auto name = fmt::format("file{}.ts", i);
+            files.push_back((std::filesystem::path(directory) / name).string());
+            fileWrite(files.back(), generate(shape, i));
+            manifest += name + "\n";
+        }
+        fileWrite((std::filesystem::path(directory) / "files.txt").string(), manifest);
+        return files;
+    }
+
+    /**
+     * One feature of Shape grown over `sizes` with all other features left out, see scale().
+     */
+    struct Scaling {
+        struct Point {
+            unsigned int size = 0;
+            double cold = 0; //ms, median
+            double warm = 0;
+            std::size_t poolBytes = 0;
+        };
+
+        string feature;
+        vector<Point> points;
+
+        /**
+         * Slope of log(warm) over log(size) by least squares: 1 is linear, 2 quadratic. 0 with fewer than two points.
+         */
+        double exponent() const {
+            if (points.size() < 2) return 0;
+            double n = points.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+            for (auto &&point: points) {
+                auto x = std::log((double) point.size);
+                auto y = std::log(std::max(point.warm, 1e-9));
+                sx += x;
+                sy += y;
+                sxx += x * x;
+                sxy += x * y;
+            }
+            auto d = n * sxx - sx * sx;
+            return d ? (n * sxy - sx * sy) / d : 0;
+        }
+
+        //`feature,size,cold,warm,poolBytes` per point, for plotting
+        string csv() const {
+            string out;
+            for (auto &&point: points) out += fmt::format("{},{},{:.6f},{:.6f},{}\n", feature, point.size, point.cold, point.warm, point.poolBytes);
+            return out;
+        }
+    };
+
+    inline const vector<string_view> &scalingFeatures() {
+        static const vector<string_view> features{"declarations", "union", "depth", "template", "object"};
+        return features;
+    }
+
+    /**
+     * Runs a single generated file per size in which only `feature` (one of scalingFeatures()) grows. Declarations
+     * grow the number of groups with one small union each, all other features grow within a single group.
+     */
+    inline Scaling scale(string_view feature, const vector<unsigned int> &sizes, unsigned int iterations) {
+        Scaling scaling{.feature = string(feature)};
+        for (auto size: sizes) {
+            Shape shape{.files = 1, .declarations = 1, .unionWidth = 0, .genericDepth = 0, .templateFanout = 0, .objectSize = 0, .imports = false};
+            if (feature == "declarations") {
+                shape.declarations = size;
+                shape.unionWidth = 4;
+            } else if (feature == "union") {
+                shape.unionWidth = size;
+            } else if (feature == "depth") {
+                shape.genericDepth = size;
+            } else if (feature == "template") {
+                shape.templateFanout = size;
+            } else if (feature == "object") {
+                shape.objectSize = size;
+            } else {
+                throw std::runtime_error(fmt::format("Unknown feature {}", feature));
+            }
+            auto result = run(fmt::format("{}{}.ts", feature, size), generate(shape, 0), iterations);
+            if (!result.error.empty()) throw std::runtime_error(result.error);
+            scaling.points.push_back({.size = size, .cold = result.cold.median(), .warm = result.warm.median(), .poolBytes = result.poolBytes});
+        }
+        return scaling;
+    }
+}
@@ -3,6 +3,7 @@
 #include <filesystem>
 
 #include "./app.h"
+#include "./type_graph.h"
 #include "../parser2.h"
 #include "../checker/compiler.h"
 #include "../checker/vm2.h"
@@ -69,11 +70,18 @@ const v3: NoNumber<Primitive> = 34;
 
     checker::DebugBinResult debugBinResult;
     auto module = make_shared<vm2::Module>();
+    auto vm = std::make_unique<vm2::VM>();
+    //steps of the debug session, scrubbed in the Trace window without executing again
+    vm2::Trace trace;
+    //stack entry shown in the Type Graph window, -1 for the top of the stack
+    int graphStackIndex = -1;
+    TypeGraphLayouter layouter;
 
     ExecutionData lastExecution;
 
     auto extractErrors = [&] {
         editor.inlineErrors.clear();
+        module->renderErrors();
         for (auto &&e: module->errors) {
             auto map = e.module->findNormalizedMap(e.ip);
             auto lineChar = e.module->mapToLineCharacter(map);
@@ -127,7 +135,7 @@ const v3: NoNumber<Primitive> = 34;
 
         for (auto i = 0; i<iterations; i++) {
             module->clear();
-            vm2::run(module);
+            vm->run(module);
         }
         lastExecution.checkTime = (std::chrono::high_resolution_clock::now() - start) / iterations;
 
@@ -293,6 +301,7 @@ const v3: NoNumber<Primitive> = 34;
                 ImGui::TableSetupColumn("message", ImGuiTableColumnFlags_WidthStretch | ImGuiTableColumnFlags_NoSort);
                 ImGui::TableHeadersRow();
 
+                module->renderErrors();
                 for (auto &&e: module->errors) {
                     ImGui::TableNextRow();
 
@@ -323,8 +332,11 @@ const v3: NoNumber<Primitive> = 34;
                         debugActive = true;
                         debugEnded = false;
                         editor.SetReadOnly(true);
-                        vm2::stepper = true;
-                        vm2::prepare(module);
+                        vm->tierThreshold = 0;
+                        trace.clear();
+                        vm->trace = &trace;
+                        graphStackIndex = -1;
+                        vm->prepare(module);
                     }
                 }
 
@@ -337,14 +349,15 @@ const v3: NoNumber<Primitive> = 34;
                         if (ImGui::Button("Next")) {
                             static vm2::FoundSourceMap lastMap;
                             while (true) {
-                                vm2::process();
-                                if (!vm2::subroutine) {
+                                vm->process<vm2::Stepping>();
+                                if (!vm->subroutine) {
                                     debugEnded = true;
+                                    vm->tierThreshold = vm2::tier::defaultThreshold;
                                     editor.SetReadOnly(false);
                                     editor.highlights.clear();
                                     break;
                                 } else {
-                                    auto map = module->findNormalizedMap(vm2::subroutine->ip);
+                                    auto map = module->findNormalizedMap(vm->subroutine->ip);
                                     if (!map.found()) continue; //another step please
                                     if (map.pos == lastMap.pos && map.end == lastMap.end) continue; //another step please
                                     lastMap = map;
@@ -369,21 +382,21 @@ const v3: NoNumber<Primitive> = 34;
                         }
                     }
 
-                    if (vm2::subroutine) {
-                        ImGui::Text("Stack (%d), OP=%s (%d)", vm2::sp, string(magic_enum::enum_name<tr::instructions::OP>(vm2::subroutine->op())).c_str(), vm2::subroutine->ip);
+                    if (vm->subroutine) {
+                        ImGui::Text("Stack (%d), OP=%s (%d)", vm->sp, string(magic_enum::enum_name<tr::instructions::OP>(vm->subroutine->op())).c_str(), vm->subroutine->ip);
 
                         static auto showNonVariables = false;
 
-                        if (!selectedSubroutine) selectedSubroutine = vm2::activeSubroutines.front();
+                        if (!selectedSubroutine) selectedSubroutine = vm->activeSubroutines.front();
 
                         ImGui::Checkbox("Show all stack entries", &showNonVariables);
 
                         ImGui::PushItemWidth(120);
                         if (ImGui::BeginListBox("###listbox")) {
                             string_view lastName = "main";
-                            for (int i = 0; i<vm2::activeSubroutines.size(); i++) {
+                            for (int i = 0; i<vm->activeSubroutines.size(); i++) {
                                 //for (auto it = frames.rbegin(); it != frames.rend(); it++) {
-                                auto frame = vm2::activeSubroutines.at(i);
+                                auto frame = vm->activeSubroutines.at(i);
                                 ImGui::PushID(i);
 
                                 if (!frame->subroutine) {
@@ -397,7 +410,7 @@ const v3: NoNumber<Primitive> = 34;
                                 }
 
                                 ImGui::SameLine();
-                                ImGui::TextColored(grey, to_string(showNonVariables ? frame->size() : frame->variables).c_str());
+                                ImGui::TextColored(grey, to_string(showNonVariables ? vm->frameSize(frame) : frame->variables).c_str());
 
                                 // Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
                                 if (selectedSubroutine == frame) ImGui::SetItemDefaultFocus();
@@ -412,18 +425,18 @@ const v3: NoNumber<Primitive> = 34;
                             ImGui::SameLine();
                             ImGui::BeginGroup();
                             auto start = selectedSubroutine->initialSp; // + frame->variables;
-                            auto end = vm2::sp;
-                            auto subroutinesEnd = vm2::activeSubroutines.size();
+                            auto end = vm->sp;
+                            auto subroutinesEnd = vm->activeSubroutines.size();
                             for (int i = 0; i<subroutinesEnd; i++) {
-                                if (vm2::activeSubroutines.at(i) == selectedSubroutine) {
+                                if (vm->activeSubroutines.at(i) == selectedSubroutine) {
                                     if (subroutinesEnd == i + 1) break; //end reached
-                                    end = vm2::activeSubroutines.at(i + 1)->initialSp;
+                                    end = vm->activeSubroutines.at(i + 1)->initialSp;
                                     break;
                                 }
                             }
 
                             if (end > start) {
-                                span<vm2::Type *> frameStack{vm2::stack.data() + start, end - start};
+                                span<vm2::Type *> frameStack{vm->stack.data() + start, end - start};
 
                                 for (unsigned int i = 0; i<frameStack.size(); i++) {
                                     auto type = frameStack[i];
@@ -432,14 +445,17 @@ const v3: NoNumber<Primitive> = 34;
                                     ImGui::Text("    ");
                                     ImGui::SameLine();
                                     if (i<selectedSubroutine->variables) {
-                                        auto ip = selectedSubroutine->variableIPs[i];
-                                        auto identifier = module->findIdentifier(ip);
-                                        ImGui::Text(identifier.c_str());
-                                        ImGui::SameLine();
+                                        if (auto ip = vm->variableIP(selectedSubroutine, i)) {
+                                            auto identifier = module->findIdentifier(ip);
+                                            ImGui::Text(identifier.c_str());
+                                            ImGui::SameLine();
+                                        }
                                     }
-                                    auto stype = vm2::stringify(type);
-                                    if (stype.size()>20) stype = stype.substr(0, 20) + "...";
+                                    auto printed = vm->printer.print(type);
+                                    auto stype = string(printed.substr(0, 20));
+                                    if (printed.size()>20) stype += "...";
                                     ImGui::TextColored(grey, stype.c_str());
+                                    if (ImGui::IsItemClicked()) graphStackIndex = start + i;
                                 }
                             }
                             ImGui::EndGroup();
@@ -451,6 +467,116 @@ const v3: NoNumber<Primitive> = 34;
             ImGui::End();
         }
 
+        {
+            ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiCond_FirstUseEver);
+            if (ImGui::Begin("Trace", nullptr)) {
+                static int scrub = -1;
+                if (trace.size()) {
+                    auto last = (int) trace.size() - 1;
+                    if (scrub < 0 || scrub > last) scrub = last;
+                    auto changed = false;
+                    if (ImGui::Button("<")) {
+                        scrub = std::max(0, scrub - 1);
+                        changed = true;
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button(">")) {
+                        scrub = std::min(last, scrub + 1);
+                        changed = true;
+                    }
+                    ImGui::SameLine();
+                    changed |= ImGui::SliderInt("step", &scrub, 0, last);
+
+                    auto &step = trace[scrub];
+                    ImGui::PushFont(fontMonoSmall);
+                    ImGui::Text("#%llu [%u] %s frame=%u sp=%u (%+d) %uns", (unsigned long long) (trace.first() + scrub), step.ip,
+                                string(magic_enum::enum_name((tr::instructions::OP) step.op)).c_str(), (unsigned int) step.frame, step.sp, step.stackDelta, step.nanoseconds);
+                    ImGui::PopFont();
+                    if (changed) {
+                        auto map = module->findNormalizedMap(step.ip);
+                        editor.highlights.clear();
+                        if (map.found()) {
+                            auto lineChar = module->mapToLineCharacter(map);
+                            editor.highlights.push_back({.line = (int) lineChar.line, .charPos = (int) lineChar.pos, .charEnd = (int) lineChar.end});
+                        }
+                    }
+
+                    ImGui::Text("Slowest");
+                    ImGui::PushFont(fontMonoSmall);
+                    for (auto &&spot: trace.hotspots(10)) {
+                        ImGui::Text("[%u] %s %llu steps %lluns", spot.ip, string(magic_enum::enum_name(spot.op)).c_str(), (unsigned long long) spot.steps, (unsigned long long) spot.nanoseconds);
+                    }
+                    ImGui::PopFont();
+                } else {
+                    ImGui::Text("Steps of Debug are recorded here");
+                }
+            }
+            ImGui::End();
+        }
+
+        {
+            ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiCond_FirstUseEver);
+            if (ImGui::Begin("Type Graph", nullptr)) {
+                layouter.poll();
+                vm2::Type *root = nullptr;
+                if (debugActive && !debugEnded && vm->sp) {
+                    root = vm->stack[graphStackIndex >= 0 && graphStackIndex<vm->sp ? graphStackIndex : vm->sp - 1];
+                }
+
+                //the graph is only built again when the VM made a step or another entry was clicked
+                static uint64_t lastStep = -1;
+                static vm2::Type *lastRoot = nullptr;
+                if (!root) {
+                    layouter.show(nullptr);
+                    lastRoot = nullptr;
+                } else if (root != lastRoot || trace.total() != lastStep) {
+                    lastRoot = root;
+                    lastStep = trace.total();
+                    ImGui::PushFont(fontMonoSmall);
+                    layouter.show(buildTypeGraph(root, vm->printer, [](const string &label) { return ImGui::CalcTextSize(label.c_str()).x; }));
+                    ImGui::PopFont();
+                }
+
+                auto graph = layouter.graph();
+                auto layout = layouter.layout();
+                if (graph && layout) {
+                    ImGui::Text("%u nodes%s", graph->size(), graph->truncated ? " (truncated)" : "");
+                    if (layouter.busy()) {
+                        ImGui::SameLine();
+                        ImGui::TextColored(grey, "laying out...");
+                    }
+
+                    ImGui::BeginChild("graph", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+                    auto origin = ImGui::GetCursorScreenPos();
+                    auto drawList = ImGui::GetWindowDrawList();
+                    auto lineColor = ImGui::GetColorU32(grey);
+                    auto textColor = ImGui::GetColorU32(ImGuiCol_Text);
+                    vector<ImVec2> points;
+                    for (auto &&edge: layout->edges) {
+                        points.clear();
+                        for (auto &&point: edge.points) points.push_back(ImVec2(origin.x + point.x, origin.y + point.y));
+                        drawList->AddPolyline(points.data(), points.size(), lineColor, 0, 1.5);
+                    }
+                    ImGui::PushFont(fontMonoSmall);
+                    for (unsigned int u = 0; u<graph->size(); u++) {
+                        auto center = ImVec2(origin.x + layout->positions[u].x, origin.y + layout->positions[u].y);
+                        auto text = ImGui::CalcTextSize(graph->labels[u].c_str());
+                        auto min = ImVec2(center.x - text.x / 2 - 4, center.y - text.y / 2 - 2);
+                        auto max = ImVec2(center.x + text.x / 2 + 4, center.y + text.y / 2 + 2);
+                        drawList->AddRectFilled(min, max, ImGui::GetColorU32(ImGuiCol_FrameBg), 4);
+                        drawList->AddRect(min, max, lineColor, 4);
+                        drawList->AddText(ImVec2(center.x - text.x / 2, center.y - text.y / 2), textColor, graph->labels[u].c_str());
+                    }
+                    ImGui::PopFont();
+                    ImGui::Dummy(ImVec2(layout->size.x + 20, layout->size.y + 20));
+                    ImGui::EndChild();
+                } else {
+                    ImGui::Text("Click a stack entry in Virtual Machine while debugging");
+                }
+            }
+            ImGui::End();
+        }
+
         {
             ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiCond_FirstUseEver);
             if (ImGui::Begin("Bytecode", nullptr)) {
@@ -500,7 +626,7 @@ const v3: NoNumber<Primitive> = 34;
                     for (auto &&op: s.operations) {
                         ImGui::TextColored(grey, to_string(op.address).c_str());
                         ImGui::SameLine();
-                        if (vm2::subroutine && vm2::subroutine->ip == op.address) {
+                        if (vm->subroutine && vm->subroutine->ip == op.address) {
                             ImGui::TextColored(yellow, op.text.c_str());
                         } else {
                             ImGui::Text(op.text.c_str());
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../checker/vm2.h"
+#include "./graph/interface.hpp"
+
+namespace tr::gui {
+    /**
+     * Nodes and edges of a type as plain data. Types are VM memory and change with every step, so the graph is built
+     * on the UI thread and only the copy goes to the layout thread. Equal subtrees (same vm2::structuralHash()) share
+     * one node, a parent always comes before its children.
+     */
+    struct TypeGraph {
+        uint64_t hash = 0;
+        std::vector<uint64_t> keys; //structuralHash() per node
+        std::vector<std::string> labels;
+        std::vector<float> sizes; //radius per node
+        std::vector<std::pair<vertex_t, vertex_t>> edges;
+        bool truncated = false; //maxNodes reached, the rest of the type is not part of the graph
+
+        unsigned int size() const {
+            return keys.size();
+        }
+    };
+
+    /**
+     * Calls `callback(Type *child)` for each type a node of `type` points to. Property names, parameter names and
+     * function names are part of the label and get no node of their own.
+     */
+    template<typename Callback>
+    inline void forEachGraphChild(vm2::Type *type, Callback &&callback) {
+        using vm2::TypeKind;
+        using vm2::TypeRef;
+        switch (type->kind) {
+            case TypeKind::Union:
+            case TypeKind::Tuple:
+            case TypeKind::TemplateLiteral:
+            case TypeKind::ObjectLiteral:
+            case TypeKind::ClassInstance: {
+                vm2::forEachChild(type, [&callback](vm2::Type *child, bool &stop) {
+                    if (child) callback(child);
+                });
+                break;
+            }
+            case TypeKind::PropertySignature: {
+                auto name = (TypeRef *) type->type;
+                if (name && name->next && name->next->type) callback(name->next->type);
+                break;
+            }
+            case TypeKind::TupleMember:
+            case TypeKind::Array:
+            case TypeKind::Rest:
+            case TypeKind::Parameter: {
+                if (type->type) callback((vm2::Type *) type->type);
+                break;
+            }
+            case TypeKind::Function: {
+                //name, return type, parameters
+                auto first = (TypeRef *) type->type;
+                if (!first || !first->next) break;
+                for (auto current = first->next->next; current; current = current->next) callback(current->type);
+                callback(first->next->type);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Graph of `root` with at most `maxNodes` nodes. `measure` returns the width of a label, the radius of a node
+     * is half of it (the layout works with circles).
+     */
+    inline std::shared_ptr<const TypeGraph> buildTypeGraph(vm2::Type *root, vm2::TypePrinter &printer, const std::function<float(const std::string &)> &measure, unsigned int maxNodes = 400) {
+        using vm2::TypeKind;
+        auto result = std::make_shared<TypeGraph>();
+        std::unordered_map<uint64_t, vertex_t> nodes;
+        std::unordered_set<uint64_t> edges;
+        std::vector<vm2::Type *> types;
+
+        auto label = [&printer](vm2::Type *type) -> std::string {
+            switch (type->kind) {
+                case TypeKind::Union:
+                case TypeKind::Tuple:
+                case TypeKind::TemplateLiteral:
+                case TypeKind::ObjectLiteral:
+                case TypeKind::ClassInstance:
+                case TypeKind::Array:
+                case TypeKind::Rest:
+                case TypeKind::Function: {
+                    return std::string(magic_enum::enum_name(type->kind));
+                }
+                case TypeKind::PropertySignature: {
+                    auto name = (vm2::TypeRef *) type->type;
+                    auto text = name && name->type ? std::string(printer.print(name->type)) : "?";
+                    return type->flag & vm2::TypeFlag::Optional ? text + "?" : text;
+                }
+                case TypeKind::TupleMember:
+                case TypeKind::Parameter: {
+                    return type->text().empty() ? std::string(magic_enum::enum_name(type->kind)) : std::string(type->text());
+                }
+                default: {
+                    return std::string(printer.print(type).substr(0, 24));
+                }
+            }
+        };
+
+        //returns the node of `type`, adds it if it is new. -1 when maxNodes is reached
+        auto add = [&](vm2::Type *type) -> int {
+            auto key = vm2::structuralHash(type);
+            if (auto it = nodes.find(key); it != nodes.end()) return it->second;
+            if (result->size() == maxNodes) {
+                result->truncated = true;
+                return -1;
+            }
+            vertex_t u = result->size();
+            nodes.emplace(key, u);
+            types.push_back(type);
+            result->keys.push_back(key);
+            result->labels.push_back(label(type));
+            result->sizes.push_back(std::max(8.0f, measure(result->labels.back()) / 2 + 4));
+            return u;
+        };
+
+        add(root);
+        //types grows while walking it, so children are visited breadth first
+        for (vertex_t u = 0; u<types.size(); u++) {
+            forEachGraphChild(types[u], [&](vm2::Type *child) {
+                auto v = add(child);
+                if (v<0 || (vertex_t) v == u) return;
+                //the layout does not support the same edge twice, e.g. `[a, a]`
+                if (edges.insert(((uint64_t) u << 32) | (uint64_t) v).second) result->edges.emplace_back(u, (vertex_t) v);
+            });
+        }
+
+        result->hash = hash::combine(hash::combine(vm2::structuralHash(root), result->size()), result->edges.size());
+        return result;
+    }
+
+    struct TypeGraphLayout {
+        std::vector<vec2> positions; //center per node of the TypeGraph
+        std::vector<path> edges;
+        vec2 size{0, 0};
+        bool final = false; //false for the placeholder shown while the layout thread works on it
+    };
+
+    inline std::shared_ptr<const TypeGraphLayout> layoutTypeGraph(const TypeGraph &typeGraph, const attributes &attrs) {
+        auto result = std::make_shared<TypeGraphLayout>();
+        result->final = true;
+        if (!typeGraph.size()) return result;
+
+        graph g;
+        for (auto size: typeGraph.sizes) g.add_node(size);
+        for (auto &&[from, to]: typeGraph.edges) g.add_edge(from, to);
+        sugiyama_layout layout(g, attrs);
+
+        result->positions.resize(typeGraph.size());
+        for (auto &&node: layout.vertices()) {
+            if (node.u<typeGraph.size()) result->positions[node.u] = node.pos;
+        }
+        result->edges = layout.edges();
+        result->size = layout.dimensions();
+        return result;
+    }
+
+    /**
+     * Layout shown until the real one of `next` is done: nodes that are also in `previous` keep their position, new
+     * ones are put in a row below their parent. Consecutive steps usually change only a part of a type, so the view
+     * stays stable and the new part is visible right away. Edges are straight lines.
+     */
+    inline std::shared_ptr<const TypeGraphLayout> provisionalLayout(const TypeGraph &next, const TypeGraph *previous, const TypeGraphLayout *previousLayout, const attributes &attrs) {
+        auto result = std::make_shared<TypeGraphLayout>();
+        std::unordered_map<uint64_t, vec2> known;
+        if (previous && previousLayout && previousLayout->positions.size() == previous->size()) {
+            for (unsigned int i = 0; i<previous->size(); i++) known.emplace(previous->keys[i], previousLayout->positions[i]);
+        }
+
+        std::vector<int> parents(next.size(), -1);
+        for (auto &&[from, to]: next.edges) {
+            if (parents[to]<0) parents[to] = from;
+        }
+
+        result->positions.resize(next.size());
+        std::vector<unsigned int> placedChildren(next.size());
+        for (unsigned int u = 0; u<next.size(); u++) {
+            vec2 position{next.sizes[u], next.sizes[u]};
+            if (auto it = known.find(next.keys[u]); it != known.end()) {
+                position = it->second;
+            } else if (parents[u] >= 0) {
+                //parents come before their children
+                auto parent = parents[u];
+                auto offset = placedChildren[parent]++ * (2 * next.sizes[u] + attrs.node_dist);
+                position = result->positions[parent] + vec2{offset, next.sizes[parent] + next.sizes[u] + attrs.layer_dist};
+            }
+            result->positions[u] = position;
+            result->size.x = std::max(result->size.x, position.x + next.sizes[u]);
+            result->size.y = std::max(result->size.y, position.y + next.sizes[u]);
+        }
+
+        for (auto &&[from, to]: next.edges) {
+            result->edges.push_back(path{from, to, {result->positions[from], result->positions[to]}});
+        }
+        return result;
+    }
+
+    /**
+     * Lays out type graphs on a background thread, so the frame loop never waits for the layout.
+     *
+     * show() switches to a graph right away: with a layout cached for its hash that one, otherwise a
+     * provisionalLayout() until the thread is done. Only the last requested graph is laid out, graphs requested
+     * in between are skipped. Finished layouts are picked up by poll() once per frame.
+     * All methods except the thread itself are meant for the UI thread.
+     */
+    class TypeGraphLayouter {
+        attributes attrs;
+
+        //shared with the thread
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::shared_ptr<const TypeGraph> pending;
+        std::vector<std::pair<uint64_t, std::shared_ptr<const TypeGraphLayout>>> finished;
+        bool stopping = false;
+
+        //UI thread only
+        std::unordered_map<uint64_t, std::shared_ptr<const TypeGraphLayout>> cache;
+        std::shared_ptr<const TypeGraph> current;
+        std::shared_ptr<const TypeGraphLayout> currentLayout;
+
+        std::thread thread;
+
+        void work() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                wake.wait(lock, [this] { return stopping || pending; });
+                if (stopping) return;
+                auto next = std::move(pending);
+                lock.unlock();
+                auto layout = layoutTypeGraph(*next, attrs);
+                lock.lock();
+                finished.emplace_back(next->hash, std::move(layout));
+            }
+        }
+
+    public:
+        //layouts kept by graph hash, the cache is emptied when it gets bigger
+        unsigned int maxCached = 256;
+
+        explicit TypeGraphLayouter(attributes attrs = {}): attrs(attrs), thread([this] { work(); }) {}
+
+        TypeGraphLayouter(const TypeGraphLayouter &) = delete;
+        TypeGraphLayouter &operator=(const TypeGraphLayouter &) = delete;
+
+        //waits for a running layout, it can not be interrupted
+        ~TypeGraphLayouter() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+
+        void show(std::shared_ptr<const TypeGraph> next) {
+            if (current && next && current->hash == next->hash) return;
+            if (!next) {
+                current = nullptr;
+                currentLayout = nullptr;
+                return;
+            }
+            if (auto it = cache.find(next->hash); it != cache.end()) {
+                current = std::move(next);
+                currentLayout = it->second;
+                return;
+            }
+            currentLayout = provisionalLayout(*next, current.get(), currentLayout.get(), attrs);
+            current = next;
+            {
+                std::lock_guard lock(mutex);
+                pending = std::move(next);
+            }
+            wake.notify_one();
+        }
+
+        //takes over layouts finished since the last call
+        void poll() {
+            std::vector<std::pair<uint64_t, std::shared_ptr<const TypeGraphLayout>>> done;
+            {
+                std::lock_guard lock(mutex);
+                done.swap(finished);
+            }
+            for (auto &&[hash, layout]: done) {
+                if (cache.size() >= maxCached) cache.clear();
+                cache[hash] = layout;
+                if (current && current->hash == hash) currentLayout = layout;
+            }
+        }
+
+        //graph and layout to draw, both nullptr when nothing is shown
+        const TypeGraph *graph() const {
+            return current.get();
+        }
+
+        const TypeGraphLayout *layout() const {
+            return currentLayout.get();
+        }
+
+        //true while the layout of the shown graph is not done yet
+        bool busy() const {
+            return currentLayout && !currentLayout->final;
+        }
+
+        size_t cached() const {
+            return cache.size();
+        }
+    };
+}
@@ -11,6 +11,24 @@ namespace tr::hash {
         static constexpr uint64_t hash(const char *p, uint64_t len, uint64_t seed) {
             return finalize((len >= 32 ? h32bytes(p, len, seed) : seed + PRIME5) + len, p + (len & ~0x1F), len & 0x1F);
         }
+
+        /**
+         * Same result as hash(), but loops over the 32 byte stripes instead of recursing. For large runtime inputs like whole files.
+         */
+        static uint64_t hashLarge(const char *p, uint64_t len, uint64_t seed) {
+            uint64_t h = seed + PRIME5;
+            if (len >= 32) {
+                uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+                for (auto stripe = p; stripe + 32 <= p + len; stripe += 32) {
+                    v1 = fetch64(stripe, v1);
+                    v2 = fetch64(stripe + 8, v2);
+                    v3 = fetch64(stripe + 16, v3);
+                    v4 = fetch64(stripe + 24, v4);
+                }
+                h = mix3(mix3(mix3(mix3(rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18), v1), v2), v3), v4);
+            }
+            return finalize(h + len, p + (len & ~0x1F), len & 0x1F);
+        }
     private:
         static constexpr uint64_t PRIME1 = 11400714785074694791ULL;
         static constexpr uint64_t PRIME2 = 14029467366897019727ULL;
@@ -107,6 +125,13 @@ namespace tr::hash {
         return xxh64::hash(input, length(input), 0);
     }
 
+    /**
+     * Mixes `value` into `seed`, order dependent. Used to build hashes of composite types.
+     */
+    inline constexpr uint64_t combine(uint64_t seed, uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4));
+    }
+
     inline consteval uint64_t operator ""_hash(const char *s, size_t size) {
         return xxh64::hash(s, size, 0);
     }
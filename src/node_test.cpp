@@ -24,7 +24,7 @@ namespace tr {
         return (getEmitFlags(node) & (int) EmitFlags::LocalName) != 0;
     }
 
-    bool hasModifier(const shared<Node> &node, SyntaxKind kind) {
+    bool hasModifier(const Node *node, SyntaxKind kind) {
         if (!node->modifiers) return false;
         for (auto &&v: node->modifiers->list) if (v->kind == kind) return true;
         return false;
@@ -121,6 +121,8 @@ namespace tr {
     }
 
     shared<NodeUnion(PropertyName)> resolveNameToNode(const shared<Node> &node) {
+        //optional names, e.g. of an ExportDeclaration or an ImportClause without default binding
+        if (!node) return nullptr;
         switch (node->kind) {
             case SyntaxKind::Identifier:
             case SyntaxKind::StringLiteral:
@@ -285,7 +287,7 @@ namespace tr {
             case SyntaxKind::ExportAssignment:
                 return resolveNameToNode(to<ExportAssignment>(node)->name);
             default:
-                if (auto v = dynamic_pointer_cast<PropertyAccessEntityNameExpression>(node)) {
+                if (auto v = to<PropertyAccessExpression>(node)) {
                     return resolveNameToNode(v->name);
                 }
         }
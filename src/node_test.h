@@ -23,7 +23,11 @@ namespace tr {
      */
     bool isLocalName(const shared<Node> &node);
 
-    bool hasModifier(const shared<Node> &node, SyntaxKind kind);
+    bool hasModifier(const Node *node, SyntaxKind kind);
+
+    inline bool hasModifier(const shared<Node> &node, SyntaxKind kind) {
+        return hasModifier(node.get(), kind);
+    }
 
     ModifierFlags modifierToFlag(SyntaxKind token);
 
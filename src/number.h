@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+namespace tr {
+    using std::string;
+    using std::string_view;
+
+    /**
+     * Value of the text of a NumericLiteral as the scanner produces it: decimal with fraction and exponent, or
+     * 0x/0b/0o (legacy octal like `010` is already converted to decimal). Separators are skipped.
+     */
+    inline double parseNumber(string_view text) {
+        if (text.size()>2 && text[0] == '0') {
+            int base = 0;
+            switch (text[1]) {
+                case 'x':
+                case 'X': base = 16; break;
+                case 'b':
+                case 'B': base = 2; break;
+                case 'o':
+                case 'O': base = 8; break;
+            }
+            if (base) {
+                double value = 0;
+                for (auto c: text.substr(2)) {
+                    if (c == '_') continue;
+                    int digit = c >= '0' && c<='9' ? c - '0' : c >= 'a' && c<='f' ? c - 'a' + 10 : c >= 'A' && c<='F' ? c - 'A' + 10 : base;
+                    if (digit >= base) break;
+                    value = value * base + digit;
+                }
+                return value;
+            }
+        }
+        string digits;
+        digits.reserve(text.size());
+        for (auto c: text) {
+            if (c != '_') digits += c;
+        }
+        //out of range gives HUGE_VAL, which is Infinity like in JS
+        return std::strtod(digits.c_str(), nullptr);
+    }
+
+    /**
+     * Text of `value` like JS Number.prototype.toString(): the shortest digits that parse back to the same value,
+     * in exponent notation below 1e-6 and from 1e21 on. So `1`, `1.0` and `0x1` are all "1", which is also the
+     * property name JS uses for them.
+     */
+    inline string formatNumber(double value) {
+        if (std::isnan(value)) return "NaN";
+        if (std::isinf(value)) return value<0 ? "-Infinity" : "Infinity";
+        if (value == 0) return "0";
+
+        //shortest round trip digits, either `123.456` or `1.23456e+21`
+        auto shortest = fmt::format("{}", std::abs(value));
+        string digits;
+        int point = -1; //value = 0.digits * 10^point
+        int exponent = 0;
+        for (size_t i = 0; i<shortest.size(); i++) {
+            auto c = shortest[i];
+            if (c == '.') {
+                point = digits.size();
+            } else if (c == 'e') {
+                exponent = std::atoi(shortest.c_str() + i + 1);
+                break;
+            } else {
+                digits += c;
+            }
+        }
+        if (point<0) point = digits.size();
+        point += exponent;
+        auto leading = digits.find_first_not_of('0');
+        digits.erase(0, leading);
+        point -= leading;
+        digits.erase(digits.find_last_not_of('0') + 1);
+
+        string result = value<0 ? "-" : "";
+        int k = digits.size();
+        if (k<=point && point<=21) {
+            result += digits;
+            result.append(point - k, '0');
+        } else if (0<point && point<=21) {
+            result += digits.substr(0, point);
+            result += '.';
+            result += digits.substr(point);
+        } else if (-6<point && point<=0) {
+            result += "0.";
+            result.append(-point, '0');
+            result += digits;
+        } else {
+            result += digits[0];
+            if (k>1) {
+                result += '.';
+                result += digits.substr(1);
+            }
+            result += point - 1 >= 0 ? "e+" : "e-";
+            result += std::to_string(std::abs(point - 1));
+        }
+        return result;
+    }
+}
@@ -9,7 +9,7 @@ namespace tr {
 
     template<typename T>
     shared<NodeArray> sameMap(const sharedOpt<NodeArray> &array, const function<shared<T>(shared<T>, int)> &callback) {
-        auto result = make_shared<NodeArray>();
+        auto result = makeNode<NodeArray>();
         if (array) {
             auto i = 0;
             for (auto &v: array->list) {
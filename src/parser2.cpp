@@ -13,6 +13,10 @@ namespace tr {
     optional<DiagnosticWithDetachedLocation> Parser::parseErrorAtPosition(int start, int length, const shared<DiagnosticMessage> &message, DiagnosticArg arg) {
         ZoneScoped;
 
+        // Mark that we've encountered an error.  We'll set an appropriate bit on the next
+        // node we finish so that it can't be reused incrementally.
+        parseErrorBeforeNextFinishedNode = true;
+
         auto lastError = lastOrUndefined(parseDiagnostics);
         // Don't report another error if it would just be at the same position as the last error.
         if (!lastError || start != lastError->start) {
@@ -21,10 +25,6 @@ namespace tr {
             return d;
         }
 
-        // Mark that we've encountered an error.  We'll set an appropriate bit on the next
-        // node we finish so that it can't be reused incrementally.
-        parseErrorBeforeNextFinishedNode = true;
-
         return nullopt;
     }
 
@@ -11,6 +11,7 @@
 #include "core.h"
 #include "path.h"
 #include "scanner.h"
+#include "syntax_cursor.h"
 #include "node_test.h"
 #include "factory.h"
 #include "hash.h"
@@ -101,8 +102,7 @@ namespace tr {
 ////    export const parseNodeFactory = createNodeFactory(NodeFactoryFlags.NoParenthesizerRules, parseBaseNodeFactory);
 
     inline sharedOpt<Node> visitNode(const function<sharedOpt<Node>(shared<Node>)> &cbNode, const sharedOpt<Node> &node) {
-        if (node) cbNode(node);
-        return nullptr;
+        return node ? cbNode(node) : nullptr;
     }
 
 //    Node *visitNode(function<Node*(Node &)> cbNode, Node &node) {
@@ -684,6 +684,27 @@ namespace tr {
         }
     }
 
+    /**
+     * Whether `node` or any node below it has a parse error. The answer is aggregated from the children once and
+     * cached in the flags of `node` (HasAggregatedChildData), like aggregateChildData() in TypeScript.
+     */
+    inline bool containsParseError(const shared<Node> &node) {
+        if (!(node->flags & (int) NodeFlags::HasAggregatedChildData)) {
+            auto child = [](const shared<Node> &child) -> sharedOpt<Node> {
+                return containsParseError(child) ? child : nullptr;
+            };
+            auto children = [](const shared<NodeArray> &nodes) -> sharedOpt<Node> {
+                for (auto &&node: nodes->list) if (containsParseError(node)) return node;
+                return nullptr;
+            };
+            if (node->flags & (int) NodeFlags::ThisNodeHasError || forEachChild(node, child, children)) {
+                node->flags |= (int) NodeFlags::ThisNodeOrAnySubNodesHasError;
+            }
+            node->flags |= (int) NodeFlags::HasAggregatedChildData;
+        }
+        return node->flags & (int) NodeFlags::ThisNodeOrAnySubNodesHasError;
+    }
+
     //@note: not in use inside Parser
 //    /** @internal */
 //    /**
@@ -766,6 +787,13 @@ namespace tr {
          * check specified by `isFileProbablyExternalModule` will be used to set the field.
          */
         optional<function<void(shared<SourceFile>)>> setExternalModuleIndicator;
+
+        /**
+         * Bodies of functions, methods, accessors and arrow functions are skipped by brace matching instead of parsed.
+         * They become an empty Block with `bodySkipped` set that still spans the body. Useful for declaration-like
+         * sources where only signatures matter, errors inside bodies are not reported.
+         */
+        bool skipFunctionBodies = false;
     };
 
 //
@@ -844,6 +872,9 @@ namespace tr {
         Scanner scanner{ScriptTarget::Latest, /*skipTrivia*/ true};
         Factory factory;
 
+        // See CreateSourceFileOptions::skipFunctionBodies
+        bool skipFunctionBodies = false;
+
         int disallowInAndDecoratorContext = (int) NodeFlags::DisallowInContext | (int) NodeFlags::DecoratorContext;
 
 //        // capture constructors in 'initializeState' to avoid null checks
@@ -877,11 +908,13 @@ namespace tr {
         LanguageVariant languageVariant;
         vector<DiagnosticWithDetachedLocation> parseDiagnostics;
         vector<DiagnosticWithDetachedLocation> jsDocDiagnostics;
-//        auto syntaxCursor: IncrementalParser.SyntaxCursor | undefined;
+        SyntaxCursor *syntaxCursor = nullptr;
+        //set by parseSourceFileStatements, receives the top-level statements instead of SourceFile::statements
+        const function<void(const shared<Node> &)> *statementSink = nullptr;
 
         SyntaxKind currentToken;
         int nodeCount = 0;
-        unordered_map<string, string> identifiers;
+        shared<AtomTable> identifiers;
         unordered_map<string, string> privateIdentifiers;
 //        auto privateIdentifiers: ESMap<string, string>;
         int identifierCount = 0;
@@ -1012,7 +1045,7 @@ namespace tr {
             return func();
         }
 
-        void initializeState(string _fileName, string _sourceText, ScriptTarget _languageVersion, ScriptKind _scriptKind) {
+        void initializeState(string _fileName, string _sourceText, ScriptTarget _languageVersion, SyntaxCursor *_syntaxCursor, ScriptKind _scriptKind) {
             ZoneScoped;
 //            NodeConstructor = objectAllocator.getNodeConstructor();
 //            TokenConstructor = objectAllocator.getTokenConstructor();
@@ -1023,13 +1056,14 @@ namespace tr {
             fileName = normalizePath(_fileName);
             sourceText = _sourceText;
             languageVersion = _languageVersion;
+            syntaxCursor = _syntaxCursor;
             scriptKind = _scriptKind;
             languageVariant = getLanguageVariant(_scriptKind);
 
             parseDiagnostics.clear();
             parsingContext = 0;
-            identifiers.clear();
-//            identifiers = new Map<string, string>();
+            //reused nodes keep their atoms
+            identifiers = syntaxCursor ? syntaxCursor->getSourceFile()->identifiers : make_shared<AtomTable>();
 //            privateIdentifiers = new Map<string, string>();
             identifierCount = 0;
             nodeCount = 0;
@@ -1067,7 +1101,8 @@ namespace tr {
             // Clear any data.  We don't want to accidentally hold onto it for too long.
             sourceText = "";
             languageVersion = ScriptTarget::Latest;
-//            syntaxCursor = undefined;
+            syntaxCursor = nullptr;
+            statementSink = nullptr;
             scriptKind = ScriptKind::Unknown;
             languageVariant = LanguageVariant::Standard;
             sourceFlags = 0;
@@ -1359,8 +1394,9 @@ namespace tr {
         SyntaxKind scanJsxText() {
             return currentToken = scanner.scanJsxToken();
         }
-        template<typename T>
-        T speculationHelper(const function<T()> &callback, SpeculationKind speculationKind) {
+        //callbacks are templates, so the many speculations per token don't allocate a std::function each
+        template<typename T, typename F>
+        T speculationHelper(F &callback, SpeculationKind speculationKind) {
             ZoneScoped;
             // Keep track of the state we'll need to rollback to if lookahead fails (or if the
             // caller asked us to always reset our state).
@@ -1400,8 +1436,8 @@ namespace tr {
          * was in immediately prior to invoking the callback.  The result of invoking the callback
          * is returned from this function.
          */
-        template<typename T>
-        T lookAhead(const function<T()> &callback) {
+        template<typename T, typename F>
+        T lookAhead(F &&callback) {
             ZoneScoped;
             return speculationHelper<T>(callback, SpeculationKind::Lookahead);
         }
@@ -1452,7 +1488,7 @@ namespace tr {
             if (token() == tokenIfBlankName) {
                 parseErrorAtCurrentToken(blankDiagnostic);
             } else {
-                parseErrorAtCurrentToken(nameDiagnostic, scanner.getTokenValue());
+                parseErrorAtCurrentToken(nameDiagnostic, string(scanner.getTokenValue()));
             }
         }
 
@@ -1713,10 +1749,10 @@ namespace tr {
         }
 
 
-        string internIdentifier(const string &text) {
+        string internIdentifier(string_view text) {
             //this was used in the JS version as optimization to not reuse text instances.
             //we do not need that.
-            return text;
+            return string(text);
 //            auto identifier = get(identifiers, text);
 //            if (!identifier) {
 //                identifier = text;
@@ -1753,8 +1789,8 @@ namespace tr {
          * callback returns something truthy, then the parser state is not rolled back.  The result
          * of invoking the callback is returned from this function.
          */
-        template<typename T>
-        T tryParse(const function<T()> &callback) {
+        template<typename T, typename F>
+        T tryParse(F &&callback) {
             return speculationHelper<T>(callback, SpeculationKind::TryParse);
         }
 
@@ -2024,22 +2060,19 @@ namespace tr {
             // Note: This may be too conservative.  Perhaps we could reuse the node and set the bit
             // on it (or its leftmost child) as having the error.  For now though, being conservative
             // is nice and likely won't ever affect perf.
-//            if (!syntaxCursor || !isReusableParsingContext(parsingContext) || parseErrorBeforeNextFinishedNode) {
-//                return undefined;
-//            }
+            //SyntaxCursor only tracks top-level statements
+            if (!syntaxCursor || parsingContext != ParsingContext::SourceElements || parseErrorBeforeNextFinishedNode) {
+                return nullptr;
+            }
 
-            //I hope we do not need to reimplement syntaxCursor too
-            return nullptr;
+            auto node = syntaxCursor->currentNode(scanner.getStartPos());
 
-//            auto node = syntaxCursor.currentNode(scanner.getStartPos());
-//
-//            // Can't reuse a missing node.
-//            // Can't reuse a node that intersected the change range.
-//            // Can't reuse a node that contains a parse error.  This is necessary so that we
-//            // produce the same set of errors again.
-//            if (nodeIsMissing(node) || node.intersectsChange || containsParseError(node)) {
-//                return undefined;
-//            }
+            // Can't reuse a missing node.
+            // Can't reuse a node that contains a parse error.  This is necessary so that we
+            // produce the same set of errors again.
+            if (!node || nodeIsMissing(node) || containsParseError(node)) {
+                return nullptr;
+            }
 //
 //            // We can only reuse a node if it was parsed under the same strict mode that we're
 //            // currently in.  i.e. if we originally parsed a node in non-strict mode, but then
@@ -2052,23 +2085,13 @@ namespace tr {
 //            // differently depending on what mode it is in.
 //            //
 //            // This also applies to all our other context flags as well.
-//            auto nodeContextFlags = node.flags & NodeFlags::ContextFlags;
-//            if (nodeContextFlags != contextFlags) {
-//                return undefined;
-//            }
-//
-//            // Ok, we have a node that looks like it could be reused.  Now verify that it is valid
-//            // in the current list parsing context that we're currently at.
-//            if (!canReuseNode(node, parsingContext)) {
-//                return undefined;
-//            }
-//
-//            if (reinterpret_cast<JSDocContainer&>(node).jsDocCache) {
-//                // jsDocCache may include tags from parent nodes, which might have been modified.
-//                reinterpret_cast<JSDocContainer&>(node).jsDocCache = undefined;
-//            }
-//
-//            return node;
+            auto nodeContextFlags = node->flags & (int) NodeFlags::ContextFlags;
+            if (nodeContextFlags != contextFlags) {
+                return nullptr;
+            }
+
+            // Every top-level statement can be reused in SourceElements, canReuseNode() is not needed.
+            return node;
         }
 
         bool isHeritageClause() {
@@ -2943,11 +2966,20 @@ namespace tr {
             ZoneScoped;
             int saveParsingContext = parsingContext;
             parsingContext |= 1 << (int) kind;
-            auto list = make_shared<NodeArray>();
+            auto list = makeNode<NodeArray>();
             auto listPos = getNodePos();
 
             while (!isListTerminator(kind)) {
                 if (isListElement(kind, /*inErrorRecovery*/ false)) {
+                    if (statementSink && kind == ParsingContext::SourceElements) {
+                        //each statement gets its own arena, so its memory is gone once the sink let go of it
+                        NodeArena::Scope arena(make_shared<NodeArena>());
+                        auto n = parseListElement(kind, parseElement);
+                        if (!n) throw runtime_error("No node given");
+                        (*statementSink)(n);
+                        continue;
+                    }
+
                     auto n = parseListElement(kind, parseElement);
                     if (!n) throw runtime_error("No node given");
                     list->push(n);
@@ -2971,7 +3003,7 @@ namespace tr {
             ZoneScoped;
             auto saveParsingContext = parsingContext;
             parsingContext |= 1 << (int) kind;
-            auto list = make_shared<NodeArray>();
+            auto list = makeNode<NodeArray>();
             auto listPos = getNodePos();
 
             int commaStart = -1; // Meaning the previous token was not a comma
@@ -3042,7 +3074,7 @@ namespace tr {
 //        }
 
         shared<NodeArray> createMissingList() {
-            auto list = createNodeArray(make_shared<NodeArray>(), getNodePos());
+            auto list = createNodeArray(makeNode<NodeArray>(), getNodePos());
             list->isMissingList = true;
             return list;
         }
@@ -3061,9 +3093,13 @@ namespace tr {
                 auto pos = getNodePos();
                 // Store original token kind if it is not just an Identifier so we can report appropriate error later in type checker
                 auto originalKeywordKind = token();
-                auto text = internIdentifier(scanner.getTokenValue());
+                auto text = scanner.getTokenValue();
+                auto atom = identifiers->intern(text, scanner.getTokenValueHash());
+                auto identifier = factory.createIdentifier(string(text), /*typeArguments*/ {}, originalKeywordKind);
+                identifier->atom = atom.id;
+                identifier->hash = atom.hash;
                 nextTokenWithoutCheck();
-                return finishNode(factory.createIdentifier(text, /*typeArguments*/ {}, originalKeywordKind), pos);
+                return finishNode(identifier, pos);
             }
 
             if (token() == SyntaxKind::PrivateIdentifier) {
@@ -3224,18 +3260,14 @@ namespace tr {
 
         shared<TemplateSpan> parseTemplateSpan(bool isTaggedTemplate) {
             auto pos = getNodePos();
-            return finishNode(
-                    factory.createTemplateSpan(
-                            allowInAnd<shared<Expression>>(CALLBACK(parseExpression)),
-                            parseLiteralOfTemplateSpan(isTaggedTemplate)
-                    ),
-                    pos
-            );
+            auto expression = allowInAnd<shared<Expression>>(CALLBACK(parseExpression));
+            auto literal = parseLiteralOfTemplateSpan(isTaggedTemplate);
+            return finishNode(factory.createTemplateSpan(expression, literal), pos);
         }
 
         shared<NodeArray> parseTemplateSpans(bool isTaggedTemplate) {
             auto pos = getNodePos();
-            auto list = make_shared<NodeArray>();
+            auto list = makeNode<NodeArray>();
             sharedOpt<TemplateSpan> node;
             do {
                 node = parseTemplateSpan(isTaggedTemplate);
@@ -3255,13 +3287,9 @@ namespace tr {
 
         shared<TemplateExpression> parseTemplateExpression(bool isTaggedTemplate) {
             auto pos = getNodePos();
-            return finishNode(
-                    factory.createTemplateExpression(
-                            parseTemplateHead(isTaggedTemplate),
-                            parseTemplateSpans(isTaggedTemplate)
-                    ),
-                    pos
-            );
+            auto head = parseTemplateHead(isTaggedTemplate);
+            auto spans = parseTemplateSpans(isTaggedTemplate);
+            return finishNode(factory.createTemplateExpression(head, spans), pos);
         }
 
         shared<Node> parseEntityName(bool allowReservedWords, const sharedOpt<DiagnosticMessage> &diagnosticMessage = nullptr) {
@@ -3303,13 +3331,10 @@ namespace tr {
 
         shared<TypeReferenceNode> parseTypeReference() {
             auto pos = getNodePos();
-            return finishNode(
-                    factory.createTypeReferenceNode(
-                            parseEntityNameOfTypeReference(),
-                            parseTypeArgumentsOfTypeReference()
-                    ),
-                    pos
-            );
+            //the order of function arguments is unspecified (GCC goes right to left), the name has to be parsed first
+            auto typeName = parseEntityNameOfTypeReference();
+            auto typeArguments = parseTypeArgumentsOfTypeReference();
+            return finishNode(factory.createTypeReferenceNode(typeName, typeArguments), pos);
         }
 
         // If true, we should abort parsing an error function.
@@ -3649,7 +3674,7 @@ namespace tr {
             sharedOpt<Node> decorator;
             sharedOpt<NodeArray> list;
             while (decorator = tryParseDecorator()) {
-                if (!list) list = make_shared<NodeArray>();
+                if (!list) list = makeNode<NodeArray>();
                 list->push(decorator);
             }
             if (!list) return nullptr;
@@ -3699,7 +3724,7 @@ namespace tr {
             sharedOpt<Node> modifier;
             while ((modifier = tryParseModifier(permitInvalidConstAsModifier, stopOnStartOfClassStaticBlock, hasSeenStatic))) {
                 if (modifier->kind == SyntaxKind::StaticKeyword) hasSeenStatic = true;
-                if (!list) list = make_shared<NodeArray>();
+                if (!list) list = makeNode<NodeArray>();
                 list->push(modifier);
             }
             if (list) return createNodeArray(list, pos);
@@ -3777,19 +3802,12 @@ namespace tr {
                 return nullptr;
             }
 
+            auto name = parseNameOfParameter(modifiers);
+            auto questionToken = parseOptionalToken<QuestionToken>(SyntaxKind::QuestionToken);
+            auto type = parseTypeAnnotation();
+            auto initializer = parseInitializer();
             auto node = withJSDoc(
-                    finishNode(
-                            factory.createParameterDeclaration(
-                                    decorators,
-                                    modifiers,
-                                    dotDotDotToken,
-                                    parseNameOfParameter(modifiers),
-                                    parseOptionalToken<QuestionToken>(SyntaxKind::QuestionToken),
-                                    parseTypeAnnotation(),
-                                    parseInitializer()
-                            ),
-                            pos
-                    ),
+                    finishNode(factory.createParameterDeclaration(decorators, modifiers, dotDotDotToken, name, questionToken, type, initializer), pos),
                     hasJSDoc
             );
             topLevel = savedTopLevel;
@@ -3862,22 +3880,22 @@ namespace tr {
         string getTemplateLiteralRawText(SyntaxKind kind) {
             auto isLast = kind == SyntaxKind::NoSubstitutionTemplateLiteral || kind == SyntaxKind::TemplateTail;
             auto tokenText = scanner.getTokenText();
-            return substring(tokenText, 1, tokenText.size() - (scanner.isUnterminated() ? 0 : isLast ? 1 : 2));
+            return string(substring(tokenText, 1, tokenText.size() - (scanner.isUnterminated() ? 0 : isLast ? 1 : 2)));
         }
 
         shared<LiteralLike> parseLiteralLikeNode(SyntaxKind kind) {
             auto pos = getNodePos();
             shared<LiteralLike> node =
-                    isTemplateLiteralKind(kind) ? factory.createTemplateLiteralLikeNode(kind, scanner.getTokenValue(), getTemplateLiteralRawText(kind), scanner.getTokenFlags() & (int) TokenFlags::TemplateLiteralLikeFlags) :
+                    isTemplateLiteralKind(kind) ? factory.createTemplateLiteralLikeNode(kind, string(scanner.getTokenValue()), getTemplateLiteralRawText(kind), scanner.getTokenFlags() & (int) TokenFlags::TemplateLiteralLikeFlags) :
                     // Octal literals are not allowed in strict mode or ES5
                     // Note that theoretically the following condition would hold true literals like 009,
                     // which is not octal. But because of how the scanner separates the tokens, we would
                     // never get a token like this. Instead, we would get 00 and 9 as two separate tokens.
                     // We also do not need to check for negatives because any prefix operator would be part of a
                     // parent unary expression.
-                    kind == SyntaxKind::NumericLiteral ? factory.createNumericLiteral(scanner.getTokenValue(), scanner.getNumericLiteralFlags()) :
-                    kind == SyntaxKind::StringLiteral ? factory.createStringLiteral(scanner.getTokenValue(), /*isSingleQuote*/ {}, scanner.hasExtendedUnicodeEscape()) :
-                    isLiteralKind(kind) ? factory.createLiteralLikeNode(kind, scanner.getTokenValue()) :
+                    kind == SyntaxKind::NumericLiteral ? factory.createNumericLiteral(string(scanner.getTokenValue()), scanner.getNumericLiteralFlags()) :
+                    kind == SyntaxKind::StringLiteral ? factory.createStringLiteral(string(scanner.getTokenValue()), /*isSingleQuote*/ {}, scanner.hasExtendedUnicodeEscape()) :
+                    isLiteralKind(kind) ? factory.createLiteralLikeNode(kind, string(scanner.getTokenValue())) :
                     throw runtime_error("Nope");
 
             if (scanner.hasExtendedUnicodeEscape()) {
@@ -3921,7 +3939,7 @@ namespace tr {
 
         shared<PrivateIdentifier> parsePrivateIdentifier() {
             auto pos = getNodePos();
-            auto node = factory.createPrivateIdentifier(internPrivateIdentifier(scanner.getTokenText()));
+            auto node = factory.createPrivateIdentifier(internPrivateIdentifier(string(scanner.getTokenText())));
             nextToken();
             return finishNode(node, pos);
         }
@@ -4051,7 +4069,7 @@ namespace tr {
                 auto pos = getNodePos();
                 nextToken();
                 auto modifier = finishNode(factory.createToken<AbstractKeyword>(SyntaxKind::AbstractKeyword), pos);
-                auto list = make_shared<NodeArray>();
+                auto list = makeNode<NodeArray>();
                 list->push(modifier);
                 modifiers = createNodeArray(list, pos);
             }
@@ -4194,7 +4212,7 @@ namespace tr {
 
         shared<JsxText> parseJsxText() {
             auto pos = getNodePos();
-            auto node = factory.createJsxText(scanner.getTokenValue(), currentToken == SyntaxKind::JsxTextAllWhiteSpaces);
+            auto node = factory.createJsxText(string(scanner.getTokenValue()), currentToken == SyntaxKind::JsxTextAllWhiteSpaces);
             currentToken = scanner.scanJsxToken();
             return finishNode(node, pos);
         }
@@ -4257,7 +4275,7 @@ namespace tr {
         }
 
         shared<NodeArray> parseJsxChildren(shared<NodeUnion(JsxOpeningElement, JsxOpeningFragment)> openingTag) {
-            auto list = make_shared<NodeArray>();
+            auto list = makeNode<NodeArray>();
             auto listPos = getNodePos();
             auto saveParsingContext = parsingContext;
             parsingContext |= 1 << (int) ParsingContext::JsxChildren;
@@ -4337,9 +4355,9 @@ namespace tr {
                                               jsxElement->openingElement->pos,
                                               end);
 
-                    auto c = children->slice(0, children->length() - 1);
-                    c.push_back(newLast);
-                    children = createNodeArray(make_shared<NodeArray>(c), children->pos, end);
+                    auto c = makeNode<NodeArray>(children->slice(0, children->length() - 1));
+                    c->push(newLast);
+                    children = createNodeArray(c, children->pos, end);
                     closingElement = jsxElement->closingElement;
                 } else {
                     closingElement = parseJsxClosingElement(opening, inExpressionContext);
@@ -4356,7 +4374,9 @@ namespace tr {
                 result = finishNode(factory.createJsxElement(opening, children, closingElement), pos);
             } else if (_opening->kind == SyntaxKind::JsxOpeningFragment) {
                 auto opening = reinterpret_pointer_cast<JsxOpeningFragment>(_opening);
-                result = finishNode(factory.createJsxFragment(opening, parseJsxChildren(opening), parseJsxClosingFragment(inExpressionContext)), pos);
+                auto children = parseJsxChildren(opening);
+                auto closingFragment = parseJsxClosingFragment(inExpressionContext);
+                result = finishNode(factory.createJsxFragment(opening, children, closingFragment), pos);
             } else {
                 assert(_opening->kind == SyntaxKind::JsxSelfClosingElement);
                 // Nothing else to do for self-closing elements
@@ -4416,7 +4436,8 @@ namespace tr {
 
             scanJsxIdentifier();
             auto pos = getNodePos();
-            return finishNode(factory.createJsxAttribute(parseIdentifierName(), parseJsxAttributeValue()), pos);
+            auto name = parseIdentifierName();
+            return finishNode(factory.createJsxAttribute(name, parseJsxAttributeValue()), pos);
         }
 
         shared<JsxAttributes> parseJsxAttributes() {
@@ -4501,7 +4522,7 @@ namespace tr {
             setAwaitContext(!!(flags & (int) SignatureFlags::Await));
 
             sharedOpt<NodeArray> parameters = flags & (int) SignatureFlags::JSDoc ?
-                                              make_shared<NodeArray>() : //we ignore JSDoc, parseDelimitedList(ParsingContext::JSDocParameters, parseJSDocParameter) :
+                                              makeNode<NodeArray>() : //we ignore JSDoc, parseDelimitedList(ParsingContext::JSDocParameters, parseJSDocParameter) :
                                               parseDelimitedList(ParsingContext::Parameters, [this, &allowAmbiguity, savedAwaitContext]()->sharedOpt<Node> { return allowAmbiguity ? parseParameter(savedAwaitContext) : parseParameterForSpeculation(savedAwaitContext); });
 
             setYieldContext(savedYieldContext);
@@ -4594,7 +4615,98 @@ namespace tr {
             }
         }
 
+        // A `/` after these tokens is a division, otherwise it starts a regular expression.
+        bool canPrecedeDivision(SyntaxKind kind) {
+            switch (kind) {
+                case SyntaxKind::Identifier:
+                case SyntaxKind::PrivateIdentifier:
+                case SyntaxKind::NumericLiteral:
+                case SyntaxKind::BigIntLiteral:
+                case SyntaxKind::StringLiteral:
+                case SyntaxKind::RegularExpressionLiteral:
+                case SyntaxKind::NoSubstitutionTemplateLiteral:
+                case SyntaxKind::TemplateTail:
+                case SyntaxKind::CloseParenToken:
+                case SyntaxKind::CloseBracketToken:
+                case SyntaxKind::PlusPlusToken:
+                case SyntaxKind::MinusMinusToken:
+                    return true;
+                //keywords that are followed by an expression
+                case SyntaxKind::ReturnKeyword:
+                case SyntaxKind::TypeOfKeyword:
+                case SyntaxKind::InstanceOfKeyword:
+                case SyntaxKind::InKeyword:
+                case SyntaxKind::OfKeyword:
+                case SyntaxKind::NewKeyword:
+                case SyntaxKind::DeleteKeyword:
+                case SyntaxKind::VoidKeyword:
+                case SyntaxKind::ThrowKeyword:
+                case SyntaxKind::CaseKeyword:
+                case SyntaxKind::DoKeyword:
+                case SyntaxKind::ElseKeyword:
+                case SyntaxKind::YieldKeyword:
+                case SyntaxKind::AwaitKeyword:
+                case SyntaxKind::ExtendsKeyword:
+                    return false;
+                default:
+                    //this, super, true, null, contextual keywords used as names, ...
+                    return kind >= SyntaxKind::FirstKeyword && kind <= SyntaxKind::LastKeyword;
+            }
+        }
+
+        // Consumes a `{ ... }` body on the token level without building nodes, see CreateSourceFileOptions::skipFunctionBodies.
+        shared<Block> skipFunctionBlock() {
+            auto pos = getNodePos();
+            nextToken(); // `{`
+            auto multiLine = scanner.hasPrecedingLineBreak();
+            auto statements = createNodeArray(makeNode<NodeArray>(), getNodePos());
+
+            int depth = 1;
+            vector<int> substitutions; //depth of each open `${`
+            auto previous = SyntaxKind::OpenBraceToken;
+            while (token() != SyntaxKind::EndOfFileToken) {
+                switch (token()) {
+                    case SyntaxKind::OpenBraceToken:
+                        depth++;
+                        break;
+                    case SyntaxKind::TemplateHead:
+                        substitutions.push_back(++depth);
+                        break;
+                    case SyntaxKind::CloseBraceToken:
+                        if (!substitutions.empty() && substitutions.back() == depth) {
+                            //continues the template, either with the next substitution or its end
+                            if (reScanTemplateToken(/*isTaggedTemplate*/ false) == SyntaxKind::TemplateTail) {
+                                substitutions.pop_back();
+                                depth--;
+                            }
+                            break;
+                        }
+                        depth--;
+                        break;
+                    case SyntaxKind::SlashToken:
+                    case SyntaxKind::SlashEqualsToken:
+                        if (!canPrecedeDivision(previous)) reScanSlashToken();
+                        break;
+                    default:
+                        break;
+                }
+                if (depth == 0) break;
+                previous = token();
+                nextToken();
+            }
+            parseExpected(SyntaxKind::CloseBraceToken);
+
+            auto block = finishNode(factory.createBlock(statements, multiLine), pos);
+            block->bodySkipped = true;
+            return block;
+        }
+
         shared<Block> parseFunctionBlock(int flags, const sharedOpt<DiagnosticMessage> &diagnosticMessage = nullptr) {
+            //JSX text is not tokenized like code, so brace matching does not work there
+            if (skipFunctionBodies && token() == SyntaxKind::OpenBraceToken && languageVariant != LanguageVariant::JSX) {
+                return skipFunctionBlock();
+            }
+
             auto savedYieldContext = inYieldContext();
             setYieldContext(!!(flags & (int) SignatureFlags::Yield));
 
@@ -5989,18 +6101,14 @@ namespace tr {
 
         shared<TemplateLiteralTypeSpan> parseTemplateTypeSpan() {
             auto pos = getNodePos();
-            return finishNode(
-                    factory.createTemplateLiteralTypeSpan(
-                            parseType(),
-                            parseLiteralOfTemplateSpan(/*isTaggedTemplate*/ false)
-                    ),
-                    pos
-            );
+            auto type = parseType();
+            auto literal = parseLiteralOfTemplateSpan(/*isTaggedTemplate*/ false);
+            return finishNode(factory.createTemplateLiteralTypeSpan(type, literal), pos);
         }
 
         shared<NodeArray> parseTemplateTypeSpans() {
             auto pos = getNodePos();
-            auto list = make_shared<NodeArray>();
+            auto list = makeNode<NodeArray>();
             shared<TemplateLiteralTypeSpan> node;
             do {
                 node = parseTemplateTypeSpan();
@@ -6011,13 +6119,9 @@ namespace tr {
 
         shared<TemplateLiteralTypeNode> parseTemplateType() {
             auto pos = getNodePos();
-            return finishNode(
-                    factory.createTemplateLiteralType(
-                            parseTemplateHead(/*isTaggedTemplate*/ false),
-                            parseTemplateTypeSpans()
-                    ),
-                    pos
-            );
+            auto head = parseTemplateHead(/*isTaggedTemplate*/ false);
+            auto spans = parseTemplateTypeSpans();
+            return finishNode(factory.createTemplateLiteralType(head, spans), pos);
         }
 
         shared<TypeNode> parseNonArrayType() {
@@ -6180,7 +6284,7 @@ namespace tr {
             auto hasLeadingOperator = parseOptional(operatorKind);
             sharedOpt<TypeNode> type = hasLeadingOperator ? parseFunctionOrConstructorTypeToError(isUnionType) : parseConstituentType();
             if (token() == operatorKind || hasLeadingOperator) {
-                auto types = make_shared<NodeArray>(type);
+                auto types = makeNode<NodeArray>(type);
                 while (parseOptional(operatorKind)) {
                     if (auto a = parseFunctionOrConstructorTypeToError(isUnionType)) {
                         types->push(a);
@@ -6376,13 +6480,8 @@ namespace tr {
 
             if (!scanner.hasPrecedingLineBreak() &&
                 (token() == SyntaxKind::AsteriskToken || isStartOfExpression())) {
-                return finishNode(
-                        factory.createYieldExpression(
-                                parseOptionalToken<AsteriskToken>(SyntaxKind::AsteriskToken),
-                                parseAssignmentExpressionOrHigher()
-                        ),
-                        pos
-                );
+                auto asteriskToken = parseOptionalToken<AsteriskToken>(SyntaxKind::AsteriskToken);
+                return finishNode(factory.createYieldExpression(asteriskToken, parseAssignmentExpressionOrHigher()), pos);
             } else {
                 // if the next token is not on the same line as yield.  or we don't have an '*' or
                 // the start of an expression, then this is just a simple "yield" expression.
@@ -6540,7 +6639,7 @@ namespace tr {
                 auto pos = getNodePos();
                 nextToken();
                 auto modifier = finishNode(factory.createToken<AsyncKeyword>(SyntaxKind::AsyncKeyword), pos);
-                auto list = make_shared<NodeArray>();
+                auto list = makeNode<NodeArray>();
                 list->push(modifier);
                 return factory.createNodeArray(list, pos);
             }
@@ -6723,7 +6822,7 @@ namespace tr {
             );
             finishNode(parameter, identifier->pos);
 
-            auto parameters = createNodeArray(make_shared<NodeArray>(parameter), parameter->pos, parameter->end);
+            auto parameters = createNodeArray(makeNode<NodeArray>(parameter), parameter->pos, parameter->end);
 
             auto equalsGreaterThanToken = parseExpectedToken<EqualsGreaterThanToken>(SyntaxKind::EqualsGreaterThanToken);
             auto body = parseArrowFunctionExpressionBody(/*isAsync*/ !!asyncModifier);
@@ -6755,19 +6854,12 @@ namespace tr {
 
             // Note: we explicitly 'allowIn' in the whenTrue part of the condition expression, and
             // we do not that for the 'whenFalse' part.
-            sharedOpt<ColonToken> colonToken;
-            return finishNode(
-                    factory.createConditionalExpression(
-                            leftOperand,
-                            questionToken,
-                            doOutsideOfContext<shared<Expression>>(disallowInAndDecoratorContext, CALLBACK(parseAssignmentExpressionOrHigher)),
-                            colonToken = parseExpectedToken<ColonToken>(SyntaxKind::ColonToken),
-                            nodeIsPresent(colonToken)
-                            ? parseAssignmentExpressionOrHigher()
-                            : createMissingNode<Identifier>(SyntaxKind::Identifier, /*reportAtCurrentPosition*/ false, Diagnostics::_0_expected(), tokenToString(SyntaxKind::ColonToken))
-                    ),
-                    pos
-            );
+            auto whenTrue = doOutsideOfContext<shared<Expression>>(disallowInAndDecoratorContext, CALLBACK(parseAssignmentExpressionOrHigher));
+            sharedOpt<ColonToken> colonToken = parseExpectedToken<ColonToken>(SyntaxKind::ColonToken);
+            shared<Expression> whenFalse = nodeIsPresent(colonToken)
+                                           ? parseAssignmentExpressionOrHigher()
+                                           : createMissingNode<Identifier>(SyntaxKind::Identifier, /*reportAtCurrentPosition*/ false, Diagnostics::_0_expected(), tokenToString(SyntaxKind::ColonToken));
+            return finishNode(factory.createConditionalExpression(leftOperand, questionToken, whenTrue, colonToken, whenFalse), pos);
         }
 
         shared<Expression> parseAssignmentExpressionOrHigher() {
@@ -7279,19 +7371,19 @@ namespace tr {
 //                case SyntaxKind::ModuleKeyword:
 //                case SyntaxKind::NamespaceKeyword:
 //                    return parseModuleDeclaration(pos, hasJSDoc, decorators, modifiers);
-//                case SyntaxKind::ImportKeyword:
-//                    return parseImportDeclarationOrImportEqualsDeclaration(pos, hasJSDoc, decorators, modifiers);
-//                case SyntaxKind::ExportKeyword:
-//                    nextToken();
-//                    switch (token()) {
+                case SyntaxKind::ImportKeyword:
+                    return parseImportDeclarationOrImportEqualsDeclaration(pos, hasJSDoc, decorators, modifiers);
+                case SyntaxKind::ExportKeyword:
+                    nextToken();
+                    switch (token()) {
 //                        case SyntaxKind::DefaultKeyword:
 //                        case SyntaxKind::EqualsToken:
 //                            return parseExportAssignment(pos, hasJSDoc, decorators, modifiers);
 //                        case SyntaxKind::AsKeyword:
 //                            return parseNamespaceExportDeclaration(pos, hasJSDoc, decorators, modifiers);
-//                        default:
-//                            return parseExportDeclaration(pos, hasJSDoc, decorators, modifiers);
-//                    }
+                        default:
+                            return parseExportDeclaration(pos, hasJSDoc, decorators, modifiers);
+                    }
 //                default:
 //                    if (decorators || modifiers) {
 //                        // We reached this point because we encountered decorators and/or modifiers and assumed a declaration
@@ -7408,7 +7500,7 @@ namespace tr {
 //            sourceFile.commentDirectives = scanner.getCommentDirectives();
 //            sourceFile.nodeCount = nodeCount;
 //            sourceFile.identifierCount = identifierCount;
-//            sourceFile.identifiers = identifiers;
+            sourceFile->identifiers = identifiers;
 //            sourceFile.parseDiagnostics = attachFileToDiagnostics(parseDiagnostics, sourceFile);
 //            if (jsDocDiagnostics) {
 //                sourceFile.jsDocDiagnostics = attachFileToDiagnostics(jsDocDiagnostics, sourceFile);
@@ -7556,62 +7648,75 @@ namespace tr {
 //            return withJSDoc(finishNode(node, pos), hasJSDoc);
 //        }
 //
-//        function parseImportDeclarationOrImportEqualsDeclaration(int pos, bool hasJSDoc, sharedOpt<NodeArray>  decorators, sharedOpt<NodeArray>  modifiers): ImportEqualsDeclaration | ImportDeclaration {
-//            parseExpected(SyntaxKind::ImportKeyword);
-//
-//            auto afterImportPos = scanner.getStartPos();
-//
-//            // We don't parse the identifier here in await context, instead we will report a grammar error in the checker.
-//            auto identifier: Identifier | undefined;
-//            if (isIdentifier()) {
-//                identifier = parseIdentifier();
-//            }
-//
-//            auto isTypeOnly = false;
-//            if (token() != SyntaxKind::FromKeyword &&
-//                identifier?.escapedText == "type" &&
-//                (isIdentifier() || tokenAfterImportDefinitelyProducesImportDeclaration())
-//            ) {
-//                isTypeOnly = true;
-//                identifier = isIdentifier() ? parseIdentifier() : undefined;
-//            }
-//
-//            if (identifier && !tokenAfterImportedIdentifierDefinitelyProducesImportDeclaration()) {
-//                return parseImportEqualsDeclaration(pos, hasJSDoc, decorators, modifiers, identifier, isTypeOnly);
-//            }
-//
-//            // ImportDeclaration:
-//            //  import ImportClause from ModuleSpecifier ;
-//            //  import ModuleSpecifier;
-//            auto importClause: ImportClause | undefined;
-//            if (identifier || // import id
-//                token() == SyntaxKind::AsteriskToken || // import *
-//                token() == SyntaxKind::OpenBraceToken    // import {
-//            ) {
-//                importClause = parseImportClause(identifier, afterImportPos, isTypeOnly);
-//                parseExpected(SyntaxKind::FromKeyword);
-//            }
-//            auto moduleSpecifier = parseModuleSpecifier();
-//
-//            auto assertClause: AssertClause | undefined;
-//            if (token() == SyntaxKind::AssertKeyword && !scanner.hasPrecedingLineBreak()) {
-//                assertClause = parseAssertClause();
-//            }
-//
-//            parseSemicolon();
-//            auto node = factory.createImportDeclaration(decorators, modifiers, importClause, moduleSpecifier, assertClause);
-//            return withJSDoc(finishNode(node, pos), hasJSDoc);
-//        }
+        shared<Statement> parseImportDeclarationOrImportEqualsDeclaration(int pos, bool hasJSDoc, const sharedOpt<NodeArray> &decorators, const sharedOpt<NodeArray> &modifiers) {
+            parseExpected(SyntaxKind::ImportKeyword);
+
+            auto afterImportPos = scanner.getStartPos();
+
+            // We don't parse the identifier here in await context, instead we will report a grammar error in the checker.
+            sharedOpt<Identifier> identifier;
+            if (isIdentifier()) {
+                identifier = parseIdentifier();
+            }
+
+            auto isTypeOnly = false;
+            if (token() != SyntaxKind::FromKeyword &&
+                identifier && identifier->escapedText == "type" &&
+                (isIdentifier() || tokenAfterImportDefinitelyProducesImportDeclaration())
+                    ) {
+                isTypeOnly = true;
+                identifier = isIdentifier() ? parseIdentifier() : nullptr;
+            }
+
+            if (identifier && !tokenAfterImportedIdentifierDefinitelyProducesImportDeclaration()) {
+                //todo: parseImportEqualsDeclaration, there is no ImportEqualsDeclaration node yet. Its module reference
+                //is skipped, so the statements after it are parsed as usual.
+                parseExpected(SyntaxKind::EqualsToken);
+                if (token() == SyntaxKind::RequireKeyword && lookAhead<bool>(CALLBACK(nextTokenIsOpenParen))) {
+                    nextToken();
+                    parseExpected(SyntaxKind::OpenParenToken);
+                    parseModuleSpecifier();
+                    parseExpected(SyntaxKind::CloseParenToken);
+                } else {
+                    parseEntityName(/*allowReservedWords*/ false);
+                }
+                parseSemicolon();
+                parseErrorAtRange(identifier, Diagnostics::Import_assignment_cannot_be_used_when_targeting_ECMAScript_modules_Consider_using_import_Asterisk_as_ns_from_mod_import_a_from_mod_import_d_from_mod_or_another_module_format_instead());
+                return withJSDoc(finishNode(factory.createMissingDeclaration(), pos), hasJSDoc);
+            }
+
+            // ImportDeclaration:
+            //  import ImportClause from ModuleSpecifier ;
+            //  import ModuleSpecifier;
+            sharedOpt<ImportClause> importClause;
+            if (identifier || // import id
+                token() == SyntaxKind::AsteriskToken || // import *
+                token() == SyntaxKind::OpenBraceToken    // import {
+                    ) {
+                importClause = parseImportClause(identifier, afterImportPos, isTypeOnly);
+                parseExpected(SyntaxKind::FromKeyword);
+            }
+            auto moduleSpecifier = parseModuleSpecifier();
+
+            sharedOpt<AssertClause> assertClause;
+            if (token() == SyntaxKind::AssertKeyword && !scanner.hasPrecedingLineBreak()) {
+                assertClause = parseAssertClause();
+            }
+
+            parseSemicolon();
+            auto node = factory.createImportDeclaration(decorators, modifiers, importClause, moduleSpecifier, assertClause);
+            return withJSDoc(finishNode(node, pos), hasJSDoc);
+        }
 //
-//        function tokenAfterImportDefinitelyProducesImportDeclaration() {
-//            return token() == SyntaxKind::AsteriskToken || token() == SyntaxKind::OpenBraceToken;
-//        }
+        bool tokenAfterImportDefinitelyProducesImportDeclaration() {
+            return token() == SyntaxKind::AsteriskToken || token() == SyntaxKind::OpenBraceToken;
+        }
 //
-//        function tokenAfterImportedIdentifierDefinitelyProducesImportDeclaration() {
-//            // In `import id ___`, the current token decides whether to produce
-//            // an ImportDeclaration or ImportEqualsDeclaration.
-//            return token() == SyntaxKind::CommaToken || token() == SyntaxKind::FromKeyword;
-//        }
+        bool tokenAfterImportedIdentifierDefinitelyProducesImportDeclaration() {
+            // In `import id ___`, the current token decides whether to produce
+            // an ImportDeclaration or ImportEqualsDeclaration.
+            return token() == SyntaxKind::CommaToken || token() == SyntaxKind::FromKeyword;
+        }
 //
 //        function parseImportEqualsDeclaration(int pos, bool hasJSDoc, sharedOpt<NodeArray>  decorators, sharedOpt<NodeArray>  modifiers, identifier: Identifier, isTypeOnly: boolean): ImportEqualsDeclaration {
 //            parseExpected(SyntaxKind::EqualsToken);
@@ -7622,24 +7727,24 @@ namespace tr {
 //            return finished;
 //        }
 //
-//        function parseImportClause(identifier: Identifier | undefined, int pos, isTypeOnly: boolean) {
-//            // ImportClause:
-//            //  ImportedDefaultBinding
-//            //  NameSpaceImport
-//            //  NamedImports
-//            //  ImportedDefaultBinding, NameSpaceImport
-//            //  ImportedDefaultBinding, NamedImports
-//
-//            // If there was no default import or if there is comma token after default import
-//            // parse namespace or named imports
-//            auto namedBindings: NamespaceImport | NamedImports | undefined;
-//            if (!identifier ||
-//                parseOptional(SyntaxKind::CommaToken)) {
-//                namedBindings = token() == SyntaxKind::AsteriskToken ? parseNamespaceImport() : parseNamedImportsOrExports(SyntaxKind::NamedImports);
-//            }
-//
-//            return finishNode(factory.createImportClause(isTypeOnly, identifier, namedBindings), pos);
-//        }
+        shared<ImportClause> parseImportClause(const sharedOpt<Identifier> &identifier, int pos, bool isTypeOnly) {
+            // ImportClause:
+            //  ImportedDefaultBinding
+            //  NameSpaceImport
+            //  NamedImports
+            //  ImportedDefaultBinding, NameSpaceImport
+            //  ImportedDefaultBinding, NamedImports
+
+            // If there was no default import or if there is comma token after default import
+            // parse namespace or named imports
+            sharedOpt<Node> namedBindings;
+            if (!identifier ||
+                parseOptional(SyntaxKind::CommaToken)) {
+                namedBindings = token() == SyntaxKind::AsteriskToken ? (shared<Node>) parseNamespaceImport() : (shared<Node>) parseNamedImportsOrExports(SyntaxKind::NamedImports);
+            }
+
+            return finishNode(factory.createImportClause(isTypeOnly, identifier, namedBindings), pos);
+        }
 //
 //        function parseModuleReference() {
 //            return isExternalModuleReference()
@@ -7656,178 +7761,167 @@ namespace tr {
 //            return finishNode(factory.createExternalModuleReference(expression), pos);
 //        }
 //
-//        function parseModuleSpecifier(): Expression {
-//            if (token() == SyntaxKind::StringLiteral) {
-//                auto result = parseLiteralNode();
-//                result.text = internIdentifier(result.text);
-//                return result;
-//            }
-//            else {
-//                // We allow arbitrary expressions here, even though the grammar only allows string
-//                // literals.  We check to ensure that it is only a string literal later in the grammar
-//                // check pass.
-//                return parseExpression();
-//            }
-//        }
-//
-//        function parseNamespaceImport(): NamespaceImport {
-//            // NameSpaceImport:
-//            //  * as ImportedBinding
-//            auto pos = getNodePos();
-//            parseExpected(SyntaxKind::AsteriskToken);
-//            parseExpected(SyntaxKind::AsKeyword);
-//            auto name = parseIdentifier();
-//            return finishNode(factory.createNamespaceImport(name), pos);
-//        }
-//
-//        function parseNamedImportsOrExports(kind: SyntaxKind::NamedImports): NamedImports;
-//        function parseNamedImportsOrExports(kind: SyntaxKind::NamedExports): NamedExports;
-//        function parseNamedImportsOrExports(kind: SyntaxKind): NamedImportsOrExports {
-//            auto pos = getNodePos();
+        shared<Expression> parseModuleSpecifier() {
+            if (token() == SyntaxKind::StringLiteral) {
+                auto result = parseLiteralNode();
+                result->text = internIdentifier(result->text);
+                return result;
+            } else {
+                // We allow arbitrary expressions here, even though the grammar only allows string
+                // literals.  We check to ensure that it is only a string literal later in the grammar
+                // check pass.
+                return parseExpression();
+            }
+        }
 //
-//            // NamedImports:
-//            //  { }
-//            //  { ImportsList }
-//            //  { ImportsList, }
-//
-//            // ImportsList:
-//            //  ImportSpecifier
-//            //  ImportsList, ImportSpecifier
-//            auto node = kind == SyntaxKind::NamedImports
-//                ? factory.createNamedImports(parseBracketedList(ParsingContext::ImportOrExportSpecifiers, parseImportSpecifier, SyntaxKind::OpenBraceToken, SyntaxKind::CloseBraceToken))
-//                : factory.createNamedExports(parseBracketedList(ParsingContext::ImportOrExportSpecifiers, parseExportSpecifier, SyntaxKind::OpenBraceToken, SyntaxKind::CloseBraceToken));
-//            return finishNode(node, pos);
-//        }
+        shared<NamespaceImport> parseNamespaceImport() {
+            // NameSpaceImport:
+            //  * as ImportedBinding
+            auto pos = getNodePos();
+            parseExpected(SyntaxKind::AsteriskToken);
+            parseExpected(SyntaxKind::AsKeyword);
+            auto name = parseIdentifier();
+            return finishNode(factory.createNamespaceImport(name), pos);
+        }
 //
-//        function parseExportSpecifier() {
-//            auto hasJSDoc = hasPrecedingJSDocComment();
-//            return withJSDoc(parseImportOrExportSpecifier(SyntaxKind::ExportSpecifier) as ExportSpecifier, hasJSDoc);
-//        }
+        shared<Node> parseNamedImportsOrExports(SyntaxKind kind) {
+            auto pos = getNodePos();
+
+            // NamedImports:
+            //  { }
+            //  { ImportsList }
+            //  { ImportsList, }
+
+            // ImportsList:
+            //  ImportSpecifier
+            //  ImportsList, ImportSpecifier
+            if (kind == SyntaxKind::NamedImports) {
+                return finishNode(factory.createNamedImports(parseBracketedList(ParsingContext::ImportOrExportSpecifiers, CALLBACK(parseImportSpecifier), SyntaxKind::OpenBraceToken, SyntaxKind::CloseBraceToken)), pos);
+            }
+            return finishNode(factory.createNamedExports(parseBracketedList(ParsingContext::ImportOrExportSpecifiers, CALLBACK(parseExportSpecifier), SyntaxKind::OpenBraceToken, SyntaxKind::CloseBraceToken)), pos);
+        }
 //
-//        function parseImportSpecifier() {
-//            return parseImportOrExportSpecifier(SyntaxKind::ImportSpecifier) as ImportSpecifier;
-//        }
+        shared<Node> parseExportSpecifier() {
+            auto hasJSDoc = hasPrecedingJSDocComment();
+            return withJSDoc(parseImportOrExportSpecifier(SyntaxKind::ExportSpecifier), hasJSDoc);
+        }
 //
-//        function parseImportOrExportSpecifier(kind: SyntaxKind): ImportOrExportSpecifier {
-//            auto pos = getNodePos();
-//            // ImportSpecifier:
-//            //   BindingIdentifier
-//            //   IdentifierName as BindingIdentifier
-//            // ExportSpecifier:
-//            //   IdentifierName
-//            //   IdentifierName as IdentifierName
-//            auto checkIdentifierIsKeyword = isKeyword(token()) && !isIdentifier();
-//            auto checkIdentifierStart = scanner.getTokenPos();
-//            auto checkIdentifierEnd = scanner.getTextPos();
-//            auto isTypeOnly = false;
-//            auto propertyName: Identifier | undefined;
-//            auto canParseAsKeyword = true;
-//            auto name = parseIdentifierName();
-//            if (name.escapedText == "type") {
-//                // If the first token of an import specifier is 'type', there are a lot of possibilities,
-//                // especially if we see 'as' afterwards:
-//                //
-//                // import { type } from "mod";          - isTypeOnly: false,   name: type
-//                // import { type as } from "mod";       - isTypeOnly: true,    name: as
-//                // import { type as as } from "mod";    - isTypeOnly: false,   name: as,    propertyName: type
-//                // import { type as as as } from "mod"; - isTypeOnly: true,    name: as,    propertyName: as
-//                if (token() == SyntaxKind::AsKeyword) {
-//                    // { type as ...? }
-//                    auto firstAs = parseIdentifierName();
-//                    if (token() == SyntaxKind::AsKeyword) {
-//                        // { type as as ...? }
-//                        auto secondAs = parseIdentifierName();
-//                        if (tokenIsIdentifierOrKeyword(token())) {
-//                            // { type as as something }
-//                            isTypeOnly = true;
-//                            propertyName = firstAs;
-//                            name = parseNameWithKeywordCheck();
-//                            canParseAsKeyword = false;
-//                        }
-//                        else {
-//                            // { type as as }
-//                            propertyName = name;
-//                            name = secondAs;
-//                            canParseAsKeyword = false;
-//                        }
-//                    }
-//                    else if (tokenIsIdentifierOrKeyword(token())) {
-//                        // { type as something }
-//                        propertyName = name;
-//                        canParseAsKeyword = false;
-//                        name = parseNameWithKeywordCheck();
-//                    }
-//                    else {
-//                        // { type as }
-//                        isTypeOnly = true;
-//                        name = firstAs;
-//                    }
-//                }
-//                else if (tokenIsIdentifierOrKeyword(token())) {
-//                    // { type something ...? }
-//                    isTypeOnly = true;
-//                    name = parseNameWithKeywordCheck();
-//                }
-//            }
+        shared<Node> parseImportSpecifier() {
+            return parseImportOrExportSpecifier(SyntaxKind::ImportSpecifier);
+        }
 //
-//            if (canParseAsKeyword && token() == SyntaxKind::AsKeyword) {
-//                propertyName = name;
-//                parseExpected(SyntaxKind::AsKeyword);
-//                name = parseNameWithKeywordCheck();
-//            }
-//            if (kind == SyntaxKind::ImportSpecifier && checkIdentifierIsKeyword) {
-//                parseErrorAt(checkIdentifierStart, checkIdentifierEnd, Diagnostics::Identifier_expected());
-//            }
-//            auto node = kind == SyntaxKind::ImportSpecifier
-//                ? factory.createImportSpecifier(isTypeOnly, propertyName, name)
-//                : factory.createExportSpecifier(isTypeOnly, propertyName, name);
-//            return finishNode(node, pos);
-//
-//            function parseNameWithKeywordCheck() {
-//                checkIdentifierIsKeyword = isKeyword(token()) && !isIdentifier();
-//                checkIdentifierStart = scanner.getTokenPos();
-//                checkIdentifierEnd = scanner.getTextPos();
-//                return parseIdentifierName();
-//            }
-//        }
+        shared<Node> parseImportOrExportSpecifier(SyntaxKind kind) {
+            auto pos = getNodePos();
+            // ImportSpecifier:
+            //   BindingIdentifier
+            //   IdentifierName as BindingIdentifier
+            // ExportSpecifier:
+            //   IdentifierName
+            //   IdentifierName as IdentifierName
+            auto checkIdentifierIsKeyword = isKeyword(token()) && !isIdentifier();
+            auto checkIdentifierStart = scanner.getTokenPos();
+            auto checkIdentifierEnd = scanner.getTextPos();
+            auto isTypeOnly = false;
+            sharedOpt<Identifier> propertyName;
+            auto canParseAsKeyword = true;
+            auto name = parseIdentifierName();
+            auto parseNameWithKeywordCheck = [&]() {
+                checkIdentifierIsKeyword = isKeyword(token()) && !isIdentifier();
+                checkIdentifierStart = scanner.getTokenPos();
+                checkIdentifierEnd = scanner.getTextPos();
+                return parseIdentifierName();
+            };
+            if (name->escapedText == "type") {
+                // If the first token of an import specifier is 'type', there are a lot of possibilities,
+                // especially if we see 'as' afterwards:
+                //
+                // import { type } from "mod";          - isTypeOnly: false,   name: type
+                // import { type as } from "mod";       - isTypeOnly: true,    name: as
+                // import { type as as } from "mod";    - isTypeOnly: false,   name: as,    propertyName: type
+                // import { type as as as } from "mod"; - isTypeOnly: true,    name: as,    propertyName: as
+                if (token() == SyntaxKind::AsKeyword) {
+                    // { type as ...? }
+                    auto firstAs = parseIdentifierName();
+                    if (token() == SyntaxKind::AsKeyword) {
+                        // { type as as ...? }
+                        auto secondAs = parseIdentifierName();
+                        if (tokenIsIdentifierOrKeyword(token())) {
+                            // { type as as something }
+                            isTypeOnly = true;
+                            propertyName = firstAs;
+                            name = parseNameWithKeywordCheck();
+                            canParseAsKeyword = false;
+                        } else {
+                            // { type as as }
+                            propertyName = name;
+                            name = secondAs;
+                            canParseAsKeyword = false;
+                        }
+                    } else if (tokenIsIdentifierOrKeyword(token())) {
+                        // { type as something }
+                        propertyName = name;
+                        canParseAsKeyword = false;
+                        name = parseNameWithKeywordCheck();
+                    } else {
+                        // { type as }
+                        isTypeOnly = true;
+                        name = firstAs;
+                    }
+                } else if (tokenIsIdentifierOrKeyword(token())) {
+                    // { type something ...? }
+                    isTypeOnly = true;
+                    name = parseNameWithKeywordCheck();
+                }
+            }
+
+            if (canParseAsKeyword && token() == SyntaxKind::AsKeyword) {
+                propertyName = name;
+                parseExpected(SyntaxKind::AsKeyword);
+                name = parseNameWithKeywordCheck();
+            }
+            if (kind == SyntaxKind::ImportSpecifier && checkIdentifierIsKeyword) {
+                parseErrorAt(checkIdentifierStart, checkIdentifierEnd, Diagnostics::Identifier_expected());
+            }
+            if (kind == SyntaxKind::ImportSpecifier) return finishNode(factory.createImportSpecifier(isTypeOnly, propertyName, name), pos);
+            return finishNode(factory.createExportSpecifier(isTypeOnly, propertyName, name), pos);
+        }
 //
-//        function parseNamespaceExport(int pos): NamespaceExport {
-//            return finishNode(factory.createNamespaceExport(parseIdentifierName()), pos);
-//        }
+        shared<NamespaceExport> parseNamespaceExport(int pos) {
+            return finishNode(factory.createNamespaceExport(parseIdentifierName()), pos);
+        }
 //
-//        function parseExportDeclaration(int pos, bool hasJSDoc, sharedOpt<NodeArray>  decorators, sharedOpt<NodeArray>  modifiers): ExportDeclaration {
-//            auto savedAwaitContext = inAwaitContext();
-//            setAwaitContext(/*value*/ true);
-//            auto exportClause: NamedExportBindings | undefined;
-//            auto moduleSpecifier: Expression | undefined;
-//            auto assertClause: AssertClause | undefined;
-//            auto isTypeOnly = parseOptional(SyntaxKind::TypeKeyword);
-//            auto namespaceExportPos = getNodePos();
-//            if (parseOptional(SyntaxKind::AsteriskToken)) {
-//                if (parseOptional(SyntaxKind::AsKeyword)) {
-//                    exportClause = parseNamespaceExport(namespaceExportPos);
-//                }
-//                parseExpected(SyntaxKind::FromKeyword);
-//                moduleSpecifier = parseModuleSpecifier();
-//            }
-//            else {
-//                exportClause = parseNamedImportsOrExports(SyntaxKind::NamedExports);
-//                // It is not uncommon to accidentally omit the 'from' keyword. Additionally, in editing scenarios,
-//                // the 'from' keyword can be parsed as a named export when the export clause is unterminated (i.e. `export { from "moduleName";`)
-//                // If we don't have a 'from' keyword, see if we have a string literal such that ASI won't take effect.
-//                if (token() == SyntaxKind::FromKeyword || (token() == SyntaxKind::StringLiteral && !scanner.hasPrecedingLineBreak())) {
-//                    parseExpected(SyntaxKind::FromKeyword);
-//                    moduleSpecifier = parseModuleSpecifier();
-//                }
-//            }
-//            if (moduleSpecifier && token() == SyntaxKind::AssertKeyword && !scanner.hasPrecedingLineBreak()) {
-//                assertClause = parseAssertClause();
-//            }
-//            parseSemicolon();
-//            setAwaitContext(savedAwaitContext);
-//            auto node = factory.createExportDeclaration(decorators, modifiers, isTypeOnly, exportClause, moduleSpecifier, assertClause);
-//            return withJSDoc(finishNode(node, pos), hasJSDoc);
-//        }
+        shared<ExportDeclaration> parseExportDeclaration(int pos, bool hasJSDoc, const sharedOpt<NodeArray> &decorators, const sharedOpt<NodeArray> &modifiers) {
+            auto savedAwaitContext = inAwaitContext();
+            setAwaitContext(/*value*/ true);
+            sharedOpt<Node> exportClause;
+            sharedOpt<Expression> moduleSpecifier;
+            sharedOpt<AssertClause> assertClause;
+            auto isTypeOnly = parseOptional(SyntaxKind::TypeKeyword);
+            auto namespaceExportPos = getNodePos();
+            if (parseOptional(SyntaxKind::AsteriskToken)) {
+                if (parseOptional(SyntaxKind::AsKeyword)) {
+                    exportClause = parseNamespaceExport(namespaceExportPos);
+                }
+                parseExpected(SyntaxKind::FromKeyword);
+                moduleSpecifier = parseModuleSpecifier();
+            } else {
+                exportClause = parseNamedImportsOrExports(SyntaxKind::NamedExports);
+                // It is not uncommon to accidentally omit the 'from' keyword. Additionally, in editing scenarios,
+                // the 'from' keyword can be parsed as a named export when the export clause is unterminated (i.e. `export { from "moduleName";`)
+                // If we don't have a 'from' keyword, see if we have a string literal such that ASI won't take effect.
+                if (token() == SyntaxKind::FromKeyword || (token() == SyntaxKind::StringLiteral && !scanner.hasPrecedingLineBreak())) {
+                    parseExpected(SyntaxKind::FromKeyword);
+                    moduleSpecifier = parseModuleSpecifier();
+                }
+            }
+            if (moduleSpecifier && token() == SyntaxKind::AssertKeyword && !scanner.hasPrecedingLineBreak()) {
+                assertClause = parseAssertClause();
+            }
+            parseSemicolon();
+            setAwaitContext(savedAwaitContext);
+            auto node = factory.createExportDeclaration(decorators, modifiers, isTypeOnly, exportClause, moduleSpecifier, assertClause);
+            return withJSDoc(finishNode(node, pos), hasJSDoc);
+        }
 //
 //        function parseExportAssignment(int pos, bool hasJSDoc, sharedOpt<NodeArray>  decorators, sharedOpt<NodeArray>  modifiers): ExportAssignment {
 //            auto savedAwaitContext = inAwaitContext();
@@ -8882,7 +8976,7 @@ namespace tr {
 //            }
 //        }
 
-        shared<SourceFile> parseSourceFile(const string &fileName, const string &sourceText, ScriptTarget languageVersion, bool setParentNodes, optional<ScriptKind> _scriptKind, optional<function<void(shared<SourceFile>)>> setExternalModuleIndicatorOverride) {
+        shared<SourceFile> parseSourceFile(const string &fileName, const string &sourceText, ScriptTarget languageVersion, bool setParentNodes, optional<ScriptKind> _scriptKind, optional<function<void(shared<SourceFile>)>> setExternalModuleIndicatorOverride, SyntaxCursor *syntaxCursor = nullptr) {
             ZoneScoped;
             auto scriptKind = ensureScriptKind(fileName, _scriptKind);
 
@@ -8898,7 +8992,9 @@ namespace tr {
             //                return result;
             //            }
 
-            initializeState(fileName, sourceText, languageVersion, scriptKind);
+            //all nodes of this file go into one arena, released in one go once the last node is gone
+            NodeArena::Scope arena(make_shared<NodeArena>());
+            initializeState(fileName, sourceText, languageVersion, syntaxCursor, scriptKind);
 
             auto result = parseSourceFileWorker(languageVersion, setParentNodes, scriptKind, setExternalModuleIndicatorOverride ? *setExternalModuleIndicatorOverride : setExternalModuleIndicator);
 
@@ -8906,6 +9002,48 @@ namespace tr {
 
             return result;
         }
+
+        /**
+         * Parses `sourceText` like parseSourceFile, but hands each top-level statement to `onStatement` as soon as it is
+         * finished instead of collecting it, so the returned SourceFile has no statements. A statement's nodes live in
+         * their own arena and are released once `onStatement` and everything it handed the statement to let go of it,
+         * so peak memory is bounded by the largest statement instead of the whole file.
+         */
+        shared<SourceFile> parseSourceFileStatements(const string &fileName, const string &sourceText, ScriptTarget languageVersion, optional<ScriptKind> scriptKind, const function<void(const shared<Node> &)> &onStatement) {
+            ZoneScoped;
+            statementSink = &onStatement;
+            try {
+                return parseSourceFile(fileName, sourceText, languageVersion, false, scriptKind, {});
+            } catch (...) {
+                statementSink = nullptr;
+                throw;
+            }
+        }
+
+        /**
+         * Parses `newText`, the text of `sourceFile` after `change`, reusing all top-level statements the change did not
+         * touch. Only the edited statements are parsed again, which keeps an update per keystroke cheap.
+         *
+         * Reused statements are shared with the old tree and the ones after the change are moved to their new position,
+         * so `sourceFile` must not be used anymore afterwards.
+         */
+        shared<SourceFile> updateSourceFile(const shared<SourceFile> &sourceFile, const string &newText, TextChangeRange change) {
+            ZoneScoped;
+            if (change.span.length == 0 && change.newLength == 0) {
+                // if the text didn't change, then we can just return our current source file as-is.
+                return sourceFile;
+            }
+
+            auto setExternalModuleIndicator = sourceFile->setExternalModuleIndicator;
+            if (sourceFile->statements->list.empty()) {
+                // If we don't have any statements in the current source file, then there's no real
+                // way to incrementally parse.  So just do a full parse instead.
+                return parseSourceFile(sourceFile->fileName, newText, sourceFile->languageVersion, false, sourceFile->scriptKind, setExternalModuleIndicator);
+            }
+
+            SyntaxCursor cursor(sourceFile, change);
+            return parseSourceFile(sourceFile->fileName, newText, sourceFile->languageVersion, false, sourceFile->scriptKind, setExternalModuleIndicator, &cursor);
+        }
     };
 //
 //        export function parseIsolatedEntityName(content: string, languageVersion: ScriptTarget): EntityName | undefined {
@@ -9894,6 +10032,7 @@ namespace tr {
             languageVersion = options.languageVersion;
             format = options.impliedNodeFormat;
             overrideSetExternalModuleIndicator = options.setExternalModuleIndicator;
+            parser.skipFunctionBodies = options.skipFunctionBodies;
         }
 
         if (languageVersion == ScriptTarget::JSON) {
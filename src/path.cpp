@@ -296,4 +296,54 @@ namespace tr {
 //        if (! normalized.empty() && hasTrailingDirectorySeparator(path)) return ensureTrailingDirectorySeparator(normalized);
 //        return normalized;
     }
+
+    string_view getDirectoryPath(string_view path) {
+        auto end = path.find_last_of("/\\");
+        if (end == string_view::npos) return {};
+        return path.substr(0, end ? end : 1);
+    }
+
+    void appendCombinedPath(string &out, string_view directory, string_view path) {
+        auto start = out.size();
+        //out[start, root) is "/" or a volume like "c:/", the part `..` can not go above
+        auto root = start;
+        auto isSeparator = [](char c) { return c == '/' || c == '\\'; };
+        auto append = [&](string_view segments, bool first) {
+            unsigned int i = 0;
+            while (i < segments.size()) {
+                auto end = i;
+                while (end < segments.size() && !isSeparator(segments[end])) end++;
+                auto segment = segments.substr(i, end - i);
+                if (first && i == 0) {
+                    if (segment.empty() && end < segments.size()) {
+                        out += '/';
+                        root = out.size();
+                    } else if (segment.size() == 2 && segment[1] == ':') {
+                        out += segment;
+                        out += '/';
+                        root = out.size();
+                        i = end + 1;
+                        continue;
+                    }
+                }
+                i = end + 1;
+                if (segment.empty() || segment == ".") continue;
+                if (segment == "..") {
+                    auto last = out.find_last_of('/', out.size() - 1);
+                    auto lastStart = last == string::npos || last < root ? root : last + 1;
+                    if (out.size() > root && string_view(out).substr(lastStart) != "..") {
+                        //drop the last segment with the separator before it
+                        out.resize(lastStart > root ? lastStart - 1 : root);
+                        continue;
+                    }
+                    if (root > start) continue;
+                }
+                if (out.size() > root) out += '/';
+                out += segment;
+            }
+        };
+        append(directory, true);
+        append(path, out.size() == start);
+        if (out.size() == start) out += '.';
+    }
 }
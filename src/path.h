@@ -147,4 +147,29 @@ namespace tr {
     vector<string> reducePathComponents(const vector<string> &components);
 
     string normalizePath(string &_path);
+
+    /**
+     * Everything before the last separator of `path`, "" if it has none. A view into `path`.
+     *
+     * ```ts
+     * getDirectoryPath("/path/to/file.ext") === "/path/to"
+     * getDirectoryPath("/file.ext") === "/"
+     * getDirectoryPath("file.ext") === ""
+     * ```
+     */
+    string_view getDirectoryPath(string_view path);
+
+    /**
+     * Appends `directory` combined with the relative `path` to `out`, with `.` and `..` segments resolved and `\`
+     * converted into `/`, like std::filesystem::path::lexically_normal() of both on POSIX. A volume like `c:/`
+     * counts as root. Leading `..` of relative paths are kept, the ones above a root are dropped.
+     * Nothing but `out` allocates, so with a reused buffer it is allocation free.
+     *
+     * ```ts
+     * appendCombinedPath("/path/to", "../lib/./file") === "/path/lib/file"
+     * appendCombinedPath("", "../file") === "../file"
+     * appendCombinedPath("c:/path", "../..") === "c:/"
+     * ```
+     */
+    void appendCombinedPath(string &out, string_view directory, string_view path);
 }
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "./core.h"
+#include "./fs.h"
+#include "./hash.h"
+#include "./cache.h"
+#include "./scheduler.h"
+#include "./driver.h"
+
+namespace tr::driver {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * A set of files checked over and over again, e.g. by an editor or a watch mode, where only a few files change
+     * between two checks.
+     *
+     * Each file is remembered by path with the xxh64 of its source, its module and the hash of the vm2::Exports of
+     * every module it imports as of its last run. check() reads all files again, but only compiles those whose source
+     * changed and only runs those whose source changed or whose imported Exports::hash did. All other files keep their
+     * module and diagnostics (CheckedFile::reused). A changed file that still exports the same types ends the
+     * propagation there, its importers are not run again.
+     *
+     * Workers and their VMs live as long as the project. Sources are read through fileMap().
+     */
+    class Project {
+        struct Entry {
+            CheckedFile checked;
+            uint64_t contentHash = 0;
+            vector<string> dependencies; //file of each import of the module, empty if not resolved
+            uint64_t linkedHash = 0; //of the imported Exports the module last ran with
+            bool changed = false; //source differs from the last check
+            bool ran = false; //the module completed a run since it was compiled
+        };
+
+        Scheduler scheduler;
+        vector<std::unique_ptr<vm2::VM>> vms;
+        BytecodeCache *cache;
+        shared<const vm2::Prelude> prelude;
+        uint64_t salt;
+        std::unordered_map<string, Entry> entries;
+
+        /**
+         * Compiles `entry` when `source` (its mapped file) changed since the last check. Unchanged files are only hashed,
+         * changed ones are copied, so that their diagnostics are not affected by later writes to the file.
+         */
+        void update(Entry &entry, string_view source) {
+            auto &out = entry.checked;
+            auto contentHash = hash::xxh64::hashLarge(source.data(), source.size(), salt);
+            entry.changed = !out.module || contentHash != entry.contentHash;
+            if (!entry.changed) return;
+            string code(source);
+            entry.contentHash = contentHash;
+            entry.ran = false;
+            out.module = nullptr;
+            out.exports = nullptr;
+            out.cached = false;
+
+            if (cache) {
+                if (auto bin = cache->find(code, salt)) {
+                    auto storage = std::make_shared<const string>(std::move(code));
+                    out.module = std::make_shared<vm2::Module>(bin, bin->view(), out.file, storage, *storage);
+                    out.cached = true;
+                }
+            }
+            if (!out.module) {
+                auto t = std::chrono::high_resolution_clock::now();
+                Parser parser;
+                auto sourceFile = parser.parseSourceFile(out.file, code, types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+                out.took.parse = since(t);
+
+                t = std::chrono::high_resolution_clock::now();
+                checker::Compiler compiler;
+                if (prelude) compiler.prelude = &prelude->symbols;
+                auto program = compiler.compileSourceFile(sourceFile);
+                out.took.compile = since(t);
+
+                t = std::chrono::high_resolution_clock::now();
+                program.compactSourceMap = true;
+                auto bin = program.build();
+                out.took.build = since(t);
+                if (cache) cache->store(code, bin, salt);
+                out.module = std::make_shared<vm2::Module>(std::move(bin), out.file, std::move(code));
+            }
+            vm2::parseHeader(out.module);
+        }
+
+    public:
+        explicit Project(unsigned int threads = std::thread::hardware_concurrency(), BytecodeCache *cache = nullptr, shared<const vm2::Prelude> prelude = nullptr):
+                scheduler(threads), cache(cache), prelude(std::move(prelude)), salt(this->prelude ? this->prelude->hash : 0) {
+            for (unsigned int i = 0; i < scheduler.size(); i++) {
+                vms.push_back(std::make_unique<vm2::VM>());
+                vms.back()->prelude = this->prelude;
+            }
+        }
+
+        Project(const Project &) = delete;
+        Project &operator=(const Project &) = delete;
+
+        /**
+         * Checks `files` against the state of the last check. Files not in `files` anymore are forgotten, imports
+         * resolve like in driver::check().
+         *
+         * With `changed` (e.g. from a file watcher) only those and files new to the project are read, all others are
+         * taken as unchanged without touching them.
+         */
+        Result check(const vector<string> &files, const std::unordered_set<string> *changed = nullptr) {
+            ZoneScoped;
+            Result result;
+            result.threads = scheduler.size();
+            auto start = std::chrono::high_resolution_clock::now();
+
+            std::unordered_set<string> keep(files.begin(), files.end());
+            std::erase_if(entries, [&keep](auto &entry) { return !keep.contains(entry.first); });
+            //all entries exist before the workers touch them, so their addresses are stable
+            vector<Entry *> order;
+            for (auto &&file: files) {
+                auto &entry = entries[file];
+                entry.checked.file = file;
+                order.push_back(&entry);
+            }
+
+            for (auto entry: order) {
+                auto &out = entry->checked;
+                out.took = {};
+                if (changed && out.module && !changed->contains(out.file)) {
+                    entry->changed = false;
+                    continue;
+                }
+                out.error.clear();
+                scheduler.push([this, entry] {
+                    auto &out = entry->checked;
+                    try {
+                        auto t = std::chrono::high_resolution_clock::now();
+                        if (!fileExists(out.file)) throw std::runtime_error("File not found " + out.file);
+                        auto source = fileMap(out.file);
+                        out.took.read = since(t);
+                        update(*entry, source->view());
+                    } catch (std::exception &e) {
+                        out.error = e.what();
+                        out.module = nullptr;
+                        out.exports = nullptr;
+                        entry->ran = false;
+                    }
+                });
+            }
+            scheduler.wait();
+
+            ModuleResolver resolver([this](const string &file) { return entries.contains(file); });
+            vector<Entry *> pending;
+            for (auto entry: order) {
+                if (!entry->checked.module) continue;
+                entry->dependencies.clear();
+                for (auto &&import: entry->checked.module->imports) {
+                    entry->dependencies.push_back(resolver.resolve(entry->checked.file, import.specifier));
+                }
+                pending.push_back(entry);
+            }
+
+            //in dependency order like driver::check(), so a module sees the Exports its imports have after this check
+            std::unordered_set<const Entry *> waiting(pending.begin(), pending.end());
+            while (!waiting.empty()) {
+                vector<Entry *> wave;
+                for (auto entry: pending) {
+                    if (!waiting.contains(entry)) continue;
+                    auto ready = true;
+                    for (auto &&dependency: entry->dependencies) ready &= dependency.empty() || !waiting.contains(&entries[dependency]);
+                    if (ready) wave.push_back(entry);
+                }
+                //a cycle, the rest
+                if (wave.empty()) for (auto entry: pending) if (waiting.contains(entry)) wave.push_back(entry);
+
+                for (auto entry: wave) {
+                    auto &out = entry->checked;
+                    uint64_t linkedHash = 0;
+                    for (auto &&dependency: entry->dependencies) {
+                        auto exports = dependency.empty() ? nullptr : entries[dependency].checked.exports;
+                        linkedHash = hash::combine(linkedHash, dependency.empty() ? hash::const_hash("unresolved") : exports ? exports->hash : 0);
+                    }
+                    out.reused = entry->ran && !entry->changed && linkedHash == entry->linkedHash;
+                    if (out.reused) continue;
+                    entry->linkedHash = linkedHash;
+                    if (!out.module->imports.empty()) {
+                        vm2::link(out.module, [&](string_view specifier) -> shared<const vm2::Exports> {
+                            auto &file = resolver.resolve(out.file, specifier);
+                            if (file.empty()) return nullptr;
+                            auto &dependency = entries[file].checked;
+                            //an empty Exports for a resolved module without exports, so imports report the missing member
+                            if (!dependency.exports && dependency.module) return std::make_shared<const vm2::Exports>();
+                            return dependency.exports;
+                        });
+                    }
+                    scheduler.push([this, entry] {
+                        try {
+                            runModule(*vms[Scheduler::worker()], entry->checked);
+                            entry->ran = true;
+                        } catch (std::exception &e) {
+                            entry->checked.error = e.what();
+                            entry->ran = false;
+                        }
+                    });
+                }
+                scheduler.wait();
+                for (auto entry: wave) waiting.erase(entry);
+            }
+
+            for (auto entry: order) result.files.push_back(entry->checked);
+            result.wall = since(start);
+            return result;
+        }
+    };
+}
@@ -5,6 +5,7 @@
 #include "core.h"
 #include "utilities.h"
 #include "diagnostic_messages.h"
+#include "number.h"
 #include <optional>
 
 using namespace tr;
@@ -14,9 +15,15 @@ namespace tr {
     using tr::utf::charCodeAt;
     using tr::utf::CharacterCodes;
     using tr::utf::fromCharCode;
+    using tr::utf::isAscii;
+    using tr::utf::hasAsciiClass;
+    namespace AsciiClass = tr::utf::AsciiClass;
+    using tr::utf::findBytes;
+    using tr::utf::skipAsciiWhiteSpace;
+    using tr::utf::findLineBreakCandidate;
     using namespace tr::hash;
 
-    bool isShebangTrivia(const string &text, int pos) {
+    bool isShebangTrivia(string_view text, int pos) {
         // Shebangs check must only be done at the start of the file
         //    Debug.assert(pos == 0);
         //    return shebangTriviaRegex.test(text);
@@ -24,40 +31,45 @@ namespace tr {
         return false;
     }
 
-    string Scanner::scanString(bool jsxAttributeString) {
+    string_view Scanner::scanString(bool jsxAttributeString) {
         ZoneScoped;
         auto quote = charCodeAt(text, pos);
         pos++;
-        string result;
+        string result; //only used when there are escapes
+        bool escaped = false;
         auto start = pos;
+        auto valueEnd = pos;
         while (true) {
             if (pos >= end) {
-                result += substring(text, start, pos);
+                valueEnd = pos;
                 tokenFlags |= TokenFlags::Unterminated;
 //            error(Diagnostics::Unterminated_string_literal());
                 break;
             }
             auto ch = charCodeAt(text, pos);
             if (ch.code == quote.code) {
-                result += substring(text, start, pos);
+                valueEnd = pos;
                 pos++;
                 break;
             }
             if (ch.code == CharacterCodes::backslash && !jsxAttributeString) {
                 result += substring(text, start, pos);
                 result += scanEscapeSequence();
+                escaped = true;
                 start = pos;
                 continue;
             }
             if (isLineBreak(ch) && !jsxAttributeString) {
-                result += substring(text, start, pos);
+                valueEnd = pos;
                 tokenFlags |= TokenFlags::Unterminated;
 //            error(Diagnostics::Unterminated_string_literal());
                 break;
             }
             pos++;
         }
-        return result;
+        if (!escaped) return substring(text, start, valueEnd);
+        result += substring(text, start, valueEnd);
+        return materialize(std::move(result));
     }
 
     bool isDigit(const CharCode &ch) {
@@ -103,7 +115,7 @@ namespace tr {
                 break;
             }
             found++;
-            result.append(substring(text, pos, ch.length));
+            result += (char) ch.code;
             pos++;
             isPreviousTokenSeparator = false;
         }
@@ -185,7 +197,7 @@ namespace tr {
                 if (isTaggedTemplate && pos < end && isDigit(charCodeAt(text, pos))) {
                     pos++;
                     tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                    return substring(text, start, pos);
+                    return string(substring(text, start, pos));
                 }
                 return "\0";
             case CharacterCodes::b:
@@ -212,7 +224,7 @@ namespace tr {
                             charCodeAt(text, escapePos).code != CharacterCodes::openBrace) {
                             pos = escapePos;
                             tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                            return substring(text, start, pos);
+                            return string(substring(text, start, pos));
                         }
                     }
                 }
@@ -223,7 +235,7 @@ namespace tr {
                     // '\u{'
                     if (isTaggedTemplate && !isHexDigit(charCodeAt(text, pos))) {
                         tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                        return substring(text, start, pos);
+                        return string(substring(text, start, pos));
                     }
 
                     if (isTaggedTemplate) {
@@ -236,13 +248,13 @@ namespace tr {
                             // '\u{Not Code Point' or '\u{CodePoint'
                             if (charCodeAt(text, pos).code != CharacterCodes::closeBrace) {
                                 tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                                return substring(text, start, pos);
+                                return string(substring(text, start, pos));
                             } else {
                                 pos = savePos;
                             }
                         } catch (invalid_argument &error) {
                             tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                            return substring(text, start, pos);
+                            return string(substring(text, start, pos));
                         }
                     }
                     tokenFlags |= TokenFlags::ExtendedUnicodeEscape;
@@ -257,11 +269,11 @@ namespace tr {
                 if (isTaggedTemplate) {
                     if (!isHexDigit(charCodeAt(text, pos))) {
                         tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                        return substring(text, start, pos);
+                        return string(substring(text, start, pos));
                     } else if (!isHexDigit(charCodeAt(text, pos + 1))) {
                         pos++;
                         tokenFlags |= TokenFlags::ContainsInvalidEscape;
-                        return substring(text, start, pos);
+                        return string(substring(text, start, pos));
                     }
                 }
                 // '\xDD'
@@ -289,12 +301,14 @@ namespace tr {
 
         pos++;
         auto start = pos;
-        string contents;
+        auto valueEnd = pos;
+        string contents; //only used when there are escapes or carriage returns
+        bool escaped = false;
         SyntaxKind resultingToken;
 
         while (true) {
             if (pos >= end) {
-                contents += substring(text, start, pos);
+                valueEnd = pos;
                 tokenFlags |= TokenFlags::Unterminated;
 //            error(Diagnostics::Unterminated_template_literal());
                 resultingToken = startedWithBacktick ? SyntaxKind::NoSubstitutionTemplateLiteral : SyntaxKind::TemplateTail;
@@ -305,7 +319,7 @@ namespace tr {
 
             // '`'
             if (currChar.code == CharacterCodes::backtick) {
-                contents += substring(text, start, pos);
+                valueEnd = pos;
                 pos++;
                 resultingToken = startedWithBacktick ? SyntaxKind::NoSubstitutionTemplateLiteral : SyntaxKind::TemplateTail;
                 break;
@@ -313,7 +327,7 @@ namespace tr {
 
             // '${'
             if (currChar.code == CharacterCodes::$ && pos + 1 < end && charCodeAt(text, pos + 1).code == CharacterCodes::openBrace) {
-                contents += substring(text, start, pos);
+                valueEnd = pos;
                 pos += 2;
                 resultingToken = startedWithBacktick ? SyntaxKind::TemplateHead : SyntaxKind::TemplateMiddle;
                 break;
@@ -323,6 +337,7 @@ namespace tr {
             if (currChar.code == CharacterCodes::backslash) {
                 contents += substring(text, start, pos);
                 contents += scanEscapeSequence(isTaggedTemplate);
+                escaped = true;
                 start = pos;
                 continue;
             }
@@ -338,6 +353,7 @@ namespace tr {
                 }
 
                 contents += "\n";
+                escaped = true;
                 start = pos;
                 continue;
             }
@@ -347,7 +363,12 @@ namespace tr {
 
 //    Debug.assert(resultingToken !== undefined);
 
-        tokenValue = contents;
+        if (escaped) {
+            contents += substring(text, start, valueEnd);
+            tokenValue = materialize(std::move(contents));
+        } else {
+            tokenValue = substring(text, start, valueEnd);
+        }
         return resultingToken;
     }
 
@@ -385,7 +406,7 @@ namespace tr {
         if (charCodeAt(text, pos - 1).code == CharacterCodes::_) {
 //        error(Diagnostics::Numeric_separators_are_not_allowed_here(), pos - 1, 1);
         }
-        return result + substring(text, start, pos);
+        return result.append(substring(text, start, pos));
     }
 
 /**
@@ -402,7 +423,7 @@ namespace tr {
 // a <<<<<<< or >>>>>>> marker then it is also followed by a space.
     const unsigned long mergeConflictMarkerLength = size("<<<<<<<") - 1;
 
-    bool isConflictMarkerTrivia(const string &text, int pos) {
+    bool isConflictMarkerTrivia(string_view text, int pos) {
         ZoneScoped;
         assert(pos >= 0);
 
@@ -424,7 +445,7 @@ namespace tr {
         return false;
     }
 
-    int Scanner::error(const shared<DiagnosticMessage> &message, int errPos, int length) {
+    void Scanner::error(const shared<DiagnosticMessage> &message, int errPos, int length) {
         if (errPos == -1) errPos = pos;
 
         cout << "Error: " << message->code << ": " << message->message << " at " << errPos << "\n";
@@ -434,7 +455,7 @@ namespace tr {
         }
     }
 
-    int scanConflictMarkerTrivia(string &text, int pos) {
+    int scanConflictMarkerTrivia(string_view text, int pos) {
         ZoneScoped;
         auto ch = charCodeAt(text, pos);
         auto len = text.size();
@@ -460,7 +481,7 @@ namespace tr {
         return pos;
     }
 
-    int Scanner::scanConflictMarkerTrivia(string &text, int pos) {
+    int Scanner::scanConflictMarkerTrivia(string_view text, int pos) {
         error(Diagnostics::Merge_conflict_marker_encountered(), pos, mergeConflictMarkerLength);
         return scanConflictMarkerTrivia(text, pos);
     }
@@ -510,9 +531,8 @@ namespace tr {
     }
 
     bool isIdentifierStart(const CharCode &ch, ScriptTarget languageVersion) {
-        return (ch.code >= CharacterCodes::A && ch.code <= CharacterCodes::Z) || (ch.code >= CharacterCodes::a && ch.code <= CharacterCodes::z) ||
-               ch.code == CharacterCodes::$ || ch.code == CharacterCodes::_ ||
-               (ch.code > CharacterCodes::maxAsciiCharacter && isUnicodeIdentifierStart(ch, languageVersion));
+        if (isAscii(ch.code)) return hasAsciiClass(ch.code, AsciiClass::IdentifierStart);
+        return ch.code > CharacterCodes::maxAsciiCharacter && isUnicodeIdentifierStart(ch, languageVersion);
     }
 
     /* @internal */
@@ -532,25 +552,26 @@ namespace tr {
     }
 
     bool isIdentifierPart(const CharCode &ch, ScriptTarget languageVersion, LanguageVariant identifierVariant) {
-        return (ch.code >= CharacterCodes::A && ch.code <= CharacterCodes::Z) || (ch.code >= CharacterCodes::a && ch.code <= CharacterCodes::z) ||
-               (ch.code >= CharacterCodes::_0 && ch.code <= CharacterCodes::_9) || ch.code == CharacterCodes::$ || ch.code == CharacterCodes::_ ||
-               // "-" and ":" are valid in JSX Identifiers
-               (identifierVariant == LanguageVariant::JSX ? (ch.code == CharacterCodes::minus || ch.code == CharacterCodes::colon) : false) ||
-               (ch.code > CharacterCodes::maxAsciiCharacter && isUnicodeIdentifierPart(ch, languageVersion));
+        if (isAscii(ch.code)) {
+            return hasAsciiClass(ch.code, AsciiClass::IdentifierPart) ||
+                   // "-" and ":" are valid in JSX Identifiers
+                   (identifierVariant == LanguageVariant::JSX && (ch.code == CharacterCodes::minus || ch.code == CharacterCodes::colon));
+        }
+        return ch.code > CharacterCodes::maxAsciiCharacter && isUnicodeIdentifierPart(ch, languageVersion);
     }
 
     const regex shebangTriviaRegex("^#!.*");
 
-    int scanShebangTrivia(const string &text, int pos) {
-        smatch m;
-        if (regex_search(text, m, shebangTriviaRegex)) {
+    int scanShebangTrivia(string_view text, int pos) {
+        cmatch m;
+        if (regex_search(text.begin(), text.end(), m, shebangTriviaRegex)) {
             pos = pos + m[1].length();
         }
         return pos;
     }
 
     /* @internal */
-    int skipTrivia(string &text, int pos, optional<bool> stopAfterLineBreak, optional<bool> stopAtComments, optional<bool> inJSDoc) {
+    int skipTrivia(string_view text, int pos, optional<bool> stopAfterLineBreak, optional<bool> stopAtComments, optional<bool> inJSDoc) {
         ZoneScoped;
         if (positionIsSynthesized(pos)) {
             return pos;
@@ -577,7 +598,7 @@ namespace tr {
                 case CharacterCodes::verticalTab:
                 case CharacterCodes::formFeed:
                 case CharacterCodes::space:
-                    pos++;
+                    pos = skipAsciiWhiteSpace(text, pos);
                     continue;
                 case CharacterCodes::slash:
                     if (stopAtComments && *stopAtComments) {
@@ -586,10 +607,13 @@ namespace tr {
                     if (charCodeAt(text, pos + 1).code == CharacterCodes::slash) {
                         pos += 2;
                         while (pos < text.size()) {
-                            if (isLineBreak(charCodeAt(text, pos))) {
+                            pos = findLineBreakCandidate(text, pos);
+                            if (pos >= text.size()) break;
+                            auto next = charCodeAt(text, pos);
+                            if (isLineBreak(next)) {
                                 break;
                             }
-                            pos++;
+                            pos += next.length;
                         }
                         canConsumeStar = false;
                         continue;
@@ -597,7 +621,9 @@ namespace tr {
                     if (charCodeAt(text, pos + 1).code == CharacterCodes::asterisk) {
                         pos += 2;
                         while (pos < text.size()) {
-                            if (charCodeAt(text, pos).code == CharacterCodes::asterisk && charCodeAt(text, pos + 1).code == CharacterCodes::slash) {
+                            pos = findBytes<false, '*'>(text, pos);
+                            if (pos >= text.size()) break;
+                            if (charCodeAt(text, pos + 1).code == CharacterCodes::slash) {
                                 pos += 2;
                                 break;
                             }
@@ -637,7 +663,7 @@ namespace tr {
 
                 default:
                     if (ch.code > CharacterCodes::maxAsciiCharacter && (isWhiteSpaceLike(ch))) {
-                        pos++;
+                        pos += ch.length;
                         continue;
                     }
                     break;
@@ -669,8 +695,11 @@ namespace tr {
         return {-1, 0};
     }
 
-    string Scanner::scanIdentifierParts() {
-        string result;
+    string_view Scanner::scanIdentifierParts() {
+        //only used when there are escapes
+        auto &result = identifierBuffer;
+        result.clear();
+        bool escaped = false;
         auto start = pos;
         while (pos < end) {
             auto ch = charCodeAt(text, pos);
@@ -682,6 +711,7 @@ namespace tr {
                     pos += 3;
                     tokenFlags |= TokenFlags::ExtendedUnicodeEscape;
                     result += scanExtendedUnicodeEscape();
+                    escaped = true;
                     start = pos;
                     continue;
                 }
@@ -692,6 +722,7 @@ namespace tr {
                 tokenFlags |= TokenFlags::UnicodeEscape;
                 result += substring(text, start, pos);
                 result += fromCharCode(ch.code);
+                escaped = true;
                 // Valid Unicode escape is always six characters
                 pos += 6;
                 start = pos;
@@ -699,6 +730,7 @@ namespace tr {
                 break;
             }
         }
+        if (!escaped) return substring(text, start, pos);
         result += substring(text, start, pos);
         return result;
     }
@@ -723,30 +755,36 @@ namespace tr {
         }
     }
 
+    //digits without leading zero that fit into an int, what stoi() and to_string() would give back unchanged
+    static bool isSimplifiedInteger(string_view value) {
+        if (value.empty() || value.size() > 9 || (value[0] == '0' && value.size() > 1)) return false;
+        for (auto c: value) if (c < '0' || c > '9') return false;
+        return true;
+    }
+
     SyntaxKind Scanner::checkBigIntSuffix() {
         ZoneScoped;
         if (charCodeAt(text, pos).code == CharacterCodes::n) {
-            tokenValue += "n";
             // Use base 10 instead of base 2 or base 8 for shorter literals
             if (tokenFlags & TokenFlags::BinaryOrOctalSpecifier) {
-                tokenValue = parsePseudoBigInt(tokenValue) + "n";
+                auto value = string(tokenValue);
+                tokenValue = materialize(parsePseudoBigInt(value) + "n");
+            } else {
+                tokenValue = materialize(string(tokenValue) + "n");
             }
             pos++;
             return SyntaxKind::BigIntLiteral;
         } else {
+            //plain decimal integers are in simplified form already
+            if (!(tokenFlags & TokenFlags::BinaryOrOctalSpecifier) && isSimplifiedInteger(tokenValue)) return SyntaxKind::NumericLiteral;
             // not a bigint, so can convert to number in simplified form
-            // Number() may not support 0b or 0o, so use parseInt() instead
-            auto numericValue = tokenFlags & TokenFlags::BinarySpecifier
-                                ? stoi(substring(tokenValue, 2), 0, 2) // skip "0b"
-                                : tokenFlags & TokenFlags::OctalSpecifier
-                                  ? stoi(substring(tokenValue, 2), 0, 8) // skip "0o"
-                                  : stoi(tokenValue);
-            tokenValue = std::to_string(numericValue);
+            //parseNumber() handles 0x, 0b and 0o and does not overflow like stoi() did
+            tokenValue = materialize(formatNumber(parseNumber(tokenValue)));
             return SyntaxKind::NumericLiteral;
         }
     }
 
-    optional<CommentDirectiveType> getDirectiveFromComment(const string &text, const regex &commentDirectiveRegEx) {
+    optional<CommentDirectiveType> getDirectiveFromComment(string_view text, const regex &commentDirectiveRegEx) {
         cmatch match;
         if (regex_search("//@ts-ignore", match, commentDirectiveRegEx)) {
             if (match[1] == "ts-expect-error") return CommentDirectiveType::ExpectError;
@@ -777,30 +815,32 @@ namespace tr {
             // Do note that this means that `scanJsxIdentifier` effectively _mutates_ the visible token without advancing to a new token
             // Any caller should be expecting this behavior and should only read the pos or token value after calling it.
             auto namespaceSeparator = false;
+            auto value = string(tokenValue);
             while (pos < end) {
                 auto ch = charCodeAt(text, pos);
                 if (ch.code == CharacterCodes::minus) {
-                    tokenValue += "-";
+                    value += "-";
                     pos++;
                     continue;
                 } else if (ch.code == CharacterCodes::colon && !namespaceSeparator) {
-                    tokenValue += ":";
+                    value += ":";
                     pos++;
                     namespaceSeparator = true;
                     token = SyntaxKind::Identifier; // swap from keyword kind to identifier kind
                     continue;
                 }
                 auto oldPos = pos;
-                tokenValue += scanIdentifierParts(); // reuse `scanIdentifierParts` so unicode escapes are handled
+                value += scanIdentifierParts(); // reuse `scanIdentifierParts` so unicode escapes are handled
                 if (pos == oldPos) {
                     break;
                 }
             }
             // Do not include a trailing namespace separator in the token, since this is against the spec.
-            if (substring(tokenValue, -1) == ":") {
-                tokenValue = substring(tokenValue, 0, -1);
+            if (!value.empty() && value.back() == ':') {
+                value.pop_back();
                 pos--;
             }
+            tokenValue = materialize(std::move(value));
             return getIdentifierToken();
         }
         return token;
@@ -880,11 +920,11 @@ namespace tr {
 
     vector<CommentDirective> Scanner::appendIfCommentDirective(
             vector<CommentDirective> &commentDirectives,
-            const string &text,
+            string_view text,
             const regex &commentDirectiveRegEx,
             int lineStart
     ) {
-        auto type = getDirectiveFromComment(trimStringStart(text), commentDirectiveRegEx);
+        auto type = getDirectiveFromComment(trimStringStart(string(text)), commentDirectiveRegEx);
         if (!type.has_value()) {
             return commentDirectives;
         }
@@ -916,29 +956,31 @@ namespace tr {
             if (!finalFragment.size()) {
 //            error(Diagnostics::Digit_expected());
             } else {
-                scientificFragment = substring(text, end, preNumericPart) + finalFragment;
+                scientificFragment = string(substring(text, end, preNumericPart)) + finalFragment;
                 scientificFragmentSet = true;
                 end = pos;
             }
         }
-        string result;
+        string_view result;
         if (tokenFlags & TokenFlags::ContainsSeparator) {
-            result = mainFragment;
+            auto value = mainFragment;
             if (decimalFragment.size()) {
-                result += "." + decimalFragment;
+                value += "." + decimalFragment;
             }
             if (scientificFragment.size()) {
-                result += scientificFragment;
+                value += scientificFragment;
             }
+            result = materialize(std::move(value));
         } else {
             result = substring(text, start, end); // No need to use all the fragments; no _ removal needed
         }
 
         if (decimalFragmentSet || tokenFlags & TokenFlags::Scientific) {
             checkForIdentifierStartAfterNumericLiteral(start, !decimalFragmentSet && !!(tokenFlags & TokenFlags::Scientific));
+            //the literal text, `"" + stoi(result)` was pointer arithmetic
             return {
                     .type =  SyntaxKind::NumericLiteral,
-                    .value =  "" + stoi(result) // if value is not an integer, it can be safely coerced to a number
+                    .value =  result
             };
         } else {
             tokenValue = result;
@@ -990,177 +1032,8 @@ namespace tr {
         ZoneScoped;
         // Reserved words are between 2 and 12 characters long and start with a lowercase letter
         auto len = tokenValue.size();
-        if (len >= 2 && len <= 12) {
-            auto ch = charCodeAt(tokenValue, 0);
-            if (ch.code >= CharacterCodes::a && ch.code <= CharacterCodes::z) {
-                switch (runtime_hash(tokenValue)) {
-                    case "abstract"_hash:
-                        return SyntaxKind::AbstractKeyword;
-                    case "any"_hash:
-                        return SyntaxKind::AnyKeyword;
-                    case "as"_hash:
-                        return SyntaxKind::AsKeyword;
-                    case "asserts"_hash:
-                        return SyntaxKind::AssertsKeyword;
-                    case "assert"_hash:
-                        return SyntaxKind::AssertKeyword;
-                    case "bigint"_hash:
-                        return SyntaxKind::BigIntKeyword;
-                    case "boolean"_hash:
-                        return SyntaxKind::BooleanKeyword;
-                    case "break"_hash:
-                        return SyntaxKind::BreakKeyword;
-                    case "case"_hash:
-                        return SyntaxKind::CaseKeyword;
-                    case "catch"_hash:
-                        return SyntaxKind::CatchKeyword;
-                    case "class"_hash:
-                        return SyntaxKind::ClassKeyword;
-                    case "continue"_hash:
-                        return SyntaxKind::ContinueKeyword;
-                    case "const"_hash:
-                        return SyntaxKind::ConstKeyword;
-                    case "constructor"_hash:
-                        return SyntaxKind::ConstructorKeyword;
-                    case "debugger"_hash:
-                        return SyntaxKind::DebuggerKeyword;
-                    case "declare"_hash:
-                        return SyntaxKind::DeclareKeyword;
-                    case "default"_hash:
-                        return SyntaxKind::DefaultKeyword;
-                    case "delete"_hash:
-                        return SyntaxKind::DeleteKeyword;
-                    case "do"_hash:
-                        return SyntaxKind::DoKeyword;
-                    case "else"_hash:
-                        return SyntaxKind::ElseKeyword;
-                    case "enum"_hash:
-                        return SyntaxKind::EnumKeyword;
-                    case "export"_hash:
-                        return SyntaxKind::ExportKeyword;
-                    case "extends"_hash:
-                        return SyntaxKind::ExtendsKeyword;
-                    case "false"_hash:
-                        return SyntaxKind::FalseKeyword;
-                    case "finally"_hash:
-                        return SyntaxKind::FinallyKeyword;
-                    case "for"_hash:
-                        return SyntaxKind::ForKeyword;
-                    case "from"_hash:
-                        return SyntaxKind::FromKeyword;
-                    case "function"_hash:
-                        return SyntaxKind::FunctionKeyword;
-                    case "get"_hash:
-                        return SyntaxKind::GetKeyword;
-                    case "if"_hash:
-                        return SyntaxKind::IfKeyword;
-                    case "implements"_hash:
-                        return SyntaxKind::ImplementsKeyword;
-                    case "import"_hash:
-                        return SyntaxKind::ImportKeyword;
-                    case "in"_hash:
-                        return SyntaxKind::InKeyword;
-                    case "infer"_hash:
-                        return SyntaxKind::InferKeyword;
-                    case "instanceof"_hash:
-                        return SyntaxKind::InstanceOfKeyword;
-                    case "interface"_hash:
-                        return SyntaxKind::InterfaceKeyword;
-                    case "intrinsic"_hash:
-                        return SyntaxKind::IntrinsicKeyword;
-                    case "is"_hash:
-                        return SyntaxKind::IsKeyword;
-                    case "keyof"_hash:
-                        return SyntaxKind::KeyOfKeyword;
-                    case "let"_hash:
-                        return SyntaxKind::LetKeyword;
-                    case "module"_hash:
-                        return SyntaxKind::ModuleKeyword;
-                    case "namespace"_hash:
-                        return SyntaxKind::NamespaceKeyword;
-                    case "never"_hash:
-                        return SyntaxKind::NeverKeyword;
-                    case "new"_hash:
-                        return SyntaxKind::NewKeyword;
-                    case "null"_hash:
-                        return SyntaxKind::NullKeyword;
-                    case "number"_hash:
-                        return SyntaxKind::NumberKeyword;
-                    case "object"_hash:
-                        return SyntaxKind::ObjectKeyword;
-                    case "package"_hash:
-                        return SyntaxKind::PackageKeyword;
-                    case "private"_hash:
-                        return SyntaxKind::PrivateKeyword;
-                    case "protected"_hash:
-                        return SyntaxKind::ProtectedKeyword;
-                    case "public"_hash:
-                        return SyntaxKind::PublicKeyword;
-                    case "override"_hash:
-                        return SyntaxKind::OverrideKeyword;
-                    case "out"_hash:
-                        return SyntaxKind::OutKeyword;
-                    case "readonly"_hash:
-                        return SyntaxKind::ReadonlyKeyword;
-                    case "require"_hash:
-                        return SyntaxKind::RequireKeyword;
-                    case "global"_hash:
-                        return SyntaxKind::GlobalKeyword;
-                    case "return"_hash:
-                        return SyntaxKind::ReturnKeyword;
-                    case "set"_hash:
-                        return SyntaxKind::SetKeyword;
-                    case "static"_hash:
-                        return SyntaxKind::StaticKeyword;
-                    case "string"_hash:
-                        return SyntaxKind::StringKeyword;
-                    case "super"_hash:
-                        return SyntaxKind::SuperKeyword;
-                    case "switch"_hash:
-                        return SyntaxKind::SwitchKeyword;
-                    case "symbol"_hash:
-                        return SyntaxKind::SymbolKeyword;
-                    case "this"_hash:
-                        return SyntaxKind::ThisKeyword;
-                    case "throw"_hash:
-                        return SyntaxKind::ThrowKeyword;
-                    case "true"_hash:
-                        return SyntaxKind::TrueKeyword;
-                    case "try"_hash:
-                        return SyntaxKind::TryKeyword;
-                    case "type"_hash:
-                        return SyntaxKind::TypeKeyword;
-                    case "typeof"_hash:
-                        return SyntaxKind::TypeOfKeyword;
-                    case "undefined"_hash:
-                        return SyntaxKind::UndefinedKeyword;
-                    case "unique"_hash:
-                        return SyntaxKind::UniqueKeyword;
-                    case "unknown"_hash:
-                        return SyntaxKind::UnknownKeyword;
-                    case "var"_hash:
-                        return SyntaxKind::VarKeyword;
-                    case "void"_hash:
-                        return SyntaxKind::VoidKeyword;
-                    case "while"_hash:
-                        return SyntaxKind::WhileKeyword;
-                    case "with"_hash:
-                        return SyntaxKind::WithKeyword;
-                    case "yield"_hash:
-                        return SyntaxKind::YieldKeyword;
-                    case "async"_hash:
-                        return SyntaxKind::AsyncKeyword;
-                    case "await"_hash:
-                        return SyntaxKind::AwaitKeyword;
-                    case "of"_hash:
-                        return SyntaxKind::OfKeyword;
-                }
-
-//                auto it = textToKeyword.find(tokenValue);
-//                if (it != textToKeyword.end()) {
-//                    return token = it->second;
-//                }
-            }
+        if (len >= 2 && len <= 12 && tokenValue[0] >= 'a' && tokenValue[0] <= 'z') {
+            if (auto keyword = keywordToToken(tokenValue)) return *keyword;
         }
         return token = SyntaxKind::Identifier;
     }
@@ -1173,7 +1046,7 @@ namespace tr {
             while (pos < end && isIdentifierPart(ch = charCodeAt(text, pos), languageVersion)) pos += ch.length;
             tokenValue = substring(text, tokenPos, pos);
             if (ch.code == CharacterCodes::backslash) {
-                tokenValue += scanIdentifierParts();
+                tokenValue = materialize(string(tokenValue) + string(scanIdentifierParts()));
             }
             return getIdentifierToken();
         }
@@ -1247,10 +1120,11 @@ namespace tr {
                 case CharacterCodes::ideographicSpace:
                 case CharacterCodes::byteOrderMark:
                     if (skipTrivia) {
-                        pos++;
+                        pos = ch.code <= CharacterCodes::maxAsciiCharacter ? skipAsciiWhiteSpace(text.substr(0, end), pos) : pos + ch.length;
                         continue;
                     } else {
                         int size;
+                        pos = skipAsciiWhiteSpace(text.substr(0, end), pos);
                         while (pos < end && isWhiteSpaceSingleLine(charCodeAt(text, pos, &size))) {
                             pos += size;
                         }
@@ -1349,10 +1223,13 @@ namespace tr {
                         pos += 2;
 
                         while (pos < end) {
-                            if (isLineBreak(charCodeAt(text, pos))) {
+                            pos = findLineBreakCandidate(text.substr(0, end), pos);
+                            if (pos >= end) break;
+                            auto next = charCodeAt(text, pos);
+                            if (isLineBreak(next)) {
                                 break;
                             }
-                            pos++;
+                            pos += next.length;
                         }
 
                         commentDirectives = appendIfCommentDirective(
@@ -1378,6 +1255,9 @@ namespace tr {
                         auto commentClosed = false;
                         auto lastLineStart = tokenPos;
                         while (pos < end) {
+                            //only '*' and line breaks are of interest, jump over everything else
+                            pos = findBytes<false, '*', '\n', '\r', '\xE2'>(text.substr(0, end), pos);
+                            if (pos >= end) break;
                             auto ch = charCodeAt(text, pos);
 
                             if (ch.code == CharacterCodes::asterisk && charCodeAt(text, pos + 1).code == CharacterCodes::slash) {
@@ -1386,7 +1266,7 @@ namespace tr {
                                 break;
                             }
 
-                            pos++;
+                            pos += ch.length;
 
                             if (isLineBreak(ch)) {
                                 lastLineStart = pos;
@@ -1422,39 +1302,39 @@ namespace tr {
                     if (pos + 2 < end && (charCodeAt(text, pos + 1).code ==
                                           CharacterCodes::X || charCodeAt(text, pos + 1).code == CharacterCodes::x)) {
                         pos += 2;
-                        tokenValue = scanMinimumNumberOfHexDigits(1, /*canHaveSeparators*/ true);
-                        if (tokenValue.empty()) {
+                        auto digits = scanMinimumNumberOfHexDigits(1, /*canHaveSeparators*/ true);
+                        if (digits.empty()) {
 //                        error(Diagnostics::Hexadecimal_digit_expected());
-                            tokenValue = "0";
+                            digits = "0";
                         }
-                        tokenValue = "0x" + tokenValue;
+                        tokenValue = materialize("0x" + digits);
                         tokenFlags |= TokenFlags::HexSpecifier;
                         return token = checkBigIntSuffix();
                     } else if (pos + 2 < end && (charCodeAt(text, pos + 1).code ==
                                                  CharacterCodes::B || charCodeAt(text, pos + 1).code == CharacterCodes::b)) {
                         pos += 2;
-                        tokenValue = scanBinaryOrOctalDigits(/* base */ 2);
-                        if (tokenValue.empty()) {
+                        auto digits = scanBinaryOrOctalDigits(/* base */ 2);
+                        if (digits.empty()) {
 //                        error(Diagnostics::Binary_digit_expected());
-                            tokenValue = "0";
+                            digits = "0";
                         }
-                        tokenValue = "0b" + tokenValue;
+                        tokenValue = materialize("0b" + digits);
                         tokenFlags |= TokenFlags::BinarySpecifier;
                         return token = checkBigIntSuffix();
                     } else if (pos + 2 < end && (charCodeAt(text, pos + 1).code == CharacterCodes::O || charCodeAt(text, pos + 1).code == CharacterCodes::o)) {
                         pos += 2;
-                        tokenValue = scanBinaryOrOctalDigits(/* base */ 8);
-                        if (tokenValue.empty()) {
+                        auto digits = scanBinaryOrOctalDigits(/* base */ 8);
+                        if (digits.empty()) {
 //                        error(Diagnostics::Octal_digit_expected());
-                            tokenValue = "0";
+                            digits = "0";
                         }
-                        tokenValue = "0o" + tokenValue;
+                        tokenValue = materialize("0o" + digits);
                         tokenFlags |= TokenFlags::OctalSpecifier;
                         return token = checkBigIntSuffix();
                     }
                     // Try to parse as an octal
                     if (pos + 1 < end && isOctalDigit(charCodeAt(text, pos + 1))) {
-                        tokenValue = to_string(scanOctalDigits());
+                        tokenValue = materialize(to_string(scanOctalDigits()));
                         tokenFlags |= TokenFlags::Octal;
                         return token = SyntaxKind::NumericLiteral;
                     }
@@ -1603,7 +1483,8 @@ namespace tr {
                     if (extendedCookedChar.code >= 0 && isIdentifierStart(extendedCookedChar, languageVersion)) {
                         pos += 3;
                         tokenFlags |= TokenFlags::ExtendedUnicodeEscape;
-                        tokenValue = scanExtendedUnicodeEscape() + scanIdentifierParts();
+                        auto escape = scanExtendedUnicodeEscape();
+                        tokenValue = materialize(escape + string(scanIdentifierParts()));
                         return token = getIdentifierToken();
                     }
 
@@ -1611,7 +1492,7 @@ namespace tr {
                     if (cookedChar.code >= 0 && isIdentifierStart(cookedChar, languageVersion)) {
                         pos += 6;
                         tokenFlags |= TokenFlags::UnicodeEscape;
-                        tokenValue = fromCharCode(cookedChar.code) + scanIdentifierParts();
+                        tokenValue = materialize(fromCharCode(cookedChar.code) + string(scanIdentifierParts()));
                         return token = getIdentifierToken();
                     }
 
@@ -1630,7 +1511,7 @@ namespace tr {
                         pos++;
                         scanIdentifier(charCodeAt(text, pos), languageVersion);
                     } else {
-                        tokenValue = fromCharCode(charCodeAt(text, pos).code);
+                        tokenValue = materialize(fromCharCode(charCodeAt(text, pos).code));
                         error(Diagnostics::Invalid_character(), pos++, ch.length);
                     }
                     return token = SyntaxKind::PrivateIdentifier;
@@ -1666,7 +1547,7 @@ namespace tr {
         while (isOctalDigit(charCodeAt(text, pos))) {
             pos++;
         }
-        return stoi(substring(text, start, pos));
+        return stoi(string(substring(text, start, pos)), nullptr, 8);
     }
 
     SyntaxKind Scanner::reScanJsxToken(bool allowMultilineJsxText) {
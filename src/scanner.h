@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Tracy.hpp"
+#include <array>
+#include <memory>
 #include <string>
 #include <regex>
 #include <any>
@@ -15,7 +17,7 @@ namespace tr {
 
     struct ScanNumber {
         SyntaxKind type;
-        string value;
+        string_view value;
     };
 
     using ErrorCallback = function<
@@ -24,162 +26,223 @@ namespace tr {
                  int length
             )>;
 
-    int skipTrivia(string &text, int pos, optional<bool> stopAfterLineBreak = {}, optional<bool> stopAtComments = {}, optional<bool> inJSDoc = {});
+    int skipTrivia(string_view text, int pos, optional<bool> stopAfterLineBreak = {}, optional<bool> stopAtComments = {}, optional<bool> inJSDoc = {});
 
     /** @internal */
-    inline auto &textToKeywordObj() {
-        static unordered_map<string, SyntaxKind> textToKeywordObj{
-                {"abstract",    SyntaxKind::AbstractKeyword},
-                {"any",         SyntaxKind::AnyKeyword},
-                {"as",          SyntaxKind::AsKeyword},
-                {"asserts",     SyntaxKind::AssertsKeyword},
-                {"assert",      SyntaxKind::AssertKeyword},
-                {"bigint",      SyntaxKind::BigIntKeyword},
-                {"boolean",     SyntaxKind::BooleanKeyword},
-                {"break",       SyntaxKind::BreakKeyword},
-                {"case",        SyntaxKind::CaseKeyword},
-                {"catch",       SyntaxKind::CatchKeyword},
-                {"class",       SyntaxKind::ClassKeyword},
-                {"continue",    SyntaxKind::ContinueKeyword},
-                {"const",       SyntaxKind::ConstKeyword},
-                {"constructor", SyntaxKind::ConstructorKeyword},
-                {"debugger",    SyntaxKind::DebuggerKeyword},
-                {"declare",     SyntaxKind::DeclareKeyword},
-                {"default",     SyntaxKind::DefaultKeyword},
-                {"delete",      SyntaxKind::DeleteKeyword},
-                {"do",          SyntaxKind::DoKeyword},
-                {"else",        SyntaxKind::ElseKeyword},
-                {"enum",        SyntaxKind::EnumKeyword},
-                {"export",      SyntaxKind::ExportKeyword},
-                {"extends",     SyntaxKind::ExtendsKeyword},
-                {"false",       SyntaxKind::FalseKeyword},
-                {"finally",     SyntaxKind::FinallyKeyword},
-                {"for",         SyntaxKind::ForKeyword},
-                {"from",        SyntaxKind::FromKeyword},
-                {"function",    SyntaxKind::FunctionKeyword},
-                {"get",         SyntaxKind::GetKeyword},
-                {"if",          SyntaxKind::IfKeyword},
-                {"implements",  SyntaxKind::ImplementsKeyword},
-                {"import",      SyntaxKind::ImportKeyword},
-                {"in",          SyntaxKind::InKeyword},
-                {"infer",       SyntaxKind::InferKeyword},
-                {"instanceof",  SyntaxKind::InstanceOfKeyword},
-                {"interface",   SyntaxKind::InterfaceKeyword},
-                {"intrinsic",   SyntaxKind::IntrinsicKeyword},
-                {"is",          SyntaxKind::IsKeyword},
-                {"keyof",       SyntaxKind::KeyOfKeyword},
-                {"let",         SyntaxKind::LetKeyword},
-                {"module",      SyntaxKind::ModuleKeyword},
-                {"namespace",   SyntaxKind::NamespaceKeyword},
-                {"never",       SyntaxKind::NeverKeyword},
-                {"new",         SyntaxKind::NewKeyword},
-                {"null",        SyntaxKind::NullKeyword},
-                {"number",      SyntaxKind::NumberKeyword},
-                {"object",      SyntaxKind::ObjectKeyword},
-                {"package",     SyntaxKind::PackageKeyword},
-                {"private",     SyntaxKind::PrivateKeyword},
-                {"protected",   SyntaxKind::ProtectedKeyword},
-                {"public",      SyntaxKind::PublicKeyword},
-                {"override",    SyntaxKind::OverrideKeyword},
-                {"out",         SyntaxKind::OutKeyword},
-                {"readonly",    SyntaxKind::ReadonlyKeyword},
-                {"require",     SyntaxKind::RequireKeyword},
-                {"global",      SyntaxKind::GlobalKeyword},
-                {"return",      SyntaxKind::ReturnKeyword},
-                {"set",         SyntaxKind::SetKeyword},
-                {"static",      SyntaxKind::StaticKeyword},
-                {"string",      SyntaxKind::StringKeyword},
-                {"super",       SyntaxKind::SuperKeyword},
-                {"switch",      SyntaxKind::SwitchKeyword},
-                {"symbol",      SyntaxKind::SymbolKeyword},
-                {"this",        SyntaxKind::ThisKeyword},
-                {"throw",       SyntaxKind::ThrowKeyword},
-                {"true",        SyntaxKind::TrueKeyword},
-                {"try",         SyntaxKind::TryKeyword},
-                {"type",        SyntaxKind::TypeKeyword},
-                {"typeof",      SyntaxKind::TypeOfKeyword},
-                {"undefined",   SyntaxKind::UndefinedKeyword},
-                {"unique",      SyntaxKind::UniqueKeyword},
-                {"unknown",     SyntaxKind::UnknownKeyword},
-                {"var",         SyntaxKind::VarKeyword},
-                {"void",        SyntaxKind::VoidKeyword},
-                {"while",       SyntaxKind::WhileKeyword},
-                {"with",        SyntaxKind::WithKeyword},
-                {"yield",       SyntaxKind::YieldKeyword},
-                {"async",       SyntaxKind::AsyncKeyword},
-                {"await",       SyntaxKind::AwaitKeyword},
-                {"of",          SyntaxKind::OfKeyword},
-        };
-        return textToKeywordObj;
-    }
+    struct TokenText {
+        string_view text;
+        SyntaxKind kind;
+    };
 
-    inline auto &textToTokenBase() {
-        static unordered_map<string, SyntaxKind> textToTokenBase{
-                {"{",    SyntaxKind::OpenBraceToken},
-                {"}",    SyntaxKind::CloseBraceToken},
-                {"(",    SyntaxKind::OpenParenToken},
-                {")",    SyntaxKind::CloseParenToken},
-                {"[",    SyntaxKind::OpenBracketToken},
-                {"]",    SyntaxKind::CloseBracketToken},
-                {".",    SyntaxKind::DotToken},
-                {"...",  SyntaxKind::DotDotDotToken},
-                {";",    SyntaxKind::SemicolonToken},
-                {"},",   SyntaxKind::CommaToken},
-                {"<",    SyntaxKind::LessThanToken},
-                {">",    SyntaxKind::GreaterThanToken},
-                {"<=",   SyntaxKind::LessThanEqualsToken},
-                {">=",   SyntaxKind::GreaterThanEqualsToken},
-                {"==",   SyntaxKind::EqualsEqualsToken},
-                {"!=",   SyntaxKind::ExclamationEqualsToken},
-                {"==",   SyntaxKind::EqualsEqualsEqualsToken},
-                {"!==",  SyntaxKind::ExclamationEqualsEqualsToken},
-                {"=>",   SyntaxKind::EqualsGreaterThanToken},
-                {"+",    SyntaxKind::PlusToken},
-                {"-",    SyntaxKind::MinusToken},
-                {"**",   SyntaxKind::AsteriskAsteriskToken},
-                {"*",    SyntaxKind::AsteriskToken},
-                {"/",    SyntaxKind::SlashToken},
-                {"%",    SyntaxKind::PercentToken},
-                {"++",   SyntaxKind::PlusPlusToken},
-                {"--",   SyntaxKind::MinusMinusToken},
-                {"<<",   SyntaxKind::LessThanLessThanToken},
-                {"</",   SyntaxKind::LessThanSlashToken},
-                {">>",   SyntaxKind::GreaterThanGreaterThanToken},
-                {">>>",  SyntaxKind::GreaterThanGreaterThanGreaterThanToken},
-                {"&",    SyntaxKind::AmpersandToken},
-                {"|",    SyntaxKind::BarToken},
-                {"^",    SyntaxKind::CaretToken},
-                {"!",    SyntaxKind::ExclamationToken},
-                {"~",    SyntaxKind::TildeToken},
-                {"&&",   SyntaxKind::AmpersandAmpersandToken},
-                {"||",   SyntaxKind::BarBarToken},
-                {"?",    SyntaxKind::QuestionToken},
-                {"??",   SyntaxKind::QuestionQuestionToken},
-                {"?.",   SyntaxKind::QuestionDotToken},
-                {":",    SyntaxKind::ColonToken},
-                {"=",    SyntaxKind::EqualsToken},
-                {"+=",   SyntaxKind::PlusEqualsToken},
-                {"-=",   SyntaxKind::MinusEqualsToken},
-                {"*=",   SyntaxKind::AsteriskEqualsToken},
-                {"**=",  SyntaxKind::AsteriskAsteriskEqualsToken},
-                {"/=",   SyntaxKind::SlashEqualsToken},
-                {"%=",   SyntaxKind::PercentEqualsToken},
-                {"<<=",  SyntaxKind::LessThanLessThanEqualsToken},
-                {">>=",  SyntaxKind::GreaterThanGreaterThanEqualsToken},
-                {">>>=", SyntaxKind::GreaterThanGreaterThanGreaterThanEqualsToken},
-                {"&=",   SyntaxKind::AmpersandEqualsToken},
-                {"|=",   SyntaxKind::BarEqualsToken},
-                {"^=",   SyntaxKind::CaretEqualsToken},
-                {"||=",  SyntaxKind::BarBarEqualsToken},
-                {"&&=",  SyntaxKind::AmpersandAmpersandEqualsToken},
-                {"??=",  SyntaxKind::QuestionQuestionEqualsToken},
-                {"@",    SyntaxKind::AtToken},
-                {"#",    SyntaxKind::HashToken},
-                {"`",    SyntaxKind::BacktickToken},
-        };
-        return textToTokenBase;
+    constexpr std::array keywordTexts{
+            TokenText{"abstract",    SyntaxKind::AbstractKeyword},
+            TokenText{"any",         SyntaxKind::AnyKeyword},
+            TokenText{"as",          SyntaxKind::AsKeyword},
+            TokenText{"asserts",     SyntaxKind::AssertsKeyword},
+            TokenText{"assert",      SyntaxKind::AssertKeyword},
+            TokenText{"bigint",      SyntaxKind::BigIntKeyword},
+            TokenText{"boolean",     SyntaxKind::BooleanKeyword},
+            TokenText{"break",       SyntaxKind::BreakKeyword},
+            TokenText{"case",        SyntaxKind::CaseKeyword},
+            TokenText{"catch",       SyntaxKind::CatchKeyword},
+            TokenText{"class",       SyntaxKind::ClassKeyword},
+            TokenText{"continue",    SyntaxKind::ContinueKeyword},
+            TokenText{"const",       SyntaxKind::ConstKeyword},
+            TokenText{"constructor", SyntaxKind::ConstructorKeyword},
+            TokenText{"debugger",    SyntaxKind::DebuggerKeyword},
+            TokenText{"declare",     SyntaxKind::DeclareKeyword},
+            TokenText{"default",     SyntaxKind::DefaultKeyword},
+            TokenText{"delete",      SyntaxKind::DeleteKeyword},
+            TokenText{"do",          SyntaxKind::DoKeyword},
+            TokenText{"else",        SyntaxKind::ElseKeyword},
+            TokenText{"enum",        SyntaxKind::EnumKeyword},
+            TokenText{"export",      SyntaxKind::ExportKeyword},
+            TokenText{"extends",     SyntaxKind::ExtendsKeyword},
+            TokenText{"false",       SyntaxKind::FalseKeyword},
+            TokenText{"finally",     SyntaxKind::FinallyKeyword},
+            TokenText{"for",         SyntaxKind::ForKeyword},
+            TokenText{"from",        SyntaxKind::FromKeyword},
+            TokenText{"function",    SyntaxKind::FunctionKeyword},
+            TokenText{"get",         SyntaxKind::GetKeyword},
+            TokenText{"if",          SyntaxKind::IfKeyword},
+            TokenText{"implements",  SyntaxKind::ImplementsKeyword},
+            TokenText{"import",      SyntaxKind::ImportKeyword},
+            TokenText{"in",          SyntaxKind::InKeyword},
+            TokenText{"infer",       SyntaxKind::InferKeyword},
+            TokenText{"instanceof",  SyntaxKind::InstanceOfKeyword},
+            TokenText{"interface",   SyntaxKind::InterfaceKeyword},
+            TokenText{"intrinsic",   SyntaxKind::IntrinsicKeyword},
+            TokenText{"is",          SyntaxKind::IsKeyword},
+            TokenText{"keyof",       SyntaxKind::KeyOfKeyword},
+            TokenText{"let",         SyntaxKind::LetKeyword},
+            TokenText{"module",      SyntaxKind::ModuleKeyword},
+            TokenText{"namespace",   SyntaxKind::NamespaceKeyword},
+            TokenText{"never",       SyntaxKind::NeverKeyword},
+            TokenText{"new",         SyntaxKind::NewKeyword},
+            TokenText{"null",        SyntaxKind::NullKeyword},
+            TokenText{"number",      SyntaxKind::NumberKeyword},
+            TokenText{"object",      SyntaxKind::ObjectKeyword},
+            TokenText{"package",     SyntaxKind::PackageKeyword},
+            TokenText{"private",     SyntaxKind::PrivateKeyword},
+            TokenText{"protected",   SyntaxKind::ProtectedKeyword},
+            TokenText{"public",      SyntaxKind::PublicKeyword},
+            TokenText{"override",    SyntaxKind::OverrideKeyword},
+            TokenText{"out",         SyntaxKind::OutKeyword},
+            TokenText{"readonly",    SyntaxKind::ReadonlyKeyword},
+            TokenText{"require",     SyntaxKind::RequireKeyword},
+            TokenText{"global",      SyntaxKind::GlobalKeyword},
+            TokenText{"return",      SyntaxKind::ReturnKeyword},
+            TokenText{"set",         SyntaxKind::SetKeyword},
+            TokenText{"static",      SyntaxKind::StaticKeyword},
+            TokenText{"string",      SyntaxKind::StringKeyword},
+            TokenText{"super",       SyntaxKind::SuperKeyword},
+            TokenText{"switch",      SyntaxKind::SwitchKeyword},
+            TokenText{"symbol",      SyntaxKind::SymbolKeyword},
+            TokenText{"this",        SyntaxKind::ThisKeyword},
+            TokenText{"throw",       SyntaxKind::ThrowKeyword},
+            TokenText{"true",        SyntaxKind::TrueKeyword},
+            TokenText{"try",         SyntaxKind::TryKeyword},
+            TokenText{"type",        SyntaxKind::TypeKeyword},
+            TokenText{"typeof",      SyntaxKind::TypeOfKeyword},
+            TokenText{"undefined",   SyntaxKind::UndefinedKeyword},
+            TokenText{"unique",      SyntaxKind::UniqueKeyword},
+            TokenText{"unknown",     SyntaxKind::UnknownKeyword},
+            TokenText{"var",         SyntaxKind::VarKeyword},
+            TokenText{"void",        SyntaxKind::VoidKeyword},
+            TokenText{"while",       SyntaxKind::WhileKeyword},
+            TokenText{"with",        SyntaxKind::WithKeyword},
+            TokenText{"yield",       SyntaxKind::YieldKeyword},
+            TokenText{"async",       SyntaxKind::AsyncKeyword},
+            TokenText{"await",       SyntaxKind::AwaitKeyword},
+            TokenText{"of",          SyntaxKind::OfKeyword},
+    };
+
+    constexpr std::array punctuationTexts{
+            TokenText{"{",           SyntaxKind::OpenBraceToken},
+            TokenText{"}",           SyntaxKind::CloseBraceToken},
+            TokenText{"(",           SyntaxKind::OpenParenToken},
+            TokenText{")",           SyntaxKind::CloseParenToken},
+            TokenText{"[",           SyntaxKind::OpenBracketToken},
+            TokenText{"]",           SyntaxKind::CloseBracketToken},
+            TokenText{".",           SyntaxKind::DotToken},
+            TokenText{"...",         SyntaxKind::DotDotDotToken},
+            TokenText{";",           SyntaxKind::SemicolonToken},
+            TokenText{",",           SyntaxKind::CommaToken},
+            TokenText{"<",           SyntaxKind::LessThanToken},
+            TokenText{">",           SyntaxKind::GreaterThanToken},
+            TokenText{"<=",          SyntaxKind::LessThanEqualsToken},
+            TokenText{">=",          SyntaxKind::GreaterThanEqualsToken},
+            TokenText{"==",          SyntaxKind::EqualsEqualsToken},
+            TokenText{"!=",          SyntaxKind::ExclamationEqualsToken},
+            TokenText{"===",         SyntaxKind::EqualsEqualsEqualsToken},
+            TokenText{"!==",         SyntaxKind::ExclamationEqualsEqualsToken},
+            TokenText{"=>",          SyntaxKind::EqualsGreaterThanToken},
+            TokenText{"+",           SyntaxKind::PlusToken},
+            TokenText{"-",           SyntaxKind::MinusToken},
+            TokenText{"**",          SyntaxKind::AsteriskAsteriskToken},
+            TokenText{"*",           SyntaxKind::AsteriskToken},
+            TokenText{"/",           SyntaxKind::SlashToken},
+            TokenText{"%",           SyntaxKind::PercentToken},
+            TokenText{"++",          SyntaxKind::PlusPlusToken},
+            TokenText{"--",          SyntaxKind::MinusMinusToken},
+            TokenText{"<<",          SyntaxKind::LessThanLessThanToken},
+            TokenText{"</",          SyntaxKind::LessThanSlashToken},
+            TokenText{">>",          SyntaxKind::GreaterThanGreaterThanToken},
+            TokenText{">>>",         SyntaxKind::GreaterThanGreaterThanGreaterThanToken},
+            TokenText{"&",           SyntaxKind::AmpersandToken},
+            TokenText{"|",           SyntaxKind::BarToken},
+            TokenText{"^",           SyntaxKind::CaretToken},
+            TokenText{"!",           SyntaxKind::ExclamationToken},
+            TokenText{"~",           SyntaxKind::TildeToken},
+            TokenText{"&&",          SyntaxKind::AmpersandAmpersandToken},
+            TokenText{"||",          SyntaxKind::BarBarToken},
+            TokenText{"?",           SyntaxKind::QuestionToken},
+            TokenText{"??",          SyntaxKind::QuestionQuestionToken},
+            TokenText{"?.",          SyntaxKind::QuestionDotToken},
+            TokenText{":",           SyntaxKind::ColonToken},
+            TokenText{"=",           SyntaxKind::EqualsToken},
+            TokenText{"+=",          SyntaxKind::PlusEqualsToken},
+            TokenText{"-=",          SyntaxKind::MinusEqualsToken},
+            TokenText{"*=",          SyntaxKind::AsteriskEqualsToken},
+            TokenText{"**=",         SyntaxKind::AsteriskAsteriskEqualsToken},
+            TokenText{"/=",          SyntaxKind::SlashEqualsToken},
+            TokenText{"%=",          SyntaxKind::PercentEqualsToken},
+            TokenText{"<<=",         SyntaxKind::LessThanLessThanEqualsToken},
+            TokenText{">>=",         SyntaxKind::GreaterThanGreaterThanEqualsToken},
+            TokenText{">>>=",        SyntaxKind::GreaterThanGreaterThanGreaterThanEqualsToken},
+            TokenText{"&=",          SyntaxKind::AmpersandEqualsToken},
+            TokenText{"|=",          SyntaxKind::BarEqualsToken},
+            TokenText{"^=",          SyntaxKind::CaretEqualsToken},
+            TokenText{"||=",         SyntaxKind::BarBarEqualsToken},
+            TokenText{"&&=",         SyntaxKind::AmpersandAmpersandEqualsToken},
+            TokenText{"??=",         SyntaxKind::QuestionQuestionEqualsToken},
+            TokenText{"@",           SyntaxKind::AtToken},
+            TokenText{"#",           SyntaxKind::HashToken},
+            TokenText{"`",           SyntaxKind::BacktickToken},
+    };
+
+    /**
+     * Collision free hash table over a fixed list of token texts. The seed is searched at compile time, so a lookup is
+     * one multiplication and a single compare against the only candidate. Hashes the length and the first, middle and
+     * last byte, so these have to differ between the texts of a list (the seed search would not terminate otherwise).
+     */
+    template<size_t N>
+    struct TokenTextTable {
+        static constexpr unsigned int bits = 10;
+
+        std::array<TokenText, N> texts;
+        std::array<uint8_t, 1 << bits> slots{}; //index + 1 into texts, 0 is empty
+        uint32_t seed = 0;
+
+        static constexpr uint32_t hash(string_view text, uint32_t seed) {
+            uint32_t key = (uint8_t) text[0] | (uint8_t) text[text.size() / 2] << 8 | (uint8_t) text.back() << 16 | (uint32_t) text.size() << 24;
+            return (key * seed) >> (32 - bits);
+        }
+
+        constexpr explicit TokenTextTable(const std::array<TokenText, N> &texts): texts(texts) {
+            static_assert(N < 255);
+            for (seed = 0x9E3779B1; ; seed += 2) {
+                slots = {};
+                bool collision = false;
+                for (size_t i = 0; i < N && !collision; i++) {
+                    auto &slot = slots[hash(texts[i].text, seed)];
+                    if (slot) collision = true;
+                    slot = i + 1;
+                }
+                if (!collision) break;
+            }
+        }
+
+        constexpr optional<SyntaxKind> find(string_view text) const {
+            if (text.empty()) return nullopt;
+            auto slot = slots[hash(text, seed)];
+            if (slot && texts[slot - 1].text == text) return texts[slot - 1].kind;
+            return nullopt;
+        }
+    };
+
+    constexpr TokenTextTable keywordTable(keywordTexts);
+    constexpr TokenTextTable punctuationTable(punctuationTexts);
+
+    static_assert(keywordTable.find("constructor") == SyntaxKind::ConstructorKeyword);
+    static_assert(!keywordTable.find("constructors"));
+    static_assert(punctuationTable.find(">>>=") == SyntaxKind::GreaterThanGreaterThanGreaterThanEqualsToken);
+
+    /**
+     * Keyword kind for identifier text, nullopt for plain identifiers.
+     */
+    constexpr optional<SyntaxKind> keywordToToken(string_view text) {
+        return keywordTable.find(text);
     }
 
+    //token text by kind, empty for tokens without fixed text
+    constexpr auto tokenStrings = [] {
+        std::array<string_view, (size_t) SyntaxKind::LastToken + 1> strings{};
+        for (auto &&t: keywordTexts) strings[(size_t) t.kind] = t.text;
+        for (auto &&t: punctuationTexts) strings[(size_t) t.kind] = t.text;
+        return strings;
+    }();
+
     /*
         As per ECMAScript Language Specification 3th Edition, Section 7.6: Identifiers
         IdentifierStart ::
@@ -345,11 +408,6 @@ namespace tr {
         return unicodeESNextIdentifierPart;
     }
 
-    inline unordered_map<string, SyntaxKind> &textToToken() {
-        static auto textToToken = combine<SyntaxKind>(textToKeywordObj(), textToTokenBase());
-        return textToToken;
-    }
-
     inline bool lookupInUnicodeMap(int code, const vector<int> &map) {
         // Bail out quickly if it couldn't possibly be in the map.
         if (code < map[0]) {
@@ -380,19 +438,14 @@ namespace tr {
     }
 
     /* @internal */
-    inline optional<SyntaxKind> stringToToken(string s) {
-        return get(textToToken(), s);
+    constexpr optional<SyntaxKind> stringToToken(string_view s) {
+        if (auto kind = keywordTable.find(s)) return kind;
+        return punctuationTable.find(s);
     }
 
-    inline unordered_map<SyntaxKind, string> tokenStrings() {
-        static auto tokenStrings = reverse(textToToken());
-        return tokenStrings;
-    };
-
     /* @internal */
     inline string tokenToString(SyntaxKind t) {
-        auto v = get(tokenStrings(), t);
-        if (v) return *v;
+        if ((size_t) t < tokenStrings.size()) return string(tokenStrings[(size_t) t]);
         return "";
     }
 
@@ -418,9 +471,36 @@ namespace tr {
     /* @internal */
     bool isIdentifierText(string name, ScriptTarget languageVersion = ScriptTarget::Latest, LanguageVariant identifierVariant = LanguageVariant::Standard);
 
+    /**
+     * Tokens are views into `text`, which is owned by the caller and has to outlive the scanner and its token values.
+     * Only values that differ from the source text (escapes, numeric separators, normalized numbers) are materialized
+     * into a buffer of the scanner, valid until the next token.
+     */
     class Scanner {
+        //one buffer per nested checkpoint of a materialized token, so speculation never copies one, see Checkpoint
+        vector<std::unique_ptr<string>> tokenValueBuffers;
+        unsigned int activeBuffer = 0;
+        string identifierBuffer;
+
+        //token range getTokenValueHash() was computed for
+        int hashedTokenPos = -1;
+        int hashedPos = -1;
+        uint64_t tokenValueHash = 0;
+
+        //stores a value that is not part of the source text
+        string_view materialize(string &&value) {
+            auto &buffer = *tokenValueBuffers[activeBuffer];
+            buffer = std::move(value);
+            return buffer;
+        }
+
+        bool isMaterialized() const {
+            auto &buffer = *tokenValueBuffers[activeBuffer];
+            return tokenValue.data() >= buffer.data() && tokenValue.data() < buffer.data() + buffer.size();
+        }
+
     public:
-        string text;
+        string_view text;
 
         // Current position (end position of text of current token)
         int pos{};
@@ -441,7 +521,7 @@ namespace tr {
         int inJSDocType = 0;
 
         SyntaxKind token;
-        string tokenValue;
+        string_view tokenValue;
         int tokenFlags{};
 
         LanguageVariant languageVariant = LanguageVariant::Standard;
@@ -450,11 +530,55 @@ namespace tr {
 
         optional<ErrorCallback> onError;
 
-        explicit Scanner(const string &text): text(text) {
+        explicit Scanner(string_view text): text(text) {
             end = text.size();
+            tokenValueBuffers.push_back(std::make_unique<string>());
         }
 
         explicit Scanner(ScriptTarget languageVersion, bool skipTrivia): languageVersion(languageVersion), skipTrivia(skipTrivia) {
+            tokenValueBuffers.push_back(std::make_unique<string>());
+        }
+
+        /**
+         * State restored when speculation fails. Trivially copyable: a materialized token value stays in its buffer
+         * because saving moves materialization to the next one, whose capacity is reused by later checkpoints of the
+         * same depth.
+         */
+        struct Checkpoint {
+            int pos;
+            int startPos;
+            int tokenPos;
+            int tokenFlags;
+            SyntaxKind token;
+            string_view tokenValue;
+            unsigned int buffer;
+        };
+
+        Checkpoint checkpoint() {
+            Checkpoint checkpoint{pos, startPos, tokenPos, tokenFlags, token, tokenValue, activeBuffer};
+            if (isMaterialized()) {
+                if (++activeBuffer == tokenValueBuffers.size()) tokenValueBuffers.push_back(std::make_unique<string>());
+            }
+            return checkpoint;
+        }
+
+        void restore(const Checkpoint &checkpoint) {
+            pos = checkpoint.pos;
+            startPos = checkpoint.startPos;
+            tokenPos = checkpoint.tokenPos;
+            tokenFlags = checkpoint.tokenFlags;
+            token = checkpoint.token;
+            tokenValue = checkpoint.tokenValue;
+            activeBuffer = checkpoint.buffer;
+            hashedTokenPos = hashedPos = -1;
+        }
+
+        //keeps the current state, the saved one is not needed anymore
+        void commit(const Checkpoint &checkpoint) {
+            if (activeBuffer == checkpoint.buffer) return;
+            //the buffer of the current token takes the place of the saved one, strings themselves don't move
+            std::swap(tokenValueBuffers[checkpoint.buffer], tokenValueBuffers[activeBuffer]);
+            activeBuffer = checkpoint.buffer;
         }
 
         SyntaxKind scan();
@@ -472,15 +596,16 @@ namespace tr {
             startPos = textPos;
             tokenPos = textPos;
             token = SyntaxKind::Unknown;
-            tokenValue = "";
+            tokenValue = {};
             tokenFlags = TokenFlags::None;
+            hashedTokenPos = hashedPos = -1;
         }
 
         void setOnError(optional<ErrorCallback> errorCallback) {
             onError = errorCallback;
         }
 
-        void setText(string newText = "", int start = 0, int length = -1) {
+        void setText(string_view newText = {}, int start = 0, int length = -1) {
             text = newText;
             end = length == -1 ? text.size() : start + length;
             setTextPos(start);
@@ -508,10 +633,22 @@ namespace tr {
             return false;
         }
 
-        string getTokenValue() {
+        string_view getTokenValue() {
             return tokenValue;
         }
 
+        /**
+         * hash::runtime_hash of the token value, computed once per token. Identifiers carry it from here into the compiler and the bytecode.
+         */
+        uint64_t getTokenValueHash() {
+            if (hashedTokenPos != tokenPos || hashedPos != pos) {
+                tokenValueHash = hash::runtime_hash(tokenValue);
+                hashedTokenPos = tokenPos;
+                hashedPos = pos;
+            }
+            return tokenValueHash;
+        }
+
         int getTextPos() {
             return pos;
         }
@@ -524,38 +661,30 @@ namespace tr {
             return startPos;
         }
 
-        template<typename T>
-        T lookAhead(const function<T()> &callback) {
+        template<typename T, typename F>
+        T lookAhead(F &&callback) {
             ZoneScoped;
             return speculationHelper<T>(callback, /*isLookahead*/ true);
         }
 
-        template<typename T>
-        T tryScan(const function<T()> &callback) {
+        template<typename T, typename F>
+        T tryScan(F &&callback) {
             ZoneScoped;
             return speculationHelper<T>(callback, /*isLookahead*/ false);
         }
 
-        template<typename T>
-        T speculationHelper(const function<T()> &callback, bool isLookahead) {
+        template<typename T, typename F>
+        T speculationHelper(F &callback, bool isLookahead) {
             ZoneScoped;
-            const auto savePos = pos;
-            const auto saveStartPos = startPos;
-            const auto saveTokenPos = tokenPos;
-            const auto saveToken = token;
-            const auto saveTokenValue = tokenValue;
-            const auto saveTokenFlags = tokenFlags;
-            const auto result = callback();
+            const auto saved = checkpoint();
+            T result = callback();
 
             // If our callback returned something 'falsy' or we're just looking ahead,
             // then unconditionally restore us to where we were.
             if (isLookahead || !(bool)result) {
-                pos = savePos;
-                startPos = saveStartPos;
-                tokenPos = saveTokenPos;
-                token = saveToken;
-                tokenValue = saveTokenValue;
-                tokenFlags = saveTokenFlags;
+                restore(saved);
+            } else {
+                commit(saved);
             }
             return result;
         }
@@ -592,7 +721,7 @@ namespace tr {
         SyntaxKind scanJsxIdentifier();
         SyntaxKind reScanJsxToken(bool allowMultilineJsxText = false);
 
-        string getTokenText() {
+        string_view getTokenText() {
             return substring(text, tokenPos, pos);
         }
 
@@ -648,7 +777,7 @@ namespace tr {
 
         SyntaxKind checkBigIntSuffix();
 
-        string scanIdentifierParts();
+        string_view scanIdentifierParts();
 
         string scanNumberFragment();
 
@@ -664,17 +793,17 @@ namespace tr {
 
         string scanEscapeSequence(bool isTaggedTemplate = false);
 
-        string scanString(bool jsxAttributeString = false);
+        string_view scanString(bool jsxAttributeString = false);
 
         bool isOctalDigit(const CharCode &code);
 
-        int error(const shared<DiagnosticMessage> &message, int errPos = -1, int length = -1);
+        void error(const shared<DiagnosticMessage> &message, int errPos = -1, int length = -1);
 
-        vector<CommentDirective> appendIfCommentDirective(vector<CommentDirective> &commentDirectives, const string &text, const regex &commentDirectiveRegEx, int lineStart);
+        vector<CommentDirective> appendIfCommentDirective(vector<CommentDirective> &commentDirectives, string_view text, const regex &commentDirectiveRegEx, int lineStart);
 
         int scanOctalDigits();
 
-        int scanConflictMarkerTrivia(string &text, int pos);
+        int scanConflictMarkerTrivia(string_view text, int pos);
 
         SyntaxKind getIdentifierToken();
     };
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Tracy.hpp"
+
+namespace tr {
+    using std::function;
+    using std::vector;
+
+    /**
+     * Fixed size thread pool with one task deque per worker.
+     *
+     * A worker pops its own tasks LIFO (so a task pushed from inside a task, e.g. the next stage of the same file,
+     * runs right after on the same core while its data is still hot) and when empty steals FIFO from the others.
+     * This way one long running task only occupies its own worker, everything queued behind it is taken by others.
+     */
+    class Scheduler {
+        struct Worker {
+            std::mutex mutex;
+            std::deque<function<void()>> tasks;
+        };
+
+        vector<std::unique_ptr<Worker>> workers;
+        vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::condition_variable finished;
+        //tasks sitting in a deque. Counted after they are pushed and after they are taken, so it never exceeds what
+        //the deques hold and a worker woken by it finds a task instead of spinning until the push lands. A task taken
+        //before it was counted makes it negative for a moment. It only grows while `mutex` is held, so a waiting
+        //worker can not miss it
+        std::atomic<int> queued = 0;
+        std::atomic<unsigned int> pending = 0; //tasks queued or running
+        std::atomic<unsigned int> nextWorker = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+
+        inline static thread_local int currentWorker = -1;
+        inline static thread_local Scheduler *currentScheduler = nullptr;
+
+        bool take(unsigned int index, function<void()> &task) {
+            {
+                auto &own = *workers[index];
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+            for (unsigned int i = 1; i < workers.size(); i++) {
+                auto &victim = *workers[(index + i) % workers.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(unsigned int index) {
+            currentWorker = index;
+            currentScheduler = this;
+#if TRACY_ENABLE
+            tracy::SetThreadName(("worker " + std::to_string(index)).c_str());
+#endif
+            function<void()> task;
+            while (true) {
+                if (take(index, task)) {
+                    queued--;
+                    try {
+                        task();
+                    } catch (...) {
+                        std::lock_guard lock(mutex);
+                        if (!error) error = std::current_exception();
+                    }
+                    task = nullptr;
+                    if (--pending == 0) {
+                        std::lock_guard lock(mutex);
+                        finished.notify_all();
+                    }
+                    continue;
+                }
+
+                std::unique_lock lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping && queued <= 0) return;
+            }
+        }
+
+    public:
+        explicit Scheduler(unsigned int size = std::thread::hardware_concurrency()) {
+            if (size == 0) size = 1;
+            for (unsigned int i = 0; i < size; i++) workers.push_back(std::make_unique<Worker>());
+            for (unsigned int i = 0; i < size; i++) threads.emplace_back(&Scheduler::work, this, i);
+        }
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        ~Scheduler() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for (auto &&thread: threads) thread.join();
+        }
+
+        unsigned int size() const {
+            return workers.size();
+        }
+
+        /**
+         * Index of the worker running the calling task, -1 when called from outside the pool.
+         * Use it to address per-worker state (e.g. one vm2::VM per worker) without locking.
+         */
+        static int worker() {
+            return currentWorker;
+        }
+
+        /**
+         * Queues a task. Called from within a task of this pool it goes to the worker's own deque,
+         * otherwise the workers are filled round-robin.
+         */
+        void push(function<void()> task) {
+            auto index = currentScheduler == this && currentWorker >= 0 ? (unsigned int) currentWorker : nextWorker++ % workers.size();
+            pending++;
+            {
+                auto &worker = *workers[index];
+                std::lock_guard lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard lock(mutex);
+                queued++;
+            }
+            wakeup.notify_one();
+        }
+
+        /**
+         * Blocks until all queued tasks (including tasks they pushed) are done.
+         * Rethrows the first exception a task has thrown.
+         */
+        void wait() {
+            {
+                std::unique_lock lock(mutex);
+                finished.wait(lock, [this] { return pending == 0; });
+            }
+            if (error) {
+                auto e = error;
+                error = nullptr;
+                std::rethrow_exception(e);
+            }
+        }
+    };
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "./core.h"
+#include "./project.h"
+
+namespace tr::driver {
+    using std::string;
+    using std::string_view;
+    using std::vector;
+
+    /**
+     * Line based request protocol of a long-lived check server, which keeps a Project (parsed, compiled and linked
+     * modules, workers and their VMs) warm between requests. One request per line, arguments separated by spaces:
+     *
+     *   check file...         adds the files to the project, checks all its files and reports those given
+     *   changed [file...]     the given files (all if none) changed on disk, checks the project and reports all files
+     *   diagnostics [file...] reports the diagnostics of the last check without checking
+     *   forget file...        removes the files from the project
+     *   shutdown              ends serve()
+     *
+     * A report is one line per diagnostic, `file:line:character: message` (both 1-based), or `file: error: message`
+     * when the file could not be read or compiled. Each response ends with a line `ok <errors> errors` or `error <reason>`.
+     */
+    class Server {
+        Project project;
+        vector<string> files; //of the project, in the order they were added
+        std::unordered_set<string> known;
+        bool stopped = false;
+
+        static vector<string> split(string_view line) {
+            vector<string> words;
+            std::size_t pos = 0;
+            while (pos < line.size()) {
+                auto end = line.find(' ', pos);
+                if (end == string_view::npos) end = line.size();
+                if (end > pos) words.emplace_back(line.substr(pos, end - pos));
+                pos = end + 1;
+            }
+            return words;
+        }
+
+        void add(const string &file) {
+            if (known.insert(file).second) files.push_back(file);
+        }
+
+        //diagnostics of `file` as of the last check, returns their count
+        unsigned int report(const CheckedFile &file, string &out) {
+            if (!file.error.empty()) {
+                out += fmt::format("{}: error: {}\n", file.file, file.error);
+                return 1;
+            }
+            if (!file.module) return 0;
+            file.module->renderErrors();
+            for (auto &&e: file.module->errors) {
+                auto map = e.ip ? file.module->findNormalizedMap(e.ip) : vm2::FoundSourceMap{0, 0};
+                if (map.found()) {
+                    auto position = file.module->mapToLineCharacter(map);
+                    out += fmt::format("{}:{}:{}: {}\n", file.file, position.line + 1, position.pos + 1, e.message);
+                } else {
+                    out += fmt::format("{}: {}\n", file.file, e.message);
+                }
+            }
+            return file.module->errors.size();
+        }
+
+        string report(const Result &result, const std::unordered_set<string> *only) {
+            string out;
+            unsigned int errors = 0;
+            for (auto &&file: result.files) {
+                if (!only || only->contains(file.file)) errors += report(file, out);
+            }
+            return out + fmt::format("ok {} errors\n", errors);
+        }
+
+    public:
+        Result last; //of the last check
+
+        //relative paths in requests are relative to `cwd`
+        std::filesystem::path cwd;
+
+        explicit Server(unsigned int threads = std::thread::hardware_concurrency(), BytecodeCache *cache = nullptr, shared<const vm2::Prelude> prelude = nullptr, std::filesystem::path cwd = std::filesystem::current_path()):
+                project(threads, cache, std::move(prelude)), cwd(std::move(cwd)) {
+        }
+
+        bool running() const {
+            return !stopped;
+        }
+
+        /**
+         * Handles one request line and returns the response, including its final `ok`/`error` line.
+         */
+        string handle(string_view line) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.remove_suffix(1);
+            auto words = split(line);
+            if (words.empty()) return "error empty request\n";
+            auto command = words[0];
+            vector<string> paths;
+            for (unsigned int i = 1; i < words.size(); i++) {
+                auto p = std::filesystem::path(words[i]);
+                paths.push_back((p.is_absolute() ? p : cwd / p).lexically_normal().string());
+            }
+            std::unordered_set<string> arguments(paths.begin(), paths.end());
+
+            try {
+                if (command == "check") {
+                    if (paths.empty()) return "error check needs files\n";
+                    for (auto &&file: paths) add(file);
+                    last = project.check(files);
+                    return report(last, &arguments);
+                }
+                if (command == "changed") {
+                    for (auto &&file: paths) add(file);
+                    last = project.check(files, paths.empty() ? nullptr : &arguments);
+                    return report(last, nullptr);
+                }
+                if (command == "diagnostics") {
+                    return report(last, arguments.empty() ? nullptr : &arguments);
+                }
+                if (command == "forget") {
+                    std::erase_if(files, [&arguments](auto &file) { return arguments.contains(file); });
+                    for (auto &&file: arguments) known.erase(file);
+                    std::erase_if(last.files, [&arguments](auto &file) { return arguments.contains(file.file); });
+                    return "ok 0 errors\n";
+                }
+                if (command == "shutdown") {
+                    stopped = true;
+                    return "ok 0 errors\n";
+                }
+            } catch (std::exception &e) {
+                return fmt::format("error {}\n", e.what());
+            }
+            return fmt::format("error unknown command {}\n", command);
+        }
+
+        /**
+         * Answers requests of `in` until it ends or a shutdown request.
+         */
+        void serve(std::istream &in, std::ostream &out) {
+            string line;
+            while (running() && std::getline(in, line)) {
+                out << handle(line) << std::flush;
+            }
+        }
+
+        /**
+         * Listens on a Unix domain socket at `path` and answers the requests of one connection after the other, until
+         * a shutdown request.
+         */
+        void serve(const string &path) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(address.sun_path)) throw std::runtime_error("Socket path too long " + path);
+            std::copy(path.begin(), path.end(), address.sun_path);
+
+            auto listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listener < 0) throw std::runtime_error("Could not create socket");
+            ::unlink(path.c_str());
+            if (::bind(listener, (sockaddr *) &address, sizeof(address)) < 0 || ::listen(listener, 8) < 0) {
+                ::close(listener);
+                throw std::runtime_error("Could not listen on " + path);
+            }
+
+            while (running()) {
+                auto connection = ::accept(listener, nullptr, nullptr);
+                if (connection < 0) {
+                    //interrupted, or the client gave up before it was accepted
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    //out of descriptors or memory, which a closing connection gives back
+                    if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                        continue;
+                    }
+                    ::close(listener);
+                    ::unlink(path.c_str());
+                    throw std::runtime_error("Could not accept on " + path);
+                }
+                string buffer;
+                char chunk[4096];
+                //false once the client is gone, writing to it would raise SIGPIPE without MSG_NOSIGNAL
+                auto open = true;
+                while (open && running()) {
+                    auto read = ::read(connection, chunk, sizeof(chunk));
+                    if (read < 0 && errno == EINTR) continue;
+                    if (read <= 0) break;
+                    buffer.append(chunk, read);
+                    std::size_t end;
+                    while (open && running() && (end = buffer.find('\n')) != string::npos) {
+                        auto response = handle(string_view(buffer).substr(0, end));
+                        buffer.erase(0, end + 1);
+                        for (std::size_t written = 0; open && written < response.size();) {
+                            auto n = ::send(connection, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+                            if (n < 0 && errno == EINTR) continue;
+                            if (n <= 0) open = false;
+                            else written += n;
+                        }
+                    }
+                }
+                ::close(connection);
+            }
+            ::close(listener);
+            ::unlink(path.c_str());
+        }
+    };
+}
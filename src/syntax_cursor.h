@@ -11,33 +11,43 @@ namespace tr {
         Value = -1
     };
 
-    //not used
-//    struct IncrementalNode : Node, IncrementalElement {
-//        bool hasBeenIncrementallyParsed;
-//    };
-
+    /**
+     * Hands out the top-level statements of an old SourceFile that an edit did not touch, so that the parser reuses
+     * them instead of parsing them again (see Parser::updateSourceFile).
+     *
+     * Statements ending before the change keep their position, statements starting after it are moved by the length
+     * difference of the edit once they are reused. The last statement before the change is never reused, since where
+     * it ends can depend on the first changed token (automatic semicolon insertion). Reused nodes are shared with the
+     * old tree, which is not valid anymore after the update.
+     */
     class SyntaxCursor {
-        SourceFile *sourceFile;
-//        NodeArray *currentArray;
-
-        int currentArrayIndex = 0;
+        shared<SourceFile> sourceFile;
+        unsigned int reusableBefore = 0; //statements [0, reusableBefore) end before the change
+        unsigned int reusableAfter = 0; //statements [reusableAfter, size) start after the change
+        int delta = 0; //new minus old length
 
-//        assert(currentArrayIndex < currentArray.length);
-        Node *current;
+        unsigned int next = 0; //the parser asks for increasing positions, so the search continues here
+        sharedOpt<Node> current;
         int lastQueriedPosition = InvalidPosition::Value;
+
+        int newPos(unsigned int index) const;
+
     public:
-        SyntaxCursor(SourceFile *sourceFile) : sourceFile(sourceFile) {
-//            currentArray = &sourceFile->statements;
-//            current = &currentArray->list[currentArrayIndex];
-        }
+        SyntaxCursor(shared<SourceFile> sourceFile, types::TextChangeRange change);
 
-        Node currentNode(int position);
+        const shared<SourceFile> &getSourceFile() const {
+            return sourceFile;
+        }
 
-        // Finds the highest element in the tree we can find that starts at the provided position.
-        // The element must be a direct child of some node list in the tree.  This way after we
-        // return it, we can easily return its next sibling in the list.
-        void findHighestListElementThatStartsAtPosition(int position);
+        /**
+         * The reusable statement starting at `position` of the new text, nullptr if there is none.
+         */
+        sharedOpt<Node> currentNode(int position);
     };
 
-} // ts
+    /**
+     * Shifts pos/end of `node` and all its children by `delta`.
+     */
+    void moveNode(const shared<Node> &node, int delta);
 
+} // ts
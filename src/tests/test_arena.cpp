@@ -0,0 +1,98 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <memory>
+
+#include "../arena.h"
+#include "../parser2.h"
+
+using namespace tr;
+
+TEST_CASE("arenaAllocate") {
+    NodeArena arena;
+    auto a = arena.allocate(3, 1);
+    auto b = arena.allocate(8, 8);
+    REQUIRE(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+    REQUIRE(b>a);
+    //bigger than a quarter chunk, gets its own block
+    auto big = arena.allocate(1024 * 1024, 16);
+    REQUIRE(reinterpret_cast<uintptr_t>(big) % 16 == 0);
+    REQUIRE(arena.size() == 3 + 8 + 1024 * 1024);
+}
+
+TEST_CASE("arenaScope") {
+    std::weak_ptr<NodeArena> weak;
+    shared<Identifier> node;
+    {
+        auto arena = std::make_shared<NodeArena>();
+        weak = arena;
+        NodeArena::Scope scope(arena);
+        REQUIRE(NodeArena::active() == arena);
+        node = makeNode<Identifier>();
+        REQUIRE(arena->size()>=sizeof(Identifier));
+    }
+    REQUIRE(!NodeArena::active());
+    //the node keeps its arena alive
+    REQUIRE(!weak.expired());
+    node.reset();
+    REQUIRE(weak.expired());
+}
+
+TEST_CASE("arenaParser") {
+    Parser parser;
+    auto result = parser.parseSourceFile("app.ts", "const v1: string = 'abc';", ScriptTarget::Latest, false, ScriptKind::TS, {});
+    REQUIRE(!NodeArena::active());
+    REQUIRE(result->statements->list.size() == 1);
+}
+
+TEST_CASE("arenaParentLinks") {
+    std::weak_ptr<Identifier> weak;
+    auto child = makeNode<Identifier>();
+    {
+        auto parent = makeNode<Identifier>();
+        weak = parent;
+        child->setParent(parent);
+        REQUIRE(child->getParent() == parent.get());
+    }
+    //parent links do not own
+    REQUIRE(weak.expired());
+}
+
+TEST_CASE("arenaList") {
+    ArenaList<shared<int>, 3> list;
+    auto one = std::make_shared<int>(1);
+    for (auto i = 0; i<3; i++) list.push_back(one);
+    REQUIRE(list.size() == 3);
+
+    auto arena = std::make_shared<NodeArena>();
+    {
+        NodeArena::Scope scope(arena);
+        for (auto i = 0; i<5; i++) list.push_back(std::make_shared<int>(i));
+        REQUIRE(arena->size() >= sizeof(shared<int>) * 8);
+    }
+    REQUIRE(list.size() == 8);
+    REQUIRE(*list.back() == 4);
+    REQUIRE(one.use_count() == 4);
+
+    auto slice = list.span(1, 4);
+    REQUIRE(slice.size() == 3);
+    REQUIRE(slice.data() == list.data() + 1);
+
+    auto moved = std::move(list);
+    REQUIRE(list.empty());
+    REQUIRE(moved.size() == 8);
+    auto copy = moved;
+    REQUIRE(one.use_count() == 7);
+    copy.clear();
+    moved.clear();
+    REQUIRE(one.use_count() == 1);
+}
+
+TEST_CASE("arenaNodeArraySlice") {
+    Parser parser;
+    auto result = parser.parseSourceFile("app.ts", "function f(a, b, c, d, e) {}", ScriptTarget::Latest, false, ScriptKind::TS, {});
+    auto f = to<FunctionDeclaration>(result->statements->list[0]);
+    REQUIRE(f->parameters->length() == 5);
+    auto tail = f->parameters->slice(3);
+    REQUIRE(tail.size() == 2);
+    REQUIRE(tail[0] == f->parameters->list[3]);
+}
@@ -0,0 +1,75 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <string>
+#include <string_view>
+
+#include "../typerunner.h"
+
+using std::string;
+using std::string_view;
+
+static int check(tr_context *context, string_view code) {
+    string_view file = "app.ts";
+    return tr_check_source(context, file.data(), file.size(), code.data(), code.size());
+}
+
+static string query(tr_context *context, string_view name) {
+    const char *type = nullptr;
+    size_t length = 0;
+    if (!tr_query_type(context, name.data(), name.size(), &type, &length)) return "";
+    return string(type, length);
+}
+
+TEST_CASE("capi") {
+    auto context = tr_context_new();
+    REQUIRE(context);
+
+    string code = "type A = string | number;\nconst a: A = true;\nconst b: string = 'b';";
+    REQUIRE(check(context, code) == 1);
+    //the source is copied, the caller may reuse its buffer
+    code.assign(code.size(), ' ');
+
+    const tr_diagnostic *diagnostics = nullptr;
+    REQUIRE(tr_get_diagnostics(context, &diagnostics) == 1);
+    REQUIRE(diagnostics[0].message_length > 0);
+    REQUIRE(diagnostics[0].line == 1);
+    REQUIRE(diagnostics[0].end > diagnostics[0].start);
+
+    REQUIRE(query(context, "A") == "string | number");
+    REQUIRE(query(context, "missing") == "");
+    REQUIRE(string(tr_last_error(context)) == "");
+
+    //the same context checks the next source with its warm pools
+    for (unsigned int i = 0; i < 10; i++) {
+        REQUIRE(check(context, "type B = string;\nconst b: B = 'b';") == 0);
+        REQUIRE(tr_get_diagnostics(context, &diagnostics) == 0);
+        REQUIRE(query(context, "B") == "string");
+        REQUIRE(query(context, "A") == "");
+    }
+
+    tr_context_reset(context);
+    REQUIRE(tr_get_diagnostics(context, &diagnostics) == 0);
+    REQUIRE(query(context, "B") == "");
+    REQUIRE(check(context, "const c: number = 'c';") == 1);
+
+    tr_context_free(context);
+}
+
+TEST_CASE("capi contexts") {
+    //contexts share nothing
+    auto a = tr_context_new();
+    auto b = tr_context_new();
+    REQUIRE(check(a, "type A = number;") == 0);
+    REQUIRE(check(b, "type A = string;\nconst a: A = 1;") == 1);
+    REQUIRE(query(a, "A") == "number");
+    REQUIRE(query(b, "A") == "string");
+
+    //a failure of the checker is not reported as one of the source
+    REQUIRE(check(a, "type A = *;") == TR_ERROR_PARSE);
+    REQUIRE(string(tr_last_error(a)) == "JSDoc not supported");
+    REQUIRE(check(b, "type A = string;\nconst a = (1, 2);") == TR_ERROR_INTERNAL);
+    REQUIRE(string(tr_last_error(b)).starts_with("Internal error: "));
+    REQUIRE(query(b, "A") == "");
+    tr_context_free(a);
+    tr_context_free(b);
+}
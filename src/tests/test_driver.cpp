@@ -0,0 +1,389 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <atomic>
+
+#include "../core.h"
+#include "../fs.h"
+#include "../scheduler.h"
+#include "../driver.h"
+#include "../project.h"
+#include "../server.h"
+#include "../watcher.h"
+#include "../cache.h"
+#include "../bench.h"
+#include "../generator.h"
+
+using namespace tr;
+
+TEST_CASE("scheduler") {
+    Scheduler scheduler(4);
+    std::atomic<unsigned int> done = 0;
+    std::atomic<unsigned int> outside = 0;
+
+    //one slow task must not block the rest; nested pushes are waited for as well
+    scheduler.push([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        done++;
+    });
+    for (unsigned int i = 0; i < 100; i++) {
+        scheduler.push([&] {
+            if (Scheduler::worker() < 0) outside++;
+            scheduler.push([&] { done++; });
+        });
+    }
+    scheduler.wait();
+    REQUIRE(done == 101);
+    REQUIRE(outside == 0);
+    REQUIRE(Scheduler::worker() == -1);
+
+    scheduler.push([] { throw std::runtime_error("failed"); });
+    REQUIRE_THROWS(scheduler.wait());
+}
+
+TEST_CASE("driverCheck") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_driver";
+    std::filesystem::create_directories(dir);
+    fileWrite((dir / "a.ts").string(), "const v1: string = 'abc';\nconst v2: number = 'abc';\n");
+    fileWrite((dir / "b.ts").string(), "const v1: string | number = 123;\nconst v2: string | number = true;\nconst v3: string = 2;\n");
+    fileWrite((dir / "c.ts").string(), "const v1: number = 1;\n");
+    fileWrite((dir / "tsconfig.json").string(), R"({"compilerOptions": {}, "files": ["a.ts", "b.ts", "c.ts"]})");
+    fileWrite((dir / "files.txt").string(), "a.ts\n# comment\nb.ts\n\nc.ts\nmissing.ts\n");
+
+    auto files = driver::readManifest((dir / "tsconfig.json").string());
+    REQUIRE(files.size() == 3);
+    REQUIRE(files[0] == (dir / "a.ts").string());
+
+    for (unsigned int threads: {1, 4}) {
+        auto result = driver::check(files, threads);
+        REQUIRE(result.threads == threads);
+        REQUIRE(result.files.size() == 3);
+        REQUIRE(result.files[0].module->errors.size() == 1);
+        REQUIRE(result.files[1].module->errors.size() == 2);
+        REQUIRE(result.files[2].module->errors.size() == 0);
+        REQUIRE(result.errors() == 3);
+        REQUIRE(result.wall.count() > 0);
+    }
+
+    auto listed = driver::readManifest((dir / "files.txt").string());
+    REQUIRE(listed.size() == 4);
+    auto result = driver::check(listed, 2);
+    REQUIRE(result.errors() == 3);
+    REQUIRE(!result.files[3].module);
+    REQUIRE(!result.files[3].error.empty());
+}
+
+TEST_CASE("driverDiagnostics") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_diagnostics";
+    std::filesystem::create_directories(dir);
+    vector<string> files{(dir / "a.ts").string(), (dir / "b.ts").string(), (dir / "c.ts").string()};
+    fileWrite(files[0], "const v1: number = 'a\"b';\n");
+    fileWrite(files[1], "const v1: number = 1;\n");
+    fileWrite(files[2], "const v1: string = 1;\nconst v2: string = 2;\n");
+
+    auto text = driver::check(files, 4, nullptr, nullptr, vm2::DiagnosticFormat::Text);
+    REQUIRE(text.files[0].diagnostics.find("Found 1 errors") != string::npos);
+    string printed;
+    text.files[2].module->formatErrors(printed);
+    REQUIRE(printed == text.files[2].diagnostics);
+    //without a format nothing is formatted
+    REQUIRE(driver::check(files, 1).files[0].diagnostics.empty());
+
+    auto json = driver::check(files, 4, nullptr, nullptr, vm2::DiagnosticFormat::Json);
+    REQUIRE(json.files[1].diagnostics.empty());
+    REQUIRE(json.files[2].diagnostics.find("\"line\": 2, \"character\": 7") != string::npos);
+    std::ostringstream out;
+    {
+        vm2::DiagnosticWriter writer(vm2::DiagnosticFormat::Json, out);
+        for (auto &&file: json.files) writer.write(file.diagnostics);
+    }
+    auto written = out.str();
+    REQUIRE(written.starts_with("[\n{\"file\": \""));
+    REQUIRE(written.ends_with("}\n]\n"));
+    //escaped, in file order
+    REQUIRE(written.find("a\\\"b") != string::npos);
+    REQUIRE(written.find("a.ts") < written.find("c.ts"));
+    REQUIRE(std::count(written.begin(), written.end(), '\n') == 5);
+
+    auto sarif = driver::check(files, 2, nullptr, nullptr, vm2::DiagnosticFormat::Sarif);
+    std::ostringstream sarifOut;
+    {
+        vm2::DiagnosticWriter writer(vm2::DiagnosticFormat::Sarif, sarifOut);
+        for (auto &&file: sarif.files) writer.write(file.diagnostics);
+    }
+    REQUIRE(sarifOut.str().find("\"version\": \"2.1.0\"") != string::npos);
+    REQUIRE(sarifOut.str().find("\"region\": {\"startLine\": 1, \"startColumn\": 7") != string::npos);
+    REQUIRE(sarifOut.str().ends_with("]}]}\n"));
+
+    REQUIRE(vm2::parseDiagnosticFormat("sarif") == vm2::DiagnosticFormat::Sarif);
+    REQUIRE_THROWS(vm2::parseDiagnosticFormat("xml"));
+}
+
+TEST_CASE("driverPrelude") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_prelude";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    fileWrite((dir / "lib.d.ts").string(), "type Id = string | number;\nconst version: string = '1';\n");
+    vector<string> files;
+    for (unsigned int i = 0; i < 8; i++) {
+        files.push_back((dir / fmt::format("{}.ts", i)).string());
+        fileWrite(files.back(), "const v1: Id = 1;\nconst v2: Id = true;\nconst v3: number = version;\n");
+    }
+    auto prelude = driver::loadPrelude((dir / "lib.d.ts").string());
+    REQUIRE(prelude->types.size() == 2);
+
+    BytecodeCache cache(dir / "cache", {});
+    auto cold = driver::check(files, 4, &cache, prelude);
+    REQUIRE(cold.errors() == 2 * 8);
+    auto warm = driver::check(files, 4, &cache, prelude);
+    REQUIRE(warm.files[0].cached);
+    REQUIRE(warm.errors() == 2 * 8);
+    //bytecode linked against the prelude is not served without it
+    auto isolated = driver::check({files[0]}, 1, &cache);
+    REQUIRE(!isolated.files[0].cached);
+    REQUIRE(isolated.files[0].module->errors.size() > 2);
+
+    //the first load with a cache stores the snapshot, the second restores it
+    auto stored = driver::loadPrelude((dir / "lib.d.ts").string(), &cache);
+    auto restored = driver::loadPrelude((dir / "lib.d.ts").string(), &cache);
+    REQUIRE(restored->hash == stored->hash);
+    REQUIRE(restored->types.size() == 2);
+    auto snapshotted = driver::check(files, 4, &cache, restored);
+    REQUIRE(snapshotted.files[0].cached);
+    REQUIRE(snapshotted.errors() == 2 * 8);
+}
+
+TEST_CASE("bytecodeCache") {
+    for (auto size: {0, 5, 31, 32, 33, 100, 1000}) {
+        string text(size, 'x');
+        for (int i = 0; i < size; i++) text[i] = 'a' + i % 26;
+        REQUIRE(tr::hash::xxh64::hashLarge(text.data(), text.size(), 7) == tr::hash::xxh64::hash(text.data(), text.size(), 7));
+    }
+
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_cache";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "src");
+    auto a = (dir / "src" / "a.ts").string();
+    fileWrite(a, "const v1: string = 'abc';\nconst v2: number = 'abc';\n");
+
+    BytecodeCache cache(dir / "cache", {});
+    auto cold = driver::check({a}, 1, &cache);
+    REQUIRE(cold.errors() == 1);
+    REQUIRE(!cold.files[0].cached);
+
+    auto warm = driver::check({a}, 1, &cache);
+    REQUIRE(warm.files[0].cached);
+    REQUIRE(warm.errors() == 1);
+    REQUIRE(warm.files[0].module->findIdentifier(warm.files[0].module->errors[0].ip) == "v2");
+
+    //content addressed: a changed file misses, an unchanged copy anywhere hits
+    fileWrite(a, "const v1: string = 'abc';\n");
+    REQUIRE(!driver::check({a}, 1, &cache).files[0].cached);
+    auto copy = (dir / "copy.ts").string();
+    fileWrite(copy, "const v1: string = 'abc';\n");
+    REQUIRE(driver::check({copy}, 1, &cache).files[0].cached);
+
+    //read-only tier
+    BytecodeCache shared(dir / "empty", dir / "cache");
+    REQUIRE(shared.find("const v1: string = 'abc';\n"));
+    REQUIRE(!std::filesystem::exists(dir / "empty"));
+
+    //evicts down to 3/4 of maxBytes, oldest first
+    BytecodeCache small(dir / "small", {}, 1);
+    small.store("a", cache.find("const v1: string = 'abc';\n")->view());
+    REQUIRE(std::filesystem::is_empty(dir / "small"));
+}
+
+
+TEST_CASE("driverLink") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_link";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "lib");
+    fileWrite((dir / "a.ts").string(), "import {B} from './lib/b';\nimport {X} from './missing';\nconst v1: B = true;\nconst v2: B = 1;\n");
+    fileWrite((dir / "lib/b.ts").string(), "import {Id} from '../c';\nexport type B = Id | boolean;\nconst v: Id = 2;\n");
+    fileWrite((dir / "c.ts").string(), "export type Id = string;\nconst v: Id = 'c';\n");
+    vector<string> files{(dir / "a.ts").string(), (dir / "lib/b.ts").string(), (dir / "c.ts").string()};
+
+    for (unsigned int threads: {1, 4}) {
+        auto result = driver::check(files, threads);
+        REQUIRE(result.files[2].exports);
+        REQUIRE(result.files[2].module->errors.size() == 0);
+        REQUIRE(result.files[1].exports);
+        REQUIRE(result.files[1].module->errors.size() == 1);
+        REQUIRE(!result.files[0].exports);
+        REQUIRE(result.files[0].module->errors.size() == 2);
+        REQUIRE(result.files[0].module->errors[0].message == "Cannot find module './missing'");
+        REQUIRE(result.errors() == 3);
+    }
+
+    REQUIRE(driver::resolveModule((dir / "a.ts").string(), "./lib/b", [](auto &) { return true; }) == (dir / "lib/b").string());
+    REQUIRE(driver::resolveModule((dir / "a.ts").string(), "lib", [](auto &) { return true; }).empty());
+
+    //on disk, one listing per directory and one resolution per directory and specifier
+    driver::ModuleResolver resolver;
+    REQUIRE(resolver.resolve(files[0], "./lib/b") == files[1]);
+    REQUIRE(resolver.resolve(files[0], "./lib/../c") == files[2]);
+    REQUIRE(resolver.resolve((dir / "other.ts").string(), "./c") == files[2]);
+    REQUIRE(resolver.resolve(files[1], "../c") == files[2]);
+    REQUIRE(resolver.resolve(files[0], "./missing").empty());
+    REQUIRE(resolver.resolve(files[0], "lib").empty());
+    REQUIRE(resolver.size() == 6);
+}
+
+TEST_CASE("project") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_project";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    fileWrite((dir / "a.ts").string(), "import {B} from './b';\nconst v1: B = true;\nconst v2: B = 1;\n");
+    fileWrite((dir / "b.ts").string(), "import {Id} from './c';\nexport type B = Id | boolean;\nconst v: Id = 2;\n");
+    fileWrite((dir / "c.ts").string(), "export type Id = string;\nconst v: Id = 'c';\n");
+    vector<string> files{(dir / "a.ts").string(), (dir / "b.ts").string(), (dir / "c.ts").string()};
+
+    driver::Project project(2);
+    auto reused = [](const driver::Result &result) {
+        vector<bool> flags;
+        for (auto &&file: result.files) flags.push_back(file.reused);
+        return flags;
+    };
+
+    auto cold = project.check(files);
+    REQUIRE(reused(cold) == vector<bool>{false, false, false});
+    REQUIRE(cold.errors() == 2);
+
+    auto warm = project.check(files);
+    REQUIRE(reused(warm) == vector<bool>{true, true, true});
+    REQUIRE(warm.errors() == 2);
+    REQUIRE(warm.files[1].module == cold.files[1].module);
+
+    //same exports, the importers keep their diagnostics
+    fileWrite((dir / "c.ts").string(), "export type Id = string;\nconst v: Id = 3;\n");
+    auto body = project.check(files);
+    REQUIRE(reused(body) == vector<bool>{true, true, false});
+    REQUIRE(body.files[2].module->errors.size() == 1);
+    REQUIRE(body.errors() == 3);
+
+    //changed exports propagate through b to a
+    fileWrite((dir / "c.ts").string(), "export type Id = number;\n");
+    auto exports = project.check(files);
+    REQUIRE(reused(exports) == vector<bool>{false, false, false});
+    REQUIRE(exports.errors() == 0);
+
+    //b is gone, a does not resolve it anymore
+    auto removed = project.check({files[0]});
+    REQUIRE(removed.files.size() == 1);
+    REQUIRE(!removed.files[0].reused);
+    REQUIRE(removed.files[0].module->errors[0].message == "Cannot find module './b'");
+}
+
+TEST_CASE("server") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_server";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    fileWrite((dir / "a.ts").string(), "import {B} from './b';\nconst v1: B = 1;\n");
+    fileWrite((dir / "b.ts").string(), "export type B = boolean;\n");
+
+    driver::Server server(2, nullptr, nullptr, dir);
+    auto a = (dir / "a.ts").string();
+    REQUIRE(server.handle("check a.ts b.ts\n") == a + ":2:7: Type '1' is not assignable to type 'boolean'\nok 1 errors\n");
+    REQUIRE(server.handle("diagnostics b.ts") == "ok 0 errors\n");
+
+    fileWrite((dir / "b.ts").string(), "export type B = number;\n");
+    REQUIRE(server.handle("changed b.ts") == "ok 0 errors\n");
+    REQUIRE(server.last.files[0].module->errors.empty());
+
+    REQUIRE(server.handle("check missing.ts").starts_with((dir / "missing.ts").string() + ": error: File not found"));
+    REQUIRE(server.handle("forget missing.ts") == "ok 0 errors\n");
+    REQUIRE(server.handle("unknown").starts_with("error"));
+    REQUIRE(server.handle("").starts_with("error"));
+
+    std::stringstream in("diagnostics\nshutdown\ndiagnostics\n"), out;
+    server.serve(in, out);
+    REQUIRE(out.str() == "ok 0 errors\nok 0 errors\n");
+    REQUIRE(!server.running());
+}
+
+TEST_CASE("fileWatcher") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_watch";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto a = (dir / "a.ts").string();
+    auto b = (dir / "b.ts").string();
+    fileWrite(a, "const v1: number = 1;\n");
+    fileWrite(b, "const v1: number = 1;\n");
+
+    FileWatcher watcher({a, b});
+    REQUIRE(watcher.wait(std::chrono::milliseconds(10), std::chrono::milliseconds(50)).empty());
+
+    //a burst of writes is reported once, files not watched are not reported
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (unsigned int i = 0; i < 10; i++) fileWrite(a, fmt::format("const v1: number = {};\n", i));
+    fileWrite((dir / "other.ts").string(), "");
+    auto changed = watcher.wait(std::chrono::milliseconds(200), std::chrono::milliseconds(5000));
+    REQUIRE(changed == std::unordered_set<string>{a});
+}
+
+TEST_CASE("bench") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_bench";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    fileWrite((dir / "b.ts").string(), "const v1: string = 'abc';\nconst v2: number = 'abc';\n");
+    fileWrite((dir / "a.ts").string(), "type A<T> = T | string;\nconst v1: A<number> = 1;\n");
+    fileWrite((dir / "notes.txt").string(), "not a source");
+
+    auto files = benchmark::corpus({dir.string()});
+    REQUIRE(files.size() == 2);
+    REQUIRE(files[0] == (dir / "a.ts").string());
+
+    benchmark::Report report;
+    report.iterations = 3;
+    for (auto &&file: files) report.files.push_back(benchmark::runFile(file, std::filesystem::path(file).filename().string(), 3));
+    REQUIRE(report.files[0].error.empty());
+    REQUIRE(report.files[0].parse.values.size() == 3);
+    REQUIRE(report.files[0].warm.values.size() == 3);
+    REQUIRE(report.files[0].peakTypes > 0);
+    REQUIRE(report.files[1].errors == 1);
+    REQUIRE(!benchmark::runFile((dir / "missing.ts").string(), "missing.ts", 1).error.empty());
+
+    benchmark::Samples samples;
+    for (auto ms: {5.0, 1.0, 4.0, 2.0, 3.0}) samples.values.push_back(ms);
+    REQUIRE(samples.median() == 3.0);
+    REQUIRE(samples.p95() == 5.0);
+
+    //against itself nothing regressed, against a baseline with half the time everything that takes long enough did
+    auto json = report.json();
+    REQUIRE(benchmark::compare(report, json, 10).empty());
+    auto faster = report;
+    for (auto &&file: faster.files) file.warm.values = {1.0};
+    for (auto &&file: report.files) file.warm.values = {2.0};
+    auto regressions = benchmark::compare(report, faster.json(), 10);
+    REQUIRE(regressions.size() == 2);
+    REQUIRE(regressions[0].file == "a.ts");
+    REQUIRE(regressions[0].phase == "warm");
+    REQUIRE(regressions[0].change() == 100);
+    REQUIRE(benchmark::compare(report, faster.json(), 150).empty());
+}
+
+TEST_CASE("generator") {
+    auto dir = std::filesystem::temp_directory_path() / "typerunner_generator";
+    std::filesystem::remove_all(dir);
+    benchmark::Shape shape{.files = 3, .declarations = 5};
+    auto files = benchmark::generate(shape, dir.string());
+    REQUIRE(files.size() == 3);
+    REQUIRE(driver::readManifest((dir / "files.txt").string()) == files);
+    REQUIRE(benchmark::generate(shape, 1).find("import {Shared0} from './file0';") == 0);
+
+    //every group has failing assignments, imports resolve
+    auto result = driver::check(files, 2);
+    for (auto &&file: result.files) {
+        REQUIRE(file.error.empty());
+        REQUIRE(file.module->errors.size() >= shape.declarations);
+    }
+
+    auto scaling = benchmark::scale("union", {4, 8, 16}, 2);
+    REQUIRE(scaling.points.size() == 3);
+    REQUIRE(scaling.points[2].size == 16);
+    REQUIRE(scaling.csv().starts_with("union,4,"));
+    REQUIRE_THROWS(benchmark::scale("unknown", {1}, 1));
+
+    benchmark::Scaling quadratic{.feature = "x", .points = {{.size = 10, .warm = 1}, {.size = 20, .warm = 4}, {.size = 40, .warm = 16}}};
+    REQUIRE(std::abs(quadratic.exponent() - 2) < 1e-9);
+}
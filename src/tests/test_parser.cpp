@@ -80,4 +80,149 @@ const thisWorks: RedundantBigAssUnion[] = ["hello", 123]
     fmt::print("parse {} bytes ", code.size());
 
     usleep(100'000);
-}
\ No newline at end of file
+}
+TEST(parser, kindCast) {
+    Parser parser;
+    auto result = parser.parseSourceFile("app.ts", "function f(a) {}; const g = (b) => b; true;", tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    auto f = result->statements->list[0];
+    EXPECT_TRUE(f->validCast<FunctionLikeDeclarationBase>());
+    EXPECT_EQ(f->cast<FunctionLikeDeclarationBase>().parameters->length(), 1);
+    EXPECT_FALSE(f->validCast<BooleanLiteral>());
+    EXPECT_THROW(f->cast<ArrowFunction>(), std::runtime_error);
+
+    auto arrow = to<VariableStatement>(result->statements->list[2])->declarationList->declarations->list[0];
+    auto initializer = to<VariableDeclaration>(arrow)->initializer;
+    EXPECT_TRUE(initializer->validCast<FunctionLikeDeclarationBase>());
+    EXPECT_EQ(&initializer->cast<FunctionLikeDeclarationBase>(), static_cast<FunctionLikeDeclarationBase *>(to<ArrowFunction>(initializer).get()));
+
+    auto literal = to<ExpressionStatement>(result->statements->list[3])->expression;
+    EXPECT_TRUE(literal->validCast<BooleanLiteral>());
+    EXPECT_TRUE(to<BooleanLiteral>(literal));
+    EXPECT_FALSE(to<MemberName>(literal));
+}
+
+TEST(parser, identifierAtoms) {
+    Parser parser;
+    auto result = parser.parseSourceFile("app.ts", "type Abc = string; type B = Abc;", tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    auto declared = to<TypeAliasDeclaration>(result->statements->list[0])->name;
+    auto referenced = to<Identifier>(to<TypeReferenceNode>(to<TypeAliasDeclaration>(result->statements->list[1])->type)->typeName);
+    EXPECT_EQ(declared->atom, referenced->atom);
+    EXPECT_EQ(declared->hash, tr::hash::runtime_hash("Abc"));
+    EXPECT_EQ(result->identifiers->text(declared->atom), "Abc");
+    EXPECT_EQ(result->identifiers->size(), 2);
+}
+
+TEST(parser, updateSourceFile) {
+    //every position in the updated tree has to match a fresh parse of the new text
+    function<void(const shared<Node> &, const shared<Node> &)> same = [&](const shared<Node> &a, const shared<Node> &b) {
+        EXPECT_EQ(a->kind, b->kind);
+        EXPECT_EQ(a->pos, b->pos);
+        EXPECT_EQ(a->end, b->end);
+        vector<shared<Node>> childrenA, childrenB;
+        auto collect = [](vector<shared<Node>> &children) {
+            return [&children](const shared<NodeArray> &array) -> sharedOpt<Node> {
+                for (auto &&child: array->list) children.push_back(child);
+                return nullptr;
+            };
+        };
+        forEachChild(a, [&](const shared<Node> &child) -> sharedOpt<Node> { childrenA.push_back(child); return nullptr; }, collect(childrenA));
+        forEachChild(b, [&](const shared<Node> &child) -> sharedOpt<Node> { childrenB.push_back(child); return nullptr; }, collect(childrenB));
+        EXPECT_EQ(childrenA.size(), childrenB.size());
+        for (size_t i = 0; i<childrenA.size() && i<childrenB.size(); i++) same(childrenA[i], childrenB[i]);
+    };
+
+    string code = "type Z = 1;\ntype A = {a: number, b: string[]};\ntype C = A | number;\nfunction f(x: string) { return x; }\nclass B { c: number }\n";
+    Parser parser;
+    auto old = parser.parseSourceFile("app.ts", code, tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    vector<shared<Node>> statements(old->statements->list.begin(), old->statements->list.end());
+
+    //`number` -> `boolean` in the third statement
+    auto start = (int) code.find("| number") + 2;
+    auto newCode = code.substr(0, start) + "boolean" + code.substr(start + 6);
+    auto updated = parser.updateSourceFile(old, newCode, {{start, 6}, 7});
+    auto fresh = parser.parseSourceFile("app.ts", newCode, tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+
+    same(updated, fresh);
+    EXPECT_EQ(updated->statements->list.size(), 5);
+    //the one right before the edit is reparsed too, all others are reused
+    EXPECT_EQ(updated->statements->list[0], statements[0]);
+    EXPECT_FALSE(updated->statements->list[1] == statements[1]);
+    EXPECT_FALSE(updated->statements->list[2] == statements[2]);
+    EXPECT_EQ(updated->statements->list[3], statements[3]);
+    EXPECT_EQ(updated->statements->list[4], statements[4]);
+    EXPECT_EQ(updated->identifiers, old->identifiers);
+
+    //edit that merges statements: removing `}\nclass B {` turns the class members into the function body
+    start = (int) newCode.find("}\nclass");
+    auto merged = newCode.substr(0, start) + newCode.substr(start + 10);
+    updated = parser.updateSourceFile(updated, merged, {{start, 10}, 0});
+    fresh = parser.parseSourceFile("app.ts", merged, tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    same(updated, fresh);
+}
+
+TEST(parser, updateSourceFileParseErrors) {
+    //the error is on a node deep inside the second statement, which therefore is reparsed although the edit is not close
+    string code = "type Z = 1;\nconst y = (1 + );\ntype A = string;\ntype B = number;\ntype C = 1;\n";
+    Parser parser;
+    auto old = parser.parseSourceFile("app.ts", code, tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    vector<shared<Node>> statements(old->statements->list.begin(), old->statements->list.end());
+    EXPECT_FALSE(statements[1]->flags & (int) NodeFlags::ThisNodeHasError);
+    EXPECT_TRUE(containsParseError(statements[1]));
+    EXPECT_FALSE(containsParseError(statements[0]));
+
+    auto start = (int) code.find("= 1;\n", code.find("type C")) + 2;
+    auto newCode = code.substr(0, start) + "2" + code.substr(start + 1);
+    auto updated = parser.updateSourceFile(old, newCode, {{start, 1}, 1});
+    EXPECT_EQ(updated->statements->list[0], statements[0]);
+    EXPECT_FALSE(updated->statements->list[1] == statements[1]);
+    EXPECT_EQ(updated->statements->list[2], statements[2]);
+}
+
+TEST(parser, importEquals) {
+    //not supported yet, reported as error on the statement and the rest of the file is parsed as usual
+    Parser parser;
+    auto result = parser.parseSourceFile("app.ts", "import fs = require('fs');\nimport C = A.B.C;\ntype Z = 1;\n", tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+    EXPECT_EQ(result->statements->list.size(), 3);
+    EXPECT_EQ(result->statements->list[0]->kind, SyntaxKind::MissingDeclaration);
+    EXPECT_TRUE(result->statements->list[0]->flags & (int) NodeFlags::ThisNodeHasError);
+    EXPECT_EQ(result->statements->list[1]->kind, SyntaxKind::MissingDeclaration);
+    EXPECT_EQ(result->statements->list[1]->end, 44);
+    EXPECT_EQ(result->statements->list[2]->kind, SyntaxKind::TypeAliasDeclaration);
+}
+
+TEST(parser, skipFunctionBodies) {
+    string code = "function f(a: string): string { return a + '}'; /* } */ }\n"
+                  "class A { m() { const r = /}/; return r; } get v() { return {}; } }\n"
+                  "const g = (x: number) => { if (x) { return x; } // }\n return 0; };\n"
+                  "type B = string;\n";
+    auto skipped = createSourceFile("app.ts", code, CreateSourceFileOptions{tr::types::ScriptTarget::Latest, {}, {}, true});
+    Parser parser;
+    auto full = parser.parseSourceFile("app.ts", code, tr::types::ScriptTarget::Latest, false, ScriptKind::TS, {});
+
+    EXPECT_EQ(skipped->statements->list.size(), 4);
+    EXPECT_EQ(skipped->statements->list.size(), full->statements->list.size());
+    for (size_t i = 0; i<skipped->statements->list.size(); i++) {
+        EXPECT_EQ(skipped->statements->list[i]->kind, full->statements->list[i]->kind);
+        EXPECT_EQ(skipped->statements->list[i]->pos, full->statements->list[i]->pos);
+        EXPECT_EQ(skipped->statements->list[i]->end, full->statements->list[i]->end);
+    }
+
+    auto f = to<FunctionDeclaration>(skipped->statements->list[0]);
+    auto body = to<Block>(f->body);
+    EXPECT_TRUE(body->bodySkipped);
+    EXPECT_TRUE(body->statements->empty());
+    EXPECT_EQ(body->end, to<FunctionDeclaration>(full->statements->list[0])->body->end);
+    EXPECT_FALSE(to<Block>(to<FunctionDeclaration>(full->statements->list[0])->body)->bodySkipped);
+
+    auto a = to<ClassDeclaration>(skipped->statements->list[1]);
+    EXPECT_EQ(a->members->length(), 2);
+    EXPECT_TRUE(to<Block>(to<MethodDeclaration>(a->members->list[0])->body)->bodySkipped);
+    EXPECT_TRUE(to<Block>(to<GetAccessorDeclaration>(a->members->list[1])->body)->bodySkipped);
+
+    EXPECT_EQ(skipped->statements->list[3]->kind, SyntaxKind::TypeAliasDeclaration);
+
+    //`}` inside template substitutions, `/` as division and as start of a regular expression
+    auto templates = createSourceFile("app.ts", "function t(a: number) { return `${ {a: '}'}.a }}${`${1}`}` + a / 2 + /}/.source; }\ntype C = 1;", CreateSourceFileOptions{tr::types::ScriptTarget::Latest, {}, {}, true});
+    EXPECT_EQ(templates->statements->list.size(), 2);
+    EXPECT_EQ(templates->statements->list[1]->kind, SyntaxKind::TypeAliasDeclaration);
+}
@@ -210,4 +210,122 @@ TEST_CASE("allocator5") {
     REQUIRE(p4[0].i == 4);
     REQUIRE(p5[0].i == 5);
     REQUIRE(p6[0].i == 6);
-}
\ No newline at end of file
+}
+TEST_CASE("size classes") {
+    using Pool = PoolArray<Item, 4096>;
+    REQUIRE(Pool::poolAmount == 12);
+    REQUIRE(Pool::maxSlotSize == 2048);
+    REQUIRE(Pool::poolIndex(0) == 0);
+    REQUIRE(Pool::poolIndex(1) == 0);
+    REQUIRE(Pool::poolIndex(2) == 1);
+    REQUIRE(Pool::poolIndex(3) == 2);
+    REQUIRE(Pool::poolIndex(4) == 2);
+    REQUIRE(Pool::poolIndex(5) == 3);
+    REQUIRE(Pool::poolIndex(1024) == 10);
+    REQUIRE(Pool::poolIndex(1025) == 11);
+
+    Pool pool;
+    REQUIRE(pool.pool(1025).slotSize == 2048);
+    //a block holds two allocations of the biggest class, without overlapping
+    auto p1 = pool.construct(2048);
+    auto p2 = pool.construct(2048);
+    REQUIRE(pool.pool(2048).blocks == 1);
+    REQUIRE(&p1[2047] < &p2[0]);
+    pool.construct(2048);
+    REQUIRE(pool.pool(2048).blocks == 2);
+}
+
+TEST_CASE("grow") {
+    PoolArray<Item, 16> pool;
+    auto p1 = pool.construct(5);
+    auto data = p1.data();
+    REQUIRE(pool.active == 5);
+
+    //5 to 8 share a size class
+    REQUIRE(pool.grow(p1, 8));
+    REQUIRE(p1.data() == data);
+    REQUIRE(p1.size() == 8);
+    REQUIRE(pool.active == 8);
+
+    REQUIRE_FALSE(pool.grow(p1, 9));
+    REQUIRE_FALSE(pool.grow(p1, 4));
+    REQUIRE(p1.size() == 8);
+
+    pool.deallocate(p1);
+    REQUIRE(pool.active == 0);
+    REQUIRE(pool.pool(8).stats().freeSlots == 1);
+}
+
+TEST_CASE("large allocation") {
+    PoolArray<Item, 8> pool;
+    REQUIRE(pool.maxSlotSize == 4);
+
+    auto p1 = pool.construct(3000);
+    REQUIRE(p1.size() == 3000);
+    p1[2999].i = 3;
+    REQUIRE(pool.active == 3000);
+    REQUIRE(pool.largeStats().active == 1);
+    for (auto &&p: pool.stats()) REQUIRE(p.blocks == 0);
+
+    auto p2 = pool.construct(5);
+    auto p3 = pool.construct(6);
+    REQUIRE(pool.largeStats().active == 3);
+    REQUIRE(pool.largeStats().peak == 3);
+
+    pool.destruct(p2);
+    REQUIRE(pool.largeStats().active == 2);
+    REQUIRE(pool.active == 3006);
+
+    pool.gc(p3);
+    REQUIRE(pool.largeStats().gcQueued == 1);
+
+    //clear() releases what is left
+    pool.clear();
+    REQUIRE(pool.largeStats().active == 0);
+    REQUIRE(pool.largeStats().bytes == 0);
+    REQUIRE(pool.largeStats().gcQueued == 0);
+    REQUIRE(pool.largeStats().peak == 3);
+}
+
+TEST_CASE("block source") {
+    struct Counting: BlockSource {
+        RegionBlockSource region{true, RegionBlockSource::currentNode(), 1};
+        int blocks = 0;
+
+        void *allocate(std::size_t bytes) override {
+            blocks++;
+            return region.allocate(bytes);
+        }
+
+        void deallocate(void *block, std::size_t bytes) override {
+            blocks--;
+            region.deallocate(block, bytes);
+        }
+    } source;
+
+    {
+        PoolArray<Item, 8> pool;
+        pool.setBlockSource(&source);
+        auto p1 = pool.construct(1);
+        auto p2 = pool.construct(4);
+        REQUIRE(source.blocks == 2);
+        REQUIRE(source.region.reserved() == RegionBlockSource::hugePageSize);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(p1.data()) / RegionBlockSource::hugePageSize == reinterpret_cast<std::uintptr_t>(p2.data()) / RegionBlockSource::hugePageSize);
+        p2[3].i = 4;
+        REQUIRE_THROWS(pool.setBlockSource(nullptr));
+
+        //a second block in the class of p1, released again by trim()
+        for (unsigned int i = 0; i < 8; i++) pool.construct(1);
+        pool.clear();
+        REQUIRE(source.blocks == 3);
+        REQUIRE(pool.trim() == 1);
+        REQUIRE(source.blocks == 2);
+    }
+    REQUIRE(source.blocks == 0);
+
+    //freed blocks are handed out again
+    PoolArray<Item, 8> pool;
+    pool.setBlockSource(&source);
+    pool.construct(1);
+    REQUIRE(source.region.reserved() == RegionBlockSource::hugePageSize);
+}
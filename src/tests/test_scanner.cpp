@@ -37,4 +37,127 @@ TEST(scanner, basisc) {
 //    std::cout << enum_name(scanner.scan()) << "\n";
 //    std::cout << enum_name(scanner.scan()) << "\n";
 //    std::cout << enum_name(scanner.scan()) << "\n";
-}
\ No newline at end of file
+}
+TEST(scanner, tokenViews) {
+    std::string code = "abc 'plain' 'esc\\n' 1_000 42 `t` x";
+    Scanner scanner(code);
+    scanner.skipTrivia = true;
+    scanner.setScriptTarget(tr::types::ScriptTarget::Latest);
+
+    auto inSource = [&](std::string_view v) {
+        return v.data() >= code.data() && v.data() + v.size() <= code.data() + code.size();
+    };
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+    EXPECT_EQ(scanner.getTokenValue(), "abc");
+    EXPECT_TRUE(inSource(scanner.getTokenValue()));
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::StringLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "plain");
+    EXPECT_TRUE(inSource(scanner.getTokenValue()));
+
+    //escapes are materialized
+    EXPECT_EQ(scanner.scan(), SyntaxKind::StringLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "esc\n");
+    EXPECT_FALSE(inSource(scanner.getTokenValue()));
+
+    //survives a look ahead that materializes another value
+    scanner.lookAhead<bool>([&] {
+        scanner.scan();
+        return true;
+    });
+    EXPECT_EQ(scanner.getTokenValue(), "esc\n");
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::NumericLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "1000");
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::NumericLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "42");
+    EXPECT_TRUE(inSource(scanner.getTokenValue()));
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::NoSubstitutionTemplateLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "t");
+    EXPECT_TRUE(inSource(scanner.getTokenValue()));
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+    EXPECT_EQ(scanner.getTokenText(), "x");
+}
+
+TEST(scanner, keywords) {
+    for (auto &&keyword: keywordTexts) {
+        EXPECT_EQ(keywordToToken(keyword.text), keyword.kind);
+        EXPECT_EQ(tokenToString(keyword.kind), keyword.text);
+    }
+    for (auto &&punctuation: punctuationTexts) {
+        EXPECT_EQ(stringToToken(punctuation.text), punctuation.kind);
+    }
+    EXPECT_FALSE(keywordToToken("abstracts"));
+    EXPECT_FALSE(keywordToToken("Any"));
+    EXPECT_FALSE(stringToToken(""));
+    EXPECT_EQ(tokenToString(SyntaxKind::EqualsEqualsEqualsToken), "===");
+    EXPECT_EQ(tokenToString(SyntaxKind::Identifier), "");
+
+    Scanner scanner("constructor constructors");
+    scanner.skipTrivia = true;
+    EXPECT_EQ(scanner.scan(), SyntaxKind::ConstructorKeyword);
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+}
+
+TEST(scanner, triviaRuns) {
+    using tr::utf::findBytes;
+    std::string spaces(100, ' ');
+    EXPECT_EQ((findBytes<true, ' '>(spaces + "x", 0)), 100);
+    EXPECT_EQ((findBytes<false, '*'>(spaces, 3)), 100);
+    EXPECT_EQ((findBytes<false, '\n', '\r'>(spaces + "\r\n", 40)), 100);
+
+    //runs longer than a SIMD chunk, followed by a comment containing U+2028 (line separator) and umlauts
+    std::string code = spaces + "a" + spaces + "//" + std::string(50, '-') + "ä b /* ö" + std::string(40, '*') + "\n*/ c";
+    Scanner scanner(code);
+    scanner.skipTrivia = true;
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+    EXPECT_EQ(scanner.getTokenValue(), "a");
+    EXPECT_EQ(scanner.getTokenPos(), 100);
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+    EXPECT_EQ(scanner.getTokenValue(), "b");
+    EXPECT_TRUE(scanner.hasPrecedingLineBreak());
+
+    EXPECT_EQ(scanner.scan(), SyntaxKind::Identifier);
+    EXPECT_EQ(scanner.getTokenValue(), "c");
+    EXPECT_TRUE(scanner.hasPrecedingLineBreak());
+    EXPECT_EQ(scanner.scan(), SyntaxKind::EndOfFileToken);
+
+    EXPECT_EQ(skipTrivia(code, 0), 100);
+    EXPECT_EQ(skipTrivia(code, 101), code.find('b'));
+}
+
+TEST(scanner, speculation) {
+    std::string code = "'a\\tb' 'c\\nd' 1_000 x";
+    Scanner scanner(code);
+    scanner.skipTrivia = true;
+    scanner.scan();
+    EXPECT_EQ(scanner.getTokenValue(), "a\tb");
+
+    //materialized values of the callbacks don't overwrite the one of the checkpoint
+    for (unsigned int i = 0; i < 3; i++) {
+        EXPECT_EQ(scanner.lookAhead<SyntaxKind>([&]() { scanner.scan(); return scanner.scan(); }), SyntaxKind::NumericLiteral);
+        EXPECT_EQ(scanner.getTokenValue(), "a\tb");
+        EXPECT_EQ(scanner.getTokenPos(), 0);
+    }
+    EXPECT_FALSE(scanner.tryScan<bool>([&]() { scanner.scan(); return false; }));
+    EXPECT_EQ(scanner.getTokenValue(), "a\tb");
+
+    EXPECT_TRUE(scanner.tryScan<bool>([&]() { scanner.scan(); return true; }));
+    EXPECT_EQ(scanner.getTokenValue(), "c\nd");
+
+    //nested
+    EXPECT_FALSE(scanner.lookAhead<bool>([&]() {
+        scanner.scan();
+        EXPECT_TRUE(scanner.tryScan<bool>([&]() { scanner.scan(); return true; }));
+        return scanner.lookAhead<bool>([&]() { scanner.scan(); return false; });
+    }));
+    EXPECT_EQ(scanner.getTokenValue(), "c\nd");
+    EXPECT_EQ(scanner.scan(), SyntaxKind::NumericLiteral);
+    EXPECT_EQ(scanner.getTokenValue(), "1000");
+}
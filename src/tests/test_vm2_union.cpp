@@ -15,6 +15,7 @@ using std::string;
 using std::string_view;
 
 TEST_CASE("bigUnion") {
+    vm2::VM vm;
     tr::checker::Program program;
 
     auto foos = 300;
@@ -50,20 +51,20 @@ TEST_CASE("bigUnion") {
     program.pushOp(OP::Halt);
 
     auto module = std::make_shared<vm2::Module>(program.build(), "app.ts", "");
-    run(module);
-    run(module);
+    vm.run(module);
+    vm.run(module);
     module->printErrors();
     REQUIRE(module->errors.size() == 0);
 
-    debug("pool.active = {}", tr::vm2::pool.active);
-    debug("poolRef.active = {}", tr::vm2::poolRef.active);
-    tr::vm2::clear(module);
-    tr::vm2::gcStackAndFlush();
-    REQUIRE(tr::vm2::pool.active == 0);
-    REQUIRE(tr::vm2::poolRef.active == 0);
+    debug("pool.active = {}", vm.pool.active);
+    debug("poolRef.active = {}", vm.poolRef.active);
+    vm.clear(module);
+    vm.gcStackAndFlush();
+    REQUIRE(vm.pool.active == 0);
+    REQUIRE(vm.poolRef.active == 0);
 
     tr::bench("first", 1000, [&] {
         module->clear();
-        run(module);
+        vm.run(module);
     });
 }
@@ -15,22 +15,28 @@ namespace tr {
         return bin;
     }
 
-    shared<vm2::Module> test(string code, unsigned int expectedErrors = 0) {
+    shared<vm2::Module> test(vm2::VM &vm, string code, unsigned int expectedErrors = 0) {
         auto bin = compile(code);
         auto module = make_shared<vm2::Module>(bin, "app.ts", code);
-        vm2::run(module);
+        vm.run(module);
         module->printErrors();
         REQUIRE(expectedErrors == module->errors.size());
         return module;
     }
 
+    shared<vm2::Module> test(string code, unsigned int expectedErrors = 0) {
+        auto vm = std::make_unique<vm2::VM>();
+        return test(*vm, code, expectedErrors);
+    }
+
     void testWarmBench(string code, int iterations = 1000) {
         auto bin = compile(code);
         auto module = make_shared<vm2::Module>(bin, "app.ts", code);
-        auto warmTime = benchRun(iterations, [&module] {
+        auto vm = std::make_unique<vm2::VM>();
+        auto warmTime = benchRun(iterations, [&module, &vm] {
             ZoneScoped;
             module->clear();
-            vm2::run(module);
+            vm->run(module);
         });
         std::cout << fmt::format("{} iterations (it): warm {:.9f}ms/it", iterations, warmTime.count() / iterations);
     }
@@ -38,24 +44,25 @@ namespace tr {
     void testBench(string code, unsigned int expectedErrors = 0, int iterations = 1000) {
         auto bin = compile(code);
         auto module = make_shared<vm2::Module>(bin, "app.ts", code);
-        vm2::run(module);
+        auto vm = std::make_unique<vm2::VM>();
+        vm->run(module);
         module->printErrors();
         REQUIRE(expectedErrors == module->errors.size());
         if (expectedErrors != module->errors.size()) return;
 
-        auto warmTime = benchRun(iterations, [&module] {
+        auto warmTime = benchRun(iterations, [&module, &vm] {
             ZoneScoped;
             module->clear();
-            vm2::run(module);
+            vm->run(module);
         });
 
         auto compileTime = benchRun(iterations, [&code] {
             compile(code, false);
         });
 
-        auto coldTime = benchRun(iterations, [&code] {
+        auto coldTime = benchRun(iterations, [&code, &vm] {
             auto module = make_shared<vm2::Module>(compile(code, false), "app.ts", code);
-            vm2::run(module);
+            vm->run(module);
         });
 
         std::cout << fmt::format("{} iterations (it): compile {:.9f}ms/it, cold {:.9f}ms/it, warm {:.9f}ms/it", iterations, compileTime.count() / iterations, coldTime.count() / iterations, warmTime.count() / iterations);
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+/**
+ * Reader of the type info format written by vm2::TypeInfoWriter: resolved types of named declarations as a
+ * deduplicated graph, for services that need type information without parsing TypeScript or JSON. Depends on nothing
+ * but the standard library, so it can be copied into a consumer as it is.
+ *
+ * The reader works in place on the bytes (e.g. a file mapped with tr::MappedFile), nothing is copied or allocated.
+ * Layout, little endian, all sections 4 byte aligned:
+ *
+ *   header   8 x uint32: magic, version, type count, edge count, root count, string bytes, 0, 0
+ *   types    per type 20 bytes: uint8 kind, uint8 flags, uint16 0, uint32 text offset, uint32 text length,
+ *            uint32 first edge, uint32 edge count
+ *   edges    per edge uint32 type id: the children of each type, consecutive
+ *   roots    per root 3 x uint32: name offset, name length, type id
+ *   strings  all texts and names, each distinct one once
+ *
+ * Type ids are indices into the types. Structurally equal types are written once, so two equal ids mean equal types.
+ * Children by kind:
+ *
+ *   Union, Tuple, TemplateLiteral, Object, Class: the members
+ *   PropertySignature: name, type
+ *   Function, MethodSignature: name, return type, parameters
+ *   Array, Rest, TupleMember: the element type
+ *   Parameter: its type, the name is the text
+ *
+ * Literals have their value as text, Opaque types have no children.
+ */
+namespace tr::typeinfo {
+    constexpr uint32_t magic = 0x49545254; //"TRTI"
+    constexpr uint32_t version = 1;
+    constexpr uint32_t headerSize = 32;
+    constexpr uint32_t typeSize = 20;
+    constexpr uint32_t rootSize = 12;
+
+    //stable across VM versions, independent of vm2::TypeKind
+    enum class Kind: uint8_t {
+        Unknown,
+        Never,
+        Any,
+        Null,
+        Undefined,
+        String,
+        Number,
+        BigInt,
+        Boolean,
+        Symbol,
+        StringLiteral,
+        NumberLiteral,
+        BigIntLiteral,
+        True,
+        False,
+        Union,
+        Object,
+        PropertySignature,
+        MethodSignature,
+        Tuple,
+        TupleMember,
+        Array,
+        Rest,
+        TemplateLiteral,
+        Function,
+        Parameter,
+        Class,
+        Opaque, //references code of the module that created it (class references and instances, function references)
+    };
+
+    enum Flag: uint8_t {
+        Readonly = 1 << 0,
+        Optional = 1 << 1,
+        Static = 1 << 2,
+    };
+
+    inline uint32_t readUint32(std::string_view data, uint32_t offset) {
+        uint32_t value;
+        std::memcpy(&value, data.data() + offset, 4);
+        return value;
+    }
+
+    class Reader;
+
+    class TypeView {
+        const Reader *reader;
+        uint32_t record;
+
+        uint32_t field(uint32_t offset) const;
+
+    public:
+        uint32_t id;
+
+        TypeView(const Reader *reader, uint32_t id, uint32_t record): reader(reader), record(record), id(id) {}
+
+        Kind kind() const;
+        uint8_t flags() const;
+        std::string_view text() const;
+
+        //number of children
+        uint32_t size() const {
+            return field(16);
+        }
+
+        TypeView child(uint32_t index) const;
+
+        bool operator==(const TypeView &other) const {
+            return reader == other.reader && id == other.id;
+        }
+    };
+
+    class Reader {
+        std::string_view data;
+        uint32_t typeCount = 0;
+        uint32_t edgeCount = 0;
+        uint32_t rootCount = 0;
+        uint32_t typesOffset = headerSize;
+        uint32_t edgesOffset = 0;
+        uint32_t rootsOffset = 0;
+        uint32_t stringsOffset = 0;
+        uint32_t stringsSize = 0;
+
+        friend class TypeView;
+
+        std::string_view string(uint32_t offset, uint32_t length) const {
+            return data.substr(stringsOffset + offset, length);
+        }
+
+    public:
+        /**
+         * Checks all offsets once, so views never read outside of `data`. Throws if `data` is not valid type info.
+         * `data` has to stay alive as long as the reader and its views.
+         */
+        explicit Reader(std::string_view data): data(data) {
+            if (data.size() < headerSize || readUint32(data, 0) != magic) throw std::runtime_error("No type info");
+            if (readUint32(data, 4) != version) throw std::runtime_error("Unsupported type info version");
+            typeCount = readUint32(data, 8);
+            edgeCount = readUint32(data, 12);
+            rootCount = readUint32(data, 16);
+            stringsSize = readUint32(data, 20);
+            uint64_t edges = (uint64_t) typesOffset + (uint64_t) typeCount * typeSize;
+            uint64_t roots = edges + (uint64_t) edgeCount * 4;
+            uint64_t strings = roots + (uint64_t) rootCount * rootSize;
+            if (strings + stringsSize > data.size()) throw std::runtime_error("Invalid type info");
+            edgesOffset = edges;
+            rootsOffset = roots;
+            stringsOffset = strings;
+
+            for (uint32_t i = 0; i < typeCount; i++) {
+                auto record = typesOffset + i * typeSize;
+                if ((uint8_t) data[record] > (uint8_t) Kind::Opaque) throw std::runtime_error("Invalid type info");
+                if ((uint64_t) readUint32(data, record + 4) + readUint32(data, record + 8) > stringsSize) throw std::runtime_error("Invalid type info");
+                if ((uint64_t) readUint32(data, record + 12) + readUint32(data, record + 16) > edgeCount) throw std::runtime_error("Invalid type info");
+            }
+            for (uint32_t i = 0; i < edgeCount; i++) {
+                if (readUint32(data, edgesOffset + i * 4) >= typeCount) throw std::runtime_error("Invalid type info");
+            }
+            for (uint32_t i = 0; i < rootCount; i++) {
+                auto record = rootsOffset + i * rootSize;
+                if ((uint64_t) readUint32(data, record) + readUint32(data, record + 4) > stringsSize) throw std::runtime_error("Invalid type info");
+                if (readUint32(data, record + 8) >= typeCount) throw std::runtime_error("Invalid type info");
+            }
+        }
+
+        uint32_t types() const {
+            return typeCount;
+        }
+
+        TypeView type(uint32_t id) const {
+            if (id >= typeCount) throw std::out_of_range("Invalid type id");
+            return {this, id, typesOffset + id * typeSize};
+        }
+
+        uint32_t roots() const {
+            return rootCount;
+        }
+
+        std::string_view rootName(uint32_t index) const {
+            auto record = rootsOffset + index * rootSize;
+            return string(readUint32(data, record), readUint32(data, record + 4));
+        }
+
+        TypeView root(uint32_t index) const {
+            return type(readUint32(data, rootsOffset + index * rootSize + 8));
+        }
+
+        //the type of the root `name`, if there is one
+        std::optional<TypeView> find(std::string_view name) const {
+            for (uint32_t i = 0; i < rootCount; i++) {
+                if (rootName(i) == name) return root(i);
+            }
+            return std::nullopt;
+        }
+    };
+
+    inline uint32_t TypeView::field(uint32_t offset) const {
+        return readUint32(reader->data, record + offset);
+    }
+
+    inline Kind TypeView::kind() const {
+        return (Kind) reader->data[record];
+    }
+
+    inline uint8_t TypeView::flags() const {
+        return (uint8_t) reader->data[record + 1];
+    }
+
+    inline std::string_view TypeView::text() const {
+        return reader->string(field(4), field(8));
+    }
+
+    inline TypeView TypeView::child(uint32_t index) const {
+        if (index >= size()) throw std::out_of_range("Invalid child index");
+        return reader->type(readUint32(reader->data, reader->edgesOffset + (field(12) + index) * 4));
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/**
+ * C API of the checker, for embedding TypeRunner into other languages.
+ *
+ * A tr_context owns a VM with its pools, the module of the last check and its diagnostics. Contexts share nothing, so
+ * each thread can use its own, and a context kept between requests checks with warm pools and no allocation of a new
+ * VM. A context must not be used by two threads at the same time.
+ *
+ * Strings are passed as pointer and length, they do not have to be 0-terminated. Everything a context returns points
+ * into memory of the context and stays valid until the next tr_check_source(), tr_context_reset() or tr_context_free()
+ * on it, nothing has to be freed by the caller.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tr_context tr_context;
+
+typedef struct {
+    const char *message;
+    size_t message_length;
+    //0-based, UINT32_MAX when the diagnostic has no source position
+    uint32_t line;
+    uint32_t character;
+    //offsets into the source, both 0 when the diagnostic has no source position
+    uint32_t start;
+    uint32_t end;
+} tr_diagnostic;
+
+tr_context *tr_context_new(void);
+void tr_context_free(tr_context *context);
+
+/**
+ * Drops the module of the last check and its diagnostics. The pools of the VM stay allocated for the next check.
+ */
+void tr_context_reset(tr_context *context);
+
+/**
+ * Negative results of tr_check_source(), tr_last_error() has the reason.
+ */
+enum {
+    //the source could not be parsed
+    TR_ERROR_PARSE = -1,
+    //the checker failed on a parsed source, e.g. a construct it does not support yet. Not a diagnostic of the source.
+    TR_ERROR_INTERNAL = -2,
+};
+
+/**
+ * Parses, compiles and checks `source` as file `file`. Returns the number of diagnostics, or TR_ERROR_PARSE or
+ * TR_ERROR_INTERNAL when the source could not be checked at all (see tr_last_error()). `source` is copied, it may
+ * change after the call.
+ */
+int tr_check_source(tr_context *context, const char *file, size_t file_length, const char *source, size_t source_length);
+
+/**
+ * The diagnostics of the last tr_check_source() into `*diagnostics`, returns their count.
+ */
+size_t tr_get_diagnostics(tr_context *context, const tr_diagnostic **diagnostics);
+
+/**
+ * The type of the top-level declaration `name` (type alias, interface, class, function, variable) of the last checked
+ * source as text, e.g. `string | number`, into `*type` and `*type_length`. Type parameters of generic declarations
+ * are unknown. Returns 0 if there is no such declaration, 1 otherwise.
+ */
+int tr_query_type(tr_context *context, const char *name, size_t name_length, const char **type, size_t *type_length);
+
+/**
+ * Why the last call on `context` failed, "" if it did not. 0-terminated.
+ */
+const char *tr_last_error(tr_context *context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,6 +10,8 @@
 #include <type_traits>
 #include <stdexcept>
 #include "core.h"
+#include "arena.h"
+#include "atom.h"
 #include "enum.h"
 #include <fmt/core.h>
 #include <fmt/format.h>
@@ -81,6 +83,19 @@ namespace tr::types {
         int end = -1;
     };
 
+    struct TextSpan {
+        int start = 0;
+        int length = 0;
+    };
+
+    /**
+     * An edit: `span` of the old text was replaced by `newLength` characters.
+     */
+    struct TextChangeRange {
+        TextSpan span;
+        int newLength = 0;
+    };
+
     struct CommentDirective {
         TextRange range;
         CommentDirectiveType type;
@@ -1199,8 +1214,14 @@ namespace tr {
 
     class Node;
 
+    /**
+     * Nodes of a list. Up to 3 are stored inline (most lists are parameters, type arguments and the like),
+     * bigger lists live in the AST arena.
+     */
+    using NodeList = ArenaList<shared<Node>, 3>;
+
     struct NodeArray {
-        vector<shared<Node>> list;
+        NodeList list;
         int pos;
         int end;
         bool hasTrailingComma = false;
@@ -1209,7 +1230,9 @@ namespace tr {
 
         NodeArray() {}
 
-        NodeArray(const vector<shared<Node>> &list, bool hasTrailingComma = false): list(list), hasTrailingComma(hasTrailingComma) {}
+        NodeArray(std::span<const shared<Node>> list, bool hasTrailingComma = false): list(list), hasTrailingComma(hasTrailingComma) {}
+
+        NodeArray(const vector<shared<Node>> &list, bool hasTrailingComma = false): list(std::span<const shared<Node>>(list)), hasTrailingComma(hasTrailingComma) {}
 
         NodeArray(const shared<Node> &item) {
             list.push_back(item);
@@ -1224,7 +1247,7 @@ namespace tr {
         }
 
         void push(shared<Node> node) {
-            list.push_back(node);
+            list.push_back(std::move(node));
         }
 
         bool operator==(NodeArray &other) {
@@ -1237,10 +1260,12 @@ namespace tr {
             return true;
         }
 
-        vector<shared<Node>> slice(int start, int end = 0) {
+        /**
+         * View into the list, valid as long as the list is not modified.
+         */
+        std::span<const shared<Node>> slice(int start, int end = 0) {
             if (!end) end = list.size();
-            return std::vector<shared<Node>>(list.begin() + start, list.begin() + end);
-//            return slice<shared<Node>>(list, start, end);
+            return list.span(start, end);
         }
     };
 
@@ -1314,14 +1339,50 @@ namespace tr {
 //        typeNode?: TypeNode;                         // VariableDeclaration type
     };
 
+    /**
+     * Compile-time table of the node types a union or a kind-less base covers. Downcasts dispatch on the SyntaxKind
+     * tag of the node against this table, no RTTI involved. Entries can be unions with their own table.
+     */
+    template<typename ...Types>
+    struct NodeKinds {
+        template<typename T>
+        static bool has(SyntaxKind kind) {
+            if constexpr (requires { typename T::Kinds; }) {
+                return T::Kinds::contains(kind);
+            } else {
+                return kind == T::KIND;
+            }
+        }
+
+        static bool contains(SyntaxKind kind) {
+            return (has<Types>(kind) || ...);
+        }
+
+        //static_cast to the concrete type, then implicitly to Base. Needed for bases that are not a Node themselves.
+        template<typename Base, typename N>
+        static Base *cast(N *node) {
+            Base *result = nullptr;
+            ((node->kind == Types::KIND ? (result = static_cast<Types *>(node), true) : false) || ...);
+            return result;
+        }
+    };
+
+    /**
+     * Concrete node types of a base that is not derived from Node (e.g. FunctionLikeDeclarationBase), as `using type = NodeKinds<...>`.
+     */
+    template<typename T>
+    struct NodeKindsOf {};
+
     /**
      * All BaseNode pointers are owned by SourceFile. If SourceFile destroys, all its Nodes are destroyed as well.
      *
      * There are a big variety of sub types: All have in common that they are the owner of their data (except *parent).
+     * Parent links are non-owning, so walking up or down the tree never touches a reference counter and children
+     * can not keep their parents alive.
      */
     class Node: public SourceMapRange {
     protected:
-        sharedOpt<Node> parent = nullptr;
+        Node *parent = nullptr;
     public:
         SyntaxKind kind = SyntaxKind::Unknown;
         constexpr static auto KIND = SyntaxKind::Unknown;
@@ -1348,25 +1409,46 @@ namespace tr {
             return parent != nullptr;
         }
 
-        void setParent(shared<Node> p) {
+        void setParent(Node *p) {
             parent = p;
         }
 
-        sharedOpt<Node> getParent() {
+        void setParent(const sharedOpt<Node> &p) {
+            parent = p.get();
+        }
+
+        Node *getParent() {
             if (!hasParent()) throw std::runtime_error("Node has no parent set");
             return parent;
         }
 
-        //using dynamic_cast
+        /**
+         * Downcast by kind tag. Unions and kind-less bases need a NodeKinds table, nullptr when the kind does not match.
+         */
+        template<class T>
+        T *tryCast() {
+            if constexpr (std::is_same_v<T, Node>) {
+                return this;
+            } else if constexpr (requires { typename NodeKindsOf<T>::type; }) {
+                return NodeKindsOf<T>::type::template cast<T>(this);
+            } else if constexpr (requires { typename T::Kinds; }) {
+                //unions are just a Node with type information
+                return T::Kinds::contains(kind) ? reinterpret_cast<T *>(this) : nullptr;
+            } else {
+                static_assert(T::KIND != SyntaxKind::Unknown, "Node type has no kind, add a NodeKinds table");
+                return kind == T::KIND ? static_cast<T *>(this) : nullptr;
+            }
+        }
+
         template<class T>
         T &cast() {
-            return dynamic_cast<T &>(*this);
+            if (auto result = tryCast<T>()) return *result;
+            throw runtime_error(fmt::format("Can not cast Node of kind {}", (int) kind));
         }
 
-        //using dynamic_cast
         template<class T>
         bool validCast() {
-            return dynamic_cast<T *>(this) != nullptr;
+            return tryCast<T>() != nullptr;
         }
 
         template<class T>
@@ -1383,11 +1465,32 @@ namespace tr {
 //        }
     };
 
+    /**
+     * Kind checked downcast. Types with a NodeKinds table (unions, kind-less bases) are checked against it,
+     * other kind-less types like Expression pass through unchecked.
+     */
     template<class T>
-    sharedOpt<T> to(sharedOpt<Node> p) {
+    sharedOpt<T> to(const sharedOpt<Node> &p) {
         if (!p) return nullptr;
-        if (T::KIND != SyntaxKind::Unknown && p->kind != T::KIND) return nullptr;
-        return reinterpret_pointer_cast<T>(p);
+        if constexpr (requires { typename NodeKindsOf<T>::type; } || requires { typename T::Kinds; }) {
+            auto result = p->tryCast<T>();
+            return result ? sharedOpt<T>(p, result) : nullptr;
+        } else {
+            if (T::KIND != SyntaxKind::Unknown && p->kind != T::KIND) return nullptr;
+            return reinterpret_pointer_cast<T>(p);
+        }
+    }
+
+    //non-owning variant for walks that do not keep the node
+    template<class T>
+    T *to(Node *p) {
+        if (!p) return nullptr;
+        if constexpr (requires { typename NodeKindsOf<T>::type; } || requires { typename T::Kinds; }) {
+            return p->tryCast<T>();
+        } else {
+            if (T::KIND != SyntaxKind::Unknown && p->kind != T::KIND) return nullptr;
+            return reinterpret_cast<T *>(p);
+        }
     }
 
     inline sharedOpt<Node> operator||(sharedOpt<Node> a, sharedOpt<Node> b) {
@@ -1401,8 +1504,13 @@ namespace tr {
         return *a == *b;
     };
 
-    template<typename Default, typename ... T>
+    /**
+     * Named union of node types, e.g. `struct MemberName: BaseNodeUnion<Identifier, PrivateIdentifier> {}`. The types
+     * are only used for the kind table of casts.
+     */
+    template<typename ... Types>
     struct BaseNodeUnion: Node {
+        using Kinds = NodeKinds<Types...>;
     };
 
 #define NodeUnion(x...) Node
@@ -1416,12 +1524,12 @@ namespace tr {
 /**
  * Defines a shared union property and initializes its first type.
  */
-#define UnionProperty(name, Types...) shared<Node> name = make_shared<FIRST_ARG((Types))>()
+#define UnionProperty(name, Types...) shared<Node> name = makeNode<FIRST_ARG((Types))>()
 #define OptionalUnionProperty(name, Types...) sharedOpt<Node> name
 
-//Parent properties can not have initializer as it would lead to circular ref. We expect from the user to set it where required.
-#define ParentProperty(Types...) shared<UnionNode<Types>> parent
-#define Property(name, Type) shared<Type> name = make_shared<Type>()
+//Parent properties are non-owning and not initialized. We expect from the user to set it where required.
+#define ParentProperty(Types...) UnionNode<Types> *parent = nullptr
+#define Property(name, Type) shared<Type> name = makeNode<Type>()
 #define OptionalProperty(name, Type) sharedOpt<Type> name
 
     struct DeclarationName;
@@ -1491,7 +1599,7 @@ namespace tr {
 
     struct FalseLiteral: BrandKind<SyntaxKind::FalseKeyword, PrimaryExpression> {};
 
-    struct BooleanLiteral: NodeUnion(TrueLiteral, FalseLiteral) {};
+    struct BooleanLiteral: BaseNodeUnion<TrueLiteral, FalseLiteral> {};
 
     struct ThisExpression: BrandKind<SyntaxKind::ThisKeyword, PrimaryExpression> {};
 
@@ -1556,8 +1664,8 @@ namespace tr {
     /** @deprecated Use `ReadonlyKeyword` instead. */
     using ReadonlyToken = ReadonlyKeyword;
 
-    struct Modifier: NodeUnion(
-            AbstractKeyword, AsyncKeyword, ConstKeyword, DeclareKeyword, DefaultKeyword, ExportKeyword, InKeyword, PrivateKeyword, ProtectedKeyword, PublicKeyword, OutKeyword, OverrideKeyword, ReadonlyKeyword, StaticKeyword) {
+    struct Modifier: BaseNodeUnion<
+            AbstractKeyword, AsyncKeyword, ConstKeyword, DeclareKeyword, DefaultKeyword, ExportKeyword, InKeyword, PrivateKeyword, ProtectedKeyword, PublicKeyword, OutKeyword, OverrideKeyword, ReadonlyKeyword, StaticKeyword> {
     };
 
     struct ModifiersArray: NodeTypeArray(Modifier) {};
@@ -1603,6 +1711,8 @@ namespace tr {
          * so regular objects can be used as hash map. We do not need that. `escapedText` is thus just the text, not escaped at all.
          */
         string escapedText;
+        unsigned int atom = 0; //id in SourceFile::identifiers, 0 for synthesized identifiers
+        uint64_t hash = 0; //hash::runtime_hash(escapedText) as computed by the scanner, 0 when unknown
         optional<SyntaxKind> originalKeywordKind;// Original syntaxKind which get set so that we can report an error later
 
         optional<bool> isInJSDocNamespace;
@@ -1634,6 +1744,7 @@ namespace tr {
     struct Block: BrandKind<SyntaxKind::Block, Statement> {
         shared<NodeTypeArray(Statement)> statements;
         /*@internal*/ bool multiLine;
+        bool bodySkipped = false; //statements were not parsed, see CreateSourceFileOptions::skipFunctionBodies
     };
 
     struct TemplateLiteralLike: LiteralLike {
@@ -1652,6 +1763,8 @@ namespace tr {
 
     struct NumericLiteral: BrandKind<SyntaxKind::NumericLiteral, LiteralExpression> {
         int numericLiteralFlags = types::TokenFlags::None;
+        //parsed once from text by the factory, see parseNumber()
+        double value = 0;
     };
 
     struct BigIntLiteral: BrandKind<SyntaxKind::BigIntLiteral, LiteralExpression> {
@@ -1667,7 +1780,7 @@ namespace tr {
 
     struct QualifiedName: BrandKind<SyntaxKind::QualifiedName, Node> {
         shared<NodeUnion(EntityName)> left;
-        shared<Identifier> right = make_shared<Identifier>();
+        shared<Identifier> right = makeNode<Identifier>();
         /*@internal*/ OptionalProperty(jsdocDotPos, int); // QualifiedName occurs in JSDoc-style generic: Id1.Id2.<T>
     };
 
@@ -1760,7 +1873,7 @@ namespace tr {
     struct DefaultClause;
 
     struct CaseBlock: BrandKind<SyntaxKind::CaseBlock, Node> {
-        shared<SwitchStatement> parent;
+        SwitchStatement *parent = nullptr;
         shared<NodeTypeArray(CaseClause, DefaultClause)> clauses;
     };
 
@@ -1771,13 +1884,13 @@ namespace tr {
     };
 
     struct CaseClause: BrandKind<SyntaxKind::CaseClause, Node> {
-        Property(parent, CaseBlock);
+        CaseBlock *parent = nullptr;
         Property(expression, Expression);
         shared<NodeTypeArray(Statement)> statements;
     };
 
     struct DefaultClause: BrandKind<SyntaxKind::DefaultClause, Node> {
-        shared<CaseBlock> parent;
+        CaseBlock *parent = nullptr;
         shared<NodeTypeArray(Statement)> statements;
     };
 
@@ -1849,7 +1962,7 @@ namespace tr {
     };
 
     struct CatchClause: BrandKind<SyntaxKind::CatchClause, Node> {
-        shared<TryStatement> parent;
+        TryStatement *parent = nullptr;
         OptionalProperty(variableDeclaration, VariableDeclaration);
         Property(block, Block);
     };
@@ -1864,7 +1977,7 @@ namespace tr {
         bool isConst();
     };
 
-    struct MemberName: NodeUnion(Identifier, PrivateIdentifier) {};
+    struct MemberName: BaseNodeUnion<Identifier, PrivateIdentifier> {};
 
     struct PropertyAccessExpression: BrandKind<SyntaxKind::PropertyAccessExpression, MemberExpression, NamedDeclaration> {
         Property(expression, LeftHandSideExpression);
@@ -1876,7 +1989,7 @@ namespace tr {
 
     struct PropertyAccessEntityNameExpression;
 
-    struct EntityNameExpression: NodeUnion(Identifier, PropertyAccessEntityNameExpression) {};
+    struct EntityNameExpression: BaseNodeUnion<Identifier, PropertyAccessEntityNameExpression> {};
 
     //seems to be needed only for JSDoc
     struct PropertyAccessEntityNameExpression: PropertyAccessExpression {
@@ -1885,7 +1998,7 @@ namespace tr {
     };
 
     using StringLiteralLike = NodeUnion(StringLiteral, NoSubstitutionTemplateLiteral);
-    struct DeclarationName: NodeUnion(Identifier, PrivateIdentifier, StringLiteralLike, NumericLiteral, ComputedPropertyName, ElementAccessExpression, BindingPattern, EntityNameExpression) {};
+    struct DeclarationName: BaseNodeUnion<Identifier, PrivateIdentifier, StringLiteral, NoSubstitutionTemplateLiteral, NumericLiteral, ComputedPropertyName, ElementAccessExpression, BindingPattern, EntityNameExpression> {};
 
     struct MetaProperty: BrandKind<SyntaxKind::MetaProperty, PrimaryExpression> {
         SyntaxKind keywordToken = SyntaxKind::NewKeyword; //: SyntaxKind.NewKeyword | SyntaxKind.ImportKeyword;
@@ -1979,6 +2092,14 @@ namespace tr {
         OptionalProperty(initializer, Expression);
     };
 
+    struct FunctionDeclaration;
+    struct MethodDeclaration;
+    struct ConstructorDeclaration;
+    struct GetAccessorDeclaration;
+    struct SetAccessorDeclaration;
+    struct FunctionExpression;
+    struct ArrowFunction;
+
     struct FunctionLikeDeclarationBase: SignatureDeclarationBase {
         OptionalProperty(asteriskToken, AsteriskToken);
         OptionalProperty(questionToken, QuestionToken);
@@ -1989,6 +2110,11 @@ namespace tr {
 //        /* @internal */ optional<NodeType<FlowNode>> returnFlowNode;
     };
 
+    template<>
+    struct NodeKindsOf<FunctionLikeDeclarationBase> {
+        using type = NodeKinds<FunctionDeclaration, MethodDeclaration, ConstructorDeclaration, GetAccessorDeclaration, SetAccessorDeclaration, FunctionExpression, ArrowFunction>;
+    };
+
 #define FunctionBody Block
 #define ConciseBody FunctionBody, Expression
 
@@ -2072,7 +2198,7 @@ namespace tr {
     };
 
     struct EnumMember: BrandKind<SyntaxKind::EnumMember, NamedDeclaration, Node> {
-        Property(parent, EnumDeclaration);
+        EnumDeclaration *parent = nullptr;
         // This does include ComputedPropertyName, but the parser will give an error
         // if it parses a ComputedPropertyName in an EnumMember
         UnionProperty(name, PropertyName);
@@ -2110,7 +2236,7 @@ namespace tr {
     };
 
     struct ModuleBlock: BrandKind<SyntaxKind::ModuleBlock, Statement> {
-        shared<ModuleDeclaration> parent;
+        ModuleDeclaration *parent = nullptr;
         shared<NodeTypeArray(Statement)> statements;
     };
 
@@ -2140,7 +2266,7 @@ namespace tr {
     };
 
     struct ExternalModuleReference: BrandKind<SyntaxKind::ImportEqualsDeclaration, Node> {
-        Property(parent, ImportEqualsDeclaration);
+        ImportEqualsDeclaration *parent = nullptr;
         Property(expression, Expression);
     };
 
@@ -2148,20 +2274,20 @@ namespace tr {
 
     struct ImportClause;
     struct NamespaceImport: BrandKind<SyntaxKind::NamespaceImport, NamedDeclaration, Node> {
-        shared<ImportClause> parent;
+        ImportClause *parent = nullptr;
         Property(name, Identifier);
     };
 
     struct NamedImports;
     struct ImportSpecifier: BrandKind<SyntaxKind::ImportSpecifier, NamedDeclaration, Node> {
-        shared<NamedImports> parent;
+        NamedImports *parent = nullptr;
         OptionalProperty(propertyName, Identifier);  // Name preceding "as" keyword (or undefined when "as" is absent)
         Property(name, Identifier);           // Declared name
         bool isTypeOnly;
     };
 
     struct NamedImports: BrandKind<SyntaxKind::NamedImports, Node> {
-        shared<ImportClause> parent;
+        ImportClause *parent = nullptr;
         shared<NodeTypeArray(ImportSpecifier)> elements;
     };
 
@@ -2172,7 +2298,7 @@ namespace tr {
 
     struct AssertClause;
     struct AssertEntry: BrandKind<SyntaxKind::AssertEntry, Node> {
-        shared<AssertClause> parent;
+        AssertClause *parent = nullptr;
         UnionProperty(name, AssertionKey);
         Property(value, Expression);
     };
@@ -2210,20 +2336,20 @@ namespace tr {
     };
 
     struct NamespaceExport: BrandKind<SyntaxKind::NamespaceExport, NamedDeclaration, Node> {
-        shared<ExportDeclaration> parent;
+        ExportDeclaration *parent = nullptr;
         Property(name, Identifier);
     };
 
     struct NamedExports;
     struct ExportSpecifier: BrandKind<SyntaxKind::ExportSpecifier, NamedDeclaration, Node> {
-        shared<NamedExports> parent;
+        NamedExports *parent = nullptr;
         bool isTypeOnly;
         OptionalProperty(propertyName, Identifier);  // Name preceding "as" keyword (or undefined when "as" is absent)
         Property(name, Identifier);           // Declared name
     };
 
     struct NamedExports: BrandKind<SyntaxKind::NamedExports, Node> {
-        shared<ExportDeclaration> parent;
+        ExportDeclaration *parent = nullptr;
         shared<NodeTypeArray(ExportSpecifier)> elements;
     };
 
@@ -2274,7 +2400,7 @@ namespace tr {
  * Unless `isExportEquals` is set, this node was parsed as an `export default`.
  */
     struct ExportAssignment: BrandKind<SyntaxKind::ExportAssignment, DeclarationStatement> {
-        shared<SourceFile> parent;
+        SourceFile *parent = nullptr;
         bool isExportEquals;
         Property(expression, Expression);
     };
@@ -2282,7 +2408,7 @@ namespace tr {
     struct ImportTypeNode;
 
     struct ImportTypeAssertionContainer: BrandKind<SyntaxKind::ImportTypeAssertionContainer, Node> {
-        shared<ImportTypeNode> parent;
+        ImportTypeNode *parent = nullptr;
         Property(assertClause, AssertClause);
         bool multiLine = false;
     };
@@ -2306,13 +2432,13 @@ namespace tr {
 #define ObjectTypeDeclaration ClassLikeDeclaration, InterfaceDeclaration, TypeLiteralNode
 
     struct MethodSignature: BrandKind<SyntaxKind::MethodSignature, SignatureDeclarationBase, TypeElement, Node> {
-        shared<NodeUnion(ObjectTypeDeclaration)> parent;
+        NodeUnion(ObjectTypeDeclaration) *parent = nullptr;
         UnionProperty(name, PropertyName);
     };
 
     struct IndexSignatureDeclaration: BrandKind<SyntaxKind::IndexSignature, SignatureDeclarationBase, ClassElement, TypeElement, Node> {
         using TypeElement::name;
-        shared<NodeUnion(ObjectTypeDeclaration)> parent;
+        NodeUnion(ObjectTypeDeclaration) *parent = nullptr;
 //        sharedOpt<NodeTypeArray(Decorator)> decorators;           // Array of decorators (in document order)
 //        sharedOpt<NodeTypeArray(Modifier)> modifiers;            // Array of modifiers
         Property(type, TypeNode);
@@ -2351,7 +2477,7 @@ namespace tr {
 
     struct ConstructorDeclaration: BrandKind<SyntaxKind::Constructor, FunctionLikeDeclarationBase, ClassElement, Node> {
         using ClassElement::name;
-        shared<NodeUnion(ClassLikeDeclaration)> parent;
+        NodeUnion(ClassLikeDeclaration) *parent = nullptr;
         OptionalProperty(body, FunctionBody);
 
         /* @internal */ sharedOpt<NodeTypeArray(TypeParameterDeclaration)> typeParameters; // Present for use with reporting a grammar error
@@ -2536,7 +2662,7 @@ namespace tr {
     };
 
     struct TemplateMiddle: BrandKind<SyntaxKind::TemplateMiddle, TemplateLiteralLike> {
-        shared<NodeUnion(TemplateSpan, TemplateLiteralTypeSpan)> parent;
+        NodeUnion(TemplateSpan, TemplateLiteralTypeSpan) *parent = nullptr;
         /* @internal */
         optional<types::TokenFlags> templateFlags;
     };
@@ -2548,7 +2674,7 @@ namespace tr {
     };
 
     struct TemplateLiteralTypeSpan: BrandKind<SyntaxKind::TemplateLiteralTypeSpan, TypeNode> {
-        shared<TemplateLiteralTypeNode> parent;
+        TemplateLiteralTypeNode *parent = nullptr;
         Property(type, TypeNode);
         UnionProperty(literal, TemplateMiddle, TemplateTail);
     };
@@ -2573,7 +2699,7 @@ namespace tr {
     };
 
     struct TemplateSpan: BrandKind<SyntaxKind::TemplateSpan, Node> {
-        Property(parent, TemplateExpression);
+        TemplateExpression *parent = nullptr;
         Property(expression, Expression);
         UnionProperty(literal, TemplateMiddle, TemplateTail);
     };
@@ -2697,32 +2823,32 @@ namespace tr {
     };
 
     struct JsxAttribute: BrandKind<SyntaxKind::JsxAttribute, ObjectLiteralElement, Node> {
-        shared<JsxAttributes> parent;
+        JsxAttributes *parent = nullptr;
         Property(name, Identifier);
         /// JSX attribute initializers are optional; <X y /> is sugar for <X y={true} />
         OptionalUnionProperty(initializer, JsxAttributeValue);
     };
 
     struct JsxAttributes: BrandKind<SyntaxKind::JsxAttributes, PrimaryExpression> {
-        OptionalUnionProperty(parent, JsxOpeningLikeElement);
+        UnionNode<JsxOpeningLikeElement> *parent = nullptr;
         shared<NodeTypeArray(JsxAttributeLike)> properties;
     };
 
     // The opening element of a <Tag>...</Tag> JsxElement
     struct JsxOpeningElement: BrandKind<SyntaxKind::JsxOpeningElement, Expression> {
-        shared<JsxElement> parent;
+        JsxElement *parent = nullptr;
         UnionProperty(tagName, JsxTagNameExpression);
         sharedOpt<NodeTypeArray(TypeNode)> typeArguments;
         Property(attributes, JsxAttributes);
     };
 
     struct JsxText: BrandKind<SyntaxKind::JsxText, LiteralLike> {
-        shared<NodeUnion(JsxElement, JsxFragment)> parent;
+        NodeUnion(JsxElement, JsxFragment) *parent = nullptr;
         bool containsOnlyTriviaWhiteSpaces;
     };
 
     struct JsxClosingElement: BrandKind<SyntaxKind::JsxClosingElement, Node> {
-        shared<JsxElement> parent;
+        JsxElement *parent = nullptr;
         UnionProperty(tagName, JsxTagNameExpression);
     };
 
@@ -2748,12 +2874,12 @@ namespace tr {
     struct JsxFragment;
     /// The opening element of a <>...</> JsxFragment
     struct JsxOpeningFragment: BrandKind<SyntaxKind::JsxOpeningFragment, Expression> {
-        shared<JsxFragment> parent;
+        JsxFragment *parent = nullptr;
     };
 
     /// The closing element of a <>...</> JsxFragment
     struct JsxClosingFragment: BrandKind<SyntaxKind::JsxClosingFragment, Expression> {
-        shared<JsxFragment> parent;
+        JsxFragment *parent = nullptr;
     };
 
     /// A JSX expression of the form <>...</>
@@ -2764,7 +2890,7 @@ namespace tr {
     };
 
     struct JsxSpreadAttribute: BrandKind<SyntaxKind::JsxSpreadAttribute, ObjectLiteralElement, Node> {
-        Property(parent, JsxAttributes);
+        JsxAttributes *parent = nullptr;
         Property(expression, Expression);
     };
 
@@ -2781,7 +2907,7 @@ namespace tr {
 //    using ClassMemberModifier = NodeType<AccessibilityModifier, ReadonlyKeyword, StaticKeyword>;
 
     struct Decorator: BrandKind<SyntaxKind::Decorator, Node> {
-        Property(parent, NamedDeclaration);
+        NamedDeclaration *parent = nullptr;
         Property(expression, Expression);
     };
 
@@ -2866,7 +2992,7 @@ namespace tr {
 //        // JS identifier-declarations that are intended to merge with globals
 //        /* @internal */ jsGlobalAugmentations?: SymbolTable;
 //
-//        /* @internal */ identifiers: ESMap<string, string>; // Map from a string to an interned string
+        /* @internal */ shared<AtomTable> identifiers; // Interned identifier texts, see Identifier::atom
 //        /* @internal */ nodeCount: number;
 //        /* @internal */ identifierCount: number;
 //        /* @internal */ symbolCount: number;
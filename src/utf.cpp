@@ -4,7 +4,7 @@
  * Note that an arbitrary `charCodeAt(text, position+1)` does not work since the current code point might be longer than one byte.
  * We probably should introduction `int position, int offset` so that `charCodeAt(text, position, 1)` returns the correct unicode code point.
  */
-tr::utf::CharCode tr::utf::charCodeAt(const std::string &text, int position, int *size) {
+tr::utf::CharCode tr::utf::decodeCharCode(std::string_view text, int position, int *size) {
     //from - https://stackoverflow.com/a/40054802/979328
     int length = 1;
     int first = text[position];
@@ -16,22 +16,22 @@ tr::utf::CharCode tr::utf::charCodeAt(const std::string &text, int position, int
     if (size != nullptr) *size = length;
 
     //from http://www.zedwood.com/article/cpp-utf8-char-to-codepoint
-    if (length < 1) return {-1, position};
+    if (length < 1) return {-1, length};
     unsigned char u0 = first;
     if (u0 >= 0 && u0 <= 127) return {u0, length};
-    if (length < 2) return {-1, position};
+    if (length < 2) return {-1, length};
     unsigned char u1 = text[position + 1];
     if (u0 >= 192 && u0 <= 223) return {(u0 - 192) * 64 + (u1 - 128), length};
     if (first == (const char) 0xed && (text[position + 1] & 0xa0) == 0xa0)
-        return {-1, position}; //code points, 0xd800 to 0xdfff
-    if (length < 3) return {-1, position};
+        return {-1, length}; //code points, 0xd800 to 0xdfff
+    if (length < 3) return {-1, length};
     unsigned char u2 = text[position + 2];
     if (u0 >= 224 && u0 <= 239) return {(u0 - 224) * 4096 + (u1 - 128) * 64 + (u2 - 128), length};
-    if (length < 4) return {-1, position};
+    if (length < 4) return {-1, length};
     unsigned char u3 = text[position + 3];
     if (u0 >= 240 && u0 <= 247)
         return {(u0 - 240) * 262144 + (u1 - 128) * 4096 + (u2 - 128) * 64 + (u3 - 128), length};
-    return {-1, position};
+    return {-1, length};
 }
 
 std::string tr::utf::fromCharCode(int cp) {
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <locale>
 #include <codecvt>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace tr::utf {
     enum CharacterCodes {
         nullCharacter = 0,
@@ -150,12 +161,116 @@ namespace tr::utf {
         int length;
     };
 
+    //full UTF-8 decoding, see charCodeAt()
+    CharCode decodeCharCode(std::string_view text, int position, int *size = nullptr);
+
     // Updates size if non-nullptr is given
-    CharCode charCodeAt(const std::string &text, int position, int *size = nullptr);
+    inline CharCode charCodeAt(std::string_view text, int position, int *size = nullptr) {
+        //ASCII is by far the most common, only high-bit bytes need decoding
+        if ((size_t) position < text.size()) [[likely]] {
+            unsigned char c = text[position];
+            if (c < 0x80) {
+                if (size) *size = 1;
+                return {c, 1};
+            }
+        }
+        return decodeCharCode(text, position, size);
+    }
 
     std::string fromCharCode(int cp);
 
+    namespace AsciiClass {
+        enum: uint8_t {
+            WhiteSpace = 1 << 0, //single line
+            LineBreak = 1 << 1,
+            IdentifierStart = 1 << 2,
+            IdentifierPart = 1 << 3,
+        };
+    }
+
+    /**
+     * Class bits of each byte below 0x80, so the hot ASCII checks are one table load instead of comparison chains.
+     * Bytes >= 0x80 have no class, those code points go through the Unicode checks.
+     */
+    constexpr auto asciiClasses = [] {
+        std::array<uint8_t, 256> classes{};
+        for (auto c: {' ', '\t', '\v', '\f'}) classes[c] |= AsciiClass::WhiteSpace;
+        for (auto c: {'\n', '\r'}) classes[c] |= AsciiClass::LineBreak;
+        for (int c = 'a'; c <= 'z'; c++) classes[c] |= AsciiClass::IdentifierStart | AsciiClass::IdentifierPart;
+        for (int c = 'A'; c <= 'Z'; c++) classes[c] |= AsciiClass::IdentifierStart | AsciiClass::IdentifierPart;
+        for (int c = '0'; c <= '9'; c++) classes[c] |= AsciiClass::IdentifierPart;
+        for (auto c: {'$', '_'}) classes[c] |= AsciiClass::IdentifierStart | AsciiClass::IdentifierPart;
+        return classes;
+    }();
+
+    inline bool isAscii(int code) {
+        return code >= 0 && code <= maxAsciiCharacter;
+    }
+
+    inline bool hasAsciiClass(int code, uint8_t asciiClass) {
+        return asciiClasses[code] & asciiClass;
+    }
+
+    /**
+     * First position from `pos` on whose byte is one of Bytes (or is none of them when Negate), text.size() if there is none.
+     * Compares 32/16 bytes at a time with AVX2/SSE2/NEON, so runs of whitespace or comment text are skipped without
+     * looking at every character.
+     */
+    template<bool Negate, char ...Bytes>
+    inline size_t findBytes(std::string_view text, size_t pos) {
+        auto data = text.data();
+        auto size = text.size();
+#if defined(__AVX2__)
+        while (pos + 32 <= size) {
+            auto chunk = _mm256_loadu_si256((const __m256i *) (data + pos));
+            auto hit = _mm256_setzero_si256();
+            ((hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(Bytes)))), ...);
+            uint32_t mask = _mm256_movemask_epi8(hit);
+            if constexpr (Negate) mask = ~mask;
+            if (mask) return pos + __builtin_ctz(mask);
+            pos += 32;
+        }
+#endif
+#if defined(__SSE2__)
+        while (pos + 16 <= size) {
+            auto chunk = _mm_loadu_si128((const __m128i *) (data + pos));
+            auto hit = _mm_setzero_si128();
+            ((hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(Bytes)))), ...);
+            uint32_t mask = _mm_movemask_epi8(hit);
+            if constexpr (Negate) mask = ~mask & 0xFFFF;
+            if (mask) return pos + __builtin_ctz(mask);
+            pos += 16;
+        }
+#elif defined(__ARM_NEON)
+        while (pos + 16 <= size) {
+            auto chunk = vld1q_u8((const uint8_t *) data + pos);
+            auto hit = vdupq_n_u8(0);
+            ((hit = vorrq_u8(hit, vceqq_u8(chunk, vdupq_n_u8((uint8_t) Bytes)))), ...);
+            if constexpr (Negate) hit = vmvnq_u8(hit);
+            //4 bits per byte, there is no movemask on NEON
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+            if (mask) return pos + (__builtin_ctzll(mask) >> 2);
+            pos += 16;
+        }
+#endif
+        for (; pos < size; pos++) {
+            if (((data[pos] == Bytes) || ...) != Negate) return pos;
+        }
+        return size;
+    }
+
+    //position after the ASCII single line whitespace starting at pos
+    inline size_t skipAsciiWhiteSpace(std::string_view text, size_t pos) {
+        return findBytes<true, ' ', '\t', '\v', '\f'>(text, pos);
+    }
+
+    //next \n, \r or start of a multi-byte sequence that might be a line/paragraph separator (U+2028/2029 start with 0xE2)
+    inline size_t findLineBreakCandidate(std::string_view text, size_t pos) {
+        return findBytes<false, '\n', '\r', '\xE2'>(text, pos);
+    }
+
     inline bool isWhiteSpaceSingleLine(const CharCode &ch) {
+        if (isAscii(ch.code)) return hasAsciiClass(ch.code, AsciiClass::WhiteSpace);
         // Note: nextLine is in the Zs space, and should be considered to be a whitespace.
         // It is explicitly not a line-break as it isn't in the exact set specified by EcmaScript.
         return ch.code == CharacterCodes::space ||
@@ -184,6 +299,7 @@ namespace tr::utf {
         // Only the characters in Table 3 are treated as line terminators. Other new line or line
         // breaking characters are treated as white space but not as line terminators.
 
+        if (isAscii(ch.code)) return hasAsciiClass(ch.code, AsciiClass::LineBreak);
         return ch.code == CharacterCodes::lineFeed ||
                ch.code == CharacterCodes::carriageReturn ||
                ch.code == CharacterCodes::lineSeparator ||
@@ -195,13 +311,33 @@ namespace tr::utf {
         return isWhiteSpaceSingleLine(ch) || isLineBreak(ch);
     }
 
-    inline unsigned int eatWhitespace(const std::string &text, unsigned int pos) {
+    inline unsigned int eatWhitespace(std::string_view text, unsigned int pos) {
         auto end = text.size();
         while (pos < end) {
+            pos = findBytes<true, ' ', '\t', '\n', '\r'>(text, pos);
+            if (pos >= end) break;
             auto charCode = charCodeAt(text, pos);
             if (!isWhiteSpaceLike(charCode)) break;
             pos += charCode.length;
         }
         return pos;
     }
+
+    /**
+     * Offsets of the first character of each line, always starting with 0.
+     * Uses memchr, which libc implements with SIMD, instead of a per-character loop.
+     */
+    inline std::vector<unsigned int> computeLineStarts(std::string_view text) {
+        std::vector<unsigned int> starts{0};
+        auto begin = text.data();
+        auto end = begin + text.size();
+        auto current = begin;
+        while (current < end) {
+            auto found = static_cast<const char *>(std::memchr(current, '\n', end - current));
+            if (!found) break;
+            current = found + 1;
+            starts.push_back(current - begin);
+        }
+        return starts;
+    }
 }
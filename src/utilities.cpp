@@ -15,10 +15,8 @@ namespace tr {
     }
 
     sharedOpt<Node> lastOrUndefined(sharedOpt<NodeArray> array) {
-        if (!array) return nullptr;
-        auto last = lastOrUndefined(array->list);
-        if (last) *last;
-        return nullptr;
+        if (!array || array->list.empty()) return nullptr;
+        return array->list.back();
     }
 
     NodeArray &setTextRangePosEnd(NodeArray &range, int pos, int end) {
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define TYPERUNNER_KQUEUE 1
+#include <fcntl.h>
+#include <sys/event.h>
+#include <unistd.h>
+#endif
+
+namespace tr {
+    using std::string;
+    using std::vector;
+
+    /**
+     * Reports which of a fixed set of files changed on disk: inotify on Linux, kqueue on macOS and the BSDs, polling
+     * last_write_time everywhere else.
+     *
+     * inotify watches the directories of the files, not each file, so one watch covers all files of a directory and
+     * files replaced by a rename (editors, git checkout) stay watched. kqueue needs a descriptor per file, which is
+     * opened again when a file was replaced.
+     */
+    class FileWatcher {
+        std::unordered_set<string> files;
+
+#if defined(__linux__)
+        int fd = -1;
+        std::unordered_map<int, string> directories; //by watch descriptor
+
+        //blocks up to `timeout` (forever if negative) for events and adds changed files to `changed`, false on timeout
+        bool read(std::unordered_set<string> &changed, int timeout) {
+            pollfd request{.fd = fd, .events = POLLIN};
+            if (::poll(&request, 1, timeout) <= 0) return false;
+            alignas(inotify_event) char buffer[64 * 1024];
+            auto size = ::read(fd, buffer, sizeof(buffer));
+            for (char *i = buffer; size > 0 && i < buffer + size;) {
+                auto event = (inotify_event *) i;
+                i += sizeof(inotify_event) + event->len;
+                //the kernel dropped events, anything could have changed
+                if (event->mask & IN_Q_OVERFLOW) {
+                    changed.insert(files.begin(), files.end());
+                    continue;
+                }
+                auto directory = directories.find(event->wd);
+                if (directory == directories.end() || !event->len) continue;
+                auto file = (std::filesystem::path(directory->second) / event->name).string();
+                if (files.contains(file)) changed.insert(file);
+            }
+            return true;
+        }
+#elif TYPERUNNER_KQUEUE
+        int kq = -1;
+        std::unordered_map<int, string> descriptors; //file by descriptor
+
+        void watch(const string &file) {
+#if defined(O_EVTONLY)
+            auto descriptor = ::open(file.c_str(), O_EVTONLY);
+#else
+            auto descriptor = ::open(file.c_str(), O_RDONLY);
+#endif
+            if (descriptor < 0) return;
+            struct kevent change;
+            EV_SET(&change, descriptor, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME | NOTE_ATTRIB, 0, nullptr);
+            ::kevent(kq, &change, 1, nullptr, 0, nullptr);
+            descriptors.emplace(descriptor, file);
+        }
+
+        bool read(std::unordered_set<string> &changed, int timeout) {
+            struct kevent events[256];
+            timespec wait{.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L};
+            auto count = ::kevent(kq, nullptr, 0, events, 256, timeout < 0 ? nullptr : &wait);
+            if (count <= 0) return false;
+            for (int i = 0; i < count; i++) {
+                auto descriptor = (int) events[i].ident;
+                auto found = descriptors.find(descriptor);
+                if (found == descriptors.end()) continue;
+                auto file = found->second;
+                changed.insert(file);
+                if (events[i].fflags & (NOTE_DELETE | NOTE_RENAME)) {
+                    //replaced, watch the new file of that name
+                    ::close(descriptor);
+                    descriptors.erase(found);
+                    watch(file);
+                }
+            }
+            return true;
+        }
+#else
+        std::unordered_map<string, std::filesystem::file_time_type> times;
+
+        static std::filesystem::file_time_type timeOf(const string &file) {
+            std::error_code ec;
+            auto time = std::filesystem::last_write_time(file, ec);
+            return ec ? std::filesystem::file_time_type{} : time;
+        }
+
+        bool read(std::unordered_set<string> &changed, int timeout) {
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+            while (true) {
+                auto found = false;
+                for (auto &&[file, time]: times) {
+                    auto now = timeOf(file);
+                    if (now == time) continue;
+                    time = now;
+                    changed.insert(file);
+                    found = true;
+                }
+                if (found) return true;
+                if (timeout >= 0 && std::chrono::steady_clock::now() >= until) return false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+#endif
+
+    public:
+        explicit FileWatcher(const vector<string> &watched) {
+            for (auto &&file: watched) files.insert(std::filesystem::path(file).lexically_normal().string());
+#if defined(__linux__)
+            fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd < 0) throw std::runtime_error("Could not initialize inotify");
+            std::unordered_set<string> parents;
+            for (auto &&file: files) parents.insert(std::filesystem::path(file).parent_path().string());
+            for (auto &&directory: parents) {
+                auto wd = ::inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+                if (wd >= 0) directories.emplace(wd, directory);
+            }
+#elif TYPERUNNER_KQUEUE
+            kq = ::kqueue();
+            if (kq < 0) throw std::runtime_error("Could not initialize kqueue");
+            for (auto &&file: files) watch(file);
+#else
+            for (auto &&file: files) times.emplace(file, timeOf(file));
+#endif
+        }
+
+        FileWatcher(const FileWatcher &) = delete;
+        FileWatcher &operator=(const FileWatcher &) = delete;
+
+        ~FileWatcher() {
+#if defined(__linux__)
+            if (fd >= 0) ::close(fd);
+#elif TYPERUNNER_KQUEUE
+            for (auto &&[descriptor, file]: descriptors) ::close(descriptor);
+            if (kq >= 0) ::close(kq);
+#endif
+        }
+
+        /**
+         * Blocks until a watched file changed, then until no further change arrived for `quiet`, so that a burst
+         * (a checkout or a save-all touching thousands of files) is reported once. Returns the changed files.
+         *
+         * Empty when nothing changed within `timeout`, a negative timeout waits forever.
+         */
+        std::unordered_set<string> wait(std::chrono::milliseconds quiet = std::chrono::milliseconds(50), std::chrono::milliseconds timeout = std::chrono::milliseconds(-1)) {
+            std::unordered_set<string> changed;
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            //events of other files in watched directories do not count
+            while (changed.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (!read(changed, timeout.count() < 0 ? -1 : std::max<int>(0, left))) return changed;
+            }
+            while (read(changed, quiet.count())) {}
+            return changed;
+        }
+    };
+}